@@ -0,0 +1,377 @@
+/**
+ * @file GatewayCaptures.cpp
+ *
+ * This module contains the implementation of the functions used to load,
+ * make, and encode captures of the payloads received over Discord gateway
+ * connections.
+ *
+ * © 2020 by Richard Walters
+ */
+
+#include "GatewayCaptures.hpp"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <SystemAbstractions/File.hpp>
+#include <vector>
+#include <zlib.h>
+
+namespace {
+
+    /**
+     * This is the first of the made-up snowflakes used in the captures.
+     */
+    constexpr uint64_t FIRST_SNOWFLAKE = 700000000000000000;
+
+    /**
+     * This is the number of channels in each guild made for a capture.
+     */
+    constexpr size_t CHANNELS_PER_GUILD = 20;
+
+    /**
+     * This is the number of roles in each guild made for a capture.
+     */
+    constexpr size_t ROLES_PER_GUILD = 10;
+
+    /**
+     * This is the number of members listed in each guild made
+     * for a capture.
+     */
+    constexpr size_t MEMBERS_PER_GUILD = 50;
+
+    /**
+     * This function returns the made-up snowflake with the given index,
+     * as a quoted JSON string.
+     *
+     * @param[in] index
+     *     This is the index of the snowflake to return.
+     *
+     * @return
+     *     The snowflake is returned as a quoted JSON string.
+     */
+    std::string Snowflake(uint64_t index) {
+        return "\"" + std::to_string(FIRST_SNOWFLAKE + index) + "\"";
+    }
+
+    /**
+     * This function wraps the given event data in a dispatch payload.
+     *
+     * @param[in] eventName
+     *     This is the name of the event.
+     *
+     * @param[in] sequence
+     *     This is the sequence number of the event.
+     *
+     * @param[in] data
+     *     This is the JSON-encoded data of the event.
+     *
+     * @return
+     *     The JSON-encoded dispatch payload is returned.
+     */
+    std::string Dispatch(
+        const std::string& eventName,
+        size_t sequence,
+        const std::string& data
+    ) {
+        return (
+            "{\"t\":\"" + eventName
+            + "\",\"s\":" + std::to_string(sequence)
+            + ",\"op\":0,\"d\":" + data
+            + "}"
+        );
+    }
+
+    /**
+     * This function returns the JSON-encoded user object with the
+     * given index.
+     *
+     * @param[in] index
+     *     This is the index of the user to return.
+     *
+     * @return
+     *     The JSON-encoded user object is returned.
+     */
+    std::string User(uint64_t index) {
+        return (
+            "{\"username\":\"user" + std::to_string(index)
+            + "\",\"public_flags\":0,\"id\":" + Snowflake(index)
+            + ",\"discriminator\":\"" + std::to_string(1000 + index % 9000)
+            + "\",\"avatar\":\"0123456789abcdef0123456789abcdef\"}"
+        );
+    }
+
+    /**
+     * This function returns the JSON-encoded data of the GUILD_CREATE
+     * event for the guild with the given index.
+     *
+     * @param[in] guild
+     *     This is the index of the guild.
+     *
+     * @return
+     *     The JSON-encoded guild object is returned.
+     */
+    std::string Guild(size_t guild) {
+        const auto guildBase = (uint64_t)guild * 1000;
+        std::string channels;
+        for (size_t i = 0; i < CHANNELS_PER_GUILD; ++i) {
+            if (i > 0) {
+                channels += ',';
+            }
+            channels += (
+                "{\"type\":0,\"topic\":null,\"rate_limit_per_user\":0,"
+                "\"position\":" + std::to_string(i)
+                + ",\"permission_overwrites\":[],\"parent_id\":null,"
+                "\"nsfw\":false,\"name\":\"channel-" + std::to_string(i)
+                + "\",\"last_message_id\":" + Snowflake(guildBase + 500 + i)
+                + ",\"id\":" + Snowflake(guildBase + 100 + i)
+                + "}"
+            );
+        }
+        std::string roles;
+        for (size_t i = 0; i < ROLES_PER_GUILD; ++i) {
+            if (i > 0) {
+                roles += ',';
+            }
+            roles += (
+                "{\"position\":" + std::to_string(i)
+                + ",\"permissions\":104324673,\"name\":\"role-" + std::to_string(i)
+                + "\",\"mentionable\":false,\"managed\":false,"
+                "\"id\":" + Snowflake(guildBase + 200 + i)
+                + ",\"hoist\":false,\"color\":0}"
+            );
+        }
+        std::string members;
+        for (size_t i = 0; i < MEMBERS_PER_GUILD; ++i) {
+            if (i > 0) {
+                members += ',';
+            }
+            members += (
+                "{\"user\":" + User(guildBase + 300 + i)
+                + ",\"roles\":[" + Snowflake(guildBase + 200 + i % ROLES_PER_GUILD)
+                + "],\"nick\":null,\"mute\":false,"
+                "\"joined_at\":\"2020-04-01T12:34:56.789000+00:00\","
+                "\"hoisted_role\":null,\"deaf\":false}"
+            );
+        }
+        return (
+            "{\"id\":" + Snowflake(guildBase)
+            + ",\"name\":\"guild-" + std::to_string(guild)
+            + "\",\"owner_id\":" + Snowflake(guildBase + 300)
+            + ",\"region\":\"us-west\",\"member_count\":" + std::to_string(MEMBERS_PER_GUILD)
+            + ",\"large\":false,\"unavailable\":false,"
+            "\"joined_at\":\"2020-04-01T12:34:56.789000+00:00\","
+            "\"channels\":[" + channels
+            + "],\"roles\":[" + roles
+            + "],\"members\":[" + members
+            + "],\"presences\":[],\"voice_states\":[],\"emojis\":[]}"
+        );
+    }
+
+    /**
+     * This function appends to the given frame the header of a WebSocket
+     * frame sent by a server (and so not masked) with the given opcode
+     * and payload length.
+     *
+     * @param[in,out] frame
+     *     This is the frame to which to append the header.
+     *
+     * @param[in] opcode
+     *     This is the opcode of the frame.
+     *
+     * @param[in] length
+     *     This is the length of the frame's payload.
+     */
+    void AppendFrameHeader(
+        std::vector< uint8_t >& frame,
+        uint8_t opcode,
+        size_t length
+    ) {
+        frame.push_back(0x80 | opcode);
+        if (length < 126) {
+            frame.push_back((uint8_t)length);
+        } else if (length < 65536) {
+            frame.push_back(126);
+            frame.push_back((uint8_t)(length >> 8));
+            frame.push_back((uint8_t)length);
+        } else {
+            frame.push_back(127);
+            for (int i = 7; i >= 0; --i) {
+                frame.push_back((uint8_t)((uint64_t)length >> (i * 8)));
+            }
+        }
+    }
+
+}
+
+bool LoadGatewayCapture(
+    const std::string& path,
+    GatewayCapture& capture
+) {
+    SystemAbstractions::File file(path);
+    if (!file.OpenReadOnly()) {
+        return false;
+    }
+    std::vector< uint8_t > buffer(file.GetSize());
+    if (file.Read(buffer) != buffer.size()) {
+        return false;
+    }
+    capture.name = path;
+    capture.payloads.clear();
+    size_t lineStart = 0;
+    while (lineStart < buffer.size()) {
+        auto lineEnd = lineStart;
+        while (
+            (lineEnd < buffer.size())
+            && (buffer[lineEnd] != '\n')
+        ) {
+            ++lineEnd;
+        }
+        auto payloadEnd = lineEnd;
+        if (
+            (payloadEnd > lineStart)
+            && (buffer[payloadEnd - 1] == '\r')
+        ) {
+            --payloadEnd;
+        }
+        if (payloadEnd > lineStart) {
+            capture.payloads.emplace_back(
+                (const char*)buffer.data() + lineStart,
+                payloadEnd - lineStart
+            );
+        }
+        lineStart = lineEnd + 1;
+    }
+    return true;
+}
+
+GatewayCapture MakeReadyCapture(size_t guilds) {
+    std::string unavailableGuilds;
+    for (size_t i = 0; i < guilds; ++i) {
+        if (i > 0) {
+            unavailableGuilds += ',';
+        }
+        unavailableGuilds += (
+            "{\"unavailable\":true,\"id\":" + Snowflake((uint64_t)i * 1000)
+            + "}"
+        );
+    }
+    GatewayCapture capture;
+    capture.name = "READY";
+    capture.payloads.push_back(
+        Dispatch(
+            "READY",
+            1,
+            (
+                "{\"v\":6,\"user_settings\":{},\"user\":{\"verified\":true,"
+                "\"username\":\"DiscordPlay\",\"mfa_enabled\":false,"
+                "\"id\":" + Snowflake(999999999)
+                + ",\"flags\":0,\"email\":null,\"discriminator\":\"0001\","
+                "\"bot\":true,\"avatar\":null},"
+                "\"session_id\":\"0123456789abcdef0123456789abcdef\","
+                "\"relationships\":[],\"private_channels\":[],\"presences\":[],"
+                "\"guilds\":[" + unavailableGuilds
+                + "],\"application\":{\"id\":" + Snowflake(999999999)
+                + ",\"flags\":0},\"_trace\":[\"[\\\"gateway-prd-main-abcd\\\",{\\\"micros\\\":12345}]\"]}"
+            )
+        )
+    );
+    return capture;
+}
+
+GatewayCapture MakeGuildCreateFlood(size_t guilds) {
+    GatewayCapture capture;
+    capture.name = "GUILD_CREATE";
+    capture.payloads.reserve(guilds);
+    for (size_t i = 0; i < guilds; ++i) {
+        capture.payloads.push_back(Dispatch("GUILD_CREATE", i + 2, Guild(i)));
+    }
+    return capture;
+}
+
+GatewayCapture MakeMessageCreateStorm(
+    size_t messages,
+    size_t guilds
+) {
+    GatewayCapture capture;
+    capture.name = "MESSAGE_CREATE";
+    capture.payloads.reserve(messages);
+    for (size_t i = 0; i < messages; ++i) {
+        const auto guildBase = (uint64_t)(i % guilds) * 1000;
+        const auto author = guildBase + 300 + i % MEMBERS_PER_GUILD;
+        capture.payloads.push_back(
+            Dispatch(
+                "MESSAGE_CREATE",
+                guilds + i + 2,
+                (
+                    "{\"type\":0,\"tts\":false,"
+                    "\"timestamp\":\"2020-04-01T12:34:56.789000+00:00\","
+                    "\"referenced_message\":null,\"pinned\":false,"
+                    "\"nonce\":\"" + std::to_string(FIRST_SNOWFLAKE + i)
+                    + "\",\"mentions\":[],\"mention_roles\":[],"
+                    "\"mention_everyone\":false,\"member\":{\"roles\":[],"
+                    "\"mute\":false,\"joined_at\":\"2020-04-01T12:34:56.789000+00:00\","
+                    "\"hoisted_role\":null,\"deaf\":false},"
+                    "\"id\":" + Snowflake(10000000 + i)
+                    + ",\"flags\":0,\"embeds\":[],\"edited_timestamp\":null,"
+                    "\"content\":\"This is message number " + std::to_string(i)
+                    + " of the storm, with a little text to make it typical.\","
+                    "\"channel_id\":" + Snowflake(guildBase + 100 + i % CHANNELS_PER_GUILD)
+                    + ",\"author\":" + User(author)
+                    + ",\"attachments\":[],\"guild_id\":" + Snowflake(guildBase)
+                    + "}"
+                )
+            )
+        );
+    }
+    return capture;
+}
+
+std::vector< std::vector< uint8_t > > EncodeGatewayFrames(
+    const GatewayCapture& capture,
+    size_t repeat,
+    bool zlibStream
+) {
+    std::vector< std::vector< uint8_t > > frames;
+    frames.reserve(capture.payloads.size() * repeat);
+    z_stream deflateStream;
+    if (zlibStream) {
+        deflateStream.zalloc = Z_NULL;
+        deflateStream.zfree = Z_NULL;
+        deflateStream.opaque = Z_NULL;
+        (void)deflateInit(&deflateStream, Z_DEFAULT_COMPRESSION);
+    }
+    std::vector< uint8_t > compressed;
+    for (size_t i = 0; i < repeat; ++i) {
+        for (const auto& payload: capture.payloads) {
+            std::vector< uint8_t > frame;
+            if (zlibStream) {
+                compressed.resize(deflateBound(&deflateStream, (uLong)payload.size()) + 16);
+                deflateStream.next_in = (Bytef*)payload.data();
+                deflateStream.avail_in = (uInt)payload.size();
+                size_t length = 0;
+                do {
+                    if (length == compressed.size()) {
+                        compressed.resize(compressed.size() * 2);
+                    }
+                    deflateStream.next_out = (Bytef*)compressed.data() + length;
+                    deflateStream.avail_out = (uInt)(compressed.size() - length);
+                    (void)deflate(&deflateStream, Z_SYNC_FLUSH);
+                    length = compressed.size() - deflateStream.avail_out;
+                } while (deflateStream.avail_out == 0);
+                frame.reserve(length + 10);
+                AppendFrameHeader(frame, 0x2, length);
+                frame.insert(frame.end(), compressed.begin(), compressed.begin() + length);
+            } else {
+                frame.reserve(payload.size() + 10);
+                AppendFrameHeader(frame, 0x1, payload.size());
+                frame.insert(frame.end(), payload.begin(), payload.end());
+            }
+            frames.push_back(std::move(frame));
+        }
+    }
+    if (zlibStream) {
+        (void)deflateEnd(&deflateStream);
+    }
+    return frames;
+}
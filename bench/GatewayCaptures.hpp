@@ -0,0 +1,117 @@
+#pragma once
+
+/**
+ * @file GatewayCaptures.hpp
+ *
+ * This module declares the functions used to load, make, and encode
+ * captures of the payloads received over Discord gateway connections.
+ *
+ * © 2020 by Richard Walters
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+/**
+ * This holds the payloads received over a gateway connection, in the
+ * order in which they were received.
+ */
+struct GatewayCapture {
+    /**
+     * This is the name by which the capture is reported.
+     */
+    std::string name;
+
+    /**
+     * These are the JSON-encoded payloads of the capture.
+     */
+    std::vector< std::string > payloads;
+};
+
+/**
+ * This function loads a capture from the given file, which holds one
+ * JSON-encoded payload per line.  Blank lines are skipped.
+ *
+ * @param[in] path
+ *     This is the path of the file holding the capture.
+ *
+ * @param[out] capture
+ *     This is where to store the capture loaded.
+ *
+ * @return
+ *     An indication of whether or not the capture was loaded is returned.
+ */
+bool LoadGatewayCapture(
+    const std::string& path,
+    GatewayCapture& capture
+);
+
+/**
+ * This function makes a capture holding the READY event received
+ * by a bot in the given number of guilds, all still unavailable.
+ *
+ * @param[in] guilds
+ *     This is the number of guilds the bot is in.
+ *
+ * @return
+ *     The capture made is returned.
+ */
+GatewayCapture MakeReadyCapture(size_t guilds);
+
+/**
+ * This function makes a capture holding the GUILD_CREATE events received
+ * after READY by a bot in the given number of guilds, each with a
+ * typical number of channels, roles, and members.
+ *
+ * @param[in] guilds
+ *     This is the number of guilds the bot is in.
+ *
+ * @return
+ *     The capture made is returned.
+ */
+GatewayCapture MakeGuildCreateFlood(size_t guilds);
+
+/**
+ * This function makes a capture holding a burst of MESSAGE_CREATE
+ * events, spread over the given number of guilds.
+ *
+ * @param[in] messages
+ *     This is the number of messages in the burst.
+ *
+ * @param[in] guilds
+ *     This is the number of guilds over which to spread the messages.
+ *
+ * @return
+ *     The capture made is returned.
+ */
+GatewayCapture MakeMessageCreateStorm(
+    size_t messages,
+    size_t guilds
+);
+
+/**
+ * This function encodes the payloads of the given capture as the
+ * WebSocket frames a server would send for them.
+ *
+ * @param[in] capture
+ *     This is the capture to encode.
+ *
+ * @param[in] repeat
+ *     This is the number of times to go through the capture's payloads.
+ *
+ * @param[in] zlibStream
+ *     This indicates whether or not to compress the payloads with
+ *     Discord's "zlib-stream" transport compression, sending them in
+ *     binary frames, rather than in text frames.
+ *
+ * @return
+ *     The encoded frames, in the order they're to be received, are
+ *     returned.
+ */
+std::vector< std::vector< uint8_t > > EncodeGatewayFrames(
+    const GatewayCapture& capture,
+    size_t repeat,
+    bool zlibStream
+);
@@ -0,0 +1,340 @@
+/**
+ * @file LoopbackClient.cpp
+ *
+ * This module contains the implementation of the LoopbackClient class.
+ *
+ * © 2020 by Richard Walters
+ */
+
+#include "LoopbackClient.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <Http/Connection.hpp>
+#include <mutex>
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace {
+
+    /**
+     * This is the string appended to the key given by a WebSocket client
+     * in order to compute the digest which the server hands back to prove
+     * that it understood the upgrade request.
+     */
+    const std::string WEBSOCKET_KEY_SALT = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+
+    /**
+     * This function rotates the given 32-bit value to the left.
+     *
+     * @param[in] value
+     *     This is the value to rotate.
+     *
+     * @param[in] bits
+     *     This is the number of bits by which to rotate the value.
+     *
+     * @return
+     *     The rotated value is returned.
+     */
+    uint32_t RotateLeft(uint32_t value, int bits) {
+        return (value << bits) | (value >> (32 - bits));
+    }
+
+    /**
+     * This function computes the SHA-1 digest of the given string.
+     *
+     * @param[in] input
+     *     This is the string to digest.
+     *
+     * @return
+     *     The 20-byte digest of the string is returned.
+     */
+    std::vector< uint8_t > Sha1(const std::string& input) {
+        std::vector< uint8_t > message(input.begin(), input.end());
+        const uint64_t messageBits = (uint64_t)message.size() * 8;
+        message.push_back(0x80);
+        while ((message.size() % 64) != 56) {
+            message.push_back(0x00);
+        }
+        for (int i = 7; i >= 0; --i) {
+            message.push_back((uint8_t)(messageBits >> (i * 8)));
+        }
+        uint32_t h[5] = {
+            0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0
+        };
+        for (size_t chunk = 0; chunk < message.size(); chunk += 64) {
+            uint32_t w[80];
+            for (size_t i = 0; i < 16; ++i) {
+                w[i] = (
+                    ((uint32_t)message[chunk + i * 4] << 24)
+                    | ((uint32_t)message[chunk + i * 4 + 1] << 16)
+                    | ((uint32_t)message[chunk + i * 4 + 2] << 8)
+                    | (uint32_t)message[chunk + i * 4 + 3]
+                );
+            }
+            for (size_t i = 16; i < 80; ++i) {
+                w[i] = RotateLeft(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+            }
+            uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+            for (size_t i = 0; i < 80; ++i) {
+                uint32_t f, k;
+                if (i < 20) {
+                    f = (b & c) | (~b & d);
+                    k = 0x5A827999;
+                } else if (i < 40) {
+                    f = b ^ c ^ d;
+                    k = 0x6ED9EBA1;
+                } else if (i < 60) {
+                    f = (b & c) | (b & d) | (c & d);
+                    k = 0x8F1BBCDC;
+                } else {
+                    f = b ^ c ^ d;
+                    k = 0xCA62C1D6;
+                }
+                const auto temp = RotateLeft(a, 5) + f + e + k + w[i];
+                e = d;
+                d = c;
+                c = RotateLeft(b, 30);
+                b = a;
+                a = temp;
+            }
+            h[0] += a;
+            h[1] += b;
+            h[2] += c;
+            h[3] += d;
+            h[4] += e;
+        }
+        std::vector< uint8_t > digest;
+        digest.reserve(20);
+        for (size_t i = 0; i < 5; ++i) {
+            for (int j = 3; j >= 0; --j) {
+                digest.push_back((uint8_t)(h[i] >> (j * 8)));
+            }
+        }
+        return digest;
+    }
+
+    /**
+     * This function encodes the given bytes in Base64.
+     *
+     * @param[in] data
+     *     These are the bytes to encode.
+     *
+     * @return
+     *     The Base64 encoding of the bytes is returned.
+     */
+    std::string Base64Encode(const std::vector< uint8_t >& data) {
+        static const char alphabet[] = (
+            "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/"
+        );
+        std::string output;
+        for (size_t i = 0; i < data.size(); i += 3) {
+            const auto remaining = data.size() - i;
+            uint32_t group = (uint32_t)data[i] << 16;
+            if (remaining > 1) {
+                group |= (uint32_t)data[i + 1] << 8;
+            }
+            if (remaining > 2) {
+                group |= (uint32_t)data[i + 2];
+            }
+            output += alphabet[(group >> 18) & 0x3F];
+            output += alphabet[(group >> 12) & 0x3F];
+            output += ((remaining > 1) ? alphabet[(group >> 6) & 0x3F] : '=');
+            output += ((remaining > 2) ? alphabet[group & 0x3F] : '=');
+        }
+        return output;
+    }
+
+    /**
+     * This is the transaction handed back for each request, which is
+     * already completed by the time it's handed back.
+     */
+    struct LoopbackTransaction
+        : public Http::IClient::Transaction
+    {
+        // Http::IClient::Transaction
+
+        virtual bool AwaitCompletion(
+            const std::chrono::milliseconds&
+        ) override {
+            return true;
+        }
+
+        virtual void SetCompletionDelegate(
+            std::function< void() > completionDelegate
+        ) override {
+            if (completionDelegate != nullptr) {
+                completionDelegate();
+            }
+        }
+    };
+
+    /**
+     * This is the connection handed to the upgrade delegate of each
+     * request to upgrade to a WebSocket.  Data sent over it is counted
+     * and dropped.
+     */
+    struct LoopbackConnection
+        : public Http::Connection
+    {
+        // Properties
+
+        /**
+         * This is where the number of bytes sent is totaled.
+         */
+        std::shared_ptr< std::atomic< size_t > > bytesSent;
+
+        /**
+         * This is the function to call with data received from the
+         * server.
+         */
+        DataReceivedDelegate dataReceivedDelegate;
+
+        /**
+         * This is the function to call when the connection is broken.
+         */
+        BrokenDelegate brokenDelegate;
+
+        // Http::Connection
+
+        virtual std::string GetPeerAddress() override {
+            return "127.0.0.1";
+        }
+
+        virtual std::string GetPeerId() override {
+            return "127.0.0.1:443";
+        }
+
+        virtual void SetDataReceivedDelegate(
+            DataReceivedDelegate newDataReceivedDelegate
+        ) override {
+            dataReceivedDelegate = newDataReceivedDelegate;
+        }
+
+        virtual void SetBrokenDelegate(BrokenDelegate newBrokenDelegate) override {
+            brokenDelegate = newBrokenDelegate;
+        }
+
+        virtual void SendData(const std::vector< uint8_t >& data) override {
+            *bytesSent += data.size();
+        }
+
+        virtual void Break(bool) override {
+            // The delegates aren't called here, since the WebSocket
+            // breaking the connection may be holding its own lock.
+            dataReceivedDelegate = nullptr;
+            brokenDelegate = nullptr;
+        }
+    };
+
+}
+
+/**
+ * This contains the private properties of a LoopbackClient class instance.
+ */
+struct LoopbackClient::Impl {
+    /**
+     * This is used to synchronize access to the object.
+     */
+    std::mutex mutex;
+
+    /**
+     * This is used to publish any diagnostic messages.
+     */
+    SystemAbstractions::DiagnosticsSender diagnosticsSender{"LoopbackClient"};
+
+    /**
+     * This is the response given to each resource request.
+     */
+    Http::Response response;
+
+    /**
+     * This is the connection most recently upgraded to a WebSocket.
+     */
+    std::shared_ptr< LoopbackConnection > connection;
+
+    /**
+     * This is where the number of bytes sent over all connections
+     * is totaled.
+     */
+    std::shared_ptr< std::atomic< size_t > > bytesSent = std::make_shared< std::atomic< size_t > >(0);
+};
+
+LoopbackClient::~LoopbackClient() noexcept = default;
+
+LoopbackClient::LoopbackClient()
+    : impl_(new Impl())
+{
+}
+
+void LoopbackClient::SetResponse(const Http::Response& response) {
+    std::lock_guard< decltype(impl_->mutex) > lock(impl_->mutex);
+    impl_->response = response;
+}
+
+bool LoopbackClient::Deliver(const std::vector< uint8_t >& data) {
+    const auto& connection = impl_->connection;
+    if (
+        (connection == nullptr)
+        || (connection->dataReceivedDelegate == nullptr)
+    ) {
+        return false;
+    }
+    connection->dataReceivedDelegate(data);
+    return true;
+}
+
+size_t LoopbackClient::GetBytesSent() const {
+    return *impl_->bytesSent;
+}
+
+SystemAbstractions::DiagnosticsSender::UnsubscribeDelegate LoopbackClient::SubscribeToDiagnostics(
+    SystemAbstractions::DiagnosticsSender::DiagnosticMessageDelegate delegate,
+    size_t minLevel
+) {
+    return impl_->diagnosticsSender.SubscribeToDiagnostics(delegate, minLevel);
+}
+
+auto LoopbackClient::Request(
+    Http::Request request,
+    bool,
+    UpgradeDelegate upgradeDelegate
+) -> std::shared_ptr< Transaction > {
+    const auto transaction = std::make_shared< LoopbackTransaction >();
+    transaction->state = Transaction::State::Completed;
+    if (upgradeDelegate == nullptr) {
+        std::lock_guard< decltype(impl_->mutex) > lock(impl_->mutex);
+        transaction->response = impl_->response;
+        return transaction;
+    }
+    auto& response = transaction->response;
+    response.statusCode = 101;
+    response.reasonPhrase = "Switching Protocols";
+    response.headers.SetHeader("Connection", "upgrade");
+    response.headers.SetHeader("Upgrade", "websocket");
+    response.headers.SetHeader(
+        "Sec-WebSocket-Accept",
+        Base64Encode(
+            Sha1(
+                request.headers.GetHeaderValue("Sec-WebSocket-Key")
+                + WEBSOCKET_KEY_SALT
+            )
+        )
+    );
+    const auto connection = std::make_shared< LoopbackConnection >();
+    connection->bytesSent = impl_->bytesSent;
+    {
+        std::lock_guard< decltype(impl_->mutex) > lock(impl_->mutex);
+        impl_->connection = connection;
+    }
+    impl_->diagnosticsSender.SendDiagnosticInformationFormatted(
+        1,
+        "Upgraded connection for %s",
+        request.target.GenerateString().c_str()
+    );
+    upgradeDelegate(response, connection, "");
+    return transaction;
+}
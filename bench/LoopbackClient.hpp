@@ -0,0 +1,103 @@
+#pragma once
+
+/**
+ * @file LoopbackClient.hpp
+ *
+ * This module declares the LoopbackClient class.
+ *
+ * © 2020 by Richard Walters
+ */
+
+#include <Http/IClient.hpp>
+#include <Http/Response.hpp>
+#include <memory>
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+/**
+ * This is an implementation of Http::IClient which never touches the
+ * network.  Every request is completed right away, on the thread which
+ * made it.  Resource requests get a canned response, and requests to
+ * upgrade to a WebSocket are accepted, handing back a connection through
+ * which the benchmark feeds server frames into the client's WebSocket.
+ */
+class LoopbackClient
+    : public Http::IClient
+{
+    // Lifecycle Methods
+public:
+    ~LoopbackClient() noexcept;
+    LoopbackClient(const LoopbackClient&) = delete;
+    LoopbackClient(LoopbackClient&&) noexcept = delete;
+    LoopbackClient& operator=(const LoopbackClient&) = delete;
+    LoopbackClient& operator=(LoopbackClient&&) noexcept = delete;
+
+    // Public Methods
+public:
+    /**
+     * This is the constructor of the class.
+     */
+    LoopbackClient();
+
+    /**
+     * This method sets the response given to each resource request.
+     *
+     * @param[in] response
+     *     This is the response to give to each resource request.
+     */
+    void SetResponse(const Http::Response& response);
+
+    /**
+     * This method hands the given data to the most recently upgraded
+     * connection, as if it had been received from the server.  The
+     * data is processed before the method returns.
+     *
+     * @note
+     *     This isn't synchronized with upgrading connections, so it
+     *     should be called from the thread making requests.
+     *
+     * @param[in] data
+     *     This is the data to hand to the connection.
+     *
+     * @return
+     *     An indication of whether or not there was a connection to
+     *     take the data is returned.
+     */
+    bool Deliver(const std::vector< uint8_t >& data);
+
+    /**
+     * This method returns the number of bytes sent by the client over
+     * all connections upgraded so far.
+     *
+     * @return
+     *     The number of bytes sent by the client is returned.
+     */
+    size_t GetBytesSent() const;
+
+    // Http::IClient
+public:
+    virtual SystemAbstractions::DiagnosticsSender::UnsubscribeDelegate SubscribeToDiagnostics(
+        SystemAbstractions::DiagnosticsSender::DiagnosticMessageDelegate delegate,
+        size_t minLevel = 0
+    ) override;
+    virtual std::shared_ptr< Transaction > Request(
+        Http::Request request,
+        bool persistConnection = true,
+        UpgradeDelegate upgradeDelegate = nullptr
+    ) override;
+
+    // Private properties
+private:
+    /**
+     * This is the type of structure that contains the private
+     * properties of the instance.  It is defined in the implementation
+     * and declared here to ensure that it is scoped inside the class.
+     */
+    struct Impl;
+
+    /**
+     * This contains the private properties of the instance.
+     */
+    std::unique_ptr< Impl > impl_;
+};
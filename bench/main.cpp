@@ -0,0 +1,614 @@
+/**
+ * @file main.cpp
+ *
+ * This module holds the main() function of the benchmark, which replays
+ * gateway captures and resource requests through the application's own
+ * WebSocket adapter and Connections, over a loopback HTTP client, and
+ * reports how fast they're handled.
+ *
+ * © 2020 by Richard Walters
+ */
+
+#include "Connections.hpp"
+#include "GatewayCaptures.hpp"
+#include "LoopbackClient.hpp"
+#include "WebSocket.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <Discord/Connections.hpp>
+#include <Http/Response.hpp>
+#include <memory>
+#include <new>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <SystemAbstractions/DiagnosticsSender.hpp>
+#include <SystemAbstractions/DiagnosticsStreamReporter.hpp>
+#include <vector>
+
+namespace {
+
+    /**
+     * This counts the dynamic memory allocations made by the program.
+     */
+    std::atomic< size_t > allocations(0);
+
+    /**
+     * This is the URI requested for each gateway connection.
+     */
+    const std::string GATEWAY_URI = "wss://gateway.discord.gg/?v=6&encoding=json";
+
+    /**
+     * This contains variables set through the operating system environment
+     * or the command-line arguments.
+     */
+    struct Environment {
+        /**
+         * These are the paths of the capture files to replay.  If none
+         * are given, captures are made up instead.
+         */
+        std::vector< std::string > capturePaths;
+
+        /**
+         * This is the number of times to replay each capture.
+         */
+        size_t repeat = 10;
+
+        /**
+         * This is the number of guilds in the made-up captures.
+         */
+        size_t guilds = 100;
+
+        /**
+         * This is the number of messages in the made-up MESSAGE_CREATE
+         * capture.
+         */
+        size_t messages = 10000;
+
+        /**
+         * This is the number of resource requests to make.
+         */
+        size_t requests = 10000;
+
+        /**
+         * This indicates whether or not the gateway connections use
+         * zlib-stream transport compression.
+         */
+        bool zlibStream = false;
+
+        /**
+         * This indicates whether or not to subscribe to the diagnostic
+         * messages published by Connections, and its WebSocket adapters,
+         * in order to include the cost of the diagnostics chain.
+         */
+        bool diagnostics = false;
+
+        /**
+         * This is the minimum level of the diagnostic messages to which
+         * to subscribe, if diagnostics are included.
+         */
+        size_t diagnosticsLevel = 0;
+    };
+
+    /**
+     * This holds the measurements taken while running one scenario.
+     */
+    struct Measurements {
+        /**
+         * This is the number of seconds each frame or request took,
+         * in the order they were handled.
+         */
+        std::vector< double > latencies;
+
+        /**
+         * This is the total number of seconds the scenario took.
+         */
+        double elapsed = 0.0;
+
+        /**
+         * This is the number of dynamic memory allocations made while
+         * running the scenario.
+         */
+        size_t allocations = 0;
+    };
+
+    /**
+     * This function prints to the standard error stream information
+     * about how to use this program.
+     */
+    void PrintUsageInformation() {
+        fprintf(
+            stderr,
+            (
+                "Usage: DiscordPlayBench [options] [capture...]\n"
+                "\n"
+                "Replay gateway captures and resource requests through the\n"
+                "WebSocket adapter and Connections, over a loopback HTTP\n"
+                "client, and report messages per second, the 50th and 99th\n"
+                "percentile latency, and allocations, per frame.\n"
+                "\n"
+                "Each capture is a file holding one JSON-encoded gateway\n"
+                "payload per line.  If none are given, READY, GUILD_CREATE,\n"
+                "and MESSAGE_CREATE captures are made up.\n"
+                "\n"
+                "Options:\n"
+                "  --repeat <count>\n"
+                "      Replay each capture this many times (default: 10).\n"
+                "  --guilds <count>\n"
+                "      Make up captures for this many guilds (default: 100).\n"
+                "  --messages <count>\n"
+                "      Make up this many MESSAGE_CREATE events\n"
+                "      (default: 10000).\n"
+                "  --requests <count>\n"
+                "      Make this many resource requests (default: 10000).\n"
+                "  --zlib-stream\n"
+                "      Compress the captures with zlib-stream transport\n"
+                "      compression.\n"
+                "  --diagnostics <level>\n"
+                "      Subscribe to diagnostic messages of at least this\n"
+                "      level, in order to include the cost of the\n"
+                "      diagnostics chain.\n"
+            )
+        );
+    }
+
+    /**
+     * This function updates the program environment to incorporate
+     * any applicable command-line arguments.
+     *
+     * @param[in] argc
+     *     This is the number of command-line arguments given to the program.
+     *
+     * @param[in] argv
+     *     This is the array of command-line arguments given to the program.
+     *
+     * @param[in,out] environment
+     *     This is the environment to update.
+     *
+     * @param[in] diagnosticsSender
+     *     This is the object to use to publish any diagnostic messages.
+     *
+     * @return
+     *     An indication of whether or not the function succeeded is returned.
+     */
+    bool ProcessCommandLineArguments(
+        int argc,
+        char* argv[],
+        Environment& environment,
+        const SystemAbstractions::DiagnosticsSender& diagnosticsSender
+    ) {
+        size_t state = 0;
+        size_t* count = nullptr;
+        for (int i = 1; i < argc; ++i) {
+            const std::string arg(argv[i]);
+            switch (state) {
+                case 0: { // next argument
+                    if (arg == "--repeat") {
+                        count = &environment.repeat;
+                        state = 1;
+                    } else if (arg == "--guilds") {
+                        count = &environment.guilds;
+                        state = 1;
+                    } else if (arg == "--messages") {
+                        count = &environment.messages;
+                        state = 1;
+                    } else if (arg == "--requests") {
+                        count = &environment.requests;
+                        state = 1;
+                    } else if (arg == "--zlib-stream") {
+                        environment.zlibStream = true;
+                    } else if (arg == "--diagnostics") {
+                        state = 2;
+                    } else if (
+                        !arg.empty()
+                        && (arg[0] == '-')
+                    ) {
+                        diagnosticsSender.SendDiagnosticInformationFormatted(
+                            SystemAbstractions::DiagnosticsSender::Levels::ERROR,
+                            "unrecognized option '%s'",
+                            arg.c_str()
+                        );
+                        return false;
+                    } else {
+                        environment.capturePaths.push_back(arg);
+                    }
+                } break;
+
+                case 1: { // --repeat, --guilds, --messages, --requests
+                    if (
+                        (sscanf(arg.c_str(), "%zu", count) != 1)
+                        || (*count == 0)
+                    ) {
+                        diagnosticsSender.SendDiagnosticInformationFormatted(
+                            SystemAbstractions::DiagnosticsSender::Levels::ERROR,
+                            "invalid count '%s'",
+                            arg.c_str()
+                        );
+                        return false;
+                    }
+                    state = 0;
+                } break;
+
+                case 2: { // --diagnostics
+                    if (sscanf(arg.c_str(), "%zu", &environment.diagnosticsLevel) != 1) {
+                        diagnosticsSender.SendDiagnosticInformationFormatted(
+                            SystemAbstractions::DiagnosticsSender::Levels::ERROR,
+                            "invalid diagnostics level '%s'",
+                            arg.c_str()
+                        );
+                        return false;
+                    }
+                    environment.diagnostics = true;
+                    state = 0;
+                } break;
+
+                default: break;
+            }
+        }
+        if (state != 0) {
+            diagnosticsSender.SendDiagnosticInformationString(
+                SystemAbstractions::DiagnosticsSender::Levels::ERROR,
+                "option is missing its value"
+            );
+            return false;
+        }
+        return true;
+    }
+
+    /**
+     * This function returns the number of seconds between the two
+     * given points in time.
+     *
+     * @param[in] start
+     *     This is the earlier point in time.
+     *
+     * @param[in] end
+     *     This is the later point in time.
+     *
+     * @return
+     *     The number of seconds between the two points in time is returned.
+     */
+    double Seconds(
+        std::chrono::steady_clock::time_point start,
+        std::chrono::steady_clock::time_point end
+    ) {
+        return std::chrono::duration< double >(end - start).count();
+    }
+
+    /**
+     * This function prints a line to the standard output stream
+     * summarizing the given measurements.
+     *
+     * @param[in] name
+     *     This is the name of the scenario measured.
+     *
+     * @param[in] unit
+     *     This is the name of the thing handled in the scenario.
+     *
+     * @param[in,out] measurements
+     *     These are the measurements taken.  The latencies are sorted.
+     */
+    void Report(
+        const std::string& name,
+        const std::string& unit,
+        Measurements& measurements
+    ) {
+        auto& latencies = measurements.latencies;
+        const auto count = latencies.size();
+        if (count == 0) {
+            return;
+        }
+        std::sort(latencies.begin(), latencies.end());
+        printf(
+            "%-24s %9zu %-8s %12.0lf/s  p50 %9.2lf us  p99 %9.2lf us  %8.2lf allocs/%s\n",
+            name.c_str(),
+            count,
+            (unit + "s").c_str(),
+            (measurements.elapsed > 0.0) ? (double)count / measurements.elapsed : 0.0,
+            latencies[count / 2] * 1e6,
+            latencies[std::min(count - 1, count * 99 / 100)] * 1e6,
+            (double)measurements.allocations / (double)count,
+            unit.c_str()
+        );
+    }
+
+    /**
+     * This function replays the given capture over a new gateway
+     * connection, timing how long each frame takes to be delivered
+     * to the callbacks registered with the WebSocket adapter.
+     *
+     * @param[in] connections
+     *     This is the Connections instance to use to make the gateway
+     *     connection.
+     *
+     * @param[in] client
+     *     This is the loopback HTTP client used by the Connections
+     *     instance, through which frames are fed to the connection.
+     *
+     * @param[in] capture
+     *     This is the capture to replay.
+     *
+     * @param[in] environment
+     *     This is the program environment.
+     *
+     * @param[in] diagnosticsSender
+     *     This is the object to use to publish any diagnostic messages.
+     *
+     * @return
+     *     An indication of whether or not every payload of the capture
+     *     was delivered is returned.
+     */
+    bool ReplayCapture(
+        Connections& connections,
+        LoopbackClient& client,
+        const GatewayCapture& capture,
+        const Environment& environment,
+        const SystemAbstractions::DiagnosticsSender& diagnosticsSender
+    ) {
+        const auto frames = EncodeGatewayFrames(
+            capture,
+            environment.repeat,
+            environment.zlibStream
+        );
+        Discord::Connections::WebSocketRequest request;
+        request.uri = GATEWAY_URI;
+        const auto webSocket = connections.QueueWebSocketRequest(request).webSocket.get();
+        if (webSocket == nullptr) {
+            diagnosticsSender.SendDiagnosticInformationString(
+                SystemAbstractions::DiagnosticsSender::Levels::ERROR,
+                "Unable to connect over loopback"
+            );
+            return false;
+        }
+        size_t delivered = 0;
+        webSocket->RegisterTextCallback(
+            [&delivered](std::string&&){
+                ++delivered;
+            }
+        );
+        webSocket->RegisterBinaryCallback(
+            [&delivered](std::string&&){
+                ++delivered;
+            }
+        );
+        Measurements measurements;
+        measurements.latencies.reserve(frames.size());
+        const auto allocationsBefore = allocations.load();
+        const auto start = std::chrono::steady_clock::now();
+        for (const auto& frame: frames) {
+            const auto frameStart = std::chrono::steady_clock::now();
+            (void)client.Deliver(frame);
+            measurements.latencies.push_back(
+                Seconds(frameStart, std::chrono::steady_clock::now())
+            );
+        }
+        measurements.elapsed = Seconds(start, std::chrono::steady_clock::now());
+        measurements.allocations = allocations.load() - allocationsBefore;
+        webSocket->Close(1000);
+        Report(capture.name, "frame", measurements);
+        if (delivered != frames.size()) {
+            diagnosticsSender.SendDiagnosticInformationFormatted(
+                SystemAbstractions::DiagnosticsSender::Levels::ERROR,
+                "Only %zu of %zu payloads of %s were delivered",
+                delivered,
+                frames.size(),
+                capture.name.c_str()
+            );
+            return false;
+        }
+        return true;
+    }
+
+    /**
+     * This function makes resource requests through the given Connections
+     * instance, timing how long each takes to be answered by the loopback
+     * HTTP client.
+     *
+     * @param[in] connections
+     *     This is the Connections instance through which to make requests.
+     *
+     * @param[in] client
+     *     This is the loopback HTTP client used by the Connections
+     *     instance.
+     *
+     * @param[in] environment
+     *     This is the program environment.
+     *
+     * @param[in] diagnosticsSender
+     *     This is the object to use to publish any diagnostic messages.
+     *
+     * @return
+     *     An indication of whether or not every request was answered
+     *     is returned.
+     */
+    bool MakeResourceRequests(
+        Connections& connections,
+        LoopbackClient& client,
+        const Environment& environment,
+        const SystemAbstractions::DiagnosticsSender& diagnosticsSender
+    ) {
+        Http::Response response;
+        response.statusCode = 200;
+        response.reasonPhrase = "OK";
+        response.headers.SetHeader("Content-Type", "application/json");
+        response.headers.SetHeader("X-RateLimit-Bucket", "80c17d2f203122d936070c88c8d10f33");
+        response.headers.SetHeader("X-RateLimit-Limit", "5");
+        response.headers.SetHeader("X-RateLimit-Remaining", "4");
+        response.headers.SetHeader("X-RateLimit-Reset-After", "1");
+        response.body = "{\"id\":\"700000000000000100\",\"type\":0,\"name\":\"channel-0\"}";
+        client.SetResponse(response);
+        std::vector< Discord::Connections::ResourceRequest > requests(environment.requests);
+        for (size_t i = 0; i < requests.size(); ++i) {
+            auto& request = requests[i];
+            request.method = "GET";
+            request.uri = (
+                "https://discord.com/api/v6/channels/"
+                + std::to_string(700000000000000100 + i % 20)
+            );
+            request.headers.push_back({"Authorization", "Bot token"});
+        }
+        size_t answered = 0;
+        Measurements measurements;
+        measurements.latencies.reserve(requests.size());
+        const auto allocationsBefore = allocations.load();
+        const auto start = std::chrono::steady_clock::now();
+        for (const auto& request: requests) {
+            const auto requestStart = std::chrono::steady_clock::now();
+            if (connections.QueueResourceRequest(request).response.get().status == 200) {
+                ++answered;
+            }
+            measurements.latencies.push_back(
+                Seconds(requestStart, std::chrono::steady_clock::now())
+            );
+        }
+        measurements.elapsed = Seconds(start, std::chrono::steady_clock::now());
+        measurements.allocations = allocations.load() - allocationsBefore;
+        Report("Resource requests", "request", measurements);
+        if (answered != requests.size()) {
+            diagnosticsSender.SendDiagnosticInformationFormatted(
+                SystemAbstractions::DiagnosticsSender::Levels::ERROR,
+                "Only %zu of %zu resource requests were answered",
+                answered,
+                requests.size()
+            );
+            return false;
+        }
+        return true;
+    }
+
+}
+
+/**
+ * These replace the global allocation functions, in order to count the
+ * dynamic memory allocations made by the program.
+ */
+void* operator new(size_t size) {
+    ++allocations;
+    const auto memory = malloc(size ? size : 1);
+    if (memory == nullptr) {
+        throw std::bad_alloc();
+    }
+    return memory;
+}
+
+void* operator new[](size_t size) {
+    return operator new(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+    ++allocations;
+    return malloc(size ? size : 1);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+    return operator new(size, std::nothrow);
+}
+
+void operator delete(void* memory) noexcept {
+    free(memory);
+}
+
+void operator delete[](void* memory) noexcept {
+    free(memory);
+}
+
+void operator delete(void* memory, size_t) noexcept {
+    free(memory);
+}
+
+void operator delete[](void* memory, size_t) noexcept {
+    free(memory);
+}
+
+/**
+ * This function is the entrypoint of the benchmark.
+ *
+ * @param[in] argc
+ *     This is the number of command-line arguments given to the program.
+ *
+ * @param[in] argv
+ *     This is the array of command-line arguments given to the program.
+ *
+ * @return
+ *     The exit code of the program is returned.
+ */
+int main(int argc, char* argv[]) {
+    // Set up diagnostics sender representing the benchmark, which
+    // prints diagnostic messages to the standard error stream.
+    SystemAbstractions::DiagnosticsSender diagnosticsSender("DiscordPlayBench");
+    diagnosticsSender.SubscribeToDiagnostics(
+        SystemAbstractions::DiagnosticsStreamReporter(stderr, stderr),
+        SystemAbstractions::DiagnosticsSender::Levels::WARNING
+    );
+
+    // Process command line.
+    Environment environment;
+    if (!ProcessCommandLineArguments(argc, argv, environment, diagnosticsSender)) {
+        PrintUsageInformation();
+        return EXIT_FAILURE;
+    }
+
+    // Load the captures to replay, or make them up if none were given.
+    std::vector< GatewayCapture > captures;
+    if (environment.capturePaths.empty()) {
+        captures.push_back(MakeReadyCapture(environment.guilds));
+        captures.push_back(MakeGuildCreateFlood(environment.guilds));
+        captures.push_back(MakeMessageCreateStorm(environment.messages, environment.guilds));
+    } else {
+        for (const auto& path: environment.capturePaths) {
+            GatewayCapture capture;
+            if (!LoadGatewayCapture(path, capture)) {
+                diagnosticsSender.SendDiagnosticInformationFormatted(
+                    SystemAbstractions::DiagnosticsSender::Levels::ERROR,
+                    "Unable to load capture '%s'",
+                    path.c_str()
+                );
+                return EXIT_FAILURE;
+            }
+            captures.push_back(std::move(capture));
+        }
+    }
+
+    // Set up the application's Connections over a loopback HTTP client,
+    // optionally with something listening to its diagnostic messages.
+    const auto client = std::make_shared< LoopbackClient >();
+    const auto connections = std::make_shared< Connections >();
+    connections->Configure(client);
+    WebSocket::Configuration webSocketConfiguration;
+    webSocketConfiguration.zlibStream = environment.zlibStream;
+    connections->SetWebSocketConfiguration(webSocketConfiguration);
+    size_t diagnosticMessages = 0;
+    SystemAbstractions::DiagnosticsSender::UnsubscribeDelegate unsubscribe;
+    if (environment.diagnostics) {
+        unsubscribe = connections->SubscribeToDiagnostics(
+            [&diagnosticMessages](
+                std::string,
+                size_t,
+                std::string
+            ){
+                ++diagnosticMessages;
+            },
+            environment.diagnosticsLevel
+        );
+    }
+
+    // Run the scenarios.
+    bool success = true;
+    for (const auto& capture: captures) {
+        if (!ReplayCapture(*connections, *client, capture, environment, diagnosticsSender)) {
+            success = false;
+        }
+    }
+    if (!MakeResourceRequests(*connections, *client, environment, diagnosticsSender)) {
+        success = false;
+    }
+    if (environment.diagnostics) {
+        unsubscribe();
+        printf("%zu diagnostic messages published\n", diagnosticMessages);
+    }
+    return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
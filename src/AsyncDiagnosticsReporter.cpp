@@ -0,0 +1,470 @@
+/**
+ * @file AsyncDiagnosticsReporter.cpp
+ *
+ * This module contains the implementation of the AsyncDiagnosticsReporter
+ * class.
+ *
+ * © 2020 by Richard Walters
+ */
+
+#include "AsyncDiagnosticsReporter.hpp"
+#include "SpscRing.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <stdint.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+    /**
+     * This holds a diagnostic message waiting to be written out.
+     */
+    struct DiagnosticRecord {
+        /**
+         * This is the time, in seconds since the reporter was made,
+         * at which the message was queued.
+         */
+        double time = 0.0;
+
+        /**
+         * This is the importance level of the message.
+         */
+        size_t level = 0;
+
+        /**
+         * This is the name of the sender of the message.
+         */
+        std::string senderName;
+
+        /**
+         * This is the content of the message.
+         */
+        std::string message;
+    };
+
+    /**
+     * This is the type of ring in which each producing thread
+     * queues its messages.
+     */
+    typedef SpscRing< DiagnosticRecord > RecordRing;
+
+    /**
+     * This is the buffer in which a producing thread queues its messages
+     * for a reporter.
+     */
+    struct RecordBuffer {
+        /**
+         * This holds the messages waiting to be written out.
+         */
+        RecordRing records;
+
+        /**
+         * This flag is set once the producing thread has exited, after
+         * which nothing more is queued, so that the reporter can let go
+         * of the buffer once it's drained.
+         */
+        std::atomic< bool > retired{false};
+
+        explicit RecordBuffer(size_t capacity)
+            : records(capacity)
+        {
+        }
+    };
+
+    /**
+     * This associates a producing thread's buffer with the reporter
+     * that drains it.
+     */
+    struct ThreadBuffer {
+        /**
+         * This is the unique identifier of the reporter.
+         */
+        uint64_t reporterId;
+
+        /**
+         * This is the buffer in which the thread queues its messages
+         * for the reporter.
+         */
+        std::shared_ptr< RecordBuffer > buffer;
+    };
+
+    /**
+     * This holds the buffers a thread has been given, one per reporter,
+     * and retires them when the thread exits.
+     */
+    struct ThreadBuffers {
+        std::vector< ThreadBuffer > entries;
+
+        ~ThreadBuffers() noexcept {
+            for (const auto& entry: entries) {
+                entry.buffer->retired.store(true, std::memory_order_release);
+            }
+        }
+    };
+
+    /**
+     * This is used to give each reporter a unique identifier, so that
+     * threads can tell them apart even if one is made where another
+     * used to be.
+     */
+    std::atomic< uint64_t > nextReporterId{1};
+
+    /**
+     * These are the buffers the current thread has been given,
+     * one per reporter.
+     */
+    thread_local ThreadBuffers threadBuffers;
+
+    /**
+     * This function appends the given diagnostic message to the given
+     * batch of text to write out, formatting it the same way as
+     * SystemAbstractions::DiagnosticsStreamReporter.
+     *
+     * @param[in] record
+     *     This is the diagnostic message to format.
+     *
+     * @param[in,out] batch
+     *     This is the batch of text to which to append the message.
+     */
+    void FormatRecord(
+        const DiagnosticRecord& record,
+        std::string& batch
+    ) {
+        const char* prefix = "";
+        if (record.level >= SystemAbstractions::DiagnosticsSender::Levels::ERROR) {
+            prefix = "error: ";
+        } else if (record.level >= SystemAbstractions::DiagnosticsSender::Levels::WARNING) {
+            prefix = "warning: ";
+        }
+        char header[64];
+        const auto headerLength = snprintf(
+            header,
+            sizeof(header),
+            "[%.6lf ",
+            record.time
+        );
+        batch.append(header, (size_t)headerLength);
+        batch += record.senderName;
+        (void)snprintf(header, sizeof(header), ":%zu] ", record.level);
+        batch += header;
+        batch += prefix;
+        batch += record.message;
+        batch += '\n';
+    }
+
+}
+
+/**
+ * This contains the private properties of a AsyncDiagnosticsReporter
+ * class instance.
+ */
+struct AsyncDiagnosticsReporter::Impl {
+    // Properties
+
+    /**
+     * This uniquely identifies the reporter among all the reporters
+     * made by the program.
+     */
+    const uint64_t id;
+
+    /**
+     * This is the file stream to which to write diagnostic messages.
+     */
+    FILE* const destination;
+
+    /**
+     * This is the maximum number of messages each producing thread
+     * may have waiting to be written out.
+     */
+    const size_t bufferCapacity;
+
+    /**
+     * This is the time at which the reporter was made.
+     */
+    const std::chrono::steady_clock::time_point startTime;
+
+    /**
+     * This is used to synchronize access to the list of buffers and
+     * the state of the background thread.
+     */
+    std::mutex mutex;
+
+    /**
+     * This is used to wake the background thread when there are
+     * messages to write out, or when it should stop.
+     */
+    std::condition_variable wakeCondition;
+
+    /**
+     * These are the buffers of all the threads which have produced
+     * messages for this reporter, and haven't yet exited with their
+     * buffers drained.
+     */
+    std::vector< std::shared_ptr< RecordBuffer > > buffers;
+
+    /**
+     * This flag is set when the background thread has been or is about
+     * to be woken, so that producing threads only need to wake it for the
+     * first message of each batch.
+     */
+    std::atomic< bool > wakePending{false};
+
+    /**
+     * This flag is set once the reporter is stopped, after which
+     * messages are discarded.
+     */
+    std::atomic< bool > stopped{false};
+
+    /**
+     * This flag tells the background thread to write out any messages
+     * still waiting, and then stop.
+     */
+    bool stopping = false;
+
+    /**
+     * This counts the threads in the middle of queuing a message, so
+     * that the background thread's final pass can wait for them.
+     */
+    std::atomic< size_t > queuing{0};
+
+    /**
+     * This counts the messages which have been dropped because
+     * a producing thread's buffer was full.
+     */
+    std::atomic< size_t > dropped{0};
+
+    /**
+     * This is the background thread which writes out messages.
+     */
+    std::thread worker;
+
+    // Methods
+
+    Impl(
+        FILE* destination,
+        size_t bufferCapacity
+    )
+        : id(nextReporterId++)
+        , destination(destination)
+        , bufferCapacity(bufferCapacity)
+        , startTime(std::chrono::steady_clock::now())
+    {
+    }
+
+    /**
+     * This method returns the buffer in which the current thread should
+     * queue its messages, making one if the thread doesn't have one yet.
+     *
+     * @return
+     *     The current thread's buffer is returned.
+     */
+    RecordRing& GetThreadBuffer() {
+        for (const auto& threadBuffer: threadBuffers.entries) {
+            if (threadBuffer.reporterId == id) {
+                return threadBuffer.buffer->records;
+            }
+        }
+        const auto buffer = std::make_shared< RecordBuffer >(bufferCapacity);
+        {
+            std::lock_guard< decltype(mutex) > lock(mutex);
+            buffers.push_back(buffer);
+        }
+
+        // Let go of buffers left behind by reporters which have since
+        // been destroyed, which are no longer shared with anyone.
+        auto& entries = threadBuffers.entries;
+        entries.erase(
+            std::remove_if(
+                entries.begin(),
+                entries.end(),
+                [](const ThreadBuffer& entry){
+                    return (entry.buffer.use_count() == 1);
+                }
+            ),
+            entries.end()
+        );
+        entries.push_back({id, buffer});
+        return buffer->records;
+    }
+
+    /**
+     * This method queues the given diagnostic message to be written out,
+     * waking the background thread if it isn't already awake.
+     *
+     * @param[in] senderName
+     *     This is the name of the sender of the message.
+     *
+     * @param[in] level
+     *     This is the importance level of the message.
+     *
+     * @param[in] message
+     *     This is the content of the message.
+     */
+    void Queue(
+        std::string&& senderName,
+        size_t level,
+        std::string&& message
+    ) {
+        // Announcing the message before checking whether the reporter is
+        // stopped means that either the check sees the reporter stopped,
+        // or the background thread's final pass waits for the message.
+        ++queuing;
+        if (stopped.load()) {
+            --queuing;
+            return;
+        }
+        DiagnosticRecord record;
+        record.time = std::chrono::duration< double >(
+            std::chrono::steady_clock::now() - startTime
+        ).count();
+        record.level = level;
+        record.senderName = std::move(senderName);
+        record.message = std::move(message);
+        const auto pushed = GetThreadBuffer().TryPush(std::move(record));
+        if (!pushed) {
+            ++dropped;
+        }
+        --queuing;
+        if (!pushed) {
+            return;
+        }
+        if (!wakePending.exchange(true)) {
+            std::lock_guard< decltype(mutex) > lock(mutex);
+            wakeCondition.notify_one();
+        }
+    }
+
+    /**
+     * This is the body of the background thread, which writes out
+     * messages as they're queued, until the reporter is stopped.
+     */
+    void Worker() {
+        std::string batch;
+        size_t droppedReported = 0;
+        std::unique_lock< decltype(mutex) > lock(mutex);
+        for (;;) {
+            wakeCondition.wait(
+                lock,
+                [this]{
+                    return (
+                        stopping
+                        || wakePending.load()
+                    );
+                }
+            );
+            wakePending = false;
+            const auto stoppingSample = stopping;
+            if (stoppingSample) {
+                lock.unlock();
+                while (queuing.load() != 0) {
+                    std::this_thread::yield();
+                }
+                lock.lock();
+            }
+            const auto buffersSample = buffers;
+            lock.unlock();
+            DiagnosticRecord record;
+            bool anyRetired = false;
+            for (const auto& buffer: buffersSample) {
+                if (buffer->retired.load(std::memory_order_acquire)) {
+                    anyRetired = true;
+                }
+                while (buffer->records.TryPop(record)) {
+                    FormatRecord(record, batch);
+                }
+            }
+            const auto droppedSample = dropped.load();
+            if (droppedSample != droppedReported) {
+                record.time = std::chrono::duration< double >(
+                    std::chrono::steady_clock::now() - startTime
+                ).count();
+                record.level = SystemAbstractions::DiagnosticsSender::Levels::WARNING;
+                record.senderName = "AsyncDiagnosticsReporter";
+                record.message = (
+                    std::to_string(droppedSample - droppedReported)
+                    + " diagnostic message(s) dropped"
+                );
+                FormatRecord(record, batch);
+                droppedReported = droppedSample;
+            }
+            if (!batch.empty()) {
+                (void)fwrite(batch.data(), 1, batch.size(), destination);
+                (void)fflush(destination);
+                batch.clear();
+            }
+            lock.lock();
+
+            // Let go of the buffers of threads which have exited, once
+            // they're drained.  A buffer retired after it was drained
+            // above is kept until the next pass.
+            if (anyRetired) {
+                buffers.erase(
+                    std::remove_if(
+                        buffers.begin(),
+                        buffers.end(),
+                        [](const std::shared_ptr< RecordBuffer >& buffer){
+                            return (
+                                buffer->retired.load(std::memory_order_acquire)
+                                && buffer->records.IsEmpty()
+                            );
+                        }
+                    ),
+                    buffers.end()
+                );
+            }
+            if (stoppingSample) {
+                break;
+            }
+        }
+    }
+};
+
+AsyncDiagnosticsReporter::~AsyncDiagnosticsReporter() noexcept {
+    Stop();
+}
+
+AsyncDiagnosticsReporter::AsyncDiagnosticsReporter(
+    FILE* destination,
+    size_t bufferCapacity
+)
+    : impl_(std::make_shared< Impl >(destination, bufferCapacity))
+{
+    impl_->worker = std::thread(&Impl::Worker, impl_.get());
+}
+
+auto AsyncDiagnosticsReporter::GetDelegate()
+    -> SystemAbstractions::DiagnosticsSender::DiagnosticMessageDelegate
+{
+    const auto impl = impl_;
+    return [impl](
+        std::string senderName,
+        size_t level,
+        std::string message
+    ){
+        impl->Queue(std::move(senderName), level, std::move(message));
+    };
+}
+
+void AsyncDiagnosticsReporter::Stop() {
+    std::unique_lock< decltype(impl_->mutex) > lock(impl_->mutex);
+    if (!impl_->worker.joinable()) {
+        return;
+    }
+    // Refuse new messages before the worker's final pass, so that every
+    // message accepted is written out.
+    impl_->stopped = true;
+    impl_->stopping = true;
+    impl_->wakeCondition.notify_one();
+    lock.unlock();
+    impl_->worker.join();
+}
+
+size_t AsyncDiagnosticsReporter::GetDroppedCount() const {
+    return impl_->dropped.load();
+}
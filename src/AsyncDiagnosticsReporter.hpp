@@ -0,0 +1,93 @@
+#pragma once
+
+/**
+ * @file AsyncDiagnosticsReporter.hpp
+ *
+ * This module declares the AsyncDiagnosticsReporter class.
+ *
+ * © 2020 by Richard Walters
+ */
+
+#include <memory>
+#include <stddef.h>
+#include <stdio.h>
+#include <SystemAbstractions/DiagnosticsSender.hpp>
+
+/**
+ * This publishes diagnostic messages to a file stream, without making the
+ * threads which produce the messages wait on the file.  Each producing
+ * thread queues its messages in its own lock-free buffer, and a background
+ * thread formats whatever has been queued and writes it out in one go.
+ * If a producing thread's buffer is full, its message is dropped and
+ * counted, and the number dropped is reported once the background thread
+ * catches up.
+ */
+class AsyncDiagnosticsReporter {
+    // Lifecycle Methods
+public:
+    ~AsyncDiagnosticsReporter() noexcept;
+    AsyncDiagnosticsReporter(const AsyncDiagnosticsReporter&) = delete;
+    AsyncDiagnosticsReporter(AsyncDiagnosticsReporter&&) noexcept = delete;
+    AsyncDiagnosticsReporter& operator=(const AsyncDiagnosticsReporter&) = delete;
+    AsyncDiagnosticsReporter& operator=(AsyncDiagnosticsReporter&&) noexcept = delete;
+
+    // Public Methods
+public:
+    /**
+     * This is the constructor of the class.  It starts the background
+     * thread which writes out diagnostic messages.
+     *
+     * @param[in] destination
+     *     This is the file stream to which to write diagnostic messages.
+     *     It isn't closed by the reporter.
+     *
+     * @param[in] bufferCapacity
+     *     This is the maximum number of messages each producing thread
+     *     may have waiting to be written out.
+     */
+    explicit AsyncDiagnosticsReporter(
+        FILE* destination,
+        size_t bufferCapacity = 4096
+    );
+
+    /**
+     * This method returns a delegate which can be subscribed to diagnostic
+     * senders in order to have their messages written out by the reporter.
+     * The delegate may be kept and used after the reporter is destroyed,
+     * but messages given to it after then are discarded.
+     *
+     * @return
+     *     A delegate which queues diagnostic messages to be written
+     *     out by the reporter is returned.
+     */
+    SystemAbstractions::DiagnosticsSender::DiagnosticMessageDelegate GetDelegate();
+
+    /**
+     * This method writes out any messages still waiting, and stops the
+     * background thread.  Messages queued after this are discarded.
+     */
+    void Stop();
+
+    /**
+     * This method returns the number of messages which have been dropped
+     * so far because a producing thread's buffer was full.
+     *
+     * @return
+     *     The number of messages dropped is returned.
+     */
+    size_t GetDroppedCount() const;
+
+    // Private properties
+private:
+    /**
+     * This is the type of structure that contains the private
+     * properties of the instance.  It is defined in the implementation
+     * and declared here to ensure that it is scoped inside the class.
+     */
+    struct Impl;
+
+    /**
+     * This contains the private properties of the instance.
+     */
+    std::shared_ptr< Impl > impl_;
+};
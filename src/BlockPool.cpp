@@ -0,0 +1,104 @@
+/**
+ * @file BlockPool.cpp
+ *
+ * This module contains the implementations of the BlockPool class.
+ *
+ * © 2020 by Richard Walters
+ */
+
+#include "BlockPool.hpp"
+
+#include <mutex>
+#include <new>
+#include <stddef.h>
+#include <vector>
+
+namespace {
+
+    /**
+     * This is the granularity, in bytes, of the block sizes kept in the pool.
+     */
+    constexpr size_t BIN_GRANULARITY = 16;
+
+    /**
+     * This is the number of different block sizes kept in the pool.  Blocks
+     * larger than this many times the granularity are not pooled.
+     */
+    constexpr size_t NUM_BINS = 64;
+
+}
+
+/**
+ * This contains the private properties of a BlockPool class instance.
+ */
+struct BlockPool::Impl {
+    // Properties
+
+    size_t maxBlocksPerBin;
+    std::mutex mutex;
+    std::vector< void* > bins[NUM_BINS];
+
+    // Methods
+
+    /**
+     * This method returns the index of the bin holding blocks of the given
+     * size, or NUM_BINS if blocks of that size are not pooled.
+     *
+     * @param[in] size
+     *     This is the size of block for which to find the bin.
+     *
+     * @return
+     *     The index of the bin is returned.
+     */
+    static size_t BinIndex(size_t size) {
+        if (size == 0) {
+            return 0;
+        }
+        const auto index = (size - 1) / BIN_GRANULARITY;
+        return (index < NUM_BINS) ? index : NUM_BINS;
+    }
+};
+
+BlockPool::~BlockPool() noexcept {
+    for (auto& bin: impl_->bins) {
+        for (auto block: bin) {
+            ::operator delete(block);
+        }
+    }
+}
+
+BlockPool::BlockPool(size_t maxBlocksPerBin)
+    : impl_(new Impl())
+{
+    impl_->maxBlocksPerBin = maxBlocksPerBin;
+}
+
+void* BlockPool::Allocate(size_t size) {
+    const auto binIndex = Impl::BinIndex(size);
+    if (binIndex == NUM_BINS) {
+        return ::operator new(size);
+    }
+    {
+        std::lock_guard< decltype(impl_->mutex) > lock(impl_->mutex);
+        auto& bin = impl_->bins[binIndex];
+        if (!bin.empty()) {
+            const auto block = bin.back();
+            bin.pop_back();
+            return block;
+        }
+    }
+    return ::operator new((binIndex + 1) * BIN_GRANULARITY);
+}
+
+void BlockPool::Deallocate(void* block, size_t size) {
+    const auto binIndex = Impl::BinIndex(size);
+    if (binIndex < NUM_BINS) {
+        std::lock_guard< decltype(impl_->mutex) > lock(impl_->mutex);
+        auto& bin = impl_->bins[binIndex];
+        if (bin.size() < impl_->maxBlocksPerBin) {
+            bin.push_back(block);
+            return;
+        }
+    }
+    ::operator delete(block);
+}
@@ -0,0 +1,142 @@
+#pragma once
+
+/**
+ * @file BlockPool.hpp
+ *
+ * This module declares the BlockPool class and the RecyclingAllocator
+ * template which uses it.
+ *
+ * © 2020 by Richard Walters
+ */
+
+#include <memory>
+#include <stddef.h>
+
+/**
+ * This is a thread-safe pool of memory blocks, binned by size, which keeps
+ * blocks that are freed so that they can be handed back out again instead
+ * of going back to the heap.
+ */
+class BlockPool {
+    // Lifecycle Methods
+public:
+    ~BlockPool() noexcept;
+    BlockPool(const BlockPool&) = delete;
+    BlockPool(BlockPool&&) noexcept = delete;
+    BlockPool& operator=(const BlockPool&) = delete;
+    BlockPool& operator=(BlockPool&&) noexcept = delete;
+
+    // Public Methods
+public:
+    /**
+     * This is the constructor of the class.
+     *
+     * @param[in] maxBlocksPerBin
+     *     This is the maximum number of freed blocks of each size to keep
+     *     around for reuse.
+     */
+    explicit BlockPool(size_t maxBlocksPerBin = 1024);
+
+    /**
+     * This method returns a block of at least the given size, recycling
+     * a previously freed block if one is available.
+     *
+     * @param[in] size
+     *     This is the number of bytes needed.
+     *
+     * @return
+     *     A pointer to the block is returned.
+     */
+    void* Allocate(size_t size);
+
+    /**
+     * This method returns a block to the pool.
+     *
+     * @param[in] block
+     *     This is the block to return.
+     *
+     * @param[in] size
+     *     This is the size that was given when the block was allocated.
+     */
+    void Deallocate(void* block, size_t size);
+
+    // Private properties
+private:
+    /**
+     * This is the type of structure that contains the private
+     * properties of the instance.  It is defined in the implementation
+     * and declared here to ensure that it is scoped inside the class.
+     */
+    struct Impl;
+
+    /**
+     * This contains the private properties of the instance.
+     */
+    std::unique_ptr< Impl > impl_;
+};
+
+/**
+ * This is a standard allocator which obtains its memory from a shared
+ * BlockPool.  It's used for objects such as the shared state of promises,
+ * which are allocated and freed at a high rate.
+ *
+ * @tparam T
+ *     This is the type of object to allocate.
+ */
+template< typename T > class RecyclingAllocator {
+    // Types
+public:
+    typedef T value_type;
+
+    // Public Methods
+public:
+    /**
+     * This is the constructor of the class.
+     *
+     * @param[in] pool
+     *     This is the pool from which to obtain memory.
+     */
+    explicit RecyclingAllocator(const std::shared_ptr< BlockPool >& pool)
+        : pool_(pool)
+    {
+    }
+
+    /**
+     * This constructor is used when the allocator is rebound to allocate
+     * a different type of object.
+     *
+     * @param[in] other
+     *     This is the allocator to rebind.
+     */
+    template< typename U > RecyclingAllocator(const RecyclingAllocator< U >& other)
+        : pool_(other.GetPool())
+    {
+    }
+
+    T* allocate(size_t n) {
+        return static_cast< T* >(pool_->Allocate(n * sizeof(T)));
+    }
+
+    void deallocate(T* p, size_t n) {
+        pool_->Deallocate(p, n * sizeof(T));
+    }
+
+    const std::shared_ptr< BlockPool >& GetPool() const {
+        return pool_;
+    }
+
+    template< typename U > bool operator==(const RecyclingAllocator< U >& other) const {
+        return pool_ == other.GetPool();
+    }
+
+    template< typename U > bool operator!=(const RecyclingAllocator< U >& other) const {
+        return pool_ != other.GetPool();
+    }
+
+    // Private properties
+private:
+    /**
+     * This is the pool from which to obtain memory.
+     */
+    std::shared_ptr< BlockPool > pool_;
+};
@@ -2,14 +2,15 @@
  * @file ConnectWebSocket.cpp
  *
  * This module contains the implementation of the ConnectWebSocket
- * function.
+ * functions.
  *
  * © 2018, 2020 by Richard Walters
  */
 
 #include "ConnectWebSocket.hpp"
+#include "Metrics.hpp"
 
-#include <condition_variable>
+#include <chrono>
 #include <future>
 #include <Http/IClient.hpp>
 #include <mutex>
@@ -23,9 +24,9 @@
 namespace {
 
     /**
-     * This holds variables that are shared between the MakeConnection
-     * function, ConnectWebSocketSynchronous function, and the delegates
-     * they hand out to be called when different events happen.
+     * This holds variables that are shared between the ConnectWebSocket
+     * function and the delegates it hands out to be called when different
+     * events happen during the connection attempt.
      */
     struct MakeConnectionSharedContext {
         // Properties
@@ -36,225 +37,306 @@ namespace {
         std::mutex mutex;
 
         /**
-         * This is used to signal ConnectWebSocketSynchronous to wake up,
-         * while it's waiting for the connection transaction to complete.
+         * This is the WebSocket which will be engaged if the connection
+         * is successfully upgraded.
          */
-        std::condition_variable connectionWaitDone;
+        std::shared_ptr< WebSockets::WebSocket > ws;
 
         /**
-         * This flag is set if the connection attempt should be aborted.
+         * This is the HTTP client transaction used to connect to the server
+         * and upgrade the connection.  It's released once the connection
+         * attempt is finished.
          */
-        bool abortAttempt = false;
+        std::shared_ptr< Http::IClient::Transaction > transaction;
 
         /**
-         * This flag is set if the connection attempt is completed.
+         * This is the object to use to publish any diagnostic messages.
          */
-        bool transactionCompleted = false;
+        std::shared_ptr< SystemAbstractions::DiagnosticsSender > diagnosticsSender;
+
+        /**
+         * This is the function to call once the connection attempt is
+         * finished.
+         */
+        ConnectionCompletionDelegate completionDelegate;
+
+        /**
+         * If metrics are kept, this is where to record how long the
+         * whole connection attempt took, if it succeeded.
+         */
+        std::shared_ptr< Metrics::Histogram > totalDuration;
+
+        /**
+         * This is when the connection attempt started.
+         */
+        std::chrono::steady_clock::time_point startTime;
+
+        /**
+         * This flag is set once the connection has been upgraded and the
+         * WebSocket has been engaged.
+         */
+        bool wsEngaged = false;
+
+        /**
+         * This flag is set once the connection attempt is finished, whether
+         * because it was completed or aborted.
+         */
+        bool finished = false;
 
         // Methods
 
         /**
-         * This method blocks until either the connection attempt is aborted or
-         * completed.
+         * This method is called when the connection attempt is either
+         * aborted or completed.  It makes sure the completion delegate is
+         * called exactly once.
          *
-         * @return
-         *     An indication of whether or not the connection attempt was
-         *     aborted is returned.
+         * @param[in] aborted
+         *     This indicates whether or not the connection attempt was
+         *     aborted.
          */
-        bool Wait() {
+        void Finish(bool aborted) {
             std::unique_lock< decltype(mutex) > lock(mutex);
-            connectionWaitDone.wait(
-                lock,
-                [this]{
-                    return abortAttempt || transactionCompleted;
-                }
-            );
-            return !abortAttempt;
-        }
-    };
-
-    /**
-     * This method is called to synchronously attempt to connect to a web
-     * server and upgrade the connection a WebSocket.
-     *
-     * @param[in] http
-     *     This is the web client object to use to make the connection.
-     *
-     * @param[in] host
-     *     This is the host name or IP address of the server to which to
-     *     connect.
-     *
-     * @param[in] port
-     *     This is the port number of the server to which to connect.
-     *
-     * @param[in] diagnosticsSender
-     *     This is the function to call to publish any diagnostic messages.
-     *
-     * @param[in] sharedContext
-     *     This olds variables that are shared between the MakeConnection
-     *     function, ConnectWebSocketSynchronous function, and the delegates
-     *     they hand out to be called when different events happen.
-     *
-     * @param[in] webSocketConfiguration
-     *     This contains variables that are used to customize the behavior
-     *     of the WebSocket.
-     *
-     * @return
-     *     The new WebSocket connection to the server is returned.
-     *
-     * @retval nullptr
-     *     This is returned if the connection could not be made.
-     */
-    std::shared_ptr< WebSockets::WebSocket > ConnectWebSocketSynchronous(
-        const std::shared_ptr< Http::IClient >& http,
-        const std::string& uriString,
-        const std::shared_ptr< SystemAbstractions::DiagnosticsSender >& diagnosticsSender,
-        const std::shared_ptr< MakeConnectionSharedContext >& sharedContext,
-        const WebSockets::WebSocket::Configuration& webSocketConfiguration
-    ) {
-        Uri::Uri uri;
-        if (!uri.ParseFromString(uriString)) {
-            diagnosticsSender->SendDiagnosticInformationFormatted(
-                SystemAbstractions::DiagnosticsSender::Levels::ERROR,
-                "WebSocket URI \"%s\" is invalid",
-                uriString.c_str()
+            if (finished) {
+                return;
+            }
+            finished = true;
+            const auto transactionSample = std::move(transaction);
+            transaction = nullptr;
+            decltype(completionDelegate) completionDelegateSample;
+            completionDelegateSample.swap(completionDelegate);
+            const auto result = (
+                (wsEngaged && !aborted)
+                ? std::move(ws)
+                : nullptr
             );
-            return nullptr;
-        }
-        // TODO: This works around a bug in Http::Client where the default port
-        // is assumed to be port 80 unless explicitly set otherwise.
-        if (
-            !uri.HasPort()
-            && (uri.GetScheme() == "wss")
-        ) {
-            uri.SetPort(443);
-        }
-        diagnosticsSender->SendDiagnosticInformationString(
-            2,
-            "Connecting..."
-        );
-
-        // Set up a client-side WebSocket and form the HTTP request for it.
-        const auto ws = std::make_shared< WebSockets::WebSocket >();
-        ws->Configure(webSocketConfiguration);
-        Http::Request request;
-        request.method = "GET";
-        request.target = std::move(uri);
-        ws->StartOpenAsClient(request);
-
-        // Use the HTTP client to send the request, providing a callback if the
-        // connection was successfully upgraded to the WebSocket protocol.
-        bool wsEngaged = false;
-        const auto transaction = http->Request(
-            request,
-            true,
-            [
-                ws,
-                &wsEngaged
-            ](
-                const Http::Response& response,
-                std::shared_ptr< Http::Connection > connection,
-                const std::string& trailer
-            ){
-                if (ws->FinishOpenAsClient(connection, response)) {
-                    wsEngaged = true;
-                }
+            ws = nullptr;
+            const auto engaged = wsEngaged;
+            lock.unlock();
+            if (
+                (result != nullptr)
+                && (totalDuration != nullptr)
+            ) {
+                totalDuration->RecordSince(startTime);
             }
-        );
-        transaction->SetCompletionDelegate(
-            [sharedContext]{
-                std::lock_guard< decltype(sharedContext->mutex) > lock(sharedContext->mutex);
-                sharedContext->transactionCompleted = true;
-                sharedContext->connectionWaitDone.notify_one();
+            if (aborted) {
+                diagnosticsSender->SendDiagnosticInformationString(
+                    SystemAbstractions::DiagnosticsSender::Levels::WARNING,
+                    "connection aborted"
+                );
+            } else {
+                ReportOutcome(*transactionSample, engaged);
+            }
+            if (completionDelegateSample != nullptr) {
+                completionDelegateSample(result);
             }
-        );
-        if (!sharedContext->Wait()) {
-            diagnosticsSender->SendDiagnosticInformationString(
-                SystemAbstractions::DiagnosticsSender::Levels::WARNING,
-                "connection aborted"
-            );
-            return nullptr;
         }
-        switch (transaction->state) {
-            case Http::IClient::Transaction::State::Completed: {
-                if (wsEngaged) {
-                    diagnosticsSender->SendDiagnosticInformationString(
-                        2,
-                        "Connection established."
-                    );
-                } else {
-                    if (transaction->response.statusCode == 101) {
+
+        /**
+         * This method publishes a diagnostic message describing how the
+         * given completed connection transaction turned out.
+         *
+         * @param[in] completedTransaction
+         *     This is the HTTP client transaction which was completed.
+         *
+         * @param[in] engaged
+         *     This indicates whether or not the WebSocket was engaged.
+         */
+        void ReportOutcome(
+            const Http::IClient::Transaction& completedTransaction,
+            bool engaged
+        ) {
+            switch (completedTransaction.state) {
+                case Http::IClient::Transaction::State::Completed: {
+                    if (engaged) {
                         diagnosticsSender->SendDiagnosticInformationString(
-                            SystemAbstractions::DiagnosticsSender::Levels::WARNING,
-                            "Connection upgraded, but failed to engage WebSocket"
+                            2,
+                            "Connection established."
                         );
                     } else {
-                        diagnosticsSender->SendDiagnosticInformationFormatted(
-                            SystemAbstractions::DiagnosticsSender::Levels::WARNING,
-                            "Got back response: %u %s",
-                            transaction->response.statusCode,
-                            transaction->response.reasonPhrase.c_str()
-                        );
+                        if (completedTransaction.response.statusCode == 101) {
+                            diagnosticsSender->SendDiagnosticInformationString(
+                                SystemAbstractions::DiagnosticsSender::Levels::WARNING,
+                                "Connection upgraded, but failed to engage WebSocket"
+                            );
+                        } else {
+                            diagnosticsSender->SendDiagnosticInformationFormatted(
+                                SystemAbstractions::DiagnosticsSender::Levels::WARNING,
+                                "Got back response: %u %s",
+                                completedTransaction.response.statusCode,
+                                completedTransaction.response.reasonPhrase.c_str()
+                            );
+                        }
                     }
-                }
-            } break;
+                } break;
 
-            case Http::IClient::Transaction::State::UnableToConnect: {
-                diagnosticsSender->SendDiagnosticInformationString(
-                    SystemAbstractions::DiagnosticsSender::Levels::WARNING,
-                    "unable to connect"
-                );
-            } break;
+                case Http::IClient::Transaction::State::UnableToConnect: {
+                    diagnosticsSender->SendDiagnosticInformationString(
+                        SystemAbstractions::DiagnosticsSender::Levels::WARNING,
+                        "unable to connect"
+                    );
+                } break;
 
-            case Http::IClient::Transaction::State::Broken: {
-                diagnosticsSender->SendDiagnosticInformationString(
-                    SystemAbstractions::DiagnosticsSender::Levels::WARNING,
-                    "connection broken by server"
-                );
-            } break;
+                case Http::IClient::Transaction::State::Broken: {
+                    diagnosticsSender->SendDiagnosticInformationString(
+                        SystemAbstractions::DiagnosticsSender::Levels::WARNING,
+                        "connection broken by server"
+                    );
+                } break;
 
-            case Http::IClient::Transaction::State::Timeout: {
-                diagnosticsSender->SendDiagnosticInformationString(
-                    SystemAbstractions::DiagnosticsSender::Levels::WARNING,
-                    "timeout waiting for response"
-                );
-            } break;
+                case Http::IClient::Transaction::State::Timeout: {
+                    diagnosticsSender->SendDiagnosticInformationString(
+                        SystemAbstractions::DiagnosticsSender::Levels::WARNING,
+                        "timeout waiting for response"
+                    );
+                } break;
 
-            default: {
-                diagnosticsSender->SendDiagnosticInformationFormatted(
-                    SystemAbstractions::DiagnosticsSender::Levels::ERROR,
-                    "Unknown transaction state (%d)",
-                    (int)transaction->state
-                );
-            } break;
+                default: {
+                    diagnosticsSender->SendDiagnosticInformationFormatted(
+                        SystemAbstractions::DiagnosticsSender::Levels::ERROR,
+                        "Unknown transaction state (%d)",
+                        (int)completedTransaction.state
+                    );
+                } break;
+            }
         }
-        return wsEngaged ? ws : nullptr;
+    };
+
+}
+
+std::function< void() > ConnectWebSocket(
+    std::shared_ptr< Http::IClient > http,
+    const std::string& uriString,
+    std::shared_ptr< SystemAbstractions::DiagnosticsSender > diagnosticsSender,
+    ConnectionCompletionDelegate completionDelegate,
+    WebSockets::WebSocket::Configuration configuration,
+    std::shared_ptr< Metrics > metrics
+) {
+    const auto sharedContext = std::make_shared< MakeConnectionSharedContext >();
+    sharedContext->startTime = std::chrono::steady_clock::now();
+    sharedContext->diagnosticsSender = diagnosticsSender;
+    sharedContext->completionDelegate = std::move(completionDelegate);
+    Uri::Uri uri;
+    if (!uri.ParseFromString(uriString)) {
+        diagnosticsSender->SendDiagnosticInformationFormatted(
+            SystemAbstractions::DiagnosticsSender::Levels::ERROR,
+            "WebSocket URI \"%s\" is invalid",
+            uriString.c_str()
+        );
+        decltype(sharedContext->completionDelegate) completionDelegateSample;
+        completionDelegateSample.swap(sharedContext->completionDelegate);
+        if (completionDelegateSample != nullptr) {
+            completionDelegateSample(nullptr);
+        }
+        return []{};
+    }
+    // TODO: This works around a bug in Http::Client where the default port
+    // is assumed to be port 80 unless explicitly set otherwise.
+    if (
+        !uri.HasPort()
+        && (uri.GetScheme() == "wss")
+    ) {
+        uri.SetPort(443);
     }
+    diagnosticsSender->SendDiagnosticInformationString(
+        2,
+        "Connecting..."
+    );
 
+    // If metrics are kept, record how long it takes to get the upgrade
+    // response (which includes any TLS handshake made for a new
+    // connection), and how long the whole attempt takes.
+    std::shared_ptr< Metrics::Histogram > upgradeDuration;
+    if (metrics != nullptr) {
+        upgradeDuration = metrics->GetHistogram(
+            "discordplay_connect_duration_seconds",
+            "Time taken by each phase of making connections (tcp for every new network connection, upgrade and total for WebSockets)",
+            {{"phase", "upgrade"}}
+        );
+        sharedContext->totalDuration = metrics->GetHistogram(
+            "discordplay_connect_duration_seconds",
+            "Time taken by each phase of making connections (tcp for every new network connection, upgrade and total for WebSockets)",
+            {{"phase", "total"}}
+        );
+    }
+
+    // Set up a client-side WebSocket and form the HTTP request for it.
+    const auto ws = std::make_shared< WebSockets::WebSocket >();
+    ws->Configure(configuration);
+    sharedContext->ws = ws;
+    Http::Request request;
+    request.method = "GET";
+    request.target = std::move(uri);
+    ws->StartOpenAsClient(request);
+
+    // Use the HTTP client to send the request, providing a callback if the
+    // connection was successfully upgraded to the WebSocket protocol.  The
+    // rest of the attempt is driven by the transaction's completion
+    // delegate, so no thread waits on the outcome.
+    std::weak_ptr< MakeConnectionSharedContext > sharedContextWeak(sharedContext);
+    const auto startTime = sharedContext->startTime;
+    const auto transaction = http->Request(
+        std::move(request),
+        true,
+        [
+            startTime,
+            ws,
+            sharedContextWeak,
+            upgradeDuration
+        ](
+            const Http::Response& response,
+            std::shared_ptr< Http::Connection > connection,
+            const std::string&
+        ){
+            if (upgradeDuration != nullptr) {
+                upgradeDuration->RecordSince(startTime);
+            }
+            if (ws->FinishOpenAsClient(connection, response)) {
+                const auto sharedContext = sharedContextWeak.lock();
+                if (sharedContext == nullptr) {
+                    return;
+                }
+                std::lock_guard< decltype(sharedContext->mutex) > lock(sharedContext->mutex);
+                sharedContext->wsEngaged = true;
+            }
+        }
+    );
+    {
+        std::lock_guard< decltype(sharedContext->mutex) > lock(sharedContext->mutex);
+        if (!sharedContext->finished) {
+            sharedContext->transaction = transaction;
+        }
+    }
+    transaction->SetCompletionDelegate(
+        [sharedContext]{
+            sharedContext->Finish(false);
+        }
+    );
+    return [sharedContext]{
+        sharedContext->Finish(true);
+    };
 }
 
 MakeConnectionResults ConnectWebSocket(
     std::shared_ptr< Http::IClient > http,
     const std::string& uri,
     std::shared_ptr< SystemAbstractions::DiagnosticsSender > diagnosticsSender,
-    WebSockets::WebSocket::Configuration configuration
+    WebSockets::WebSocket::Configuration configuration,
+    std::shared_ptr< Metrics > metrics
 ) {
     MakeConnectionResults results;
-    const auto sharedContext = std::make_shared< MakeConnectionSharedContext >();
-    const auto aborted = std::make_shared< std::promise< void > >();
-    results.connectionFuture = std::async(
-        std::launch::async,
-        ConnectWebSocketSynchronous,
+    const auto connectionPromise = std::make_shared<
+        std::promise< std::shared_ptr< WebSockets::WebSocket > >
+    >();
+    results.connectionFuture = connectionPromise->get_future();
+    results.abortConnection = ConnectWebSocket(
         http,
         uri,
         diagnosticsSender,
-        sharedContext,
-        configuration
+        [connectionPromise](std::shared_ptr< WebSockets::WebSocket > webSocket){
+            connectionPromise->set_value(std::move(webSocket));
+        },
+        configuration,
+        metrics
     );
-    results.abortConnection = [sharedContext]{
-        std::lock_guard< decltype(sharedContext->mutex) > lock(sharedContext->mutex);
-        sharedContext->abortAttempt = true;
-        sharedContext->connectionWaitDone.notify_one();
-    };
     return results;
 }
@@ -3,11 +3,13 @@
 /**
  * @file ConnectWebSocket.hpp
  *
- * This module declares the ConnectWebSocket function.
+ * This module declares the ConnectWebSocket functions.
  *
  * © 2018, 2020 by Richard Walters
  */
 
+#include "Metrics.hpp"
+
 #include <functional>
 #include <future>
 #include <Http/IClient.hpp>
@@ -17,6 +19,18 @@
 #include <SystemAbstractions/DiagnosticsSender.hpp>
 #include <WebSockets/WebSocket.hpp>
 
+/**
+ * This is the type of function which is provided to ConnectWebSocket
+ * in order to be called once the connection attempt is finished.
+ *
+ * @param[in] webSocket
+ *     This is the WebSocket connected to the server, or nullptr if the
+ *     connection could not be made or the attempt was aborted.
+ */
+typedef std::function<
+    void(std::shared_ptr< WebSockets::WebSocket > webSocket)
+> ConnectionCompletionDelegate;
+
 /**
  * This is used to return values from the MakeConnection function.
  */
@@ -37,8 +51,10 @@ struct MakeConnectionResults {
 };
 
 /**
- * This method is called to asynchronously attempt to connect to a web
- * server and upgrade the connection a WebSocket.
+ * This function is called to begin attempting to connect to a web server
+ * and upgrade the connection a WebSocket.  No thread is tied up waiting
+ * for the attempt; it's driven entirely by the HTTP client's completion
+ * and upgrade delegates.
  *
  * @param[in] http
  *     This is the web client object to use to make the connection.
@@ -49,9 +65,52 @@ struct MakeConnectionResults {
  * @param[in] diagnosticsSender
  *     This is the object to use to publish any diagnostic messages.
  *
+ * @param[in] completionDelegate
+ *     This is the function to call exactly once, when the connection attempt
+ *     is finished, whether or not it succeeded.
+ *
  * @param[in] configuration
  *     These are the configurable parameters to set for the WebSocket.
  *
+ * @param[in] metrics
+ *     If not null, this is the registry in which to record how long
+ *     connecting takes.
+ *
+ * @return
+ *     A function is returned which can be called to abort the connection
+ *     attempt early.  If the attempt hasn't yet finished, the completion
+ *     delegate is called with nullptr.
+ */
+std::function< void() > ConnectWebSocket(
+    std::shared_ptr< Http::IClient > http,
+    const std::string& uri,
+    std::shared_ptr< SystemAbstractions::DiagnosticsSender > diagnosticsSender,
+    ConnectionCompletionDelegate completionDelegate,
+    WebSockets::WebSocket::Configuration configuration = WebSockets::WebSocket::Configuration(),
+    std::shared_ptr< Metrics > metrics = nullptr
+);
+
+/**
+ * This function is called to asynchronously attempt to connect to a web
+ * server and upgrade the connection a WebSocket.  It's a thin wrapper
+ * around the completion-delegate form of ConnectWebSocket.
+ *
+ * @param[in] http
+ *     This is the web client object to use to make the connection.
+ *
+ * @param[in] uri
+ *     This is the URI of the WebSocket server to which to connect.
+ *
+ * @param[in] diagnosticsSender
+ *     This is the object to use to publish any diagnostic messages.
+ *
+ * @param[in] configuration
+ *     These are the configurable parameters to set for the WebSocket.
+ *
+ * @param[in] metrics
+ *     If not null, this is the registry in which to record how long
+ *     connecting takes.
+ *
  * @return
  *     A structure is returned containing information and tools to
  *     use in coordinating with the asynchronous connection operation.
@@ -60,5 +119,6 @@ MakeConnectionResults ConnectWebSocket(
     std::shared_ptr< Http::IClient > http,
     const std::string& uri,
     std::shared_ptr< SystemAbstractions::DiagnosticsSender > diagnosticsSender,
-    WebSockets::WebSocket::Configuration configuration = WebSockets::WebSocket::Configuration()
+    WebSockets::WebSocket::Configuration configuration = WebSockets::WebSocket::Configuration(),
+    std::shared_ptr< Metrics > metrics = nullptr
 );
@@ -0,0 +1,767 @@
+/**
+ * @file ConnectionPool.cpp
+ *
+ * This module contains the implementations of the ConnectionPool class.
+ *
+ * © 2020 by Richard Walters
+ */
+
+#include "ConnectionPool.hpp"
+#include "Diagnostics.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <mutex>
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <SystemAbstractions/DiagnosticsSender.hpp>
+#include <SystemAbstractions/INetworkConnection.hpp>
+#include <SystemAbstractions/NetworkConnection.hpp>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+
+    /**
+     * This holds the state of one network connection managed by the pool,
+     * which outlives the individual users of the connection.
+     */
+    struct PooledConnectionState {
+        // Properties
+
+        /**
+         * This is used to synchronize access to the structure.
+         */
+        std::mutex mutex;
+
+        /**
+         * This is the actual network connection.
+         */
+        std::shared_ptr< SystemAbstractions::INetworkConnection > inner;
+
+        /**
+         * This identifies the server to which the connection is made.
+         */
+        std::string key;
+
+        /**
+         * This is the scheme given when the connection was made.
+         */
+        std::string scheme;
+
+        /**
+         * This is the host name of the server to which the connection
+         * is made.
+         */
+        std::string serverName;
+
+        /**
+         * This is the function to call to deliver messages received from
+         * the connection to its current user, or nullptr if the connection
+         * is idle.
+         */
+        SystemAbstractions::INetworkConnection::MessageReceivedDelegate messageReceivedDelegate;
+
+        /**
+         * This is the function to call to let the current user of the
+         * connection know the connection was broken, or nullptr if the
+         * connection is idle.
+         */
+        SystemAbstractions::INetworkConnection::BrokenDelegate brokenDelegate;
+
+        /**
+         * This indicates whether or not the actual network connection
+         * has been told to start processing.
+         */
+        bool processing = false;
+
+        /**
+         * This indicates whether or not the connection has been broken,
+         * or has otherwise become unfit for reuse.
+         */
+        bool broken = false;
+
+        /**
+         * This indicates whether or not data has been sent over the
+         * connection since it last received any, meaning a response
+         * may still be on its way.
+         */
+        bool awaitingResponse = false;
+
+        /**
+         * This is the time at which the connection was last returned
+         * to the pool.
+         */
+        double idleSince = 0.0;
+    };
+
+    /**
+     * These are the functions which the pool provides to each connection
+     * it hands out, in order to learn what happens to the connection.
+     */
+    struct PoolHooks {
+        /**
+         * This is called to take back the connection once its user
+         * closes it.
+         */
+        std::function<
+            void(const std::shared_ptr< PooledConnectionState >& state)
+        > release;
+
+        /**
+         * This is called once the user of the connection has connected
+         * it to the server at the given address and port.
+         */
+        std::function<
+            void(
+                const std::shared_ptr< PooledConnectionState >& state,
+                uint32_t peerAddress,
+                uint16_t peerPort
+            )
+        > connected;
+
+        /**
+         * If metrics are kept, this is where to record how long it takes
+         * to connect to the server.
+         */
+        std::shared_ptr< Metrics::Histogram > connectDuration;
+    };
+
+    /**
+     * This function checks whether or not connections made with the
+     * given scheme may be taken back by the pool once their users close
+     * them.  Connections for WebSockets aren't, since by the time they're
+     * closed they've been upgraded, and may have been through a WebSocket
+     * close handshake, so they can't carry anything else.  They may still
+     * be made ahead of time, as spares, since those haven't been upgraded.
+     *
+     * @param[in] scheme
+     *     This is the scheme given when the connection was made.
+     *
+     * @return
+     *     An indication of whether or not connections made with the
+     *     given scheme may be reused is returned.
+     */
+    bool IsReusableScheme(const std::string& scheme) {
+        return (
+            (scheme == "http")
+            || (scheme == "https")
+        );
+    }
+
+    /**
+     * This function starts the actual network connection processing,
+     * forwarding messages received and the connection being broken to
+     * whichever user currently holds the connection.
+     *
+     * @param[in] state
+     *     This is the state of the connection.
+     *
+     * @return
+     *     An indication of whether or not processing was started
+     *     successfully is returned.
+     */
+    bool StartProcessing(const std::shared_ptr< PooledConnectionState >& state) {
+        std::weak_ptr< PooledConnectionState > stateWeak(state);
+        return state->inner->Process(
+            [stateWeak](const std::vector< uint8_t >& message){
+                const auto state = stateWeak.lock();
+                if (state == nullptr) {
+                    return;
+                }
+                std::unique_lock< decltype(state->mutex) > lock(state->mutex);
+                const auto messageReceivedDelegate = state->messageReceivedDelegate;
+                if (messageReceivedDelegate == nullptr) {
+                    // Data arriving on an idle connection means the
+                    // connection is out of step with the protocol,
+                    // so it can't be reused.
+                    state->broken = true;
+                    lock.unlock();
+                    state->inner->Close(false);
+                    return;
+                }
+                state->awaitingResponse = false;
+                lock.unlock();
+                messageReceivedDelegate(message);
+            },
+            [stateWeak](bool graceful){
+                const auto state = stateWeak.lock();
+                if (state == nullptr) {
+                    return;
+                }
+                std::unique_lock< decltype(state->mutex) > lock(state->mutex);
+                state->broken = true;
+                const auto brokenDelegate = state->brokenDelegate;
+                lock.unlock();
+                if (brokenDelegate != nullptr) {
+                    brokenDelegate(graceful);
+                }
+            }
+        );
+    }
+
+    /**
+     * This is the network connection handed out to users of the pool.
+     * It forwards everything to the actual network connection, except that
+     * closing it returns the actual connection to the pool.
+     */
+    class PooledConnection
+        : public SystemAbstractions::INetworkConnection
+    {
+        // Public Methods
+    public:
+        PooledConnection(
+            const std::shared_ptr< PooledConnectionState >& state,
+            const PoolHooks& hooks
+        )
+            : state_(state)
+            , hooks_(hooks)
+        {
+        }
+
+        // SystemAbstractions::INetworkConnection
+    public:
+        virtual SystemAbstractions::DiagnosticsSender::UnsubscribeDelegate SubscribeToDiagnostics(
+            SystemAbstractions::DiagnosticsSender::DiagnosticMessageDelegate delegate,
+            size_t minLevel = 0
+        ) override {
+            return state_->inner->SubscribeToDiagnostics(delegate, minLevel);
+        }
+
+        virtual bool Connect(uint32_t peerAddress, uint16_t peerPort) override {
+            if (state_->inner->IsConnected()) {
+                return true;
+            }
+            const auto connectStart = std::chrono::steady_clock::now();
+            if (!state_->inner->Connect(peerAddress, peerPort)) {
+                return false;
+            }
+            if (hooks_.connectDuration != nullptr) {
+                hooks_.connectDuration->RecordSince(connectStart);
+            }
+            hooks_.connected(state_, peerAddress, peerPort);
+            return true;
+        }
+
+        virtual bool Process(
+            MessageReceivedDelegate messageReceivedDelegate,
+            BrokenDelegate brokenDelegate
+        ) override {
+            std::unique_lock< decltype(state_->mutex) > lock(state_->mutex);
+            state_->messageReceivedDelegate = messageReceivedDelegate;
+            state_->brokenDelegate = brokenDelegate;
+            if (state_->processing) {
+                return true;
+            }
+            state_->processing = true;
+            lock.unlock();
+            return StartProcessing(state_);
+        }
+
+        virtual uint32_t GetPeerAddress() const override {
+            return state_->inner->GetPeerAddress();
+        }
+
+        virtual uint16_t GetPeerPort() const override {
+            return state_->inner->GetPeerPort();
+        }
+
+        virtual bool IsConnected() const override {
+            return state_->inner->IsConnected();
+        }
+
+        virtual uint32_t GetBoundAddress() const override {
+            return state_->inner->GetBoundAddress();
+        }
+
+        virtual uint16_t GetBoundPort() const override {
+            return state_->inner->GetBoundPort();
+        }
+
+        virtual void SendMessage(const std::vector< uint8_t >& message) override {
+            {
+                std::lock_guard< decltype(state_->mutex) > lock(state_->mutex);
+                state_->awaitingResponse = true;
+            }
+            state_->inner->SendMessage(message);
+        }
+
+        virtual void Close(bool clean = false) override {
+            // The connection is only taken back once its user is done
+            // with it cleanly, having received a response to the last
+            // thing it sent.  A request aborted or timed out may still
+            // have its response on the way, which would reach whoever
+            // got the connection next.
+            std::unique_lock< decltype(state_->mutex) > lock(state_->mutex);
+            if (
+                released_
+                || !clean
+                || state_->awaitingResponse
+                || state_->broken
+                || !state_->processing
+                || !IsReusableScheme(state_->scheme)
+                || !state_->inner->IsConnected()
+            ) {
+                if (!released_) {
+                    state_->broken = true;
+                }
+                lock.unlock();
+                if (!released_) {
+                    state_->inner->Close(clean);
+                }
+                return;
+            }
+            released_ = true;
+            state_->messageReceivedDelegate = nullptr;
+            state_->brokenDelegate = nullptr;
+            lock.unlock();
+            hooks_.release(state_);
+        }
+
+        // Private properties
+    private:
+        /**
+         * This is the state of the actual network connection.
+         */
+        std::shared_ptr< PooledConnectionState > state_;
+
+        /**
+         * These are the functions to call to let the pool know what
+         * happens to the connection.
+         */
+        PoolHooks hooks_;
+
+        /**
+         * This indicates whether or not the actual network connection
+         * has been returned to the pool.
+         */
+        bool released_ = false;
+    };
+
+}
+
+/**
+ * This contains the private properties of a ConnectionPool class instance.
+ */
+struct ConnectionPool::Impl {
+    // Types
+
+    /**
+     * This holds what's needed to make more connections to a server
+     * without going through a user of the pool.
+     */
+    struct Server {
+        std::string scheme;
+        std::string serverName;
+        uint32_t address = 0;
+        uint16_t port = 0;
+        size_t warming = 0;
+    };
+
+    // Properties
+
+    std::weak_ptr< Impl > weakSelf;
+    std::unordered_map< std::string, Server > servers;
+    ConnectionFactory factory;
+    std::shared_ptr< Timekeeping::Clock > clock;
+    Configuration configuration;
+    SystemAbstractions::DiagnosticsSender diagnosticsSender;
+    std::mutex mutex;
+    std::unordered_map< std::string, std::deque< std::shared_ptr< PooledConnectionState > > > idle;
+    Statistics statistics;
+    std::shared_ptr< Metrics::Histogram > connectDuration;
+
+    // Methods
+
+    Impl()
+        : diagnosticsSender("ConnectionPool")
+    {
+    }
+
+    /**
+     * This method removes from the pool any idle connections to the given
+     * server which have broken or timed out.
+     *
+     * @note
+     *     The mutex must be held while calling this method.
+     *
+     * @param[in,out] connections
+     *     These are the idle connections to the server.
+     *
+     * @param[in] now
+     *     This is the current time.
+     *
+     * @param[in,out] evicted
+     *     This is where to put the connections removed, so that they can
+     *     be closed once the mutex is released.
+     */
+    void Purge(
+        std::deque< std::shared_ptr< PooledConnectionState > >& connections,
+        double now,
+        std::vector< std::shared_ptr< PooledConnectionState > >& evicted
+    ) {
+        for (auto it = connections.begin(); it != connections.end(); ) {
+            const auto& state = *it;
+            std::lock_guard< decltype(state->mutex) > stateLock(state->mutex);
+            if (
+                state->broken
+                || (now - state->idleSince >= configuration.idleTimeout)
+            ) {
+                evicted.push_back(state);
+                it = connections.erase(it);
+                ++statistics.evictions;
+                --statistics.idle;
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    /**
+     * This method takes back a connection whose user closed it, keeping
+     * it for reuse if there's room.
+     *
+     * @param[in] state
+     *     This is the state of the connection being returned.
+     */
+    void Release(const std::shared_ptr< PooledConnectionState >& state) {
+        std::vector< std::shared_ptr< PooledConnectionState > > evicted;
+        std::unique_lock< decltype(mutex) > lock(mutex);
+        const auto now = clock->GetCurrentTime();
+        auto& connections = idle[state->key];
+        Purge(connections, now, evicted);
+        if (connections.size() < configuration.maxIdleConnections) {
+            {
+                std::lock_guard< decltype(state->mutex) > stateLock(state->mutex);
+                state->idleSince = now;
+            }
+            connections.push_back(state);
+            ++statistics.idle;
+        } else {
+            evicted.push_back(state);
+            ++statistics.evictions;
+        }
+        lock.unlock();
+        for (const auto& evictedState: evicted) {
+            evictedState->inner->Close(false);
+        }
+    }
+
+    /**
+     * This method starts making spare connections to the given server,
+     * if there are fewer idle or in the making than the given number.
+     *
+     * @note
+     *     The mutex must be held while calling this method.
+     *
+     * @param[in] key
+     *     This identifies the server to which to make spare connections.
+     *
+     * @param[in] count
+     *     This is the number of connections to have idle or in the making.
+     *     It's limited to the number of idle connections kept for each
+     *     server, since any more would be closed as soon as they're made.
+     */
+    void Refill(
+        const std::string& key,
+        size_t count
+    ) {
+        count = std::min(count, configuration.maxIdleConnections);
+        const auto serversEntry = servers.find(key);
+        if (serversEntry == servers.end()) {
+            return;
+        }
+        auto& server = serversEntry->second;
+        const auto idleEntry = idle.find(key);
+        const auto numIdle = (
+            (idleEntry == idle.end())
+            ? 0
+            : idleEntry->second.size()
+        );
+        while (numIdle + server.warming < count) {
+            ++server.warming;
+            StartSpare(key, server);
+        }
+    }
+
+    /**
+     * This method starts making one spare connection to the given server,
+     * which is put in the pool once it's connected.  The connection is
+     * made in a separate thread, because connecting blocks.
+     *
+     * @note
+     *     The mutex must be held while calling this method.
+     *
+     * @param[in] key
+     *     This identifies the server to which to make the connection.
+     *
+     * @param[in] server
+     *     This holds what's needed to make the connection.
+     */
+    void StartSpare(
+        const std::string& key,
+        const Server& server
+    ) {
+        const auto state = std::make_shared< PooledConnectionState >();
+        state->key = key;
+        state->scheme = server.scheme;
+        state->serverName = server.serverName;
+        const auto factorySample = factory;
+        const auto address = server.address;
+        const auto port = server.port;
+        const auto implWeak = weakSelf;
+        const auto connectDurationSample = connectDuration;
+        std::thread(
+            [state, factorySample, address, port, implWeak, connectDurationSample]{
+                state->inner = factorySample(state->scheme, state->serverName);
+                const auto connectStart = std::chrono::steady_clock::now();
+                const auto connected = (
+                    (state->inner != nullptr)
+                    && state->inner->Connect(address, port)
+                );
+                if (
+                    connected
+                    && (connectDurationSample != nullptr)
+                ) {
+                    connectDurationSample->RecordSince(connectStart);
+                }
+                if (connected) {
+                    std::lock_guard< decltype(state->mutex) > lock(state->mutex);
+                    state->processing = true;
+                }
+                const auto processing = (
+                    connected
+                    && StartProcessing(state)
+                );
+                const auto impl = implWeak.lock();
+                if (impl == nullptr) {
+                    if (state->inner != nullptr) {
+                        state->inner->Close(false);
+                    }
+                    return;
+                }
+                std::unique_lock< decltype(impl->mutex) > lock(impl->mutex);
+                const auto serversEntry = impl->servers.find(state->key);
+                if (serversEntry != impl->servers.end()) {
+                    --serversEntry->second.warming;
+                }
+                lock.unlock();
+                if (processing) {
+                    DIAG_FORMATTED(
+                        impl->diagnosticsSender,
+                        DIAG_THRESHOLD_CONNECTION_POOL,
+                        0,
+                        "Spare connection to %s ready",
+                        state->key.c_str()
+                    );
+                    impl->Release(state);
+                } else {
+                    impl->diagnosticsSender.SendDiagnosticInformationFormatted(
+                        SystemAbstractions::DiagnosticsSender::Levels::WARNING,
+                        "Unable to make spare connection to %s",
+                        state->key.c_str()
+                    );
+                    if (state->inner != nullptr) {
+                        state->inner->Close(false);
+                    }
+                }
+            }
+        ).detach();
+    }
+
+    /**
+     * This method is called once a connection handed out by the pool
+     * is connected, in order to remember how to make more connections
+     * to the same server.
+     *
+     * @param[in] state
+     *     This is the state of the connection.
+     *
+     * @param[in] address
+     *     This is the address to which the connection was made.
+     *
+     * @param[in] port
+     *     This is the port to which the connection was made.
+     */
+    void Connected(
+        const std::shared_ptr< PooledConnectionState >& state,
+        uint32_t address,
+        uint16_t port
+    ) {
+        std::lock_guard< decltype(mutex) > lock(mutex);
+        auto& server = servers[state->key];
+        server.scheme = state->scheme;
+        server.serverName = state->serverName;
+        server.address = address;
+        server.port = port;
+        Refill(state->key, configuration.spareConnections);
+    }
+};
+
+ConnectionPool::~ConnectionPool() noexcept = default;
+
+ConnectionPool::ConnectionPool(
+    ConnectionFactory factory,
+    std::shared_ptr< Timekeeping::Clock > clock
+)
+    : impl_(new Impl())
+{
+    impl_->weakSelf = impl_;
+    impl_->factory = factory;
+    impl_->clock = clock;
+}
+
+void ConnectionPool::Configure(const Configuration& configuration) {
+    std::lock_guard< decltype(impl_->mutex) > lock(impl_->mutex);
+    impl_->configuration = configuration;
+}
+
+void ConnectionPool::SetMetrics(const std::shared_ptr< Metrics >& metrics) {
+    std::lock_guard< decltype(impl_->mutex) > lock(impl_->mutex);
+    if (metrics == nullptr) {
+        impl_->connectDuration = nullptr;
+    } else {
+        impl_->connectDuration = metrics->GetHistogram(
+            "discordplay_connect_duration_seconds",
+            "Time taken by each phase of making connections (tcp for every new network connection, upgrade and total for WebSockets)",
+            {{"phase", "tcp"}}
+        );
+    }
+}
+
+SystemAbstractions::DiagnosticsSender::UnsubscribeDelegate ConnectionPool::SubscribeToDiagnostics(
+    SystemAbstractions::DiagnosticsSender::DiagnosticMessageDelegate delegate,
+    size_t minLevel
+) {
+    return impl_->diagnosticsSender.SubscribeToDiagnostics(delegate, minLevel);
+}
+
+std::shared_ptr< SystemAbstractions::INetworkConnection > ConnectionPool::Acquire(
+    const std::string& scheme,
+    const std::string& serverName
+) {
+    std::weak_ptr< Impl > implWeak(impl_);
+    PoolHooks hooks;
+    hooks.release = [implWeak](
+        const std::shared_ptr< PooledConnectionState >& state
+    ){
+        const auto impl = implWeak.lock();
+        if (impl == nullptr) {
+            state->inner->Close(false);
+            return;
+        }
+        impl->Release(state);
+    };
+    hooks.connected = [implWeak](
+        const std::shared_ptr< PooledConnectionState >& state,
+        uint32_t peerAddress,
+        uint16_t peerPort
+    ){
+        const auto impl = implWeak.lock();
+        if (impl == nullptr) {
+            return;
+        }
+        impl->Connected(state, peerAddress, peerPort);
+    };
+    const auto key = scheme + "://" + serverName;
+    std::vector< std::shared_ptr< PooledConnectionState > > evicted;
+    std::shared_ptr< PooledConnectionState > state;
+    std::unique_lock< decltype(impl_->mutex) > lock(impl_->mutex);
+    const auto idleEntry = impl_->idle.find(key);
+    if (idleEntry != impl_->idle.end()) {
+        impl_->Purge(idleEntry->second, impl_->clock->GetCurrentTime(), evicted);
+        if (!idleEntry->second.empty()) {
+            state = idleEntry->second.back();
+            idleEntry->second.pop_back();
+            --impl_->statistics.idle;
+        }
+    }
+    if (state == nullptr) {
+        ++impl_->statistics.misses;
+    } else {
+        ++impl_->statistics.hits;
+        impl_->Refill(key, impl_->configuration.spareConnections);
+    }
+    const auto factory = impl_->factory;
+    hooks.connectDuration = impl_->connectDuration;
+    lock.unlock();
+    for (const auto& evictedState: evicted) {
+        evictedState->inner->Close(false);
+    }
+    if (state == nullptr) {
+        state = std::make_shared< PooledConnectionState >();
+        state->inner = factory(scheme, serverName);
+        if (state->inner == nullptr) {
+            return nullptr;
+        }
+        state->key = key;
+        state->scheme = scheme;
+        state->serverName = serverName;
+        DIAG_FORMATTED(
+            impl_->diagnosticsSender,
+            DIAG_THRESHOLD_CONNECTION_POOL,
+            0,
+            "New connection to %s",
+            key.c_str()
+        );
+    } else {
+        DIAG_FORMATTED(
+            impl_->diagnosticsSender,
+            DIAG_THRESHOLD_CONNECTION_POOL,
+            0,
+            "Reusing connection to %s",
+            key.c_str()
+        );
+    }
+    return std::make_shared< PooledConnection >(state, hooks);
+}
+
+void ConnectionPool::Warm(
+    const std::string& scheme,
+    const std::string& serverName,
+    uint16_t port,
+    size_t count
+) {
+    const auto key = scheme + "://" + serverName;
+    std::weak_ptr< Impl > implWeak(impl_);
+    std::thread(
+        [implWeak, key, scheme, serverName, port, count]{
+            const auto address = SystemAbstractions::NetworkConnection::GetAddressOfHost(serverName);
+            const auto impl = implWeak.lock();
+            if (impl == nullptr) {
+                return;
+            }
+            if (address == 0) {
+                impl->diagnosticsSender.SendDiagnosticInformationFormatted(
+                    SystemAbstractions::DiagnosticsSender::Levels::WARNING,
+                    "Unable to resolve %s to warm connections to it",
+                    serverName.c_str()
+                );
+                return;
+            }
+            DIAG_FORMATTED(
+                impl->diagnosticsSender,
+                DIAG_THRESHOLD_CONNECTION_POOL,
+                0,
+                "Warming %zu connection(s) to %s",
+                count,
+                key.c_str()
+            );
+            std::lock_guard< decltype(impl->mutex) > lock(impl->mutex);
+            auto& server = impl->servers[key];
+            server.scheme = scheme;
+            server.serverName = serverName;
+            server.address = address;
+            server.port = port;
+            impl->Refill(key, count);
+        }
+    ).detach();
+}
+
+auto ConnectionPool::GetStatistics() -> Statistics {
+    std::lock_guard< decltype(impl_->mutex) > lock(impl_->mutex);
+    return impl_->statistics;
+}
@@ -0,0 +1,221 @@
+#pragma once
+
+/**
+ * @file ConnectionPool.hpp
+ *
+ * This module declares the ConnectionPool class.
+ *
+ * © 2020 by Richard Walters
+ */
+
+#include "Metrics.hpp"
+
+#include <functional>
+#include <memory>
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <SystemAbstractions/DiagnosticsSender.hpp>
+#include <SystemAbstractions/INetworkConnection.hpp>
+#include <Timekeeping/Clock.hpp>
+
+/**
+ * This keeps network connections which are closed cleanly by their users,
+ * so that later connections to the same server can reuse them, rather than
+ * paying again for a new TCP connection and TLS handshake.  It can also
+ * keep spare connections ready ahead of time.
+ */
+class ConnectionPool {
+    // Types
+public:
+    /**
+     * This is the type of function used to make new network connections
+     * when there isn't an idle one to reuse.
+     *
+     * @param[in] scheme
+     *     This is the scheme of the URI of the resource to be accessed
+     *     through the connection.
+     *
+     * @param[in] serverName
+     *     This is the host name of the server to which to connect.
+     *
+     * @return
+     *     The new network connection is returned.
+     */
+    typedef std::function<
+        std::shared_ptr< SystemAbstractions::INetworkConnection >(
+            const std::string& scheme,
+            const std::string& serverName
+        )
+    > ConnectionFactory;
+
+    /**
+     * This holds the configurable parameters of the pool.
+     */
+    struct Configuration {
+        /**
+         * This is the maximum number of idle connections to keep for
+         * each server.
+         */
+        size_t maxIdleConnections = 4;
+
+        /**
+         * This is the number of seconds after which an idle connection
+         * is closed rather than reused.
+         */
+        double idleTimeout = 60.0;
+
+        /**
+         * This is the number of spare connections to keep ready for each
+         * server to which a connection has been made.  Spares are made in
+         * the background, so that when a new connection is needed (such as
+         * when reconnecting the gateway), it's handed out with its TLS
+         * handshake already done.  No more spares are kept than
+         * maxIdleConnections.
+         */
+        size_t spareConnections = 0;
+    };
+
+    /**
+     * This holds counters which describe how well the pool is working.
+     */
+    struct Statistics {
+        /**
+         * This is the number of connections handed out by reusing
+         * idle connections.
+         */
+        size_t hits = 0;
+
+        /**
+         * This is the number of connections handed out by making new
+         * connections.
+         */
+        size_t misses = 0;
+
+        /**
+         * This is the number of idle connections which were closed because
+         * they timed out, broke, or didn't fit in the pool.
+         */
+        size_t evictions = 0;
+
+        /**
+         * This is the number of connections currently idle in the pool.
+         */
+        size_t idle = 0;
+    };
+
+    // Lifecycle Methods
+public:
+    ~ConnectionPool() noexcept;
+    ConnectionPool(const ConnectionPool&) = delete;
+    ConnectionPool(ConnectionPool&&) noexcept = delete;
+    ConnectionPool& operator=(const ConnectionPool&) = delete;
+    ConnectionPool& operator=(ConnectionPool&&) noexcept = delete;
+
+    // Public Methods
+public:
+    /**
+     * This is the constructor of the class.
+     *
+     * @param[in] factory
+     *     This is the function to call to make new network connections.
+     *
+     * @param[in] clock
+     *     This is the clock used to time out idle connections.
+     */
+    ConnectionPool(
+        ConnectionFactory factory,
+        std::shared_ptr< Timekeeping::Clock > clock
+    );
+
+    void Configure(const Configuration& configuration);
+
+    /**
+     * This method sets the registry in which to record how long it takes
+     * to make each new network connection.
+     *
+     * @param[in] metrics
+     *     This is the registry in which to keep metrics.
+     */
+    void SetMetrics(const std::shared_ptr< Metrics >& metrics);
+
+    SystemAbstractions::DiagnosticsSender::UnsubscribeDelegate SubscribeToDiagnostics(
+        SystemAbstractions::DiagnosticsSender::DiagnosticMessageDelegate delegate,
+        size_t minLevel = 0
+    );
+
+    /**
+     * This method returns a network connection to the given server,
+     * reusing an idle one if there is one.  A reused connection is
+     * already connected, so connecting it again succeeds immediately.
+     * When the connection is cleanly closed by its user, it's kept
+     * open and returned to the pool instead.
+     *
+     * @param[in] scheme
+     *     This is the scheme of the URI of the resource to be accessed
+     *     through the connection.
+     *
+     * @param[in] serverName
+     *     This is the host name of the server to which to connect.
+     *
+     * @return
+     *     The network connection is returned.
+     */
+    std::shared_ptr< SystemAbstractions::INetworkConnection > Acquire(
+        const std::string& scheme,
+        const std::string& serverName
+    );
+
+    /**
+     * This method starts making the given number of connections to the
+     * given server ahead of time, in the background, resolving the
+     * server's address first, so that the first users of the pool don't
+     * have to wait for a new TCP connection and TLS handshake.  Once made,
+     * the connections are kept idle in the pool, like connections closed
+     * cleanly by their users.
+     *
+     * @param[in] scheme
+     *     This is the scheme of the URI of the resources to be accessed
+     *     through the connections.
+     *
+     * @param[in] serverName
+     *     This is the host name of the server to which to connect.
+     *
+     * @param[in] port
+     *     This is the port number of the server to which to connect.
+     *
+     * @param[in] count
+     *     This is the number of connections to have idle, or in
+     *     the making, up to the configured maximum number of idle
+     *     connections.
+     */
+    void Warm(
+        const std::string& scheme,
+        const std::string& serverName,
+        uint16_t port,
+        size_t count
+    );
+
+    /**
+     * This method returns counters which describe how well the pool
+     * is working.
+     *
+     * @return
+     *     The pool's counters are returned.
+     */
+    Statistics GetStatistics();
+
+    // Private properties
+private:
+    /**
+     * This is the type of structure that contains the private
+     * properties of the instance.  It is defined in the implementation
+     * and declared here to ensure that it is scoped inside the class.
+     */
+    struct Impl;
+
+    /**
+     * This contains the private properties of the instance.
+     */
+    std::shared_ptr< Impl > impl_;
+};
@@ -6,27 +6,338 @@
  * © 2020 by Richard Walters
  */
 
+#include "BlockPool.hpp"
 #include "Connections.hpp"
 #include "ConnectWebSocket.hpp"
 #include "Diagnostics.hpp"
+#include "GatewayCache.hpp"
+#include "Metrics.hpp"
+#include "RateLimiter.hpp"
+#include "ResponseCache.hpp"
 #include "WebSocket.hpp"
 
+#include <chrono>
+#include <deque>
 #include <Http/IClient.hpp>
 #include <memory>
 #include <mutex>
 #include <stddef.h>
+#include <stdint.h>
+#include <StringExtensions/StringExtensions.hpp>
 #include <SystemAbstractions/DiagnosticsSender.hpp>
 #include <unordered_map>
 #include <Uri/Uri.hpp>
+#include <vector>
+
+namespace {
+
+    /**
+     * This is the number of classes of resource requests, each of which
+     * has a lane of its own.
+     */
+    constexpr size_t NUM_PRIORITIES = 3;
+
+    /**
+     * These are the names of the classes of resource requests, used
+     * in diagnostic messages and metric labels.
+     */
+    const char* const PRIORITY_NAMES[NUM_PRIORITIES] = {
+        "critical",
+        "interactive",
+        "bulk",
+    };
+
+    /**
+     * This function checks to see if the given path ends with
+     * the given suffix.
+     *
+     * @param[in] path
+     *     This is the path to check.
+     *
+     * @param[in] suffix
+     *     This is the suffix to look for.
+     *
+     * @return
+     *     An indication of whether or not the path ends with the suffix
+     *     is returned.
+     */
+    bool EndsWith(
+        const std::string& path,
+        const std::string& suffix
+    ) {
+        return (
+            (path.length() >= suffix.length())
+            && (path.compare(path.length() - suffix.length(), suffix.length(), suffix) == 0)
+        );
+    }
+
+    /**
+     * This function checks to see if the given request is conditional,
+     * in which case it isn't answered from the response cache or merged
+     * with other requests.
+     *
+     * @param[in] request
+     *     This is the request to check.
+     *
+     * @return
+     *     An indication of whether or not the request is conditional
+     *     is returned.
+     */
+    bool IsConditional(const Discord::Connections::ResourceRequest& request) {
+        for (const auto& header: request.headers) {
+            const auto key = StringExtensions::ToLower(header.key);
+            if (
+                (key == "if-none-match")
+                || (key == "if-modified-since")
+            ) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /**
+     * This function parses the given URI into the given target of an
+     * HTTP request, using the default port for secure connections if
+     * the scheme calls for them.
+     *
+     * @param[in] uri
+     *     This is the URI to parse.
+     *
+     * @param[out] target
+     *     This is where to store the parsed URI.
+     */
+    void ParseTarget(
+        const std::string& uri,
+        Uri::Uri& target
+    ) {
+        target.ParseFromString(uri);
+        if (
+            (target.GetScheme() == "https")
+            || (target.GetScheme() == "wss")
+        ) {
+            target.SetPort(443);
+        }
+    }
+
+}
 
 /**
  * This contains the private properties of a Connections class instance.
  */
 struct Connections::Impl {
+    // Types
+
+    /**
+     * This holds the requester of a GET request which was merged into
+     * an identical one already in flight.
+     */
+    struct Follower {
+        /**
+         * This identifies the merged request.
+         */
+        int id = 0;
+
+        /**
+         * This is used to deliver the response to the requester.
+         */
+        std::promise< Response > responsePromise;
+    };
+
+    /**
+     * This identifies the transaction slot holding a GET request which
+     * other identical requests may be merged into.
+     */
+    struct InFlightGet {
+        size_t index;
+        int id;
+    };
+
+    /**
+     * This holds the state of one resource request while it's in flight.
+     * Slots are recycled rather than freed, so that steady-state traffic
+     * doesn't need to allocate a new table entry for every request.
+     */
+    struct HttpClientTransactionSlot {
+        /**
+         * This is the identifier of the resource request occupying the
+         * slot, or zero if the slot is free.
+         */
+        int id = 0;
+
+        /**
+         * This is the HTTP client transaction carrying out the request.
+         */
+        std::shared_ptr< Http::IClient::Transaction > transaction;
+
+        /**
+         * This is used to deliver the response to the requester.
+         */
+        std::promise< Response > responsePromise;
+
+        /**
+         * This is the request to send, held here until the rate limiter
+         * releases it.
+         */
+        Http::Request request;
+
+        /**
+         * This identifies the request to the rate limiter.
+         */
+        int rateLimitTicket = 0;
+
+        /**
+         * If the request is a GET whose response may be cached or shared,
+         * this is its key in the response cache.
+         */
+        std::string getKey;
+
+        /**
+         * These are the requesters of identical GET requests merged
+         * into this one.
+         */
+        std::vector< Follower > followers;
+
+        /**
+         * This indicates whether or not the requester who made the request
+         * canceled it while others merged into it were still waiting.
+         */
+        bool requesterCanceled = false;
+
+        /**
+         * This indicates whether or not the request was made conditional
+         * in order to revalidate a stale cached response.
+         */
+        bool revalidating = false;
+
+        /**
+         * If the request is revalidating a cached response, this is
+         * a copy of that response.
+         */
+        Response staleResponse;
+
+        /**
+         * This is the invalidation generation of the response cache
+         * when the request was queued.
+         */
+        uint64_t cacheGeneration = 0;
+
+        /**
+         * If metrics are kept, this is where to record how long the
+         * request took, from being queued to being answered.
+         */
+        std::shared_ptr< Metrics::Histogram > latency;
+
+        /**
+         * If metrics are kept, this is when the request was queued.
+         */
+        std::chrono::steady_clock::time_point queueTime;
+
+        /**
+         * If the request is one for the gateway URL, whose response is
+         * kept in the gateway cache, this is the key under which it's
+         * kept.  Otherwise, it's empty.
+         */
+        std::string gatewayCacheKey;
+
+        /**
+         * This is the class of the request.
+         */
+        Priority priority = Priority::Interactive;
+
+        /**
+         * This indicates whether or not the request was let through its
+         * lane to the rate limiter, rather than waiting in the lane.
+         */
+        bool admitted = false;
+    };
+
+    /**
+     * This identifies a resource request waiting in its lane.
+     */
+    struct QueuedRequest {
+        /**
+         * This is the index of the slot holding the request.
+         */
+        size_t index;
+
+        /**
+         * This is the identifier of the resource request.
+         */
+        int id;
+
+        /**
+         * This is the time by which the request should be let through.
+         */
+        double deadline;
+
+        /**
+         * This is the HTTP method of the request, which the rate limiter
+         * needs to find its bucket.
+         */
+        std::string method;
+
+        /**
+         * This is the URI of the resource requested, which the rate
+         * limiter needs to find its bucket.
+         */
+        std::string uri;
+    };
+
+    /**
+     * This holds the state of the lane of one class of resource requests.
+     */
+    struct Lane {
+        /**
+         * These are the settings of the lane.
+         */
+        LaneConfiguration configuration;
+
+        /**
+         * This is the number of requests of the class let through
+         * and not yet answered.
+         */
+        size_t inFlight = 0;
+
+        /**
+         * These are the requests of the class waiting to be let through,
+         * in the order they were queued.  Since every request in a lane
+         * has the same deadline budget, this is also the order of their
+         * deadlines.  Requests canceled while waiting are left here, and
+         * skipped when they come up.
+         */
+        std::deque< QueuedRequest > queue;
+
+        /**
+         * If metrics are kept, this counts the requests of the class
+         * waiting to be let through.
+         */
+        std::shared_ptr< Metrics::Gauge > queued;
+    };
+
     // Properties
 
+    std::weak_ptr< Impl > weakSelf;
     std::shared_ptr< Http::IClient > httpClient;
-    std::unordered_map< int, std::shared_ptr< Http::IClient::Transaction > > httpClientTransactions;
+    RateLimiter rateLimiter;
+    std::shared_ptr< Timekeeping::Clock > clock;
+    ResponseCache responseCache;
+    bool coalesceGets = false;
+    std::unordered_map< std::string, InFlightGet > inFlightGets;
+    WebSocket::Configuration webSocketConfiguration;
+    std::vector< HttpClientTransactionSlot > httpClientTransactions;
+    std::vector< size_t > freeHttpClientTransactionSlots;
+    std::shared_ptr< BlockPool > promiseStatePool = std::make_shared< BlockPool >();
+    std::shared_ptr< Metrics > metrics;
+    std::shared_ptr< Metrics::Gauge > requestsInFlight;
+    std::unordered_map< std::string, std::shared_ptr< Metrics::Histogram > > routeLatencies;
+    std::string targetPrefix;
+    Uri::Uri targetBase;
+    std::shared_ptr< GatewayCache > gatewayCache;
+    Lane lanes[NUM_PRIORITIES];
+    size_t maxRequestsInFlight = 0;
+    size_t requestsAdmitted = 0;
+    PriorityClassifier priorityClassifier;
     SystemAbstractions::DiagnosticsSender diagnosticsSender;
     std::mutex mutex;
     int nextHttpClientTransactionId = 1;
@@ -36,6 +347,721 @@ struct Connections::Impl {
     Impl()
         : diagnosticsSender("Connections")
     {
+        lanes[(size_t)Priority::Critical].configuration.deadline = 1.0;
+        lanes[(size_t)Priority::Interactive].configuration.deadline = 3.0;
+        lanes[(size_t)Priority::Bulk].configuration.deadline = 30.0;
+        lanes[(size_t)Priority::Bulk].configuration.maxInFlight = 4;
+    }
+
+    /**
+     * This method publishes the headers and body of a response as
+     * level 0 diagnostic messages.  It should only be called if someone
+     * is listening at that level (see DIAG_ENABLED), to avoid formatting
+     * messages no one will see.
+     *
+     * @param[in] response
+     *     This is the response to report.
+     */
+    void ReportResponseDetails(const Http::Response& response) {
+        diagnosticsSender.SendDiagnosticInformationString(
+            0,
+            "Headers: ---------------"
+        );
+        for (const auto& header: response.headers.GetAll()) {
+            diagnosticsSender.SendDiagnosticInformationFormatted(
+                0,
+                "%s: %s",
+                ((std::string)header.name).c_str(),
+                header.value.c_str()
+            );
+        }
+        diagnosticsSender.SendDiagnosticInformationString(
+            0,
+            "Body: ------------------------"
+        );
+        if (!response.body.empty()) {
+            diagnosticsSender.SendDiagnosticInformationString(
+                0,
+                response.body
+            );
+        }
+        diagnosticsSender.SendDiagnosticInformationString(
+            0,
+            "------------------------"
+        );
+    }
+
+    /**
+     * This method sets the given target of an HTTP request to the given
+     * URI.  Nearly every request goes to the same API server, so the
+     * scheme and authority are parsed only when they differ from those
+     * of the previous request; otherwise the copy parsed then is reused,
+     * and only the path and query are taken from the string.  URIs with
+     * percent-encoding or a fragment are parsed in full, since those
+     * parts need decoding.
+     *
+     * @note
+     *     The mutex must not be held while calling this method.
+     *
+     * @param[in] uri
+     *     This is the URI of the resource requested.
+     *
+     * @param[out] target
+     *     This is where to store the parsed URI.
+     */
+    void SetTarget(
+        const std::string& uri,
+        Uri::Uri& target
+    ) {
+        const auto schemeEnd = uri.find("://");
+        const auto authorityEnd = (
+            (schemeEnd == std::string::npos)
+            ? std::string::npos
+            : uri.find_first_of("/?#", schemeEnd + 3)
+        );
+        if (
+            (authorityEnd == std::string::npos)
+            || (uri.find_first_of("%#", authorityEnd) != std::string::npos)
+        ) {
+            ParseTarget(uri, target);
+            return;
+        }
+        std::unique_lock< decltype(mutex) > lock(mutex);
+        if (
+            (targetPrefix.length() == authorityEnd)
+            && (uri.compare(0, authorityEnd, targetPrefix) == 0)
+        ) {
+            target = targetBase;
+            lock.unlock();
+        } else {
+            lock.unlock();
+            ParseTarget(uri.substr(0, authorityEnd), target);
+            lock.lock();
+            targetPrefix = uri.substr(0, authorityEnd);
+            targetBase = target;
+            lock.unlock();
+        }
+        const auto queryStart = uri.find('?', authorityEnd);
+        const auto pathEnd = (
+            (queryStart == std::string::npos)
+            ? uri.length()
+            : queryStart
+        );
+        std::vector< std::string > path;
+        if (pathEnd - authorityEnd == 1) {
+            path.push_back("");
+        } else if (pathEnd > authorityEnd) {
+            size_t segmentStart = authorityEnd + 1;
+            path.push_back("");
+            for (;;) {
+                const auto delimiter = uri.find('/', segmentStart);
+                if (
+                    (delimiter == std::string::npos)
+                    || (delimiter >= pathEnd)
+                ) {
+                    path.push_back(uri.substr(segmentStart, pathEnd - segmentStart));
+                    break;
+                }
+                path.push_back(uri.substr(segmentStart, delimiter - segmentStart));
+                segmentStart = delimiter + 1;
+            }
+        }
+        target.SetPath(path);
+        if (queryStart != std::string::npos) {
+            target.SetQuery(uri.substr(queryStart + 1));
+        }
+    }
+
+    /**
+     * This method finds a free transaction slot, or makes a new one if
+     * there are none, and assigns it to the resource request with the
+     * given identifier.  The slot's promise is given fresh shared state,
+     * obtained from recycled memory.
+     *
+     * @note
+     *     The mutex must be held while calling this method.
+     *
+     * @param[in] id
+     *     This is the identifier of the resource request which will
+     *     occupy the slot.
+     *
+     * @return
+     *     The index of the slot is returned.
+     */
+    size_t AcquireHttpClientTransactionSlot(int id) {
+        size_t index;
+        if (freeHttpClientTransactionSlots.empty()) {
+            index = httpClientTransactions.size();
+            httpClientTransactions.emplace_back();
+        } else {
+            index = freeHttpClientTransactionSlots.back();
+            freeHttpClientTransactionSlots.pop_back();
+        }
+        auto& slot = httpClientTransactions[index];
+        slot.id = id;
+        slot.responsePromise = std::promise< Response >(
+            std::allocator_arg,
+            RecyclingAllocator< Response >(promiseStatePool)
+        );
+        if (requestsInFlight != nullptr) {
+            requestsInFlight->Add(1);
+        }
+        return index;
+    }
+
+    /**
+     * This method frees the given transaction slot, if it's still occupied
+     * by the resource request with the given identifier, handing its
+     * contents back to the caller.
+     *
+     * @note
+     *     The mutex must be held while calling this method.
+     *
+     * @param[in] index
+     *     This is the index of the slot to free.
+     *
+     * @param[in] id
+     *     This is the identifier of the resource request which is expected
+     *     to occupy the slot.
+     *
+     * @param[out] released
+     *     This is where to store the contents of the slot.
+     *
+     * @return
+     *     An indication of whether or not the slot was still occupied by
+     *     the given resource request is returned.
+     */
+    bool ReleaseHttpClientTransactionSlot(
+        size_t index,
+        int id,
+        HttpClientTransactionSlot& released
+    ) {
+        if (
+            (index >= httpClientTransactions.size())
+            || (httpClientTransactions[index].id != id)
+        ) {
+            return false;
+        }
+        auto& slot = httpClientTransactions[index];
+        released.id = id;
+        released.transaction = std::move(slot.transaction);
+        released.responsePromise = std::move(slot.responsePromise);
+        released.rateLimitTicket = slot.rateLimitTicket;
+        released.getKey = std::move(slot.getKey);
+        released.followers = std::move(slot.followers);
+        released.requesterCanceled = slot.requesterCanceled;
+        released.revalidating = slot.revalidating;
+        released.staleResponse = std::move(slot.staleResponse);
+        released.cacheGeneration = slot.cacheGeneration;
+        released.latency = std::move(slot.latency);
+        released.queueTime = slot.queueTime;
+        released.gatewayCacheKey = std::move(slot.gatewayCacheKey);
+        released.priority = slot.priority;
+        released.admitted = slot.admitted;
+        auto& lane = lanes[(size_t)slot.priority];
+        if (slot.admitted) {
+            --lane.inFlight;
+            --requestsAdmitted;
+        } else if (lane.queued != nullptr) {
+            lane.queued->Add(-1);
+        }
+        if (!released.getKey.empty()) {
+            const auto inFlightGet = inFlightGets.find(released.getKey);
+            if (
+                (inFlightGet != inFlightGets.end())
+                && (inFlightGet->second.index == index)
+                && (inFlightGet->second.id == id)
+            ) {
+                (void)inFlightGets.erase(inFlightGet);
+            }
+        }
+        slot.id = 0;
+        slot.transaction = nullptr;
+        slot.request = Http::Request();
+        slot.rateLimitTicket = 0;
+        slot.followers.clear();
+        slot.requesterCanceled = false;
+        slot.revalidating = false;
+        slot.staleResponse = Response();
+        slot.cacheGeneration = 0;
+        slot.latency = nullptr;
+        slot.gatewayCacheKey.clear();
+        slot.priority = Priority::Interactive;
+        slot.admitted = false;
+        freeHttpClientTransactionSlots.push_back(index);
+        if (requestsInFlight != nullptr) {
+            requestsInFlight->Add(-1);
+        }
+        return true;
+    }
+
+    /**
+     * This method returns the histogram in which to record how long
+     * requests on the route of the given request take.
+     *
+     * @note
+     *     The mutex must be held while calling this method, and metrics
+     *     must be kept.
+     *
+     * @param[in] method
+     *     This is the HTTP method of the request.
+     *
+     * @param[in] uri
+     *     This is the URI of the resource requested.
+     *
+     * @return
+     *     The histogram for the route of the request is returned.
+     */
+    std::shared_ptr< Metrics::Histogram > GetRouteLatency(
+        const std::string& method,
+        const std::string& uri
+    ) {
+        const auto route = RateLimiter::GetRoute(method, uri);
+        auto& latency = routeLatencies[route];
+        if (latency == nullptr) {
+            latency = metrics->GetHistogram(
+                "discordplay_rest_request_duration_seconds",
+                "Time taken by resource requests, from being queued to being answered",
+                {{"route", route}}
+            );
+        }
+        return latency;
+    }
+
+    /**
+     * This method checks to see if the given transaction slot is still
+     * occupied by the resource request with the given identifier.
+     *
+     * @note
+     *     The mutex must be held while calling this method.
+     *
+     * @param[in] index
+     *     This is the index of the slot to check.
+     *
+     * @param[in] id
+     *     This is the identifier of the resource request which is expected
+     *     to occupy the slot.
+     *
+     * @return
+     *     An indication of whether or not the slot is still occupied by
+     *     the given resource request is returned.
+     */
+    bool IsHttpClientTransactionSlotOccupied(
+        size_t index,
+        int id
+    ) const {
+        return (
+            (index < httpClientTransactions.size())
+            && (httpClientTransactions[index].id == id)
+        );
+    }
+
+    /**
+     * This method drops from the front of the given lane the requests
+     * canceled while waiting there.
+     *
+     * @note
+     *     The mutex must be held while calling this method.
+     *
+     * @param[in,out] lane
+     *     This is the lane from which to drop canceled requests.
+     */
+    void DropCanceledRequests(Lane& lane) {
+        while (
+            !lane.queue.empty()
+            && !IsHttpClientTransactionSlotOccupied(
+                lane.queue.front().index,
+                lane.queue.front().id
+            )
+        ) {
+            lane.queue.pop_front();
+        }
+    }
+
+    /**
+     * This method checks to see if the given lane has room to let through
+     * another request.
+     *
+     * @note
+     *     The mutex must be held while calling this method.
+     *
+     * @param[in] lane
+     *     This is the lane to check.
+     *
+     * @return
+     *     An indication of whether or not the lane has room to let
+     *     through another request is returned.
+     */
+    bool HasRoom(const Lane& lane) const {
+        return (
+            (
+                (lane.configuration.maxInFlight == 0)
+                || (lane.inFlight < lane.configuration.maxInFlight)
+            )
+            && (
+                (maxRequestsInFlight == 0)
+                || (requestsAdmitted < maxRequestsInFlight)
+            )
+        );
+    }
+
+    /**
+     * This method hands the resource request in the given transaction
+     * slot to the rate limiter, which will release it to be sent once
+     * its bucket allows.
+     *
+     * @note
+     *     The mutex must not be held while calling this method.
+     *
+     * @param[in] index
+     *     This is the index of the slot holding the request.
+     *
+     * @param[in] id
+     *     This is the identifier of the resource request.
+     *
+     * @param[in] method
+     *     This is the HTTP method of the request.
+     *
+     * @param[in] uri
+     *     This is the URI of the resource requested.
+     */
+    void Submit(
+        size_t index,
+        int id,
+        const std::string& method,
+        const std::string& uri
+    ) {
+        const auto implWeak = weakSelf;
+        const auto ticket = rateLimiter.Enqueue(
+            method,
+            uri,
+            [implWeak, index, id](int ticket){
+                auto impl = implWeak.lock();
+                if (impl == nullptr) {
+                    return;
+                }
+                impl->SendRequest(index, id, ticket);
+            }
+        );
+        std::unique_lock< decltype(mutex) > lock(mutex);
+        if (IsHttpClientTransactionSlotOccupied(index, id)) {
+            httpClientTransactions[index].rateLimitTicket = ticket;
+        } else {
+            lock.unlock();
+            FinishRateLimitTicket(ticket);
+        }
+    }
+
+    /**
+     * This method lets through as many of the requests waiting in the
+     * lanes as there's room for, earliest deadline first.
+     *
+     * @note
+     *     The mutex must not be held while calling this method.
+     */
+    void PumpLanes() {
+        std::vector< QueuedRequest > admitted;
+        std::unique_lock< decltype(mutex) > lock(mutex);
+        const auto now = (
+            (clock == nullptr)
+            ? 0.0
+            : clock->GetCurrentTime()
+        );
+        for (;;) {
+            Lane* next = nullptr;
+            for (auto& lane: lanes) {
+                DropCanceledRequests(lane);
+                if (
+                    !lane.queue.empty()
+                    && HasRoom(lane)
+                    && (
+                        (next == nullptr)
+                        || (lane.queue.front().deadline < next->queue.front().deadline)
+                    )
+                ) {
+                    next = &lane;
+                }
+            }
+            if (next == nullptr) {
+                break;
+            }
+            auto queued = std::move(next->queue.front());
+            next->queue.pop_front();
+            ++next->inFlight;
+            ++requestsAdmitted;
+            if (next->queued != nullptr) {
+                next->queued->Add(-1);
+            }
+            auto& slot = httpClientTransactions[queued.index];
+            slot.admitted = true;
+            if (now > queued.deadline) {
+                DIAG_FORMATTED(
+                    diagnosticsSender,
+                    DIAG_THRESHOLD_CONNECTIONS,
+                    2,
+                    "%s request for %s let through %.3lf seconds past its deadline",
+                    PRIORITY_NAMES[(size_t)slot.priority],
+                    queued.uri.c_str(),
+                    now - queued.deadline
+                );
+            }
+            admitted.push_back(std::move(queued));
+        }
+        lock.unlock();
+        for (const auto& queued: admitted) {
+            Submit(queued.index, queued.id, queued.method, queued.uri);
+        }
+    }
+
+    /**
+     * This method lets the rate limiter know a request it was tracking
+     * won't be getting a response, whether or not it was released.
+     *
+     * @param[in] ticket
+     *     This identifies the request to the rate limiter.
+     */
+    void FinishRateLimitTicket(int ticket) {
+        if (ticket == 0) {
+            return;
+        }
+        if (!rateLimiter.Withdraw(ticket)) {
+            rateLimiter.Complete(ticket, nullptr);
+        }
+    }
+
+    /**
+     * This method is called when the requester who made a resource
+     * request cancels it.  If other requesters are merged into the
+     * request, it carries on for them.
+     *
+     * @param[in] index
+     *     This is the index of the slot holding the request.
+     *
+     * @param[in] id
+     *     This is the identifier of the resource request.
+     */
+    void CancelRequest(
+        size_t index,
+        int id
+    ) {
+        HttpClientTransactionSlot released;
+        std::unique_lock< decltype(mutex) > lock(mutex);
+        if (!IsHttpClientTransactionSlotOccupied(index, id)) {
+            return;
+        }
+        auto& slot = httpClientTransactions[index];
+        if (slot.requesterCanceled) {
+            return;
+        }
+        if (!slot.followers.empty()) {
+            slot.requesterCanceled = true;
+            auto responsePromise = std::move(slot.responsePromise);
+            slot.responsePromise = std::promise< Response >();
+            lock.unlock();
+            Response canceled;
+            canceled.status = 499;
+            responsePromise.set_value(std::move(canceled));
+            return;
+        }
+        (void)ReleaseHttpClientTransactionSlot(index, id, released);
+        lock.unlock();
+        FinishRateLimitTicket(released.rateLimitTicket);
+        if (released.admitted) {
+            PumpLanes();
+        }
+        Response canceled;
+        canceled.status = 499;
+        released.responsePromise.set_value(std::move(canceled));
+    }
+
+    /**
+     * This method is called when the requester of a GET request merged
+     * into another cancels it.  If no one is left waiting for the request
+     * merged into, it's abandoned.
+     *
+     * @param[in] index
+     *     This is the index of the slot holding the request merged into.
+     *
+     * @param[in] id
+     *     This is the identifier of the request merged into.
+     *
+     * @param[in] followerId
+     *     This is the identifier of the merged request.
+     */
+    void CancelFollower(
+        size_t index,
+        int id,
+        int followerId
+    ) {
+        std::unique_lock< decltype(mutex) > lock(mutex);
+        if (!IsHttpClientTransactionSlotOccupied(index, id)) {
+            return;
+        }
+        auto& followers = httpClientTransactions[index].followers;
+        auto follower = followers.begin();
+        while (
+            (follower != followers.end())
+            && (follower->id != followerId)
+        ) {
+            ++follower;
+        }
+        if (follower == followers.end()) {
+            return;
+        }
+        auto responsePromise = std::move(follower->responsePromise);
+        (void)followers.erase(follower);
+        HttpClientTransactionSlot released;
+        const auto abandoned = (
+            followers.empty()
+            && httpClientTransactions[index].requesterCanceled
+            && ReleaseHttpClientTransactionSlot(index, id, released)
+        );
+        lock.unlock();
+        if (abandoned) {
+            FinishRateLimitTicket(released.rateLimitTicket);
+            if (released.admitted) {
+                PumpLanes();
+            }
+        }
+        Response canceled;
+        canceled.status = 499;
+        responsePromise.set_value(std::move(canceled));
+    }
+
+    /**
+     * This method is called when the rate limiter releases a resource
+     * request, in order to send it through the HTTP client.
+     *
+     * @param[in] index
+     *     This is the index of the slot holding the request.
+     *
+     * @param[in] id
+     *     This is the identifier of the resource request.
+     *
+     * @param[in] ticket
+     *     This identifies the request to the rate limiter.
+     */
+    void SendRequest(
+        size_t index,
+        int id,
+        int ticket
+    ) {
+        std::unique_lock< decltype(mutex) > lock(mutex);
+        if (!IsHttpClientTransactionSlotOccupied(index, id)) {
+            lock.unlock();
+            FinishRateLimitTicket(ticket);
+            return;
+        }
+        auto& slot = httpClientTransactions[index];
+        slot.rateLimitTicket = ticket;
+        auto request = std::move(slot.request);
+        const auto httpClientSample = httpClient;
+        lock.unlock();
+        const auto httpClientTransaction = httpClientSample->Request(std::move(request));
+        lock.lock();
+        if (IsHttpClientTransactionSlotOccupied(index, id)) {
+            httpClientTransactions[index].transaction = httpClientTransaction;
+        }
+        lock.unlock();
+        const auto implWeak = weakSelf;
+        httpClientTransaction->SetCompletionDelegate(
+            [
+                index,
+                id,
+                implWeak
+            ]{
+                auto impl = implWeak.lock();
+                if (impl == nullptr) {
+                    return;
+                }
+                impl->CompleteRequest(index, id);
+            }
+        );
+    }
+
+    /**
+     * This method is called when the HTTP client transaction carrying out
+     * a resource request is completed, in order to deliver the response
+     * to the requester.
+     *
+     * @param[in] index
+     *     This is the index of the slot holding the request.
+     *
+     * @param[in] id
+     *     This is the identifier of the resource request.
+     */
+    void CompleteRequest(
+        size_t index,
+        int id
+    ) {
+        HttpClientTransactionSlot released;
+        std::unique_lock< decltype(mutex) > lock(mutex);
+        if (!ReleaseHttpClientTransactionSlot(index, id, released)) {
+            return;
+        }
+        const auto clockSample = clock;
+        const auto gatewayCacheSample = gatewayCache;
+        lock.unlock();
+        if (released.latency != nullptr) {
+            released.latency->RecordSince(released.queueTime);
+        }
+        auto& httpResponse = released.transaction->response;
+        DIAG_FORMATTED(
+            diagnosticsSender,
+            DIAG_THRESHOLD_CONNECTIONS,
+            1,
+            "Response: %u %s",
+            httpResponse.statusCode,
+            httpResponse.reasonPhrase.c_str()
+        );
+        if (DIAG_ENABLED(diagnosticsSender, DIAG_THRESHOLD_CONNECTIONS, 0)) {
+            ReportResponseDetails(httpResponse);
+        }
+        auto headers = httpResponse.headers.GetAll();
+        Response response;
+        response.status = httpResponse.statusCode;
+        response.body = std::move(httpResponse.body);
+        response.headers.reserve(headers.size());
+        for (auto& header: headers) {
+            response.headers.push_back({
+                header.name,
+                std::move(header.value)
+            });
+        }
+        if (released.rateLimitTicket != 0) {
+            rateLimiter.Complete(released.rateLimitTicket, &response);
+        }
+        PumpLanes();
+        if (
+            !released.gatewayCacheKey.empty()
+            && (gatewayCacheSample != nullptr)
+        ) {
+            gatewayCacheSample->Store(released.gatewayCacheKey, response);
+        }
+        if (
+            !released.getKey.empty()
+            && (clockSample != nullptr)
+        ) {
+            const auto now = clockSample->GetCurrentTime();
+            if (
+                released.revalidating
+                && (response.status == 304)
+            ) {
+                responseCache.Refresh(released.getKey, response, now);
+                response = std::move(released.staleResponse);
+            } else {
+                responseCache.Store(
+                    released.getKey,
+                    response,
+                    now,
+                    released.cacheGeneration
+                );
+            }
+        }
+        for (auto& follower: released.followers) {
+            follower.responsePromise.set_value(response);
+        }
+        released.responsePromise.set_value(std::move(response));
     }
 };
 
@@ -44,6 +1070,10 @@ Connections::~Connections() noexcept = default;
 Connections::Connections()
     : impl_(new Impl())
 {
+    impl_->weakSelf = impl_;
+    impl_->rateLimiter.SubscribeToDiagnostics(
+        impl_->diagnosticsSender.Chain()
+    );
 }
 
 void Connections::Configure(const std::shared_ptr< Http::IClient >& client) {
@@ -54,6 +1084,113 @@ void Connections::Configure(const std::shared_ptr< Http::IClient >& client) {
     );
 }
 
+void Connections::SetTimers(
+    const std::shared_ptr< Timers >& timers,
+    const std::shared_ptr< Timekeeping::Clock >& clock
+) {
+    impl_->rateLimiter.Configure(timers, clock);
+    std::lock_guard< decltype(impl_->mutex) > lock(impl_->mutex);
+    impl_->clock = clock;
+}
+
+void Connections::SetWebSocketConfiguration(const WebSocket::Configuration& configuration) {
+    std::lock_guard< decltype(impl_->mutex) > lock(impl_->mutex);
+    impl_->webSocketConfiguration = configuration;
+}
+
+void Connections::SetGetCoalescing(bool coalesce) {
+    std::lock_guard< decltype(impl_->mutex) > lock(impl_->mutex);
+    impl_->coalesceGets = coalesce;
+}
+
+void Connections::SetResponseCacheConfiguration(const ResponseCache::Configuration& configuration) {
+    impl_->responseCache.Configure(configuration);
+}
+
+void Connections::SetMetrics(const std::shared_ptr< Metrics >& metrics) {
+    std::lock_guard< decltype(impl_->mutex) > lock(impl_->mutex);
+    impl_->metrics = metrics;
+    impl_->routeLatencies.clear();
+    if (metrics == nullptr) {
+        impl_->requestsInFlight = nullptr;
+    } else {
+        impl_->requestsInFlight = metrics->GetGauge(
+            "discordplay_rest_requests_in_flight",
+            "Resource requests queued or sent but not yet answered"
+        );
+    }
+    for (size_t i = 0; i < NUM_PRIORITIES; ++i) {
+        auto& lane = impl_->lanes[i];
+        if (metrics == nullptr) {
+            lane.queued = nullptr;
+        } else {
+            lane.queued = metrics->GetGauge(
+                "discordplay_rest_requests_waiting",
+                "Resource requests waiting in their lane to be let through to the rate limiter",
+                {{"priority", PRIORITY_NAMES[i]}}
+            );
+        }
+    }
+}
+
+void Connections::SetGatewayCache(const std::shared_ptr< GatewayCache >& gatewayCache) {
+    std::lock_guard< decltype(impl_->mutex) > lock(impl_->mutex);
+    impl_->gatewayCache = gatewayCache;
+}
+
+auto Connections::GetLaneConfiguration(Priority priority) -> LaneConfiguration {
+    std::lock_guard< decltype(impl_->mutex) > lock(impl_->mutex);
+    return impl_->lanes[(size_t)priority].configuration;
+}
+
+void Connections::SetLaneConfiguration(
+    Priority priority,
+    const LaneConfiguration& configuration
+) {
+    std::unique_lock< decltype(impl_->mutex) > lock(impl_->mutex);
+    impl_->lanes[(size_t)priority].configuration = configuration;
+    lock.unlock();
+    impl_->PumpLanes();
+}
+
+void Connections::SetMaxRequestsInFlight(size_t maxInFlight) {
+    std::unique_lock< decltype(impl_->mutex) > lock(impl_->mutex);
+    impl_->maxRequestsInFlight = maxInFlight;
+    lock.unlock();
+    impl_->PumpLanes();
+}
+
+void Connections::SetPriorityClassifier(PriorityClassifier classifier) {
+    std::lock_guard< decltype(impl_->mutex) > lock(impl_->mutex);
+    impl_->priorityClassifier = classifier;
+}
+
+auto Connections::ClassifyRequest(const ResourceRequest& request) -> Priority {
+    if (GatewayCache::IsGatewayRequest(request.method, request.uri)) {
+        return Priority::Critical;
+    }
+    const auto path = request.uri.substr(0, request.uri.find_first_of("?#"));
+    if (path.find("/interactions/") != std::string::npos) {
+        return Priority::Critical;
+    }
+    if (request.method == "GET") {
+        return Priority::Interactive;
+    }
+    if (
+        EndsWith(path, "/bulk-delete")
+        || (path.find("/members/") != std::string::npos)
+        || (path.find("/roles") != std::string::npos)
+        || (path.find("/bans/") != std::string::npos)
+        || (
+            (request.method == "DELETE")
+            && (path.find("/messages/") != std::string::npos)
+        )
+    ) {
+        return Priority::Bulk;
+    }
+    return Priority::Interactive;
+}
+
 SystemAbstractions::DiagnosticsSender::UnsubscribeDelegate Connections::SubscribeToDiagnostics(
     SystemAbstractions::DiagnosticsSender::DiagnosticMessageDelegate delegate,
     size_t minLevel
@@ -64,119 +1201,244 @@ SystemAbstractions::DiagnosticsSender::UnsubscribeDelegate Connections::Subscrib
 auto Connections::QueueResourceRequest(
     const ResourceRequest& request
 ) -> ResourceRequestTransaction {
-    std::lock_guard< decltype(impl_->mutex) > lock(impl_->mutex);
-    impl_->diagnosticsSender.SendDiagnosticInformationFormatted(
+    DIAG_FORMATTED(
+        impl_->diagnosticsSender,
+        DIAG_THRESHOLD_CONNECTIONS,
         1,
         "%s request for %s",
         request.method.c_str(),
         request.uri.c_str()
     );
     ResourceRequestTransaction transaction;
-    const auto responsePromise = std::make_shared< std::promise< Response > >();
-    Http::Request httpRequest;
-    const auto id = impl_->nextHttpClientTransactionId++;
-    httpRequest.method = request.method;
-    httpRequest.target.ParseFromString(request.uri);
+    std::weak_ptr< Impl > implWeak(impl_);
+
+    // A GET request may be answered from the response cache, or merged
+    // into an identical one already in flight, unless the requester
+    // made it conditional.
+    std::unique_lock< decltype(impl_->mutex) > lock(impl_->mutex);
+    const auto coalesceGets = impl_->coalesceGets;
+    const auto clock = impl_->clock;
+    const auto gatewayCache = impl_->gatewayCache;
+    const auto priorityClassifier = impl_->priorityClassifier;
+    lock.unlock();
+    const auto priority = (
+        (priorityClassifier == nullptr)
+        ? ClassifyRequest(request)
+        : priorityClassifier(request)
+    );
+
+    // The request for the gateway URL may be answered with the response
+    // kept from an earlier run of the program.
+    const auto gatewayCacheKey = (
+        (gatewayCache == nullptr)
+        ? std::string()
+        : GatewayCache::GetKey(request)
+    );
+    if (!gatewayCacheKey.empty()) {
+        Response gatewayResponse;
+        if (gatewayCache->Find(gatewayCacheKey, gatewayResponse)) {
+            DIAG_FORMATTED(
+                impl_->diagnosticsSender,
+                DIAG_THRESHOLD_CONNECTIONS,
+                1,
+                "Response for %s found in gateway cache",
+                request.uri.c_str()
+            );
+            std::promise< Response > responsePromise;
+            transaction.response = responsePromise.get_future();
+            responsePromise.set_value(std::move(gatewayResponse));
+            transaction.cancel = []{};
+            return transaction;
+        }
+    }
+    const auto cacheGets = (
+        (clock != nullptr)
+        && impl_->responseCache.IsEnabled()
+    );
+    std::string getKey;
+    auto lookup = ResponseCache::Lookup::Miss;
+    Response cachedResponse;
+    std::string entityTag;
+    uint64_t cacheGeneration = 0;
     if (
-        (httpRequest.target.GetScheme() == "https")
-        || (httpRequest.target.GetScheme() == "wss")
+        (request.method == "GET")
+        && (coalesceGets || cacheGets)
+        && !IsConditional(request)
     ) {
-        httpRequest.target.SetPort(443);
+        getKey = ResponseCache::MakeKey(request);
+        if (cacheGets) {
+            cacheGeneration = impl_->responseCache.GetGeneration();
+            lookup = impl_->responseCache.Find(
+                getKey,
+                clock->GetCurrentTime(),
+                cachedResponse,
+                entityTag
+            );
+            if (lookup == ResponseCache::Lookup::Fresh) {
+                DIAG_FORMATTED(
+                    impl_->diagnosticsSender,
+                    DIAG_THRESHOLD_CONNECTIONS,
+                    1,
+                    "Response for %s found in cache",
+                    request.uri.c_str()
+                );
+                std::promise< Response > responsePromise;
+                transaction.response = responsePromise.get_future();
+                responsePromise.set_value(std::move(cachedResponse));
+                transaction.cancel = []{};
+                return transaction;
+            }
+        }
     }
+    Http::Request httpRequest;
+    httpRequest.method = request.method;
+    impl_->SetTarget(request.uri, httpRequest.target);
     for (const auto& header: request.headers) {
         httpRequest.headers.SetHeader(header.key, header.value);
     }
+    if (lookup == ResponseCache::Lookup::Stale) {
+        httpRequest.headers.SetHeader("If-None-Match", entityTag);
+    }
     httpRequest.body = request.body;
-    auto& httpClientTransaction = impl_->httpClientTransactions[id];
-    httpClientTransaction = impl_->httpClient->Request(httpRequest);
-    std::weak_ptr< Impl > implWeak(impl_);
-    httpClientTransaction->SetCompletionDelegate(
-        [
-            id,
-            implWeak,
-            responsePromise
-        ]{
-            auto impl = implWeak.lock();
-            if (impl == nullptr) {
-                return;
-            }
-            std::unique_lock< decltype(impl->mutex) > lock(impl->mutex);
-            auto httpClientTransactionsEntry = impl->httpClientTransactions.find(id);
-            if (httpClientTransactionsEntry == impl->httpClientTransactions.end()) {
-                return;
-            }
-            const auto httpClientTransaction = httpClientTransactionsEntry->second;
-            (void)impl->httpClientTransactions.erase(httpClientTransactionsEntry);
+    lock.lock();
+    const auto id = impl_->nextHttpClientTransactionId++;
+    if (
+        coalesceGets
+        && !getKey.empty()
+    ) {
+        const auto inFlightGet = impl_->inFlightGets.find(getKey);
+        if (inFlightGet != impl_->inFlightGets.end()) {
+            const auto leaderIndex = inFlightGet->second.index;
+            const auto leaderId = inFlightGet->second.id;
+            Impl::Follower follower;
+            follower.id = id;
+            follower.responsePromise = std::promise< Response >(
+                std::allocator_arg,
+                RecyclingAllocator< Response >(impl_->promiseStatePool)
+            );
+            transaction.response = follower.responsePromise.get_future();
+            impl_->httpClientTransactions[leaderIndex].followers.push_back(std::move(follower));
             lock.unlock();
-            impl->diagnosticsSender.SendDiagnosticInformationFormatted(
+            DIAG_FORMATTED(
+                impl_->diagnosticsSender,
+                DIAG_THRESHOLD_CONNECTIONS,
                 1,
-                "Response: %u %s",
-                httpClientTransaction->response.statusCode,
-                httpClientTransaction->response.reasonPhrase.c_str()
-            );
-            impl->diagnosticsSender.SendDiagnosticInformationString(
-                0,
-                "Headers: ---------------"
+                "Request for %s merged into one in flight",
+                request.uri.c_str()
             );
-            for (const auto& header: httpClientTransaction->response.headers.GetAll()) {
-                impl->diagnosticsSender.SendDiagnosticInformationFormatted(
-                    0,
-                    "%s: %s",
-                    ((std::string)header.name).c_str(),
-                    header.value.c_str()
-                );
-            }
-            impl->diagnosticsSender.SendDiagnosticInformationString(
-                0,
-                "Body: ------------------------"
-            );
-            if (!httpClientTransaction->response.body.empty()) {
-                impl->diagnosticsSender.SendDiagnosticInformationString(
-                    0,
-                    httpClientTransaction->response.body
-                );
-            }
-            impl->diagnosticsSender.SendDiagnosticInformationString(
-                0,
-                "------------------------"
-            );
-            Response response;
-            response.status = httpClientTransaction->response.statusCode;
-            response.body = httpClientTransaction->response.body;
-            for (const auto& header: httpClientTransaction->response.headers.GetAll()) {
-                response.headers.push_back({
-                    header.name,
-                    header.value
-                });
-            }
-            responsePromise->set_value(std::move(response));
+            transaction.cancel = [
+                id,
+                leaderIndex,
+                leaderId,
+                implWeak
+            ]{
+                auto impl = implWeak.lock();
+                if (impl == nullptr) {
+                    return;
+                }
+                impl->CancelFollower(leaderIndex, leaderId, id);
+            };
+            return transaction;
+        }
+    }
+    const auto slotIndex = impl_->AcquireHttpClientTransactionSlot(id);
+    auto& slot = impl_->httpClientTransactions[slotIndex];
+    transaction.response = slot.responsePromise.get_future();
+    slot.request = std::move(httpRequest);
+    slot.gatewayCacheKey = gatewayCacheKey;
+    slot.priority = priority;
+    if (impl_->metrics != nullptr) {
+        slot.latency = impl_->GetRouteLatency(request.method, request.uri);
+        slot.queueTime = std::chrono::steady_clock::now();
+    }
+    if (!getKey.empty()) {
+        if (coalesceGets) {
+            impl_->inFlightGets[getKey] = {slotIndex, id};
+        }
+        slot.getKey = std::move(getKey);
+        slot.cacheGeneration = cacheGeneration;
+        if (lookup == ResponseCache::Lookup::Stale) {
+            slot.revalidating = true;
+            slot.staleResponse = std::move(cachedResponse);
         }
+    }
+
+    // Let the request through its lane to the rate limiter if there's
+    // room, and no request of the same class is waiting ahead of it;
+    // otherwise it waits its turn in the lane.
+    auto& lane = impl_->lanes[(size_t)priority];
+    impl_->DropCanceledRequests(lane);
+    const auto admitted = (
+        lane.queue.empty()
+        && impl_->HasRoom(lane)
     );
-    transaction.response = responsePromise->get_future();
-    transaction.cancel =  [
+    if (admitted) {
+        ++lane.inFlight;
+        ++impl_->requestsAdmitted;
+        slot.admitted = true;
+    } else {
+        Impl::QueuedRequest queued;
+        queued.index = slotIndex;
+        queued.id = id;
+        queued.deadline = (
+            (
+                (clock == nullptr)
+                ? 0.0
+                : clock->GetCurrentTime()
+            )
+            + lane.configuration.deadline
+        );
+        queued.method = request.method;
+        queued.uri = request.uri;
+        lane.queue.push_back(std::move(queued));
+        if (lane.queued != nullptr) {
+            lane.queued->Add(1);
+        }
+    }
+    lock.unlock();
+    if (admitted) {
+        impl_->Submit(slotIndex, id, request.method, request.uri);
+    } else {
+        DIAG_FORMATTED(
+            impl_->diagnosticsSender,
+            DIAG_THRESHOLD_CONNECTIONS,
+            1,
+            "%s request for %s waiting in its lane",
+            PRIORITY_NAMES[(size_t)priority],
+            request.uri.c_str()
+        );
+    }
+    transaction.cancel = [
         id,
-        implWeak,
-        responsePromise
+        slotIndex,
+        implWeak
     ]{
         auto impl = implWeak.lock();
         if (impl == nullptr) {
             return;
         }
-        std::unique_lock< decltype(impl->mutex) > lock(impl->mutex);
-        auto httpClientTransactionsEntry = impl->httpClientTransactions.find(id);
-        if (httpClientTransactionsEntry == impl->httpClientTransactions.end()) {
-            return;
-        }
-        const auto httpClientTransaction = httpClientTransactionsEntry->second;
-        (void)impl->httpClientTransactions.erase(httpClientTransactionsEntry);
-        lock.unlock();
-        responsePromise->set_value({499});
+        impl->CancelRequest(slotIndex, id);
     };
     return transaction;
 }
 
 auto Connections::QueueWebSocketRequest(
     const WebSocketRequest& request
+) -> WebSocketRequestTransaction {
+    return QueueWebSocketRequest(request, nullptr);
+}
+
+auto Connections::QueueWebSocketRequest(
+    const WebSocketRequest& request,
+    WebSocketDecorator decorator
+) -> WebSocketRequestTransaction {
+    return QueueWebSocketRequest(request, decorator, nullptr);
+}
+
+auto Connections::QueueWebSocketRequest(
+    const WebSocketRequest& request,
+    WebSocketDecorator decorator,
+    DroppedSequenceObserver droppedSequenceObserver
 ) -> WebSocketRequestTransaction {
     // Log that we are about to make a WebSocket connection attempt.
     std::unique_lock< decltype(impl_->mutex) > lock(impl_->mutex);
@@ -185,75 +1447,102 @@ auto Connections::QueueWebSocketRequest(
         "WebSocket request for %s",
         request.uri.c_str()
     );
+    const auto httpClient = impl_->httpClient;
+    const auto metrics = impl_->metrics;
+    auto webSocketConfiguration = impl_->webSocketConfiguration;
+    lock.unlock();
+    if (webSocketConfiguration.metrics == nullptr) {
+        webSocketConfiguration.metrics = metrics;
+    }
+    webSocketConfiguration.droppedSequenceObserver = droppedSequenceObserver;
+    std::weak_ptr< Impl > implWeak(impl_);
+
+    // While responses are cached, have the gateway events received over
+    // the connection drop the responses for the resources they change.
+    if (impl_->responseCache.IsEnabled()) {
+        const auto textObserver = webSocketConfiguration.textObserver;
+        webSocketConfiguration.textObserver = [
+            implWeak,
+            textObserver
+        ](const std::string& message){
+            if (textObserver != nullptr) {
+                textObserver(message);
+            }
+            auto impl = implWeak.lock();
+            if (impl == nullptr) {
+                return;
+            }
+            impl->responseCache.InvalidateFromEvent(message);
+        };
+    }
+    auto uri = request.uri;
+    if (webSocketConfiguration.zlibStream) {
+        uri += ((uri.find('?') == std::string::npos) ? '?' : '&');
+        uri += "compress=zlib-stream";
+    }
 
     // Set up a transaction object to be returned, with a promise
     // whose future is made available in the transaction.
     WebSocketRequestTransaction transaction;
-    std::promise< std::shared_ptr< Discord::WebSocket > > webSocketPromise;
-    transaction.webSocket = webSocketPromise.get_future();
-
-    // Set up a means of canceling the transaction.
-    bool cancelWebSocketConnection = false;
-    std::weak_ptr< Impl > implWeak(impl_);
-    transaction.cancel =  [
-        &cancelWebSocketConnection,
-        implWeak
-    ]{
-        auto impl = implWeak.lock();
-        if (impl == nullptr) {
-            return;
-        }
-        std::unique_lock< decltype(impl->mutex) > lock(impl->mutex);
-        cancelWebSocketConnection = true;
-    };
+    const auto webSocketPromise = std::make_shared<
+        std::promise< std::shared_ptr< Discord::WebSocket > >
+    >();
+    transaction.webSocket = webSocketPromise->get_future();
 
     // Instantiate and use the WebSocket implementation class
-    // to begin connecting to the server.
+    // to begin connecting to the server.  The promise is fulfilled
+    // from the completion delegate, once the attempt is finished, so
+    // that neither the caller nor the mutex is held up in the meantime.
     const auto webSocketDiagnosticsSender = std::make_shared< SystemAbstractions::DiagnosticsSender >("WebSocket");
     webSocketDiagnosticsSender->SubscribeToDiagnostics(impl_->diagnosticsSender.Chain());
-    auto webSocketConnectionResults = ConnectWebSocket(
-        impl_->httpClient,
-        request.uri,
-        webSocketDiagnosticsSender
+    auto abortConnection = ConnectWebSocket(
+        httpClient,
+        uri,
+        webSocketDiagnosticsSender,
+        [
+            decorator,
+            implWeak,
+            webSocketConfiguration,
+            webSocketPromise
+        ](std::shared_ptr< WebSockets::WebSocket > webSocket){
+            auto impl = implWeak.lock();
+            if (impl == nullptr) {
+                webSocketPromise->set_value(nullptr);
+                return;
+            }
+            if (webSocket == nullptr) {
+                impl->diagnosticsSender.SendDiagnosticInformationString(
+                    3,
+                    "WebSocket connection failed"
+                );
+                webSocketPromise->set_value(nullptr);
+            } else {
+                impl->diagnosticsSender.SendDiagnosticInformationString(
+                    1,
+                    "WebSocket connected"
+                );
+                const auto webSocketWrapper = std::make_shared< WebSocket >();
+                webSocketWrapper->SubscribeToDiagnostics(
+                    impl->diagnosticsSender.Chain(),
+                    DIAG_LEVEL_WEB_SOCKET_WRAPPER
+                );
+                webSocketWrapper->Configure(
+                    std::move(webSocket),
+                    webSocketConfiguration
+                );
+                std::shared_ptr< Discord::WebSocket > result(std::move(webSocketWrapper));
+                if (decorator != nullptr) {
+                    result = decorator(std::move(result));
+                }
+                webSocketPromise->set_value(std::move(result));
+            }
+        },
+        WebSockets::WebSocket::Configuration(),
+        metrics
     );
 
-    // Wait until either the transaction is canceled or the WebSocket
-    // connection attempt completes (either success or failure).
-    while (
-        !cancelWebSocketConnection
-        && (
-            webSocketConnectionResults.connectionFuture.wait_for(
-                std::chrono::milliseconds(100)
-            ) != std::future_status::ready
-        )
-    ) {
-    }
-
-    // If transaction was canceled, set the promise with a null pointer.
-    // Otherwise, provide the wrapped WebSocket.
-    if (cancelWebSocketConnection) {
-        webSocketPromise.set_value(nullptr);
-    } else {
-        auto webSocket = webSocketConnectionResults.connectionFuture.get();
-        if (webSocket == nullptr) {
-            impl_->diagnosticsSender.SendDiagnosticInformationString(
-                3,
-                "WebSocket connection failed"
-            );
-            webSocketPromise.set_value(nullptr);
-        } else {
-            impl_->diagnosticsSender.SendDiagnosticInformationString(
-                1,
-                "WebSocket connected"
-            );
-            const auto webSocketWrapper = std::make_shared< WebSocket >();
-            webSocketWrapper->SubscribeToDiagnostics(
-                impl_->diagnosticsSender.Chain(),
-                DIAG_LEVEL_WEB_SOCKET_WRAPPER
-            );
-            webSocketWrapper->Configure(std::move(webSocket));
-            webSocketPromise.set_value(std::move(webSocketWrapper));
-        }
-    }
+    // Canceling the transaction aborts the connection attempt, which
+    // in turn completes the attempt with a null WebSocket.
+    transaction.cancel = std::move(abortConnection);
     return transaction;
 }
@@ -8,10 +8,20 @@
  * © 2020 by Richard Walters
  */
 
+#include "GatewayCache.hpp"
+#include "Metrics.hpp"
+#include "ResponseCache.hpp"
+#include "Timers.hpp"
+#include "WebSocket.hpp"
+
 #include <Discord/Connections.hpp>
+#include <functional>
 #include <Http/IClient.hpp>
 #include <memory>
+#include <stddef.h>
+#include <stdint.h>
 #include <SystemAbstractions/DiagnosticsSender.hpp>
+#include <Timekeeping/Clock.hpp>
 
 /**
  * This is the implementation of Discord::Connections used
@@ -20,6 +30,98 @@
 class Connections
     : public Discord::Connections
 {
+    // Types
+public:
+    /**
+     * This is the type of function which may be given to wrap each
+     * WebSocket made, in order to change how it behaves.
+     *
+     * @param[in] webSocket
+     *     This is the WebSocket to wrap.
+     *
+     * @return
+     *     The WebSocket to hand back in its place is returned.
+     */
+    typedef std::function<
+        std::shared_ptr< Discord::WebSocket >(
+            std::shared_ptr< Discord::WebSocket >&& webSocket
+        )
+    > WebSocketDecorator;
+
+    /**
+     * This is the type of function which may be given to be called with
+     * the sequence number of each dispatch dropped as soon as it's
+     * received over a WebSocket made.
+     *
+     * @param[in] sequence
+     *     This is the sequence number of the dispatch dropped.
+     */
+    typedef std::function< void(uint64_t sequence) > DroppedSequenceObserver;
+
+    /**
+     * These are the classes of resource requests.  Each class has a lane
+     * of its own, with its own limit on the number of requests let through
+     * to the rate limiter and HTTP client at once, which holds back the
+     * rest until there's room for them.
+     */
+    enum class Priority {
+        /**
+         * This is for requests which hold up something time-critical,
+         * such as the request for the gateway URL, made while connecting,
+         * and interaction responses, which Discord expects within three
+         * seconds.
+         */
+        Critical,
+
+        /**
+         * This is for requests made on behalf of users, and any request
+         * not in another class.
+         */
+        Interactive,
+
+        /**
+         * This is for requests which are made in great numbers and aren't
+         * in a hurry, such as mass role updates and message purges.
+         */
+        Bulk,
+    };
+
+    /**
+     * This holds the settings of the lane of one class of resource
+     * requests.
+     */
+    struct LaneConfiguration {
+        /**
+         * This is the most requests of the class let through at once,
+         * or zero if there's no limit.
+         */
+        size_t maxInFlight = 0;
+
+        /**
+         * This is the number of seconds, from being queued, within which
+         * requests of the class should be let through.  Whenever there's
+         * room, the request with the earliest deadline, of all the lanes
+         * with room, is let through next, so that requests of the more
+         * urgent classes go first, but those of the others aren't held
+         * back forever.
+         */
+        double deadline = 0.0;
+    };
+
+    /**
+     * This is the type of function which may be given to decide the class
+     * of each resource request.
+     *
+     * @param[in] request
+     *     This is the resource request to classify.
+     *
+     * @return
+     *     The class of the resource request is returned.
+     */
+    typedef std::function<
+        Priority(const ResourceRequest& request)
+    > PriorityClassifier;
+
     // Lifecycle Methods
 public:
     ~Connections() noexcept;
@@ -37,6 +139,188 @@ public:
 
     void Configure(const std::shared_ptr< Http::IClient >& client);
 
+    /**
+     * This method sets up the timers and clock used to hold resource
+     * requests back until Discord's rate limits allow them to be sent.
+     * Until this is done, requests are sent as soon as they're queued.
+     *
+     * @param[in] timers
+     *     These are the timers to use to release held-back requests.
+     *
+     * @param[in] clock
+     *     This is the clock to use to track rate limit windows.
+     */
+    void SetTimers(
+        const std::shared_ptr< Timers >& timers,
+        const std::shared_ptr< Timekeeping::Clock >& clock
+    );
+
+    /**
+     * This method sets the configuration to give each WebSocket adapter
+     * made for gateway connections.  If the configuration calls for
+     * zlib-stream compression, it's also requested in the URI of each
+     * connection.
+     *
+     * @param[in] configuration
+     *     This is the configuration to give each WebSocket adapter.
+     */
+    void SetWebSocketConfiguration(const WebSocket::Configuration& configuration);
+
+    /**
+     * This method sets whether or not a GET request identical to one
+     * already in flight is merged into it, rather than sent again, with
+     * the response of the request in flight given to both.
+     *
+     * @param[in] coalesce
+     *     This indicates whether or not to merge identical GET requests.
+     */
+    void SetGetCoalescing(bool coalesce);
+
+    /**
+     * This method sets the configuration of the cache used to answer GET
+     * requests without sending them, when a response kept for an identical
+     * request may still be used.  While the cache is enabled, responses
+     * are dropped when gateway events received over the WebSocket
+     * connections made afterwards report changes to their resources.
+     * The cache is only used once the clock is set up with SetTimers.
+     *
+     * @param[in] configuration
+     *     This is the configuration of the response cache.
+     */
+    void SetResponseCacheConfiguration(const ResponseCache::Configuration& configuration);
+
+    /**
+     * This method sets the registry in which to keep metrics about the
+     * resource requests made, and the WebSocket connections made and the
+     * messages received over them, unless the WebSocket configuration
+     * names a registry of its own.  It should be called before any
+     * requests are made.
+     *
+     * @param[in] metrics
+     *     This is the registry in which to keep metrics.
+     */
+    void SetMetrics(const std::shared_ptr< Metrics >& metrics);
+
+    /**
+     * This method sets the cache in which to keep the response to the
+     * request for the gateway URL, so that it can be answered without
+     * going to Discord, even in a later run of the program.
+     *
+     * @param[in] gatewayCache
+     *     This is the cache in which to keep the gateway URL.
+     */
+    void SetGatewayCache(const std::shared_ptr< GatewayCache >& gatewayCache);
+
+    /**
+     * This method returns the configuration of the lane of the given class
+     * of resource requests.
+     *
+     * @param[in] priority
+     *     This is the class of resource requests whose lane configuration
+     *     to return.
+     *
+     * @return
+     *     The configuration of the lane is returned.
+     */
+    LaneConfiguration GetLaneConfiguration(Priority priority);
+
+    /**
+     * This method sets the configuration of the lane of the given class
+     * of resource requests.
+     *
+     * @param[in] priority
+     *     This is the class of resource requests whose lane to configure.
+     *
+     * @param[in] configuration
+     *     This is the configuration of the lane.
+     */
+    void SetLaneConfiguration(
+        Priority priority,
+        const LaneConfiguration& configuration
+    );
+
+    /**
+     * This method sets the most resource requests, of all classes, let
+     * through to the rate limiter and HTTP client at once.
+     *
+     * @param[in] maxInFlight
+     *     This is the most resource requests let through at once,
+     *     or zero if there's no limit.
+     */
+    void SetMaxRequestsInFlight(size_t maxInFlight);
+
+    /**
+     * This method sets the function called to decide the class of each
+     * resource request.  If it's never set, or set to null,
+     * ClassifyRequest is used.
+     *
+     * @param[in] classifier
+     *     This is the function to call to classify resource requests.
+     */
+    void SetPriorityClassifier(PriorityClassifier classifier);
+
+    /**
+     * This function decides the class of the given resource request,
+     * from its method and URI.  Requests for the gateway URL and
+     * interaction responses are critical, bulk message deletes and
+     * changes to guild members, roles, and bans, along with message
+     * deletes, are bulk, and the rest are interactive.
+     *
+     * @param[in] request
+     *     This is the resource request to classify.
+     *
+     * @return
+     *     The class of the resource request is returned.
+     */
+    static Priority ClassifyRequest(const ResourceRequest& request);
+
+    /**
+     * This method starts a WebSocket connection attempt, like the
+     * Discord::Connections method of the same name, except that the
+     * WebSocket made, if any, is passed through the given decorator
+     * before being handed back.
+     *
+     * @param[in] request
+     *     This describes the WebSocket to connect.
+     *
+     * @param[in] decorator
+     *     This is the function to call to wrap the WebSocket made,
+     *     if any.
+     *
+     * @return
+     *     The transaction of the connection attempt is returned.
+     */
+    WebSocketRequestTransaction QueueWebSocketRequest(
+        const WebSocketRequest& request,
+        WebSocketDecorator decorator
+    );
+
+    /**
+     * This method starts a WebSocket connection attempt, like the
+     * method of the same name which takes a decorator, except that the
+     * given observer is also called with the sequence number of each
+     * dispatch dropped as soon as it's received over the WebSocket.
+     *
+     * @param[in] request
+     *     This describes the WebSocket to connect.
+     *
+     * @param[in] decorator
+     *     This is the function to call to wrap the WebSocket made,
+     *     if any.
+     *
+     * @param[in] droppedSequenceObserver
+     *     This is the function to call with the sequence number of each
+     *     dispatch dropped.
+     *
+     * @return
+     *     The transaction of the connection attempt is returned.
+     */
+    WebSocketRequestTransaction QueueWebSocketRequest(
+        const WebSocketRequest& request,
+        WebSocketDecorator decorator,
+        DroppedSequenceObserver droppedSequenceObserver
+    );
+
     SystemAbstractions::DiagnosticsSender::UnsubscribeDelegate SubscribeToDiagnostics(
         SystemAbstractions::DiagnosticsSender::DiagnosticMessageDelegate delegate,
         size_t minLevel = 0
@@ -4,7 +4,8 @@
  * @file Diagnostics.hpp
  *
  * This module declares all the diagnostic level thresholds for
- * various components in this application
+ * various components in this application, along with macros used to
+ * publish diagnostic messages only when someone will see them.
  *
  * © 2020 by Richard Walters
  */
@@ -12,9 +13,92 @@
 #include <stddef.h>
 
 constexpr size_t DIAG_LEVEL_CONNECTIONS_INTERFACE = 1;
+constexpr size_t DIAG_LEVEL_CONNECTION_POOL = 1;
+constexpr size_t DIAG_LEVEL_GATEWAY_CACHE = 1;
 constexpr size_t DIAG_LEVEL_HTTP_CLIENT = 0;
+constexpr size_t DIAG_LEVEL_IDENTIFY_GATE = 1;
 constexpr size_t DIAG_LEVEL_TLS_DECORATOR = 2;
 constexpr size_t DIAG_LEVEL_NETWORK_CONNECTION = 1;
 constexpr size_t DIAG_LEVEL_NETWORK_TRANSPORT = 0;
 constexpr size_t DIAG_LEVEL_WEB_SOCKET = 0;
 constexpr size_t DIAG_LEVEL_WEB_SOCKET_WRAPPER = 0;
+
+/**
+ * This function returns the threshold which applies to messages published
+ * through a sender whose subscriber is itself chained to another sender
+ * at the given threshold.
+ *
+ * @param[in] inner
+ *     This is the threshold at which the sender is subscribed.
+ *
+ * @param[in] outer
+ *     This is the threshold at which the sender's subscriber is subscribed.
+ *
+ * @return
+ *     The threshold which applies to the sender's messages is returned.
+ */
+constexpr size_t DiagChainThreshold(size_t inner, size_t outer) {
+    return (inner > outer) ? inner : outer;
+}
+
+/**
+ * This function template determines at compile time whether or not
+ * messages at the given level can pass the given threshold.
+ *
+ * @tparam Threshold
+ *     This is the threshold which applies to the sender.
+ *
+ * @tparam Level
+ *     This is the level of the message.
+ *
+ * @return
+ *     An indication of whether or not messages at the given level can
+ *     pass the given threshold is returned.
+ */
+template< size_t Threshold, size_t Level > constexpr bool DiagLevelEnabled() {
+    return Level >= Threshold;
+}
+
+constexpr size_t DIAG_THRESHOLD_CONNECTIONS = DIAG_LEVEL_CONNECTIONS_INTERFACE;
+constexpr size_t DIAG_THRESHOLD_CONNECTION_POOL = DIAG_LEVEL_CONNECTION_POOL;
+constexpr size_t DIAG_THRESHOLD_WEB_SOCKET_WRAPPER = DiagChainThreshold(
+    DIAG_LEVEL_WEB_SOCKET_WRAPPER,
+    DIAG_THRESHOLD_CONNECTIONS
+);
+
+/**
+ * This macro evaluates to true if a message at the given level, which must
+ * be a constant expression, would be seen if published through the given
+ * sender.  The check against the given threshold, which should be the
+ * DIAG_THRESHOLD_* value which applies to the sender, is made at compile
+ * time, so that the sender is only asked for its minimum level if the
+ * message could pass the threshold.
+ */
+#define DIAG_ENABLED(sender, threshold, level) ( \
+    DiagLevelEnabled< (threshold), (level) >() \
+    && ((sender).GetMinLevel() <= (level)) \
+)
+
+/**
+ * This macro publishes a diagnostic message through the given sender,
+ * formatting it only if it would be seen (see DIAG_ENABLED).  The formatting
+ * arguments aren't evaluated otherwise.
+ */
+#define DIAG_FORMATTED(sender, threshold, level, ...) \
+    do { \
+        if (DIAG_ENABLED(sender, threshold, level)) { \
+            (sender).SendDiagnosticInformationFormatted((level), __VA_ARGS__); \
+        } \
+    } while (false)
+
+/**
+ * This macro publishes a diagnostic message through the given sender,
+ * only if it would be seen (see DIAG_ENABLED).  The message expression
+ * isn't evaluated otherwise.
+ */
+#define DIAG_STRING(sender, threshold, level, message) \
+    do { \
+        if (DIAG_ENABLED(sender, threshold, level)) { \
+            (sender).SendDiagnosticInformationString((level), (message)); \
+        } \
+    } while (false)
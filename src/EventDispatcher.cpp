@@ -0,0 +1,375 @@
+/**
+ * @file EventDispatcher.cpp
+ *
+ * This module contains the implementation of the EventDispatcher class.
+ *
+ * © 2020 by Richard Walters
+ */
+
+#include "EventDispatcher.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+namespace {
+
+    /**
+     * This holds the tasks waiting to run for one key.
+     */
+    struct Strand {
+        /**
+         * This is the key whose tasks the strand holds.
+         */
+        uint64_t key = 0;
+
+        /**
+         * These are the tasks waiting to run, in order.
+         */
+        std::deque< EventDispatcher::Task > tasks;
+
+        /**
+         * This flag is set while the strand is in a worker's queue
+         * or being run, so that only one of its tasks runs at a time.
+         */
+        bool scheduled = false;
+    };
+
+    /**
+     * This holds the queue of strands with tasks ready to run
+     * belonging to one worker.
+     */
+    struct WorkerQueue {
+        /**
+         * This is used to synchronize access to the queue.
+         */
+        std::mutex mutex;
+
+        /**
+         * These are the strands with tasks ready to run.
+         */
+        std::deque< std::shared_ptr< Strand > > strands;
+    };
+
+    /**
+     * This identifies the dispatcher, if any, for which the current
+     * thread is a worker.
+     */
+    thread_local const void* currentDispatcher = nullptr;
+
+    /**
+     * This is the index of the current thread among the workers of
+     * its dispatcher, if it's a worker.
+     */
+    thread_local size_t currentWorkerIndex = 0;
+
+}
+
+/**
+ * This contains the private properties of a EventDispatcher class instance.
+ */
+struct EventDispatcher::Impl {
+    // Properties
+
+    /**
+     * This is used to synchronize access to the strands.
+     */
+    std::mutex strandsMutex;
+
+    /**
+     * These are the strands of all keys with tasks waiting to run.
+     * A strand is removed once it has no more tasks.
+     */
+    std::unordered_map< uint64_t, std::shared_ptr< Strand > > strands;
+
+    /**
+     * These are the queues of the workers.
+     */
+    std::vector< std::unique_ptr< WorkerQueue > > workerQueues;
+
+    /**
+     * These are the worker threads.
+     */
+    std::vector< std::thread > workers;
+
+    /**
+     * This is used to synchronize workers going to sleep and waking up.
+     */
+    std::mutex sleepMutex;
+
+    /**
+     * This is used to wake workers when strands become ready to run,
+     * or when they should stop.
+     */
+    std::condition_variable wakeCondition;
+
+    /**
+     * This counts the strands in all the worker queues.
+     */
+    std::atomic< size_t > readyStrands{0};
+
+    /**
+     * This flag is set when the workers should stop.
+     */
+    std::atomic< bool > stopping{false};
+
+    /**
+     * This counts the tasks dispatched.
+     */
+    std::atomic< size_t > dispatched{0};
+
+    /**
+     * This counts the strands taken from another worker's queue.
+     */
+    std::atomic< size_t > stolen{0};
+
+    /**
+     * This counts the tasks waiting to run.
+     */
+    size_t queued = 0;
+
+    /**
+     * This counts the tasks currently running.
+     */
+    size_t running = 0;
+
+    /**
+     * This is used to wake threads waiting for the dispatcher to have
+     * no tasks waiting to run or running.
+     */
+    std::condition_variable drainedCondition;
+
+    /**
+     * This is the largest number of tasks which have been waiting
+     * to run at once.
+     */
+    size_t maxQueued = 0;
+
+    // Methods
+
+    /**
+     * This method puts the given strand, which has tasks ready to run,
+     * in the queue of a worker, and wakes a worker to run it.  If called
+     * from a worker, the strand goes to that worker's queue, and otherwise
+     * the worker is chosen by the strand's key.
+     *
+     * @param[in] strand
+     *     This is the strand to put in a worker's queue.
+     */
+    void Schedule(const std::shared_ptr< Strand >& strand) {
+        const auto index = (
+            (currentDispatcher == this)
+            ? currentWorkerIndex
+            : (size_t)(strand->key % workerQueues.size())
+        );
+        auto& workerQueue = *workerQueues[index];
+        {
+            std::lock_guard< decltype(workerQueue.mutex) > lock(workerQueue.mutex);
+            workerQueue.strands.push_back(strand);
+        }
+        ++readyStrands;
+        std::lock_guard< decltype(sleepMutex) > lock(sleepMutex);
+        wakeCondition.notify_one();
+    }
+
+    /**
+     * This method takes a strand with tasks ready to run, first from the
+     * front of the given worker's own queue, and otherwise from the back
+     * of another worker's queue.
+     *
+     * @param[in] index
+     *     This is the index of the worker looking for work.
+     *
+     * @param[out] strand
+     *     This is where to store the strand taken.
+     *
+     * @return
+     *     An indication of whether or not a strand was taken is returned.
+     */
+    bool TakeStrand(
+        size_t index,
+        std::shared_ptr< Strand >& strand
+    ) {
+        const auto workerCount = workerQueues.size();
+        for (size_t i = 0; i < workerCount; ++i) {
+            auto& workerQueue = *workerQueues[(index + i) % workerCount];
+            std::lock_guard< decltype(workerQueue.mutex) > lock(workerQueue.mutex);
+            if (workerQueue.strands.empty()) {
+                continue;
+            }
+            if (i == 0) {
+                strand = std::move(workerQueue.strands.front());
+                workerQueue.strands.pop_front();
+            } else {
+                strand = std::move(workerQueue.strands.back());
+                workerQueue.strands.pop_back();
+                ++stolen;
+            }
+            --readyStrands;
+            return true;
+        }
+        return false;
+    }
+
+    /**
+     * This method runs the next task of the given strand, and then puts
+     * the strand back in a worker queue if it has more tasks, or removes
+     * it if it doesn't.
+     *
+     * @param[in] strand
+     *     This is the strand whose next task should be run.
+     */
+    void RunStrand(const std::shared_ptr< Strand >& strand) {
+        std::unique_lock< decltype(strandsMutex) > lock(strandsMutex);
+        auto task = std::move(strand->tasks.front());
+        strand->tasks.pop_front();
+        --queued;
+        ++running;
+        lock.unlock();
+        task();
+        lock.lock();
+        if (
+            (--running == 0)
+            && (queued == 0)
+        ) {
+            drainedCondition.notify_all();
+        }
+        if (strand->tasks.empty()) {
+            strand->scheduled = false;
+            (void)strands.erase(strand->key);
+        } else {
+            lock.unlock();
+            Schedule(strand);
+        }
+    }
+
+    /**
+     * This is the body of each worker thread.
+     *
+     * @param[in] index
+     *     This is the index of the worker.
+     */
+    void Worker(size_t index) {
+        currentDispatcher = this;
+        currentWorkerIndex = index;
+        std::shared_ptr< Strand > strand;
+        while (!stopping) {
+            if (TakeStrand(index, strand)) {
+                RunStrand(strand);
+                strand = nullptr;
+                continue;
+            }
+            std::unique_lock< decltype(sleepMutex) > lock(sleepMutex);
+            wakeCondition.wait(
+                lock,
+                [this]{
+                    return (
+                        stopping
+                        || (readyStrands > 0)
+                    );
+                }
+            );
+        }
+    }
+};
+
+EventDispatcher::~EventDispatcher() noexcept {
+    Stop();
+}
+
+EventDispatcher::EventDispatcher(size_t workerCount)
+    : impl_(new Impl())
+{
+    if (workerCount == 0) {
+        workerCount = std::thread::hardware_concurrency();
+        if (workerCount == 0) {
+            workerCount = 1;
+        }
+    }
+    for (size_t i = 0; i < workerCount; ++i) {
+        impl_->workerQueues.emplace_back(new WorkerQueue());
+    }
+    for (size_t i = 0; i < workerCount; ++i) {
+        impl_->workers.emplace_back(&Impl::Worker, impl_.get(), i);
+    }
+}
+
+void EventDispatcher::Dispatch(
+    uint64_t key,
+    Task&& task
+) {
+    if (impl_->stopping) {
+        return;
+    }
+    ++impl_->dispatched;
+    std::unique_lock< decltype(impl_->strandsMutex) > lock(impl_->strandsMutex);
+    auto& strand = impl_->strands[key];
+    if (strand == nullptr) {
+        strand = std::make_shared< Strand >();
+        strand->key = key;
+    }
+    strand->tasks.push_back(std::move(task));
+    if (++impl_->queued > impl_->maxQueued) {
+        impl_->maxQueued = impl_->queued;
+    }
+    if (strand->scheduled) {
+        return;
+    }
+    strand->scheduled = true;
+    const auto strandSample = strand;
+    lock.unlock();
+    impl_->Schedule(strandSample);
+}
+
+void EventDispatcher::Drain() {
+    std::unique_lock< decltype(impl_->strandsMutex) > lock(impl_->strandsMutex);
+    impl_->drainedCondition.wait(
+        lock,
+        [this]{
+            return (
+                impl_->stopping
+                || (
+                    (impl_->queued == 0)
+                    && (impl_->running == 0)
+                )
+            );
+        }
+    );
+}
+
+void EventDispatcher::Stop() {
+    {
+        std::lock_guard< decltype(impl_->sleepMutex) > lock(impl_->sleepMutex);
+        impl_->stopping = true;
+        impl_->wakeCondition.notify_all();
+    }
+    {
+        std::lock_guard< decltype(impl_->strandsMutex) > lock(impl_->strandsMutex);
+        impl_->drainedCondition.notify_all();
+    }
+    for (auto& worker: impl_->workers) {
+        if (worker.joinable()) {
+            worker.join();
+        }
+    }
+    impl_->workers.clear();
+}
+
+auto EventDispatcher::GetStatistics() -> Statistics {
+    Statistics statistics;
+    statistics.dispatched = impl_->dispatched;
+    statistics.stolen = impl_->stolen;
+    {
+        std::lock_guard< decltype(impl_->strandsMutex) > lock(impl_->strandsMutex);
+        statistics.queued = impl_->queued;
+        statistics.maxQueued = impl_->maxQueued;
+    }
+    for (const auto& workerQueue: impl_->workerQueues) {
+        std::lock_guard< decltype(workerQueue->mutex) > lock(workerQueue->mutex);
+        statistics.workerQueueDepths.push_back(workerQueue->strands.size());
+    }
+    return statistics;
+}
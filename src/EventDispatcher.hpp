@@ -0,0 +1,132 @@
+#pragma once
+
+/**
+ * @file EventDispatcher.hpp
+ *
+ * This module declares the EventDispatcher class.
+ *
+ * © 2020 by Richard Walters
+ */
+
+#include <functional>
+#include <memory>
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+/**
+ * This runs tasks on a fixed pool of worker threads.  Each task is given
+ * a key, and tasks with the same key run one at a time, in the order they
+ * were dispatched, while tasks with different keys may run in parallel.
+ * Each worker has its own queue of keys with tasks ready to run, and
+ * takes work from the other workers' queues when its own is empty.
+ */
+class EventDispatcher {
+    // Types
+public:
+    /**
+     * This is the type of function dispatched to run on a worker.
+     */
+    typedef std::function< void() > Task;
+
+    /**
+     * This holds statistics about the dispatcher.
+     */
+    struct Statistics {
+        /**
+         * This is the number of tasks dispatched.
+         */
+        size_t dispatched = 0;
+
+        /**
+         * This is the number of times a worker took a key with tasks
+         * ready to run from another worker's queue.
+         */
+        size_t stolen = 0;
+
+        /**
+         * This is the number of tasks waiting to run.
+         */
+        size_t queued = 0;
+
+        /**
+         * This is the largest number of tasks which have been waiting
+         * to run at once.
+         */
+        size_t maxQueued = 0;
+
+        /**
+         * This holds, for each worker, the number of keys with tasks ready
+         * to run which are currently in the worker's queue.
+         */
+        std::vector< size_t > workerQueueDepths;
+    };
+
+    // Lifecycle Methods
+public:
+    ~EventDispatcher() noexcept;
+    EventDispatcher(const EventDispatcher&) = delete;
+    EventDispatcher(EventDispatcher&&) noexcept = delete;
+    EventDispatcher& operator=(const EventDispatcher&) = delete;
+    EventDispatcher& operator=(EventDispatcher&&) noexcept = delete;
+
+    // Public Methods
+public:
+    /**
+     * This is the constructor of the class.  It starts the workers.
+     *
+     * @param[in] workerCount
+     *     This is the number of worker threads to run.  If zero,
+     *     one is run for each hardware thread.
+     */
+    explicit EventDispatcher(size_t workerCount = 0);
+
+    /**
+     * This method queues the given task to run on a worker, after every
+     * task dispatched before it with the same key.
+     *
+     * @param[in] key
+     *     This identifies the sequence of tasks to which the task belongs.
+     *
+     * @param[in] task
+     *     This is the task to run.
+     */
+    void Dispatch(
+        uint64_t key,
+        Task&& task
+    );
+
+    /**
+     * This method waits until no tasks are waiting to run or running.
+     * It must not be called from a task run by the dispatcher.
+     */
+    void Drain();
+
+    /**
+     * This method stops the workers.  Tasks still waiting to run are
+     * discarded, as are any tasks dispatched after this.
+     */
+    void Stop();
+
+    /**
+     * This method returns statistics about the dispatcher.
+     *
+     * @return
+     *     Statistics about the dispatcher are returned.
+     */
+    Statistics GetStatistics();
+
+    // Private properties
+private:
+    /**
+     * This is the type of structure that contains the private
+     * properties of the instance.  It is defined in the implementation
+     * and declared here to ensure that it is scoped inside the class.
+     */
+    struct Impl;
+
+    /**
+     * This contains the private properties of the instance.
+     */
+    std::unique_ptr< Impl > impl_;
+};
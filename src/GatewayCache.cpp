@@ -0,0 +1,352 @@
+/**
+ * @file GatewayCache.cpp
+ *
+ * This module contains the implementation of the GatewayCache class.
+ *
+ * © 2020 by Richard Walters
+ */
+
+#include "GatewayCache.hpp"
+#include "GatewayPayload.hpp"
+
+#include <mutex>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <StringExtensions/StringExtensions.hpp>
+#include <time.h>
+
+namespace {
+
+    /**
+     * This is the HTTP status code of a successful response.
+     */
+    constexpr unsigned int STATUS_OK = 200;
+
+    /**
+     * This is the path of the gateway endpoint for bots, whose responses
+     * are only kept for their URL.
+     */
+    const std::string GATEWAY_BOT_PATH = "/gateway/bot";
+
+    /**
+     * This function returns a hash of the given string, using the 64-bit
+     * FNV-1a algorithm, which, unlike std::hash, gives the same value
+     * in every run of the program.
+     *
+     * @param[in] input
+     *     This is the string to hash.
+     *
+     * @return
+     *     The hash of the string is returned.
+     */
+    uint64_t Hash(const std::string& input) {
+        uint64_t hash = 0xcbf29ce484222325;
+        for (const auto c: input) {
+            hash ^= (uint8_t)c;
+            hash *= 0x100000001b3;
+        }
+        return hash;
+    }
+
+    /**
+     * This function checks whether or not the given string ends with
+     * the given suffix.
+     *
+     * @param[in] s
+     *     This is the string to check.
+     *
+     * @param[in] suffix
+     *     This is the suffix to look for.
+     *
+     * @return
+     *     An indication of whether or not the string ends with the
+     *     suffix is returned.
+     */
+    bool EndsWith(
+        const std::string& s,
+        const std::string& suffix
+    ) {
+        return (
+            (s.length() >= suffix.length())
+            && (s.compare(s.length() - suffix.length(), suffix.length(), suffix) == 0)
+        );
+    }
+
+    /**
+     * This function reads the whole content of the file at the given path.
+     *
+     * @param[in] path
+     *     This is the path of the file to read.
+     *
+     * @param[out] content
+     *     This is where to store the content of the file.
+     *
+     * @return
+     *     An indication of whether or not the file was read
+     *     is returned.
+     */
+    bool ReadFile(
+        const std::string& path,
+        std::string& content
+    ) {
+        const auto file = fopen(path.c_str(), "rb");
+        if (file == NULL) {
+            return false;
+        }
+        content.clear();
+        char buffer[4096];
+        for (;;) {
+            const auto amountRead = fread(buffer, 1, sizeof(buffer), file);
+            if (amountRead == 0) {
+                break;
+            }
+            content.append(buffer, amountRead);
+        }
+        const auto failed = (ferror(file) != 0);
+        (void)fclose(file);
+        return !failed;
+    }
+
+    /**
+     * This function writes the given content to the file at the given
+     * path.  The content is written to a temporary file first, which then
+     * replaces the file at the given path, so that a program started while
+     * the file is being written never reads a partial file.
+     *
+     * @param[in] path
+     *     This is the path of the file to write.
+     *
+     * @param[in] content
+     *     This is the content to write to the file.
+     *
+     * @return
+     *     An indication of whether or not the file was written
+     *     is returned.
+     */
+    bool WriteFile(
+        const std::string& path,
+        const std::string& content
+    ) {
+        const auto temporaryPath = path + ".tmp";
+        const auto file = fopen(temporaryPath.c_str(), "wb");
+        if (file == NULL) {
+            return false;
+        }
+        const auto written = fwrite(content.data(), 1, content.size(), file);
+        const auto closed = (fclose(file) == 0);
+        if (
+            (written != content.size())
+            || !closed
+        ) {
+            (void)remove(temporaryPath.c_str());
+            return false;
+        }
+#ifdef _WIN32
+        (void)remove(path.c_str());
+#endif /* _WIN32 */
+        return (rename(temporaryPath.c_str(), path.c_str()) == 0);
+    }
+
+}
+
+/**
+ * This contains the private properties of a GatewayCache class instance.
+ */
+struct GatewayCache::Impl {
+    // Properties
+
+    SystemAbstractions::DiagnosticsSender diagnosticsSender;
+    std::mutex mutex;
+    std::string path;
+    double maxAge = 0.0;
+
+    /**
+     * This is the key of the request whose response is kept.
+     */
+    std::string key;
+
+    /**
+     * This indicates whether or not a response is kept.
+     */
+    bool haveResponse = false;
+
+    /**
+     * This is the body of the response kept.
+     */
+    std::string body;
+
+    /**
+     * This is the time, in seconds since the UNIX epoch, at which the
+     * response kept was received.  Wall-clock time is used because the
+     * file outlives the program.
+     */
+    int64_t storedAt = 0;
+
+    // Methods
+
+    Impl()
+        : diagnosticsSender("GatewayCache")
+    {
+    }
+
+    /**
+     * This method loads the response kept in the file, if any.
+     *
+     * @note
+     *     The mutex must be held while calling this method.
+     */
+    void Load() {
+        haveResponse = false;
+        std::string content;
+        if (!ReadFile(path, content)) {
+            return;
+        }
+        const auto lineEnd = content.find('\n');
+        if (lineEnd == std::string::npos) {
+            diagnosticsSender.SendDiagnosticInformationFormatted(
+                SystemAbstractions::DiagnosticsSender::Levels::WARNING,
+                "Ignoring malformed gateway cache file '%s'",
+                path.c_str()
+            );
+            return;
+        }
+        const auto keyEnd = content.find('\n', lineEnd + 1);
+        if (keyEnd == std::string::npos) {
+            diagnosticsSender.SendDiagnosticInformationFormatted(
+                SystemAbstractions::DiagnosticsSender::Levels::WARNING,
+                "Ignoring malformed gateway cache file '%s'",
+                path.c_str()
+            );
+            return;
+        }
+        storedAt = (int64_t)strtoll(content.c_str(), NULL, 10);
+        key = content.substr(lineEnd + 1, keyEnd - lineEnd - 1);
+        body = content.substr(keyEnd + 1);
+        haveResponse = true;
+        diagnosticsSender.SendDiagnosticInformationFormatted(
+            1,
+            "Loaded gateway response from '%s'",
+            path.c_str()
+        );
+    }
+};
+
+GatewayCache::~GatewayCache() noexcept = default;
+
+GatewayCache::GatewayCache()
+    : impl_(new Impl())
+{
+}
+
+SystemAbstractions::DiagnosticsSender::UnsubscribeDelegate GatewayCache::SubscribeToDiagnostics(
+    SystemAbstractions::DiagnosticsSender::DiagnosticMessageDelegate delegate,
+    size_t minLevel
+) {
+    return impl_->diagnosticsSender.SubscribeToDiagnostics(delegate, minLevel);
+}
+
+void GatewayCache::Configure(
+    const std::string& path,
+    double maxAge
+) {
+    std::lock_guard< decltype(impl_->mutex) > lock(impl_->mutex);
+    impl_->path = path;
+    impl_->maxAge = maxAge;
+    impl_->Load();
+}
+
+bool GatewayCache::IsGatewayRequest(
+    const std::string& method,
+    const std::string& uri
+) {
+    if (method != "GET") {
+        return false;
+    }
+    const auto pathEnd = uri.find_first_of("?#");
+    const auto path = uri.substr(0, pathEnd);
+    return (
+        EndsWith(path, "/gateway")
+        || EndsWith(path, GATEWAY_BOT_PATH)
+    );
+}
+
+std::string GatewayCache::GetKey(const Discord::Connections::ResourceRequest& request) {
+    if (!IsGatewayRequest(request.method, request.uri)) {
+        return "";
+    }
+    std::string authorization;
+    for (const auto& header: request.headers) {
+        if (StringExtensions::ToLower(header.key) == "authorization") {
+            authorization = header.value;
+            break;
+        }
+    }
+    const auto path = request.uri.substr(0, request.uri.find_first_of("?#"));
+    char hash[17];
+    (void)snprintf(hash, sizeof(hash), "%016llx", (unsigned long long)Hash(authorization));
+    return (
+        (EndsWith(path, GATEWAY_BOT_PATH) ? GATEWAY_BOT_PATH : "/gateway")
+        + " "
+        + hash
+    );
+}
+
+bool GatewayCache::Find(
+    const std::string& key,
+    Discord::Connections::Response& response
+) {
+    if (key.compare(0, GATEWAY_BOT_PATH.length() + 1, GATEWAY_BOT_PATH + " ") == 0) {
+        return false;
+    }
+    std::lock_guard< decltype(impl_->mutex) > lock(impl_->mutex);
+    if (
+        !impl_->haveResponse
+        || (impl_->key != key)
+        || ((double)((int64_t)time(NULL) - impl_->storedAt) > impl_->maxAge)
+    ) {
+        return false;
+    }
+    response.status = STATUS_OK;
+    response.headers = {{"Content-Type", "application/json"}};
+    response.body = impl_->body;
+    return true;
+}
+
+void GatewayCache::Store(
+    const std::string& key,
+    const Discord::Connections::Response& response
+) {
+    if (response.status != STATUS_OK) {
+        return;
+    }
+    std::lock_guard< decltype(impl_->mutex) > lock(impl_->mutex);
+    if (impl_->path.empty()) {
+        return;
+    }
+    impl_->key = key;
+    impl_->body = response.body;
+    impl_->storedAt = (int64_t)time(NULL);
+    impl_->haveResponse = true;
+    if (
+        !WriteFile(
+            impl_->path,
+            std::to_string(impl_->storedAt) + "\n" + impl_->key + "\n" + impl_->body
+        )
+    ) {
+        impl_->diagnosticsSender.SendDiagnosticInformationFormatted(
+            SystemAbstractions::DiagnosticsSender::Levels::WARNING,
+            "Unable to write gateway cache file '%s'",
+            impl_->path.c_str()
+        );
+    }
+}
+
+bool GatewayCache::GetGatewayUrl(std::string& url) {
+    std::lock_guard< decltype(impl_->mutex) > lock(impl_->mutex);
+    return (
+        impl_->haveResponse
+        && GatewayPayload::GetString(impl_->body, "\"url\"", url)
+    );
+}
@@ -0,0 +1,160 @@
+#pragma once
+
+/**
+ * @file GatewayCache.hpp
+ *
+ * This module declares the GatewayCache class.
+ *
+ * © 2020 by Richard Walters
+ */
+
+#include <Discord/Connections.hpp>
+#include <memory>
+#include <string>
+#include <SystemAbstractions/DiagnosticsSender.hpp>
+
+/**
+ * This keeps the response to the request for the gateway URL in a file,
+ * so that when the program is started again, the gateway can be connected
+ * without first waiting for a round trip to the API.  Discord asks that
+ * the gateway URL be cached, and it rarely changes.  The response is kept
+ * along with which endpoint was asked and a hash of the token asking, so
+ * that it's only ever handed back for the same request.
+ */
+class GatewayCache {
+    // Lifecycle Methods
+public:
+    ~GatewayCache() noexcept;
+    GatewayCache(const GatewayCache&) = delete;
+    GatewayCache(GatewayCache&&) noexcept = delete;
+    GatewayCache& operator=(const GatewayCache&) = delete;
+    GatewayCache& operator=(GatewayCache&&) noexcept = delete;
+
+    // Public Methods
+public:
+    /**
+     * This is the constructor of the class.
+     */
+    GatewayCache();
+
+    SystemAbstractions::DiagnosticsSender::UnsubscribeDelegate SubscribeToDiagnostics(
+        SystemAbstractions::DiagnosticsSender::DiagnosticMessageDelegate delegate,
+        size_t minLevel = 0
+    );
+
+    /**
+     * This method sets up the cache to keep the response in the file at
+     * the given path, loading the response kept there before, if any.
+     *
+     * @param[in] path
+     *     This is the path of the file in which to keep the response.
+     *
+     * @param[in] maxAge
+     *     This is the number of seconds for which a response kept
+     *     may be used.
+     */
+    void Configure(
+        const std::string& path,
+        double maxAge
+    );
+
+    /**
+     * This function checks whether or not the given request is one for
+     * the gateway URL ("/gateway" or "/gateway/bot").
+     *
+     * @param[in] method
+     *     This is the HTTP method of the request.
+     *
+     * @param[in] uri
+     *     This is the URI of the resource requested.
+     *
+     * @return
+     *     An indication of whether or not the request is one for the
+     *     gateway URL is returned.
+     */
+    static bool IsGatewayRequest(
+        const std::string& method,
+        const std::string& uri
+    );
+
+    /**
+     * This function returns the key under which the response to the given
+     * request is kept, which tells apart the two gateway endpoints and the
+     * tokens making the requests (by a hash, so that the token itself is
+     * never written to the file).
+     *
+     * @param[in] request
+     *     This is the request for the gateway URL.
+     *
+     * @return
+     *     The key under which the response to the request is kept
+     *     is returned, or an empty string if the request isn't one
+     *     for the gateway URL.
+     */
+    static std::string GetKey(const Discord::Connections::ResourceRequest& request);
+
+    /**
+     * This method returns a copy of the response kept for the given key,
+     * if it's recent enough to be used.  Responses from "/gateway/bot"
+     * are never handed back, since the shard count and session start
+     * limit they give go stale long before the URL does; they're kept
+     * only so that GetGatewayUrl can be used to connect ahead of time.
+     *
+     * @param[in] key
+     *     This is the key of the request, as returned by GetKey.
+     *
+     * @param[out] response
+     *     This is where to store the response, if found.
+     *
+     * @return
+     *     An indication of whether or not a response was found
+     *     is returned.
+     */
+    bool Find(
+        const std::string& key,
+        Discord::Connections::Response& response
+    );
+
+    /**
+     * This method keeps the given response under the given key, writing
+     * it to the file, if it's a successful one.
+     *
+     * @param[in] key
+     *     This is the key of the request, as returned by GetKey.
+     *
+     * @param[in] response
+     *     This is the response to keep.
+     */
+    void Store(
+        const std::string& key,
+        const Discord::Connections::Response& response
+    );
+
+    /**
+     * This method returns the gateway URL given in the response kept,
+     * whether or not it's recent enough to be used.  It's meant for
+     * connecting to the gateway server ahead of time.
+     *
+     * @param[out] url
+     *     This is where to store the gateway URL, if found.
+     *
+     * @return
+     *     An indication of whether or not a gateway URL was found
+     *     is returned.
+     */
+    bool GetGatewayUrl(std::string& url);
+
+    // Private properties
+private:
+    /**
+     * This is the type of structure that contains the private
+     * properties of the instance.  It is defined in the implementation
+     * and declared here to ensure that it is scoped inside the class.
+     */
+    struct Impl;
+
+    /**
+     * This contains the private properties of the instance.
+     */
+    std::unique_ptr< Impl > impl_;
+};
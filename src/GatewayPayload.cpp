@@ -0,0 +1,525 @@
+/**
+ * @file GatewayPayload.cpp
+ *
+ * This module contains the implementations of the functions used to pick
+ * out a few fields of JSON-encoded Discord gateway payloads.
+ *
+ * © 2020 by Richard Walters
+ */
+
+#include "GatewayPayload.hpp"
+
+#include <string.h>
+
+namespace {
+
+    /**
+     * These are the characters JSON allows between tokens.
+     */
+    const char* const WHITESPACE = " \t\r\n";
+
+    /**
+     * This function parses the unsigned decimal integer at the given
+     * position in the given string.
+     *
+     * @param[in] text
+     *     This is the string containing the integer.
+     *
+     * @param[in] position
+     *     This is the position of the first digit of the integer.
+     *
+     * @param[out] value
+     *     This is where to store the value of the integer.
+     *
+     * @return
+     *     An indication of whether or not there were any digits
+     *     is returned.
+     */
+    bool ParseDecimal(
+        const std::string& text,
+        size_t position,
+        uint64_t& value
+    ) {
+        value = 0;
+        bool any = false;
+        while (
+            (position < text.length())
+            && (text[position] >= '0')
+            && (text[position] <= '9')
+        ) {
+            value = value * 10 + (uint64_t)(text[position++] - '0');
+            any = true;
+        }
+        return any;
+    }
+
+    /**
+     * This function returns the position of the first character at or
+     * after the given position in the given string which isn't whitespace.
+     *
+     * @param[in] text
+     *     This is the string to scan.
+     *
+     * @param[in] position
+     *     This is the position at which to start.
+     *
+     * @return
+     *     The position of the first character which isn't whitespace
+     *     is returned, or std::string::npos if there is none.
+     */
+    size_t SkipWhitespace(
+        const std::string& text,
+        size_t position
+    ) {
+        while (position < text.length()) {
+            switch (text[position]) {
+                case ' ':
+                case '\t':
+                case '\r':
+                case '\n': {
+                    ++position;
+                } break;
+
+                default: return position;
+            }
+        }
+        return std::string::npos;
+    }
+
+    /**
+     * This function returns the position just past the end of the
+     * JSON-encoded string at the given position in the given text.  The
+     * closing quote is found with memchr, which the standard library
+     * typically vectorizes, so long strings are skipped quickly.
+     *
+     * @param[in] text
+     *     This is the text containing the string.
+     *
+     * @param[in] position
+     *     This is the position of the opening quote of the string.
+     *
+     * @return
+     *     The position just past the closing quote of the string
+     *     is returned, or std::string::npos if it isn't closed.
+     */
+    size_t SkipString(
+        const std::string& text,
+        size_t position
+    ) {
+        const auto data = text.data();
+        const auto length = text.length();
+        ++position;
+        while (position < length) {
+            const auto quote = (const char*)memchr(data + position, '"', length - position);
+            if (quote == nullptr) {
+                return std::string::npos;
+            }
+            const auto quotePosition = (size_t)(quote - data);
+            size_t backslashes = 0;
+            while (
+                (quotePosition - backslashes > position)
+                && (data[quotePosition - backslashes - 1] == '\\')
+            ) {
+                ++backslashes;
+            }
+            position = quotePosition + 1;
+            if ((backslashes & 1) == 0) {
+                return position;
+            }
+        }
+        return std::string::npos;
+    }
+
+    /**
+     * This function returns the position just past the end of the
+     * JSON-encoded value at the given position in the given text.
+     * Objects and arrays are skipped as a whole, including everything
+     * nested in them, without decoding anything.
+     *
+     * @param[in] text
+     *     This is the text containing the value.
+     *
+     * @param[in] position
+     *     This is the position of the first character of the value.
+     *
+     * @return
+     *     The position just past the end of the value is returned, or
+     *     std::string::npos if the value is incomplete.
+     */
+    size_t SkipValue(
+        const std::string& text,
+        size_t position
+    ) {
+        switch (text[position]) {
+            case '"': return SkipString(text, position);
+
+            case '{':
+            case '[': {
+                size_t depth = 0;
+                while (position < text.length()) {
+                    switch (text[position]) {
+                        case '"': {
+                            position = SkipString(text, position);
+                            if (position == std::string::npos) {
+                                return std::string::npos;
+                            }
+                        } continue;
+
+                        case '{':
+                        case '[': {
+                            ++depth;
+                        } break;
+
+                        case '}':
+                        case ']': {
+                            if (--depth == 0) {
+                                return position + 1;
+                            }
+                        } break;
+
+                        default: break;
+                    }
+                    ++position;
+                }
+                return std::string::npos;
+            }
+
+            default: {
+                while (position < text.length()) {
+                    switch (text[position]) {
+                        case ',':
+                        case '}':
+                        case ']':
+                        case ' ':
+                        case '\t':
+                        case '\r':
+                        case '\n': return position;
+
+                        default: break;
+                    }
+                    ++position;
+                }
+                return std::string::npos;
+            }
+        }
+    }
+
+    /**
+     * This function moves to the next member of the JSON-encoded object
+     * being scanned in the given text.
+     *
+     * @param[in] text
+     *     This is the text containing the object.
+     *
+     * @param[in,out] position
+     *     On input, this is the position of the opening brace of the
+     *     object, or just past the value of the previous member.  On
+     *     output, this is the position of the value of the next member.
+     *
+     * @param[out] keyStart
+     *     This is where to store the position of the key of the next
+     *     member, without its quotes.
+     *
+     * @param[out] keyLength
+     *     This is where to store the length of the key of the
+     *     next member.
+     *
+     * @return
+     *     An indication of whether or not there is a next member
+     *     is returned.
+     */
+    bool NextMember(
+        const std::string& text,
+        size_t& position,
+        size_t& keyStart,
+        size_t& keyLength
+    ) {
+        position = SkipWhitespace(text, position);
+        if (
+            (position == std::string::npos)
+            || (
+                (text[position] != '{')
+                && (text[position] != ',')
+            )
+        ) {
+            return false;
+        }
+        position = SkipWhitespace(text, position + 1);
+        if (
+            (position == std::string::npos)
+            || (text[position] != '"')
+        ) {
+            return false;
+        }
+        const auto keyEnd = SkipString(text, position);
+        if (keyEnd == std::string::npos) {
+            return false;
+        }
+        keyStart = position + 1;
+        keyLength = keyEnd - keyStart - 1;
+        position = SkipWhitespace(text, keyEnd);
+        if (
+            (position == std::string::npos)
+            || (text[position] != ':')
+        ) {
+            return false;
+        }
+        position = SkipWhitespace(text, position + 1);
+        return (position != std::string::npos);
+    }
+
+    /**
+     * This function checks whether or not the key at the given position
+     * in the given text is the given key.
+     *
+     * @param[in] text
+     *     This is the text containing the key.
+     *
+     * @param[in] keyStart
+     *     This is the position of the key, without its quotes.
+     *
+     * @param[in] keyLength
+     *     This is the length of the key.
+     *
+     * @param[in] key
+     *     This is the key to check for.
+     *
+     * @return
+     *     An indication of whether or not the key matches is returned.
+     */
+    bool KeyIs(
+        const std::string& text,
+        size_t keyStart,
+        size_t keyLength,
+        const char* key
+    ) {
+        return (
+            (keyLength == strlen(key))
+            && (text.compare(keyStart, keyLength, key) == 0)
+        );
+    }
+
+    /**
+     * This function finds the value of the first occurrence of the given
+     * key anywhere in the given JSON-encoded gateway payload.  Nesting
+     * isn't tracked, so it's only meant for keys which are unambiguous
+     * wherever they appear.
+     *
+     * @param[in] payload
+     *     This is the JSON-encoded gateway payload to search.
+     *
+     * @param[in] key
+     *     This is the quoted key to find, such as "\"session_id\"".
+     *
+     * @param[out] valueStart
+     *     This is where to store the position of the value, if found.
+     *
+     * @return
+     *     An indication of whether or not the key was found
+     *     is returned.
+     */
+    bool FindNestedValue(
+        const std::string& payload,
+        const std::string& key,
+        size_t& valueStart
+    ) {
+        size_t position = 0;
+        for (;;) {
+            position = payload.find(key, position);
+            if (position == std::string::npos) {
+                return false;
+            }
+            position += key.length();
+            const auto colon = payload.find_first_not_of(WHITESPACE, position);
+            if (
+                (colon != std::string::npos)
+                && (payload[colon] == ':')
+            ) {
+                valueStart = payload.find_first_not_of(WHITESPACE, colon + 1);
+                return (valueStart != std::string::npos);
+            }
+        }
+    }
+
+}
+
+namespace GatewayPayload {
+
+    bool FindValue(
+        const std::string& payload,
+        const std::string& key,
+        size_t& valueStart
+    ) {
+        size_t position = SkipWhitespace(payload, 0);
+        if (
+            (position == std::string::npos)
+            || (payload[position] != '{')
+        ) {
+            return false;
+        }
+        size_t keyStart, keyLength;
+        while (NextMember(payload, position, keyStart, keyLength)) {
+            if (
+                (keyLength + 2 == key.length())
+                && (payload.compare(keyStart - 1, key.length(), key) == 0)
+            ) {
+                valueStart = position;
+                return true;
+            }
+            position = SkipValue(payload, position);
+            if (position == std::string::npos) {
+                break;
+            }
+        }
+        return false;
+    }
+
+    int GetOpcode(const std::string& payload) {
+        size_t valueStart;
+        uint64_t opcode;
+        if (
+            !FindValue(payload, "\"op\"", valueStart)
+            || !ParseDecimal(payload, valueStart, opcode)
+        ) {
+            return -1;
+        }
+        return (int)opcode;
+    }
+
+    bool ScanHeader(
+        const std::string& payload,
+        Header& header
+    ) {
+        header = Header();
+        size_t position = SkipWhitespace(payload, 0);
+        if (
+            (position == std::string::npos)
+            || (payload[position] != '{')
+        ) {
+            return false;
+        }
+        bool haveOpcode = false;
+        bool haveSequence = false;
+        bool haveEventName = false;
+        bool haveData = false;
+        size_t keyStart, keyLength;
+        while (NextMember(payload, position, keyStart, keyLength)) {
+            if (KeyIs(payload, keyStart, keyLength, "op")) {
+                uint64_t opcode;
+                if (ParseDecimal(payload, position, opcode)) {
+                    header.opcode = (int)opcode;
+                }
+                haveOpcode = true;
+            } else if (KeyIs(payload, keyStart, keyLength, "s")) {
+                header.hasSequence = ParseDecimal(payload, position, header.sequence);
+                haveSequence = true;
+            } else if (KeyIs(payload, keyStart, keyLength, "t")) {
+                if (payload[position] == '"') {
+                    const auto end = SkipString(payload, position);
+                    if (end != std::string::npos) {
+                        header.eventNameStart = position + 1;
+                        header.eventNameLength = end - position - 2;
+                    }
+                }
+                haveEventName = true;
+            } else if (KeyIs(payload, keyStart, keyLength, "d")) {
+                header.dataStart = position;
+                haveData = true;
+            }
+            if (
+                haveOpcode
+                && haveSequence
+                && haveEventName
+                && haveData
+            ) {
+                break;
+            }
+            position = SkipValue(payload, position);
+            if (position == std::string::npos) {
+                break;
+            }
+        }
+        return (header.opcode >= 0);
+    }
+
+    bool IsEvent(
+        const std::string& payload,
+        const Header& header,
+        const char* eventName
+    ) {
+        return (
+            (header.eventNameStart != std::string::npos)
+            && KeyIs(payload, header.eventNameStart, header.eventNameLength, eventName)
+        );
+    }
+
+    bool GetEventName(
+        const std::string& payload,
+        const Header& header,
+        std::string& eventName
+    ) {
+        if (header.eventNameStart == std::string::npos) {
+            return false;
+        }
+        eventName.assign(payload, header.eventNameStart, header.eventNameLength);
+        return true;
+    }
+
+    bool GetString(
+        const std::string& payload,
+        const std::string& key,
+        std::string& value
+    ) {
+        size_t valueStart;
+        if (
+            !FindNestedValue(payload, key, valueStart)
+            || (payload[valueStart] != '"')
+        ) {
+            return false;
+        }
+        for (auto position = valueStart + 1; position < payload.length(); ++position) {
+            if (payload[position] == '\\') {
+                ++position;
+            } else if (payload[position] == '"') {
+                value = payload.substr(valueStart + 1, position - valueStart - 1);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void GetSnowflakes(
+        const std::string& payload,
+        const std::string& key,
+        std::vector< uint64_t >& snowflakes
+    ) {
+        size_t position = 0;
+        for (;;) {
+            const auto keyPosition = payload.find(key, position);
+            if (keyPosition == std::string::npos) {
+                return;
+            }
+            position = keyPosition + key.length();
+            const auto colon = payload.find_first_not_of(WHITESPACE, position);
+            if (
+                (colon == std::string::npos)
+                || (payload[colon] != ':')
+            ) {
+                continue;
+            }
+            const auto valueStart = payload.find_first_not_of(WHITESPACE, colon + 1);
+            if (
+                (valueStart == std::string::npos)
+                || (payload[valueStart] != '"')
+            ) {
+                continue;
+            }
+            uint64_t snowflake;
+            if (ParseDecimal(payload, valueStart + 1, snowflake)) {
+                snowflakes.push_back(snowflake);
+            }
+            position = valueStart + 1;
+        }
+    }
+
+}
@@ -0,0 +1,249 @@
+#pragma once
+
+/**
+ * @file GatewayPayload.hpp
+ *
+ * This module declares functions used to pick out a few fields of
+ * JSON-encoded Discord gateway payloads without decoding them.
+ *
+ * © 2020 by Richard Walters
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace GatewayPayload {
+
+    /**
+     * This is the gateway opcode of an event dispatch.
+     */
+    constexpr int OPCODE_DISPATCH = 0;
+
+    /**
+     * This is the gateway opcode of a heartbeat.
+     */
+    constexpr int OPCODE_HEARTBEAT = 1;
+
+    /**
+     * This is the gateway opcode of an IDENTIFY.
+     */
+    constexpr int OPCODE_IDENTIFY = 2;
+
+    /**
+     * This is the gateway opcode of a RESUME.
+     */
+    constexpr int OPCODE_RESUME = 6;
+
+    /**
+     * This is the gateway opcode of a request from Discord to reconnect.
+     */
+    constexpr int OPCODE_RECONNECT = 7;
+
+    /**
+     * This is the gateway opcode of a notice from Discord that the
+     * session is invalid.
+     */
+    constexpr int OPCODE_INVALID_SESSION = 9;
+
+    /**
+     * This is the gateway opcode of an acknowledgment of a heartbeat.
+     */
+    constexpr int OPCODE_HEARTBEAT_ACK = 11;
+
+    /**
+     * This function finds the value of the given key at the top level of
+     * the given JSON-encoded gateway payload.  Keys of nested objects,
+     * and text inside strings, are skipped over.
+     *
+     * @param[in] payload
+     *     This is the JSON-encoded gateway payload to search.
+     *
+     * @param[in] key
+     *     This is the quoted key to find, such as "\"op\"".
+     *
+     * @param[out] valueStart
+     *     This is where to store the position of the value, if found.
+     *
+     * @return
+     *     An indication of whether or not the key was found
+     *     is returned.
+     */
+    bool FindValue(
+        const std::string& payload,
+        const std::string& key,
+        size_t& valueStart
+    );
+
+    /**
+     * This function returns the opcode of the given JSON-encoded
+     * gateway payload.
+     *
+     * @param[in] payload
+     *     This is the JSON-encoded gateway payload.
+     *
+     * @return
+     *     The opcode of the payload is returned, or -1 if it
+     *     has none.
+     */
+    int GetOpcode(const std::string& payload);
+
+    /**
+     * This holds what's found by scanning the top level of a JSON-encoded
+     * gateway payload.  Positions refer to the scanned payload, so nothing
+     * is copied out of it.
+     */
+    struct Header {
+        /**
+         * This is the opcode of the payload, or -1 if it has none.
+         */
+        int opcode = -1;
+
+        /**
+         * This indicates whether or not the payload has a sequence number.
+         */
+        bool hasSequence = false;
+
+        /**
+         * This is the sequence number of the payload, if it has one.
+         */
+        uint64_t sequence = 0;
+
+        /**
+         * This is the position of the name of the event dispatched by
+         * the payload, without its quotes, or std::string::npos if the
+         * payload has none.
+         */
+        size_t eventNameStart = std::string::npos;
+
+        /**
+         * This is the length of the name of the event dispatched by
+         * the payload, if it has one.
+         */
+        size_t eventNameLength = 0;
+
+        /**
+         * This is the position of the data ("d") of the payload,
+         * or std::string::npos if the payload has none.
+         */
+        size_t dataStart = std::string::npos;
+    };
+
+    /**
+     * This function scans the top level of the given JSON-encoded gateway
+     * payload, in one pass, for its opcode, sequence number, event name,
+     * and the position of its data.  Nesting is tracked, so keys inside
+     * the data are never mistaken for these, and the scan stops as soon
+     * as all of them are found, without going through the rest of the
+     * data if it comes last, as it does in the payloads Discord sends.
+     *
+     * @param[in] payload
+     *     This is the JSON-encoded gateway payload to scan.
+     *
+     * @param[out] header
+     *     This is where to store what's found.
+     *
+     * @return
+     *     An indication of whether or not the payload has an opcode
+     *     is returned.
+     */
+    bool ScanHeader(
+        const std::string& payload,
+        Header& header
+    );
+
+    /**
+     * This function checks whether or not the given JSON-encoded gateway
+     * payload dispatches the event with the given name.
+     *
+     * @param[in] payload
+     *     This is the JSON-encoded gateway payload.
+     *
+     * @param[in] header
+     *     This is what was found by scanning the payload.
+     *
+     * @param[in] eventName
+     *     This is the name of the event to check for.
+     *
+     * @return
+     *     An indication of whether or not the payload dispatches
+     *     the named event is returned.
+     */
+    bool IsEvent(
+        const std::string& payload,
+        const Header& header,
+        const char* eventName
+    );
+
+    /**
+     * This function copies the name of the event dispatched by the given
+     * JSON-encoded gateway payload, if any.
+     *
+     * @param[in] payload
+     *     This is the JSON-encoded gateway payload.
+     *
+     * @param[in] header
+     *     This is what was found by scanning the payload.
+     *
+     * @param[out] eventName
+     *     This is where to store the event name, if found.
+     *
+     * @return
+     *     An indication of whether or not an event name was found
+     *     is returned.
+     */
+    bool GetEventName(
+        const std::string& payload,
+        const Header& header,
+        std::string& eventName
+    );
+
+    /**
+     * This function finds the string value of the first occurrence of the
+     * given key in the given JSON-encoded gateway payload.  Escape sequences
+     * are skipped over but not decoded, so the value may be put back into
+     * a JSON-encoded payload as it is.
+     *
+     * @param[in] payload
+     *     This is the JSON-encoded gateway payload.
+     *
+     * @param[in] key
+     *     This is the quoted key to find, such as "\"session_id\"".
+     *
+     * @param[out] value
+     *     This is where to store the string value, without its quotes,
+     *     if found.
+     *
+     * @return
+     *     An indication of whether or not a string value was found
+     *     is returned.
+     */
+    bool GetString(
+        const std::string& payload,
+        const std::string& key,
+        std::string& value
+    );
+
+    /**
+     * This function finds the values of every occurrence of the given key
+     * whose value is a snowflake (an identifier encoded as a decimal
+     * string) in the given JSON-encoded gateway payload.  Since nesting
+     * isn't tracked, identifiers of nested objects are included.
+     *
+     * @param[in] payload
+     *     This is the JSON-encoded gateway payload.
+     *
+     * @param[in] key
+     *     This is the quoted key to find, such as "\"id\"".
+     *
+     * @param[out] snowflakes
+     *     This is where to append the values found.
+     */
+    void GetSnowflakes(
+        const std::string& payload,
+        const std::string& key,
+        std::vector< uint64_t >& snowflakes
+    );
+
+}
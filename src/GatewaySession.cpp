@@ -0,0 +1,352 @@
+/**
+ * @file GatewaySession.cpp
+ *
+ * This module contains the implementation of the GatewaySession class.
+ *
+ * © 2020 by Richard Walters
+ */
+
+#include "GatewaySession.hpp"
+#include "SessionConnections.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <math.h>
+#include <mutex>
+#include <random>
+#include <stddef.h>
+#include <thread>
+
+/**
+ * This contains the private properties of a GatewaySession class instance.
+ */
+struct GatewaySession::Impl {
+    // Properties
+
+    std::weak_ptr< Impl > weakSelf;
+    std::shared_ptr< SessionConnections > sessionConnections = std::make_shared< SessionConnections >();
+    std::shared_ptr< Timekeeping::Scheduler > scheduler;
+    std::shared_ptr< Timekeeping::Clock > clock;
+    Discord::Gateway::Configuration gatewayConfiguration;
+    Configuration configuration;
+    SystemAbstractions::DiagnosticsSender diagnosticsSender;
+    EndDelegate onEnd;
+
+    /**
+     * This is used to deliver the outcome of the first connection attempt.
+     */
+    std::promise< bool > startPromise;
+
+    /**
+     * This is used to pick how long to wait before connecting again.
+     */
+    std::mt19937 randomGenerator{std::random_device()()};
+
+    /**
+     * This is used to synchronize access to the object.
+     */
+    std::mutex mutex;
+
+    /**
+     * This is used to wake the thread which runs the session when the
+     * connection is lost or degraded, or when the session is stopped.
+     */
+    std::condition_variable wakeCondition;
+
+    /**
+     * This counts the gateways made, so that the close callback of an
+     * older one can be told apart from the current one.
+     */
+    size_t generation = 0;
+
+    /**
+     * This flag is set when the current gateway's connection is lost.
+     */
+    bool closed = false;
+
+    /**
+     * This flag is set when the current gateway's connection is degraded.
+     */
+    bool degraded = false;
+
+    /**
+     * This flag tells the thread which runs the session to stop.
+     */
+    bool stopping = false;
+
+    /**
+     * This is the thread which runs the session.
+     */
+    std::thread worker;
+
+    // Methods
+
+    explicit Impl(const std::string& name)
+        : diagnosticsSender(name)
+    {
+    }
+
+    /**
+     * This method returns how long to wait before the given attempt
+     * to connect again.  Half the delay doubles with each attempt, up to
+     * the maximum, and the other half is picked at random, so that many
+     * sessions losing their connections at once don't all try to connect
+     * again at the same time.
+     *
+     * @param[in] attempt
+     *     This counts the attempts to connect again since the last one
+     *     which lasted.
+     *
+     * @return
+     *     The number of seconds to wait is returned.
+     */
+    double GetBackoff(size_t attempt) {
+        const auto cap = std::min(
+            configuration.maxBackoff,
+            configuration.minBackoff * pow(2.0, (double)std::min(attempt, (size_t)30))
+        );
+        std::uniform_real_distribution< double > jitter(0.0, cap / 2.0);
+        return cap / 2.0 + jitter(randomGenerator);
+    }
+
+    /**
+     * This method makes a new gateway and waits for it to connect.
+     *
+     * @param[out] gateway
+     *     This is where to store the new gateway.
+     *
+     * @param[in] gatewayGeneration
+     *     This identifies the new gateway to its close callback.
+     *
+     * @return
+     *     An indication of whether or not the gateway connected
+     *     is returned.
+     */
+    bool Connect(
+        std::unique_ptr< Discord::Gateway >& gateway,
+        size_t gatewayGeneration
+    ) {
+        gateway.reset(new Discord::Gateway());
+        gateway->SetScheduler(scheduler);
+        gateway->RegisterDiagnosticMessageCallback(
+            [this](
+                size_t level,
+                std::string&& message
+            ){
+                diagnosticsSender.SendDiagnosticInformationString(level, message);
+            }
+        );
+        std::weak_ptr< Impl > implWeak(weakSelf);
+        gateway->RegisterCloseCallback(
+            [implWeak, gatewayGeneration]{
+                const auto impl = implWeak.lock();
+                if (impl == nullptr) {
+                    return;
+                }
+                std::lock_guard< decltype(impl->mutex) > lock(impl->mutex);
+                if (impl->generation == gatewayGeneration) {
+                    impl->closed = true;
+                    impl->wakeCondition.notify_all();
+                }
+            }
+        );
+        auto connected = gateway->Connect(sessionConnections, gatewayConfiguration);
+        if (
+            connected.wait_for(std::chrono::duration< double >(configuration.connectTimeout))
+            != std::future_status::ready
+        ) {
+            diagnosticsSender.SendDiagnosticInformationString(
+                SystemAbstractions::DiagnosticsSender::Levels::ERROR,
+                "Timeout connecting to Discord gateway"
+            );
+            gateway->Disconnect();
+            (void)connected.get();
+            return false;
+        }
+        if (!connected.get()) {
+            diagnosticsSender.SendDiagnosticInformationString(
+                SystemAbstractions::DiagnosticsSender::Levels::ERROR,
+                "Failed to connect to Discord gateway"
+            );
+            return false;
+        }
+        return true;
+    }
+
+    /**
+     * This is the body of the thread which runs the session.
+     */
+    void Worker() {
+        bool first = true;
+        size_t attempt = 0;
+        bool switchingOver = false;
+        std::unique_ptr< Discord::Gateway > gateway;
+        std::unique_lock< decltype(mutex) > lock(mutex);
+        while (!stopping) {
+            const auto gatewayGeneration = ++generation;
+            closed = false;
+            degraded = false;
+            lock.unlock();
+            const auto connected = Connect(gateway, gatewayGeneration);
+            const auto connectedTime = clock->GetCurrentTime();
+            if (first) {
+                first = false;
+                startPromise.set_value(connected);
+                if (!connected) {
+                    gateway->Disconnect();
+                    return;
+                }
+            }
+            lock.lock();
+
+            // Wait for the connection to be lost, opening a replacement
+            // ahead of time if it's degraded.
+            while (
+                connected
+                && !closed
+                && !stopping
+            ) {
+                wakeCondition.wait(
+                    lock,
+                    [this]{
+                        return (
+                            closed
+                            || degraded
+                            || stopping
+                        );
+                    }
+                );
+                if (
+                    degraded
+                    && !closed
+                    && !stopping
+                ) {
+                    degraded = false;
+                    lock.unlock();
+                    switchingOver = (
+                        sessionConnections->Prewarm(configuration.connectTimeout)
+                        && sessionConnections->SwitchOver()
+                    );
+                    lock.lock();
+                }
+            }
+            if (
+                connected
+                && (clock->GetCurrentTime() - connectedTime >= configuration.maxBackoff)
+            ) {
+                attempt = 0;
+            }
+            lock.unlock();
+            gateway->Disconnect();
+            gateway = nullptr;
+            lock.lock();
+            if (stopping) {
+                break;
+            }
+            if (!configuration.reconnect) {
+                const auto onEndSample = onEnd;
+                lock.unlock();
+                if (onEndSample != nullptr) {
+                    onEndSample();
+                }
+                return;
+            }
+
+            // Wait a while before connecting again, unless switching over
+            // to a replacement connection opened ahead of time.
+            const auto delay = (switchingOver ? 0.0 : GetBackoff(attempt++));
+            switchingOver = false;
+            diagnosticsSender.SendDiagnosticInformationFormatted(
+                3,
+                "Connection lost; connecting again in %.1lf seconds",
+                delay
+            );
+            (void)wakeCondition.wait_for(
+                lock,
+                std::chrono::duration< double >(delay),
+                [this]{ return stopping; }
+            );
+        }
+    }
+};
+
+GatewaySession::~GatewaySession() noexcept {
+    Stop();
+}
+
+GatewaySession::GatewaySession(const std::string& name)
+    : impl_(std::make_shared< Impl >(name))
+{
+    impl_->weakSelf = impl_;
+}
+
+SystemAbstractions::DiagnosticsSender::UnsubscribeDelegate GatewaySession::SubscribeToDiagnostics(
+    SystemAbstractions::DiagnosticsSender::DiagnosticMessageDelegate delegate,
+    size_t minLevel
+) {
+    return impl_->diagnosticsSender.SubscribeToDiagnostics(delegate, minLevel);
+}
+
+void GatewaySession::Configure(
+    const std::shared_ptr< ::Connections >& connections,
+    ::Connections::WebSocketDecorator decorator,
+    const std::shared_ptr< Timekeeping::Scheduler >& scheduler,
+    const std::shared_ptr< Timekeeping::Clock >& clock,
+    const Discord::Gateway::Configuration& gatewayConfiguration,
+    const Configuration& configuration
+) {
+    impl_->scheduler = scheduler;
+    impl_->clock = clock;
+    impl_->gatewayConfiguration = gatewayConfiguration;
+    impl_->configuration = configuration;
+    SessionConnections::Configuration sessionConfiguration;
+    sessionConfiguration.resume = configuration.reconnect;
+    if (configuration.reconnect) {
+        sessionConfiguration.degradedRoundTrip = configuration.prewarmRoundTrip;
+    }
+    sessionConfiguration.metrics = configuration.metrics;
+    impl_->sessionConnections->Configure(
+        connections,
+        decorator,
+        clock,
+        sessionConfiguration
+    );
+    (void)impl_->sessionConnections->SubscribeToDiagnostics(
+        impl_->diagnosticsSender.Chain()
+    );
+    std::weak_ptr< Impl > implWeak(impl_);
+    impl_->sessionConnections->RegisterDegradedCallback(
+        [implWeak]{
+            const auto impl = implWeak.lock();
+            if (impl == nullptr) {
+                return;
+            }
+            std::lock_guard< decltype(impl->mutex) > lock(impl->mutex);
+            impl->degraded = true;
+            impl->wakeCondition.notify_all();
+        }
+    );
+}
+
+void GatewaySession::RegisterEndCallback(EndDelegate onEnd) {
+    std::lock_guard< decltype(impl_->mutex) > lock(impl_->mutex);
+    impl_->onEnd = onEnd;
+}
+
+std::future< bool > GatewaySession::Start() {
+    auto started = impl_->startPromise.get_future();
+    impl_->worker = std::thread(&Impl::Worker, impl_.get());
+    return started;
+}
+
+void GatewaySession::Stop() {
+    std::unique_lock< decltype(impl_->mutex) > lock(impl_->mutex);
+    if (!impl_->worker.joinable()) {
+        return;
+    }
+    impl_->stopping = true;
+    impl_->wakeCondition.notify_all();
+    lock.unlock();
+    impl_->worker.join();
+}
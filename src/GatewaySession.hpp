@@ -0,0 +1,179 @@
+#pragma once
+
+/**
+ * @file GatewaySession.hpp
+ *
+ * This module declares the GatewaySession class.
+ *
+ * © 2020 by Richard Walters
+ */
+
+#include "Connections.hpp"
+#include "Metrics.hpp"
+
+#include <Discord/Gateway.hpp>
+#include <functional>
+#include <future>
+#include <memory>
+#include <string>
+#include <SystemAbstractions/DiagnosticsSender.hpp>
+#include <Timekeeping/Clock.hpp>
+#include <Timekeeping/Scheduler.hpp>
+
+/**
+ * This runs a Discord gateway connection, and optionally keeps it going:
+ * whenever the connection is lost, a new gateway is connected after a
+ * jittered, exponentially growing delay, resuming the old session rather
+ * than identifying again.  If heartbeats show the connection is degraded,
+ * a replacement connection can be opened ahead of time and switched over
+ * to right away.
+ */
+class GatewaySession {
+    // Types
+public:
+    /**
+     * This holds the configurable parameters of the session.
+     */
+    struct Configuration {
+        /**
+         * This indicates whether or not to connect again whenever the
+         * connection is lost.  If not, the session ends the first time
+         * the connection is lost.
+         */
+        bool reconnect = false;
+
+        /**
+         * This is the delay, in seconds, before the first attempt
+         * to connect again.
+         */
+        double minBackoff = 1.0;
+
+        /**
+         * This is the longest delay, in seconds, between attempts
+         * to connect again.  A connection which stays up this long
+         * resets the delay to the minimum.
+         */
+        double maxBackoff = 60.0;
+
+        /**
+         * This is the maximum number of seconds to wait for each
+         * connection attempt.
+         */
+        double connectTimeout = 5.0;
+
+        /**
+         * If nonzero, this is the heartbeat round trip time, in seconds,
+         * beyond which a replacement connection is opened and switched
+         * over to.  This is only done if the session is reconnected.
+         */
+        double prewarmRoundTrip = 0.0;
+
+        /**
+         * If set, this is the registry in which to keep the round trip
+         * times of heartbeats, and count those never acknowledged.
+         */
+        std::shared_ptr< Metrics > metrics;
+    };
+
+    /**
+     * This is the type of function called when the session ends without
+     * being stopped.
+     */
+    typedef std::function< void() > EndDelegate;
+
+    // Lifecycle Methods
+public:
+    ~GatewaySession() noexcept;
+    GatewaySession(const GatewaySession&) = delete;
+    GatewaySession(GatewaySession&&) noexcept = delete;
+    GatewaySession& operator=(const GatewaySession&) = delete;
+    GatewaySession& operator=(GatewaySession&&) noexcept = delete;
+
+    // Public Methods
+public:
+    /**
+     * This is the constructor of the class.
+     *
+     * @param[in] name
+     *     This is the name with which the session and its gateway
+     *     publish diagnostic messages.
+     */
+    explicit GatewaySession(const std::string& name);
+
+    SystemAbstractions::DiagnosticsSender::UnsubscribeDelegate SubscribeToDiagnostics(
+        SystemAbstractions::DiagnosticsSender::DiagnosticMessageDelegate delegate,
+        size_t minLevel = 0
+    );
+
+    /**
+     * This method sets up the session.
+     *
+     * @param[in] connections
+     *     This is the Connections instance to use to make requests.
+     *
+     * @param[in] decorator
+     *     If not empty, this is used to wrap each WebSocket made
+     *     for the session.
+     *
+     * @param[in] scheduler
+     *     This is the scheduler to give each gateway.
+     *
+     * @param[in] clock
+     *     This is the clock used to time connections and heartbeats.
+     *
+     * @param[in] gatewayConfiguration
+     *     This is the configuration to give each gateway.
+     *
+     * @param[in] configuration
+     *     This holds the configurable parameters of the session.
+     */
+    void Configure(
+        const std::shared_ptr< ::Connections >& connections,
+        ::Connections::WebSocketDecorator decorator,
+        const std::shared_ptr< Timekeeping::Scheduler >& scheduler,
+        const std::shared_ptr< Timekeeping::Clock >& clock,
+        const Discord::Gateway::Configuration& gatewayConfiguration,
+        const Configuration& configuration
+    );
+
+    /**
+     * This method sets the function to call when the session ends
+     * without being stopped.
+     *
+     * @param[in] onEnd
+     *     This is the function to call when the session ends.
+     */
+    void RegisterEndCallback(EndDelegate onEnd);
+
+    /**
+     * This method starts the thread which runs the session.
+     *
+     * @return
+     *     A future is returned which becomes ready once the first
+     *     connection attempt finishes, indicating whether or not it
+     *     succeeded.  If it didn't, the session ends right away, without
+     *     calling the end callback.
+     */
+    std::future< bool > Start();
+
+    /**
+     * This method disconnects the gateway, stops any further attempts
+     * to connect, and waits for the thread which runs the session
+     * to finish.
+     */
+    void Stop();
+
+    // Private properties
+private:
+    /**
+     * This is the type of structure that contains the private
+     * properties of the instance.  It is defined in the implementation
+     * and declared here to ensure that it is scoped inside the class.
+     */
+    struct Impl;
+
+    /**
+     * This contains the private properties of the instance.
+     */
+    std::shared_ptr< Impl > impl_;
+};
@@ -0,0 +1,127 @@
+/**
+ * @file IdentifyGate.cpp
+ *
+ * This module contains the implementation of the IdentifyGate class.
+ *
+ * © 2020 by Richard Walters
+ */
+
+#include "IdentifyGate.hpp"
+
+#include <mutex>
+#include <vector>
+
+/**
+ * This contains the private properties of a IdentifyGate class instance.
+ */
+struct IdentifyGate::Impl {
+    // Properties
+
+    /**
+     * These are the timers used to let held shards proceed.
+     */
+    std::shared_ptr< Timers > timers;
+
+    /**
+     * This is the clock used to track the identify intervals.
+     */
+    std::shared_ptr< Timekeeping::Clock > clock;
+
+    /**
+     * This is the length of each identify interval, in seconds.
+     */
+    double interval = 5.0;
+
+    /**
+     * This holds, for each bucket, the earliest time at which the next
+     * shard in the bucket may identify.
+     */
+    std::vector< double > nextAllowedTimes = std::vector< double >(1, 0.0);
+
+    /**
+     * This is a helper object used to generate and publish
+     * diagnostic messages.
+     */
+    SystemAbstractions::DiagnosticsSender diagnosticsSender;
+
+    /**
+     * This is used to synchronize access to the object.
+     */
+    std::mutex mutex;
+
+    // Methods
+
+    Impl()
+        : diagnosticsSender("IdentifyGate")
+    {
+    }
+};
+
+IdentifyGate::~IdentifyGate() noexcept = default;
+
+IdentifyGate::IdentifyGate()
+    : impl_(new Impl())
+{
+}
+
+void IdentifyGate::Configure(
+    const std::shared_ptr< Timers >& timers,
+    const std::shared_ptr< Timekeeping::Clock >& clock,
+    size_t maxConcurrency,
+    double interval
+) {
+    std::lock_guard< decltype(impl_->mutex) > lock(impl_->mutex);
+    impl_->timers = timers;
+    impl_->clock = clock;
+    impl_->interval = interval;
+    impl_->nextAllowedTimes.assign(
+        ((maxConcurrency == 0) ? 1 : maxConcurrency),
+        0.0
+    );
+}
+
+SystemAbstractions::DiagnosticsSender::UnsubscribeDelegate IdentifyGate::SubscribeToDiagnostics(
+    SystemAbstractions::DiagnosticsSender::DiagnosticMessageDelegate delegate,
+    size_t minLevel
+) {
+    return impl_->diagnosticsSender.SubscribeToDiagnostics(delegate, minLevel);
+}
+
+void IdentifyGate::Request(
+    size_t shardId,
+    ProceedDelegate proceed
+) {
+    std::unique_lock< decltype(impl_->mutex) > lock(impl_->mutex);
+    if (
+        (impl_->timers == nullptr)
+        || (impl_->clock == nullptr)
+    ) {
+        lock.unlock();
+        proceed();
+        return;
+    }
+    const auto bucket = shardId % impl_->nextAllowedTimes.size();
+    auto& nextAllowedTime = impl_->nextAllowedTimes[bucket];
+    const auto now = impl_->clock->GetCurrentTime();
+    const auto due = (nextAllowedTime > now) ? nextAllowedTime : now;
+    nextAllowedTime = due + impl_->interval;
+    if (due <= now) {
+        lock.unlock();
+        impl_->diagnosticsSender.SendDiagnosticInformationFormatted(
+            1,
+            "Shard %zu may identify now (bucket %zu)",
+            shardId,
+            bucket
+        );
+        proceed();
+        return;
+    }
+    impl_->diagnosticsSender.SendDiagnosticInformationFormatted(
+        1,
+        "Shard %zu identify held for %.3lf seconds (bucket %zu)",
+        shardId,
+        due - now,
+        bucket
+    );
+    (void)impl_->timers->Schedule(proceed, due);
+}
@@ -0,0 +1,105 @@
+#pragma once
+
+/**
+ * @file IdentifyGate.hpp
+ *
+ * This module declares the IdentifyGate class.
+ *
+ * © 2020 by Richard Walters
+ */
+
+#include "Timers.hpp"
+
+#include <functional>
+#include <memory>
+#include <stddef.h>
+#include <SystemAbstractions/DiagnosticsSender.hpp>
+#include <Timekeeping/Clock.hpp>
+
+/**
+ * This holds back the IDENTIFY of each shard run by the program, so that
+ * Discord's session start concurrency limit is respected.  Shards are
+ * grouped into buckets by their identifier modulo the maximum concurrency,
+ * and only one shard from each bucket may identify per interval.
+ */
+class IdentifyGate {
+    // Types
+public:
+    /**
+     * This is the type of function called when a shard may identify.
+     */
+    typedef std::function< void() > ProceedDelegate;
+
+    // Lifecycle Methods
+public:
+    ~IdentifyGate() noexcept;
+    IdentifyGate(const IdentifyGate&) = delete;
+    IdentifyGate(IdentifyGate&&) noexcept = delete;
+    IdentifyGate& operator=(const IdentifyGate&) = delete;
+    IdentifyGate& operator=(IdentifyGate&&) noexcept = delete;
+
+    // Public Methods
+public:
+    /**
+     * This is the constructor of the class.
+     */
+    IdentifyGate();
+
+    /**
+     * This method sets up the gate.
+     *
+     * @param[in] timers
+     *     These are the timers to use to let held shards proceed.
+     *
+     * @param[in] clock
+     *     This is the clock to use to track the identify intervals.
+     *
+     * @param[in] maxConcurrency
+     *     This is the number of shards which may identify per interval,
+     *     as given by Discord in the session start limit.
+     *
+     * @param[in] interval
+     *     This is the length of the interval, in seconds.
+     */
+    void Configure(
+        const std::shared_ptr< Timers >& timers,
+        const std::shared_ptr< Timekeeping::Clock >& clock,
+        size_t maxConcurrency,
+        double interval = 5.0
+    );
+
+    SystemAbstractions::DiagnosticsSender::UnsubscribeDelegate SubscribeToDiagnostics(
+        SystemAbstractions::DiagnosticsSender::DiagnosticMessageDelegate delegate,
+        size_t minLevel = 0
+    );
+
+    /**
+     * This method asks for the given shard to be allowed to identify.
+     * The given delegate is called, either right away or once the shard's
+     * bucket has a free slot.
+     *
+     * @param[in] shardId
+     *     This is the identifier of the shard which wants to identify.
+     *
+     * @param[in] proceed
+     *     This is the function to call once the shard may identify.
+     */
+    void Request(
+        size_t shardId,
+        ProceedDelegate proceed
+    );
+
+    // Private properties
+private:
+    /**
+     * This is the type of structure that contains the private
+     * properties of the instance.  It is defined in the implementation
+     * and declared here to ensure that it is scoped inside the class.
+     */
+    struct Impl;
+
+    /**
+     * This contains the private properties of the instance.
+     */
+    std::unique_ptr< Impl > impl_;
+};
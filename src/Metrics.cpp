@@ -0,0 +1,489 @@
+/**
+ * @file Metrics.cpp
+ *
+ * This module contains the implementation of the Metrics class.
+ *
+ * © 2020 by Richard Walters
+ */
+
+#include "Metrics.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <math.h>
+#include <memory>
+#include <mutex>
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <StringExtensions/StringExtensions.hpp>
+#include <vector>
+
+namespace {
+
+    /**
+     * These are the quantiles of each histogram which are rendered.
+     */
+    const double RENDERED_QUANTILES[] = {0.5, 0.9, 0.99, 0.999};
+
+    /**
+     * This is used to hand out counter shards to threads.
+     */
+    std::atomic< size_t > nextShard{0};
+
+    /**
+     * This is the index of the counter shard used by the current thread.
+     */
+    thread_local size_t threadShard = nextShard++;
+
+    /**
+     * This function returns the index of the most significant bit set
+     * in the given value, which must not be zero.
+     *
+     * @param[in] value
+     *     This is the value whose most significant bit to find.
+     *
+     * @return
+     *     The index of the most significant bit set is returned.
+     */
+    size_t MostSignificantBit(uint64_t value) {
+        size_t bit = 0;
+        for (size_t shift = 32; shift > 0; shift /= 2) {
+            if (value >= ((uint64_t)1 << shift)) {
+                value >>= shift;
+                bit += shift;
+            }
+        }
+        return bit;
+    }
+
+    /**
+     * This function returns the index of the histogram bucket which
+     * counts the given number of microseconds.
+     *
+     * @param[in] microseconds
+     *     This is the duration to count.
+     *
+     * @return
+     *     The index of the bucket which counts the duration is returned.
+     */
+    size_t GetBucketIndex(uint64_t microseconds) {
+        if (microseconds < 32) {
+            return (size_t)microseconds;
+        }
+        const auto exponent = MostSignificantBit(microseconds) - 4;
+        const auto subBucket = (size_t)(microseconds >> exponent) - 16;
+        return 32 + (exponent - 1) * 16 + subBucket;
+    }
+
+    /**
+     * This function returns the number of microseconds in the middle
+     * of the range counted by the histogram bucket with the given index.
+     *
+     * @param[in] index
+     *     This is the index of the bucket.
+     *
+     * @return
+     *     The duration in the middle of the bucket's range is returned.
+     */
+    double GetBucketMidpoint(size_t index) {
+        if (index < 32) {
+            return (double)index;
+        }
+        const auto exponent = (index - 32) / 16 + 1;
+        const auto subBucket = (double)((index - 32) % 16 + 16);
+        return (subBucket + 0.5) * ldexp(1.0, (int)exponent) - 0.5;
+    }
+
+    /**
+     * This function escapes the given label value for the Prometheus
+     * text exposition format.
+     *
+     * @param[in] value
+     *     This is the label value to escape.
+     *
+     * @return
+     *     The escaped label value is returned.
+     */
+    std::string EscapeLabelValue(const std::string& value) {
+        std::string escaped;
+        escaped.reserve(value.length());
+        for (const auto c: value) {
+            switch (c) {
+                case '\\': escaped += "\\\\"; break;
+                case '"': escaped += "\\\""; break;
+                case '\n': escaped += "\\n"; break;
+                default: escaped += c; break;
+            }
+        }
+        return escaped;
+    }
+
+    /**
+     * This function renders the given labels, plus an optional extra one,
+     * the way they appear after the name of a metric.
+     *
+     * @param[in] labels
+     *     These are the labels to render.
+     *
+     * @param[in] extra
+     *     If not empty, this is the extra label, already rendered,
+     *     to add at the end.
+     *
+     * @return
+     *     The rendered labels are returned, or an empty string if
+     *     there are none.
+     */
+    std::string RenderLabels(
+        const Metrics::Labels& labels,
+        const std::string& extra = ""
+    ) {
+        std::vector< std::string > rendered;
+        rendered.reserve(labels.size() + 1);
+        for (const auto& label: labels) {
+            rendered.push_back(label.name + "=\"" + EscapeLabelValue(label.value) + "\"");
+        }
+        if (!extra.empty()) {
+            rendered.push_back(extra);
+        }
+        if (rendered.empty()) {
+            return "";
+        }
+        return "{" + StringExtensions::Join(rendered, ",") + "}";
+    }
+
+    /**
+     * These are the types of metrics kept in the registry.
+     */
+    enum class MetricType {
+        Counter,
+        Gauge,
+        Histogram,
+    };
+
+    /**
+     * This holds all the series of one metric.
+     */
+    struct Family {
+        /**
+         * This is the type of the metric.
+         */
+        MetricType type;
+
+        /**
+         * This describes the metric.
+         */
+        std::string help;
+
+        /**
+         * These are the labels of each series of the metric, keyed
+         * by the labels rendered.
+         */
+        std::map< std::string, Metrics::Labels > labels;
+
+        /**
+         * These are the series of the metric, if it's a counter, keyed
+         * by their labels rendered.
+         */
+        std::map< std::string, std::shared_ptr< Metrics::Counter > > counters;
+
+        /**
+         * These are the series of the metric, if it's a gauge, keyed
+         * by their labels rendered.
+         */
+        std::map< std::string, std::shared_ptr< Metrics::Gauge > > gauges;
+
+        /**
+         * These are the series of the metric, if it's a histogram, keyed
+         * by their labels rendered.
+         */
+        std::map< std::string, std::shared_ptr< Metrics::Histogram > > histograms;
+    };
+
+}
+
+constexpr size_t Metrics::Counter::NUM_SHARDS;
+
+void Metrics::Counter::Add(uint64_t amount) {
+    (void)shards_[threadShard % NUM_SHARDS].value.fetch_add(amount, std::memory_order_relaxed);
+}
+
+uint64_t Metrics::Counter::GetValue() const {
+    uint64_t value = 0;
+    for (const auto& shard: shards_) {
+        value += shard.value.load(std::memory_order_relaxed);
+    }
+    return value;
+}
+
+void Metrics::Gauge::Set(int64_t value) {
+    value_.store(value, std::memory_order_relaxed);
+}
+
+void Metrics::Gauge::Add(int64_t amount) {
+    (void)value_.fetch_add(amount, std::memory_order_relaxed);
+}
+
+int64_t Metrics::Gauge::GetValue() const {
+    return value_.load(std::memory_order_relaxed);
+}
+
+constexpr size_t Metrics::Histogram::NUM_BUCKETS;
+
+Metrics::Histogram::Histogram() {
+    for (auto& bucket: buckets_) {
+        bucket.store(0, std::memory_order_relaxed);
+    }
+}
+
+void Metrics::Histogram::Record(double seconds) {
+    const auto microseconds = (
+        (seconds > 0.0)
+        ? (uint64_t)llround(seconds * 1e6)
+        : 0
+    );
+    (void)buckets_[GetBucketIndex(microseconds)].fetch_add(1, std::memory_order_relaxed);
+    (void)count_.fetch_add(1, std::memory_order_relaxed);
+    (void)sum_.fetch_add(microseconds, std::memory_order_relaxed);
+}
+
+void Metrics::Histogram::RecordSince(std::chrono::steady_clock::time_point start) {
+    Record(
+        std::chrono::duration< double >(
+            std::chrono::steady_clock::now() - start
+        ).count()
+    );
+}
+
+uint64_t Metrics::Histogram::GetCount() const {
+    return count_.load(std::memory_order_relaxed);
+}
+
+double Metrics::Histogram::GetSum() const {
+    return (double)sum_.load(std::memory_order_relaxed) / 1e6;
+}
+
+double Metrics::Histogram::GetQuantile(double quantile) const {
+    // Take a snapshot of the buckets, and count from it rather than
+    // from count_, so that the two agree even while durations are
+    // being recorded.
+    std::vector< uint64_t > snapshot(NUM_BUCKETS);
+    uint64_t total = 0;
+    for (size_t i = 0; i < NUM_BUCKETS; ++i) {
+        snapshot[i] = buckets_[i].load(std::memory_order_relaxed);
+        total += snapshot[i];
+    }
+    if (total == 0) {
+        return 0.0;
+    }
+    auto rank = (uint64_t)ceil(quantile * (double)total);
+    if (rank < 1) {
+        rank = 1;
+    }
+    uint64_t seen = 0;
+    for (size_t i = 0; i < NUM_BUCKETS; ++i) {
+        seen += snapshot[i];
+        if (seen >= rank) {
+            return GetBucketMidpoint(i) / 1e6;
+        }
+    }
+    return GetBucketMidpoint(NUM_BUCKETS - 1) / 1e6;
+}
+
+/**
+ * This contains the private properties of a Metrics class instance.
+ */
+struct Metrics::Impl {
+    // Properties
+
+    /**
+     * This is used to synchronize access to the registry.
+     */
+    std::mutex mutex;
+
+    /**
+     * These are the metrics in the registry, keyed by name.
+     */
+    std::map< std::string, Family > families;
+
+    // Methods
+
+    /**
+     * This method finds or makes the family of the metric with the
+     * given name, and the key of the series with the given labels.
+     *
+     * @note
+     *     The mutex must be held while calling this method.
+     *
+     * @param[in] name
+     *     This is the name of the metric.
+     *
+     * @param[in] help
+     *     This describes the metric.
+     *
+     * @param[in] type
+     *     This is the type of the metric.
+     *
+     * @param[in] labels
+     *     These identify the series of the metric.
+     *
+     * @param[out] key
+     *     This is where to store the key of the series.
+     *
+     * @return
+     *     The family of the metric is returned, or nullptr if the name
+     *     is already used by a metric of another type.
+     */
+    Family* GetFamily(
+        const std::string& name,
+        const std::string& help,
+        MetricType type,
+        const Labels& labels,
+        std::string& key
+    ) {
+        auto familiesEntry = families.find(name);
+        if (familiesEntry == families.end()) {
+            Family family;
+            family.type = type;
+            family.help = help;
+            familiesEntry = families.insert({name, std::move(family)}).first;
+        } else if (familiesEntry->second.type != type) {
+            return nullptr;
+        }
+        auto& family = familiesEntry->second;
+        key = RenderLabels(labels);
+        if (family.labels.find(key) == family.labels.end()) {
+            family.labels[key] = labels;
+        }
+        return &family;
+    }
+};
+
+Metrics::~Metrics() noexcept = default;
+
+Metrics::Metrics()
+    : impl_(new Impl())
+{
+}
+
+auto Metrics::GetCounter(
+    const std::string& name,
+    const std::string& help,
+    const Labels& labels
+) -> std::shared_ptr< Counter > {
+    std::lock_guard< decltype(impl_->mutex) > lock(impl_->mutex);
+    std::string key;
+    const auto family = impl_->GetFamily(name, help, MetricType::Counter, labels, key);
+    if (family == nullptr) {
+        return std::make_shared< Counter >();
+    }
+    auto& counter = family->counters[key];
+    if (counter == nullptr) {
+        counter = std::make_shared< Counter >();
+    }
+    return counter;
+}
+
+auto Metrics::GetGauge(
+    const std::string& name,
+    const std::string& help,
+    const Labels& labels
+) -> std::shared_ptr< Gauge > {
+    std::lock_guard< decltype(impl_->mutex) > lock(impl_->mutex);
+    std::string key;
+    const auto family = impl_->GetFamily(name, help, MetricType::Gauge, labels, key);
+    if (family == nullptr) {
+        return std::make_shared< Gauge >();
+    }
+    auto& gauge = family->gauges[key];
+    if (gauge == nullptr) {
+        gauge = std::make_shared< Gauge >();
+    }
+    return gauge;
+}
+
+auto Metrics::GetHistogram(
+    const std::string& name,
+    const std::string& help,
+    const Labels& labels
+) -> std::shared_ptr< Histogram > {
+    std::lock_guard< decltype(impl_->mutex) > lock(impl_->mutex);
+    std::string key;
+    const auto family = impl_->GetFamily(name, help, MetricType::Histogram, labels, key);
+    if (family == nullptr) {
+        return std::make_shared< Histogram >();
+    }
+    auto& histogram = family->histograms[key];
+    if (histogram == nullptr) {
+        histogram = std::make_shared< Histogram >();
+    }
+    return histogram;
+}
+
+std::string Metrics::Render() {
+    std::lock_guard< decltype(impl_->mutex) > lock(impl_->mutex);
+    std::string output;
+    for (const auto& familiesEntry: impl_->families) {
+        const auto& name = familiesEntry.first;
+        const auto& family = familiesEntry.second;
+        output += "# HELP " + name + " " + family.help + "\n";
+        switch (family.type) {
+            case MetricType::Counter: {
+                output += "# TYPE " + name + " counter\n";
+                for (const auto& counter: family.counters) {
+                    output += StringExtensions::sprintf(
+                        "%s%s %llu\n",
+                        name.c_str(),
+                        counter.first.c_str(),
+                        (unsigned long long)counter.second->GetValue()
+                    );
+                }
+            } break;
+
+            case MetricType::Gauge: {
+                output += "# TYPE " + name + " gauge\n";
+                for (const auto& gauge: family.gauges) {
+                    output += StringExtensions::sprintf(
+                        "%s%s %lld\n",
+                        name.c_str(),
+                        gauge.first.c_str(),
+                        (long long)gauge.second->GetValue()
+                    );
+                }
+            } break;
+
+            case MetricType::Histogram:
+            default: {
+                output += "# TYPE " + name + " summary\n";
+                for (const auto& histogram: family.histograms) {
+                    const auto& labels = family.labels.at(histogram.first);
+                    for (const auto quantile: RENDERED_QUANTILES) {
+                        output += StringExtensions::sprintf(
+                            "%s%s %.6lf\n",
+                            name.c_str(),
+                            RenderLabels(
+                                labels,
+                                StringExtensions::sprintf("quantile=\"%g\"", quantile)
+                            ).c_str(),
+                            histogram.second->GetQuantile(quantile)
+                        );
+                    }
+                    output += StringExtensions::sprintf(
+                        "%s_sum%s %.6lf\n",
+                        name.c_str(),
+                        histogram.first.c_str(),
+                        histogram.second->GetSum()
+                    );
+                    output += StringExtensions::sprintf(
+                        "%s_count%s %llu\n",
+                        name.c_str(),
+                        histogram.first.c_str(),
+                        (unsigned long long)histogram.second->GetCount()
+                    );
+                }
+            } break;
+        }
+    }
+    return output;
+}
@@ -0,0 +1,322 @@
+#pragma once
+
+/**
+ * @file Metrics.hpp
+ *
+ * This module declares the Metrics class.
+ *
+ * © 2020 by Richard Walters
+ */
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+/**
+ * This is a registry of counters, gauges, and latency histograms kept
+ * by the components of the application, which can be rendered in the
+ * Prometheus text exposition format.  Metrics are looked up (and made,
+ * the first time) by name and labels, which takes a lock, so components
+ * should look up the metrics they update often ahead of time.  Updating
+ * a metric never takes a lock.
+ */
+class Metrics {
+    // Types
+public:
+    /**
+     * This is a name and value which, along with the name of a metric,
+     * identifies one series of the metric.
+     */
+    struct Label {
+        std::string name;
+        std::string value;
+    };
+
+    /**
+     * This is the type used to hold the labels identifying a series.
+     */
+    typedef std::vector< Label > Labels;
+
+    /**
+     * This is a count which only goes up.  It's split into shards on
+     * separate cache lines, with each thread adding to one shard, so that
+     * threads counting at the same time don't contend for the same line.
+     */
+    class Counter {
+    public:
+        /**
+         * This method adds the given amount to the counter.
+         *
+         * @param[in] amount
+         *     This is the amount to add to the counter.
+         */
+        void Add(uint64_t amount = 1);
+
+        /**
+         * This method returns the current value of the counter.
+         *
+         * @return
+         *     The current value of the counter is returned.
+         */
+        uint64_t GetValue() const;
+
+    private:
+        /**
+         * This is the number of shards into which the counter is split.
+         */
+        static constexpr size_t NUM_SHARDS = 16;
+
+        /**
+         * This is one shard of the counter, padded out to fill
+         * a cache line.
+         */
+        struct Shard {
+            std::atomic< uint64_t > value{0};
+            char padding[64 - sizeof(std::atomic< uint64_t >)];
+        };
+
+        /**
+         * These are the shards of the counter.
+         */
+        Shard shards_[NUM_SHARDS];
+    };
+
+    /**
+     * This is a value which may go up or down.
+     */
+    class Gauge {
+    public:
+        /**
+         * This method sets the value of the gauge.
+         *
+         * @param[in] value
+         *     This is the value to set.
+         */
+        void Set(int64_t value);
+
+        /**
+         * This method adds the given amount (which may be negative)
+         * to the gauge.
+         *
+         * @param[in] amount
+         *     This is the amount to add to the gauge.
+         */
+        void Add(int64_t amount);
+
+        /**
+         * This method returns the current value of the gauge.
+         *
+         * @return
+         *     The current value of the gauge is returned.
+         */
+        int64_t GetValue() const;
+
+    private:
+        /**
+         * This is the current value of the gauge.
+         */
+        std::atomic< int64_t > value_{0};
+    };
+
+    /**
+     * This records durations, with microsecond resolution, in buckets
+     * whose width grows with the duration, like an HDR histogram: below
+     * 32 microseconds each bucket is one microsecond wide, and above that,
+     * each power of two is split into 16 buckets, so that quantiles,
+     * taken from the middle of their buckets, are off by no more than
+     * about 3%.
+     */
+    class Histogram {
+    public:
+        /**
+         * This is the constructor of the class.
+         */
+        Histogram();
+
+        /**
+         * This method records the given duration.
+         *
+         * @param[in] seconds
+         *     This is the duration to record, in seconds.
+         */
+        void Record(double seconds);
+
+        /**
+         * This method records the time elapsed since the given time.
+         *
+         * @param[in] start
+         *     This is the time at which the duration to record started.
+         */
+        void RecordSince(std::chrono::steady_clock::time_point start);
+
+        /**
+         * This method returns the number of durations recorded.
+         *
+         * @return
+         *     The number of durations recorded is returned.
+         */
+        uint64_t GetCount() const;
+
+        /**
+         * This method returns the total of all durations recorded.
+         *
+         * @return
+         *     The total of all durations recorded, in seconds,
+         *     is returned.
+         */
+        double GetSum() const;
+
+        /**
+         * This method estimates the duration below which the given
+         * fraction of the durations recorded fall.
+         *
+         * @param[in] quantile
+         *     This is the fraction of durations, from 0.0 to 1.0.
+         *
+         * @return
+         *     The estimated duration, in seconds, is returned, or zero
+         *     if nothing has been recorded.
+         */
+        double GetQuantile(double quantile) const;
+
+    private:
+        /**
+         * This is the number of buckets needed to cover every duration
+         * which fits in 64 bits of microseconds.
+         */
+        static constexpr size_t NUM_BUCKETS = 32 + 59 * 16;
+
+        /**
+         * These count the durations recorded in each bucket.
+         */
+        std::atomic< uint64_t > buckets_[NUM_BUCKETS];
+
+        /**
+         * This is the number of durations recorded.
+         */
+        std::atomic< uint64_t > count_{0};
+
+        /**
+         * This is the total of all durations recorded, in microseconds.
+         */
+        std::atomic< uint64_t > sum_{0};
+    };
+
+    // Lifecycle Methods
+public:
+    ~Metrics() noexcept;
+    Metrics(const Metrics&) = delete;
+    Metrics(Metrics&&) noexcept = delete;
+    Metrics& operator=(const Metrics&) = delete;
+    Metrics& operator=(Metrics&&) noexcept = delete;
+
+    // Public Methods
+public:
+    /**
+     * This is the constructor of the class.
+     */
+    Metrics();
+
+    /**
+     * This method returns the counter with the given name and labels,
+     * making it if it doesn't exist yet.
+     *
+     * @param[in] name
+     *     This is the name of the metric.
+     *
+     * @param[in] help
+     *     This describes the metric.  It's only used the first time
+     *     a series of the metric is made.
+     *
+     * @param[in] labels
+     *     These identify the series of the metric.
+     *
+     * @return
+     *     The counter is returned.  If the name is already used by a
+     *     metric of another type, a counter which isn't rendered
+     *     is returned.
+     */
+    std::shared_ptr< Counter > GetCounter(
+        const std::string& name,
+        const std::string& help,
+        const Labels& labels = Labels()
+    );
+
+    /**
+     * This method returns the gauge with the given name and labels,
+     * making it if it doesn't exist yet.
+     *
+     * @param[in] name
+     *     This is the name of the metric.
+     *
+     * @param[in] help
+     *     This describes the metric.  It's only used the first time
+     *     a series of the metric is made.
+     *
+     * @param[in] labels
+     *     These identify the series of the metric.
+     *
+     * @return
+     *     The gauge is returned.  If the name is already used by a
+     *     metric of another type, a gauge which isn't rendered
+     *     is returned.
+     */
+    std::shared_ptr< Gauge > GetGauge(
+        const std::string& name,
+        const std::string& help,
+        const Labels& labels = Labels()
+    );
+
+    /**
+     * This method returns the histogram with the given name and labels,
+     * making it if it doesn't exist yet.  Histograms are rendered as
+     * Prometheus summaries, with 50th, 90th, 99th, and 99.9th percentiles.
+     *
+     * @param[in] name
+     *     This is the name of the metric.
+     *
+     * @param[in] help
+     *     This describes the metric.  It's only used the first time
+     *     a series of the metric is made.
+     *
+     * @param[in] labels
+     *     These identify the series of the metric.
+     *
+     * @return
+     *     The histogram is returned.  If the name is already used by a
+     *     metric of another type, a histogram which isn't rendered
+     *     is returned.
+     */
+    std::shared_ptr< Histogram > GetHistogram(
+        const std::string& name,
+        const std::string& help,
+        const Labels& labels = Labels()
+    );
+
+    /**
+     * This method renders the current values of all metrics in the
+     * Prometheus text exposition format.
+     *
+     * @return
+     *     The rendered metrics are returned.
+     */
+    std::string Render();
+
+    // Private properties
+private:
+    /**
+     * This is the type of structure that contains the private
+     * properties of the instance.  It is defined in the implementation
+     * and declared here to ensure that it is scoped inside the class.
+     */
+    struct Impl;
+
+    /**
+     * This contains the private properties of the instance.
+     */
+    std::unique_ptr< Impl > impl_;
+};
@@ -0,0 +1,764 @@
+/**
+ * @file RateLimiter.cpp
+ *
+ * This module contains the implementations of the RateLimiter class.
+ *
+ * © 2020 by Richard Walters
+ */
+
+#include "RateLimiter.hpp"
+
+#include <algorithm>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string>
+#include <SystemAbstractions/DiagnosticsSender.hpp>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+namespace {
+
+    /**
+     * This is the default maximum number of requests Discord allows
+     * per second across all routes.
+     */
+    constexpr size_t DEFAULT_GLOBAL_LIMIT = 50;
+
+    /**
+     * A response whose rate limit window ends at least this many seconds
+     * after the end of the window already known for its bucket is taken
+     * to be from a new window, rather than from the same one measured
+     * with a different network delay.
+     */
+    constexpr double NEW_WINDOW_THRESHOLD = 0.5;
+
+    /**
+     * This holds the parts of a resource URI which determine which
+     * rate limit bucket applies to a request.
+     */
+    struct Route {
+        /**
+         * This is the method and path of the request, with all identifiers
+         * except the major parameters replaced by placeholders.  Discord
+         * maps each of these to a bucket hash.
+         */
+        std::string key;
+
+        /**
+         * These are the values of the major parameters (channel, guild,
+         * or webhook identifiers) in the path, which split each bucket
+         * into independent limits.
+         */
+        std::string major;
+    };
+
+    /**
+     * This function determines whether or not the given path segment
+     * looks like a Discord identifier (snowflake).
+     *
+     * @param[in] segment
+     *     This is the path segment to check.
+     *
+     * @return
+     *     An indication of whether or not the segment is an identifier
+     *     is returned.
+     */
+    bool IsIdentifier(const std::string& segment) {
+        if (segment.empty()) {
+            return false;
+        }
+        for (auto c: segment) {
+            if ((c < '0') || (c > '9')) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /**
+     * This function breaks down the given request into the parts which
+     * determine its rate limit bucket.
+     *
+     * @param[in] method
+     *     This is the HTTP method of the request.
+     *
+     * @param[in] uri
+     *     This is the URI of the resource requested.
+     *
+     * @return
+     *     The route of the request is returned.
+     */
+    Route ParseRoute(
+        const std::string& method,
+        const std::string& uri
+    ) {
+        // Skip the scheme, host, and API version prefix, and drop any
+        // query or fragment.
+        auto pathStart = uri.find("/api/");
+        if (pathStart == std::string::npos) {
+            pathStart = 0;
+        } else {
+            pathStart += 5;
+            if (
+                (pathStart < uri.length())
+                && (uri[pathStart] == 'v')
+            ) {
+                const auto versionEnd = uri.find('/', pathStart);
+                pathStart = (
+                    (versionEnd == std::string::npos)
+                    ? uri.length()
+                    : versionEnd + 1
+                );
+            }
+        }
+        const auto pathEnd = uri.find_first_of("?#", pathStart);
+        const auto path = uri.substr(
+            pathStart,
+            (pathEnd == std::string::npos) ? std::string::npos : pathEnd - pathStart
+        );
+
+        // Split the path into segments.
+        std::vector< std::string > segments;
+        size_t segmentStart = 0;
+        for (;;) {
+            const auto segmentEnd = path.find('/', segmentStart);
+            if (segmentEnd == std::string::npos) {
+                segments.push_back(path.substr(segmentStart));
+                break;
+            }
+            segments.push_back(path.substr(segmentStart, segmentEnd - segmentStart));
+            segmentStart = segmentEnd + 1;
+        }
+
+        // Replace all identifiers except major parameters with placeholders.
+        Route route;
+        route.key = method;
+        route.key += ' ';
+        for (size_t i = 0; i < segments.size(); ++i) {
+            const auto& segment = segments[i];
+            route.key += '/';
+            if (
+                (i == 1)
+                && IsIdentifier(segment)
+                && (
+                    (segments[0] == "channels")
+                    || (segments[0] == "guilds")
+                    || (segments[0] == "webhooks")
+                )
+            ) {
+                route.key += ":major";
+                route.major += '/';
+                route.major += segment;
+            } else if (
+                (i == 2)
+                && (segments[0] == "webhooks")
+                && !route.major.empty()
+            ) {
+                route.key += ":token";
+                route.major += '/';
+                route.major += segment;
+            } else if (IsIdentifier(segment)) {
+                route.key += ":id";
+            } else if (
+                (i > 0)
+                && (segments[i - 1] == "reactions")
+            ) {
+                route.key += ":reaction";
+            } else {
+                route.key += segment;
+            }
+        }
+        return route;
+    }
+
+    /**
+     * This function returns a lower-case copy of the given string.
+     *
+     * @param[in] s
+     *     This is the string to copy.
+     *
+     * @return
+     *     The lower-case copy of the string is returned.
+     */
+    std::string ToLower(const std::string& s) {
+        std::string lower(s);
+        for (auto& c: lower) {
+            if ((c >= 'A') && (c <= 'Z')) {
+                c = (char)(c - 'A' + 'a');
+            }
+        }
+        return lower;
+    }
+
+    /**
+     * This holds the rate limit information found in a response.
+     */
+    struct RateLimitHeaders {
+        std::string bucket;
+        long limit = -1;
+        long remaining = -1;
+        double resetAfter = -1.0;
+        double retryAfter = -1.0;
+        bool global = false;
+    };
+
+    /**
+     * This function extracts the rate limit information from the headers
+     * of the given response.
+     *
+     * @param[in] response
+     *     This is the response from which to extract information.
+     *
+     * @return
+     *     The rate limit information found in the response is returned.
+     */
+    RateLimitHeaders ParseRateLimitHeaders(const Discord::Connections::Response& response) {
+        RateLimitHeaders rateLimitHeaders;
+        for (const auto& header: response.headers) {
+            const auto key = ToLower(header.key);
+            if (key.compare(0, 12, "x-ratelimit-") != 0) {
+                if (key == "retry-after") {
+                    rateLimitHeaders.retryAfter = strtod(header.value.c_str(), NULL);
+                }
+                continue;
+            }
+            const auto name = key.substr(12);
+            if (name == "bucket") {
+                rateLimitHeaders.bucket = header.value;
+            } else if (name == "limit") {
+                rateLimitHeaders.limit = strtol(header.value.c_str(), NULL, 10);
+            } else if (name == "remaining") {
+                rateLimitHeaders.remaining = strtol(header.value.c_str(), NULL, 10);
+            } else if (name == "reset-after") {
+                rateLimitHeaders.resetAfter = strtod(header.value.c_str(), NULL);
+            } else if (name == "global") {
+                rateLimitHeaders.global = (ToLower(header.value) == "true");
+            }
+        }
+        return rateLimitHeaders;
+    }
+
+}
+
+/**
+ * This contains the private properties of a RateLimiter class instance.
+ */
+struct RateLimiter::Impl {
+    // Types
+
+    /**
+     * This holds information about one request known to the rate limiter.
+     */
+    struct Ticket {
+        std::string routeKey;
+        std::string major;
+        std::string bucketKey;
+        ReleaseDelegate release;
+        bool released = false;
+    };
+
+    /**
+     * This holds the state of one rate limit bucket.
+     */
+    struct Bucket {
+        /**
+         * This is the number of requests Discord allows in each window
+         * of this bucket, or -1 if not yet known.
+         */
+        long limit = -1;
+
+        /**
+         * This is the number of requests which may still be sent in the
+         * current window, or -1 if not yet known.
+         */
+        long remaining = -1;
+
+        /**
+         * This is the time at which the current window ends.
+         */
+        double resetTime = 0.0;
+
+        /**
+         * This is the number of requests released from this bucket which
+         * haven't yet completed.
+         */
+        size_t inFlight = 0;
+
+        /**
+         * These are the tickets of the requests waiting to be released.
+         */
+        std::deque< int > queue;
+
+        /**
+         * This indicates whether or not a timer has been set to
+         * pump this bucket when it refills.
+         */
+        bool timerScheduled = false;
+    };
+
+    // Properties
+
+    std::weak_ptr< Impl > weakSelf;
+    std::shared_ptr< Timers > timers;
+    std::shared_ptr< Timekeeping::Clock > clock;
+    SystemAbstractions::DiagnosticsSender diagnosticsSender;
+    std::mutex mutex;
+    std::unordered_map< std::string, std::string > routeBuckets;
+    std::unordered_map< std::string, Bucket > buckets;
+    std::unordered_map< int, Ticket > tickets;
+    std::unordered_set< std::string > globallyBlockedBuckets;
+    int nextTicket = 1;
+    size_t globalLimit = DEFAULT_GLOBAL_LIMIT;
+    size_t globalCount = 0;
+    double globalWindowStart = 0.0;
+    double globalResetTime = 0.0;
+    bool globalTimerScheduled = false;
+
+    // Methods
+
+    Impl()
+        : diagnosticsSender("RateLimiter")
+    {
+    }
+
+    /**
+     * This method schedules the given bucket to be pumped at the given
+     * time, unless it's already scheduled.
+     *
+     * @note
+     *     The mutex must be held while calling this method.
+     *
+     * @param[in] bucketKey
+     *     This identifies the bucket to pump.
+     *
+     * @param[in,out] bucket
+     *     This is the bucket to pump.
+     *
+     * @param[in] due
+     *     This is the time at which to pump the bucket.
+     */
+    void ScheduleBucket(
+        const std::string& bucketKey,
+        Bucket& bucket,
+        double due
+    ) {
+        if (bucket.timerScheduled) {
+            return;
+        }
+        bucket.timerScheduled = true;
+        diagnosticsSender.SendDiagnosticInformationFormatted(
+            1,
+            "Bucket %s exhausted; holding %zu request(s) for %.3lf seconds",
+            bucketKey.c_str(),
+            bucket.queue.size(),
+            due - clock->GetCurrentTime()
+        );
+        const auto implWeak = weakSelf;
+        (void)timers->Schedule(
+            [implWeak, bucketKey]{
+                const auto impl = implWeak.lock();
+                if (impl == nullptr) {
+                    return;
+                }
+                std::vector< std::function< void() > > releases;
+                std::unique_lock< decltype(impl->mutex) > lock(impl->mutex);
+                const auto bucketsEntry = impl->buckets.find(bucketKey);
+                if (bucketsEntry == impl->buckets.end()) {
+                    return;
+                }
+                bucketsEntry->second.timerScheduled = false;
+                impl->Pump(bucketKey, releases);
+                lock.unlock();
+                for (const auto& release: releases) {
+                    release();
+                }
+            },
+            due
+        );
+    }
+
+    /**
+     * This method schedules all buckets held back by the global limit
+     * to be pumped at the given time, unless that's already scheduled.
+     *
+     * @note
+     *     The mutex must be held while calling this method.
+     *
+     * @param[in] due
+     *     This is the time at which to pump the buckets.
+     */
+    void ScheduleGlobal(double due) {
+        if (globalTimerScheduled) {
+            return;
+        }
+        globalTimerScheduled = true;
+        const auto implWeak = weakSelf;
+        (void)timers->Schedule(
+            [implWeak]{
+                const auto impl = implWeak.lock();
+                if (impl == nullptr) {
+                    return;
+                }
+                std::vector< std::function< void() > > releases;
+                std::unique_lock< decltype(impl->mutex) > lock(impl->mutex);
+                impl->globalTimerScheduled = false;
+                decltype(impl->globallyBlockedBuckets) blocked;
+                blocked.swap(impl->globallyBlockedBuckets);
+                for (const auto& bucketKey: blocked) {
+                    impl->Pump(bucketKey, releases);
+                }
+                lock.unlock();
+                for (const auto& release: releases) {
+                    release();
+                }
+            },
+            due
+        );
+    }
+
+    /**
+     * This method releases as many requests waiting in the given bucket
+     * as the rate limits allow, scheduling the bucket to be pumped again
+     * when it refills if any requests are left waiting.
+     *
+     * @note
+     *     The mutex must be held while calling this method.
+     *
+     * @param[in] bucketKey
+     *     This identifies the bucket to pump.
+     *
+     * @param[in,out] releases
+     *     This is where to put the functions which release the requests
+     *     which may now be sent.  They must be called after the mutex
+     *     is released.
+     */
+    void Pump(
+        const std::string& bucketKey,
+        std::vector< std::function< void() > >& releases
+    ) {
+        const auto bucketsEntry = buckets.find(bucketKey);
+        if (bucketsEntry == buckets.end()) {
+            return;
+        }
+        auto& bucket = bucketsEntry->second;
+        const auto now = clock->GetCurrentTime();
+        while (!bucket.queue.empty()) {
+            if (now < globalResetTime) {
+                (void)globallyBlockedBuckets.insert(bucketKey);
+                ScheduleGlobal(globalResetTime);
+                break;
+            }
+            if (now >= globalWindowStart + 1.0) {
+                globalWindowStart = now;
+                globalCount = 0;
+            }
+            if (globalCount >= globalLimit) {
+                (void)globallyBlockedBuckets.insert(bucketKey);
+                ScheduleGlobal(globalWindowStart + 1.0);
+                break;
+            }
+            if (
+                (bucket.remaining == 0)
+                && (now >= bucket.resetTime)
+            ) {
+                bucket.remaining = bucket.limit;
+            }
+            if (bucket.remaining == 0) {
+                ScheduleBucket(bucketKey, bucket, bucket.resetTime);
+                break;
+            }
+            if (
+                (bucket.remaining < 0)
+                && (bucket.inFlight > 0)
+            ) {
+                // Until the limits of the bucket are learned from
+                // a response, only one request is sent at a time.
+                break;
+            }
+            const auto ticketId = bucket.queue.front();
+            bucket.queue.pop_front();
+            const auto ticketsEntry = tickets.find(ticketId);
+            if (ticketsEntry == tickets.end()) {
+                continue;
+            }
+            auto& ticket = ticketsEntry->second;
+            ticket.released = true;
+            releases.push_back(std::bind(std::move(ticket.release), ticketId));
+            ticket.release = nullptr;
+            ++bucket.inFlight;
+            if (bucket.remaining > 0) {
+                --bucket.remaining;
+            }
+            ++globalCount;
+        }
+    }
+
+    /**
+     * This method moves all requests from one bucket to another, once
+     * Discord reveals which bucket a route actually uses.
+     *
+     * @note
+     *     The mutex must be held while calling this method.
+     *
+     * @param[in] fromKey
+     *     This identifies the bucket from which to move requests.
+     *
+     * @param[in] toKey
+     *     This identifies the bucket to which to move requests.
+     */
+    void MergeBuckets(
+        const std::string& fromKey,
+        const std::string& toKey
+    ) {
+        if (buckets.find(fromKey) == buckets.end()) {
+            return;
+        }
+
+        // Adding the bucket merged into may rehash the map, so the bucket
+        // merged from is only looked up after that.
+        auto& to = buckets[toKey];
+        const auto fromEntry = buckets.find(fromKey);
+        auto& from = fromEntry->second;
+        to.inFlight += from.inFlight;
+        to.queue.insert(to.queue.end(), from.queue.begin(), from.queue.end());
+        if (to.limit < 0) {
+            to.limit = from.limit;
+            to.remaining = from.remaining;
+            to.resetTime = from.resetTime;
+        }
+        for (auto& ticketsEntry: tickets) {
+            if (ticketsEntry.second.bucketKey == fromKey) {
+                ticketsEntry.second.bucketKey = toKey;
+            }
+        }
+        if (!from.timerScheduled) {
+            (void)buckets.erase(fromEntry);
+        } else {
+            from.queue.clear();
+            from.inFlight = 0;
+        }
+    }
+
+    /**
+     * This method discards the given bucket if nothing would be lost
+     * by forgetting it.
+     *
+     * @note
+     *     The mutex must be held while calling this method.
+     *
+     * @param[in] bucketKey
+     *     This identifies the bucket to check.
+     */
+    void DiscardIfIdle(const std::string& bucketKey) {
+        const auto bucketsEntry = buckets.find(bucketKey);
+        if (bucketsEntry == buckets.end()) {
+            return;
+        }
+        const auto& bucket = bucketsEntry->second;
+        if (
+            bucket.queue.empty()
+            && (bucket.inFlight == 0)
+            && !bucket.timerScheduled
+            && (clock->GetCurrentTime() >= bucket.resetTime)
+        ) {
+            (void)buckets.erase(bucketsEntry);
+        }
+    }
+};
+
+RateLimiter::~RateLimiter() noexcept = default;
+
+RateLimiter::RateLimiter()
+    : impl_(new Impl())
+{
+    impl_->weakSelf = impl_;
+}
+
+std::string RateLimiter::GetRoute(
+    const std::string& method,
+    const std::string& uri
+) {
+    return ParseRoute(method, uri).key;
+}
+
+void RateLimiter::Configure(
+    const std::shared_ptr< Timers >& timers,
+    const std::shared_ptr< Timekeeping::Clock >& clock
+) {
+    std::lock_guard< decltype(impl_->mutex) > lock(impl_->mutex);
+    impl_->timers = timers;
+    impl_->clock = clock;
+}
+
+void RateLimiter::SetGlobalLimit(size_t globalLimit) {
+    std::lock_guard< decltype(impl_->mutex) > lock(impl_->mutex);
+    impl_->globalLimit = globalLimit;
+}
+
+SystemAbstractions::DiagnosticsSender::UnsubscribeDelegate RateLimiter::SubscribeToDiagnostics(
+    SystemAbstractions::DiagnosticsSender::DiagnosticMessageDelegate delegate,
+    size_t minLevel
+) {
+    return impl_->diagnosticsSender.SubscribeToDiagnostics(delegate, minLevel);
+}
+
+int RateLimiter::Enqueue(
+    const std::string& method,
+    const std::string& uri,
+    ReleaseDelegate release
+) {
+    std::unique_lock< decltype(impl_->mutex) > lock(impl_->mutex);
+    if (impl_->timers == nullptr) {
+        lock.unlock();
+        release(0);
+        return 0;
+    }
+    const auto ticketId = impl_->nextTicket++;
+    auto& ticket = impl_->tickets[ticketId];
+    auto route = ParseRoute(method, uri);
+    const auto routeBucketsEntry = impl_->routeBuckets.find(route.key);
+    if (routeBucketsEntry == impl_->routeBuckets.end()) {
+        ticket.bucketKey = route.key;
+    } else {
+        ticket.bucketKey = routeBucketsEntry->second;
+    }
+    ticket.bucketKey += '|';
+    ticket.bucketKey += route.major;
+    ticket.routeKey = std::move(route.key);
+    ticket.major = std::move(route.major);
+    ticket.release = std::move(release);
+    const auto bucketKey = ticket.bucketKey;
+    impl_->buckets[bucketKey].queue.push_back(ticketId);
+    std::vector< std::function< void() > > releases;
+    impl_->Pump(bucketKey, releases);
+    lock.unlock();
+    for (const auto& releaseSample: releases) {
+        releaseSample();
+    }
+    return ticketId;
+}
+
+bool RateLimiter::Withdraw(int ticket) {
+    std::lock_guard< decltype(impl_->mutex) > lock(impl_->mutex);
+    const auto ticketsEntry = impl_->tickets.find(ticket);
+    if (
+        (ticketsEntry == impl_->tickets.end())
+        || ticketsEntry->second.released
+    ) {
+        return false;
+    }
+    const auto bucketKey = ticketsEntry->second.bucketKey;
+    (void)impl_->tickets.erase(ticketsEntry);
+    const auto bucketsEntry = impl_->buckets.find(bucketKey);
+    if (bucketsEntry != impl_->buckets.end()) {
+        auto& queue = bucketsEntry->second.queue;
+        for (auto it = queue.begin(); it != queue.end(); ++it) {
+            if (*it == ticket) {
+                (void)queue.erase(it);
+                break;
+            }
+        }
+        impl_->DiscardIfIdle(bucketKey);
+    }
+    return true;
+}
+
+void RateLimiter::Complete(
+    int ticket,
+    const Discord::Connections::Response* response
+) {
+    std::unique_lock< decltype(impl_->mutex) > lock(impl_->mutex);
+    const auto ticketsEntry = impl_->tickets.find(ticket);
+    if (ticketsEntry == impl_->tickets.end()) {
+        return;
+    }
+    const auto routeKey = std::move(ticketsEntry->second.routeKey);
+    const auto major = std::move(ticketsEntry->second.major);
+    auto bucketKey = std::move(ticketsEntry->second.bucketKey);
+    const auto released = ticketsEntry->second.released;
+    (void)impl_->tickets.erase(ticketsEntry);
+    auto bucketsEntry = impl_->buckets.find(bucketKey);
+    if (bucketsEntry == impl_->buckets.end()) {
+        return;
+    }
+    if (
+        released
+        && (bucketsEntry->second.inFlight > 0)
+    ) {
+        --bucketsEntry->second.inFlight;
+    }
+    if (response != nullptr) {
+        const auto now = impl_->clock->GetCurrentTime();
+        const auto rateLimitHeaders = ParseRateLimitHeaders(*response);
+
+        // If Discord told us which bucket the route actually uses,
+        // remember it, and fold any requests already sorted under
+        // a different bucket into that one.
+        if (!rateLimitHeaders.bucket.empty()) {
+            impl_->routeBuckets[routeKey] = rateLimitHeaders.bucket;
+            const auto actualBucketKey = rateLimitHeaders.bucket + "|" + major;
+            if (actualBucketKey != bucketKey) {
+                impl_->MergeBuckets(bucketKey, actualBucketKey);
+                (void)impl_->buckets[actualBucketKey];
+                bucketKey = actualBucketKey;
+            }
+            bucketsEntry = impl_->buckets.find(bucketKey);
+        }
+        auto& bucket = bucketsEntry->second;
+        if (response->status == 429) {
+            const auto retryAfter = (
+                (rateLimitHeaders.retryAfter >= 0.0)
+                ? rateLimitHeaders.retryAfter
+                : rateLimitHeaders.resetAfter
+            );
+            if (rateLimitHeaders.global) {
+                impl_->globalResetTime = now + retryAfter;
+                impl_->diagnosticsSender.SendDiagnosticInformationFormatted(
+                    SystemAbstractions::DiagnosticsSender::Levels::WARNING,
+                    "Global rate limit hit; holding all requests for %.3lf seconds",
+                    retryAfter
+                );
+            } else {
+                bucket.remaining = 0;
+                bucket.resetTime = now + retryAfter;
+                impl_->diagnosticsSender.SendDiagnosticInformationFormatted(
+                    SystemAbstractions::DiagnosticsSender::Levels::WARNING,
+                    "Rate limit hit for bucket %s",
+                    bucketKey.c_str()
+                );
+            }
+        } else if (rateLimitHeaders.remaining >= 0) {
+            // Within the window already known, other requests released
+            // since this one may not be counted in the response yet, so
+            // the count is only ever lowered.  It's taken from Discord
+            // as-is only once its reset time shows a new window started.
+            const auto resetTime = (
+                (rateLimitHeaders.resetAfter >= 0.0)
+                ? now + rateLimitHeaders.resetAfter
+                : bucket.resetTime
+            );
+            bucket.limit = rateLimitHeaders.limit;
+            if (
+                (bucket.remaining < 0)
+                || (resetTime >= bucket.resetTime + NEW_WINDOW_THRESHOLD)
+            ) {
+                bucket.remaining = rateLimitHeaders.remaining;
+                bucket.resetTime = resetTime;
+            } else {
+                bucket.remaining = std::min(bucket.remaining, rateLimitHeaders.remaining);
+            }
+        }
+    }
+    std::vector< std::function< void() > > releases;
+    impl_->Pump(bucketKey, releases);
+    impl_->DiscardIfIdle(bucketKey);
+    lock.unlock();
+    for (const auto& release: releases) {
+        release();
+    }
+}
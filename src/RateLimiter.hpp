@@ -0,0 +1,175 @@
+#pragma once
+
+/**
+ * @file RateLimiter.hpp
+ *
+ * This module declares the RateLimiter class.
+ *
+ * © 2020 by Richard Walters
+ */
+
+#include "Timers.hpp"
+
+#include <Discord/Connections.hpp>
+#include <functional>
+#include <memory>
+#include <string>
+#include <SystemAbstractions/DiagnosticsSender.hpp>
+#include <Timekeeping/Clock.hpp>
+
+/**
+ * This holds resource requests back until Discord's rate limits allow them
+ * to be sent.  Requests are sorted into buckets by route and major
+ * parameter, and each bucket releases requests only while it has requests
+ * remaining in its current window, as learned from the X-RateLimit-*
+ * headers of earlier responses.  A blocked bucket is pumped again by the
+ * timers at the moment it refills.
+ */
+class RateLimiter {
+    // Types
+public:
+    /**
+     * This is the type of function called when a request is allowed to
+     * be sent.
+     *
+     * @param[in] ticket
+     *     This identifies the request being released.
+     */
+    typedef std::function< void(int ticket) > ReleaseDelegate;
+
+    // Lifecycle Methods
+public:
+    ~RateLimiter() noexcept;
+    RateLimiter(const RateLimiter&) = delete;
+    RateLimiter(RateLimiter&&) noexcept = delete;
+    RateLimiter& operator=(const RateLimiter&) = delete;
+    RateLimiter& operator=(RateLimiter&&) noexcept = delete;
+
+    // Public Methods
+public:
+    /**
+     * This is the constructor of the class.
+     */
+    RateLimiter();
+
+    /**
+     * This function returns the route of the given request, which is its
+     * method and path, with every identifier except the major parameter
+     * replaced by a placeholder, such as "GET /channels/:major/messages".
+     * Requests on the same route share rate limits, and the number of
+     * routes is small enough to label metrics with.
+     *
+     * @param[in] method
+     *     This is the HTTP method of the request.
+     *
+     * @param[in] uri
+     *     This is the URI of the resource requested.
+     *
+     * @return
+     *     The route of the request is returned.
+     */
+    static std::string GetRoute(
+        const std::string& method,
+        const std::string& uri
+    );
+
+    /**
+     * This method sets up the rate limiter to use the given timers to
+     * release requests held back by buckets, and the given clock to
+     * know when buckets refill.  Until this is done, every request is
+     * released immediately.
+     *
+     * @param[in] timers
+     *     These are the timers to use to release held-back requests.
+     *
+     * @param[in] clock
+     *     This is the clock to use to track rate limit windows.
+     */
+    void Configure(
+        const std::shared_ptr< Timers >& timers,
+        const std::shared_ptr< Timekeeping::Clock >& clock
+    );
+
+    /**
+     * This method sets the maximum number of requests which may be
+     * released in any one-second window, across all buckets.
+     *
+     * @param[in] globalLimit
+     *     This is the maximum number of requests per second to release.
+     */
+    void SetGlobalLimit(size_t globalLimit);
+
+    SystemAbstractions::DiagnosticsSender::UnsubscribeDelegate SubscribeToDiagnostics(
+        SystemAbstractions::DiagnosticsSender::DiagnosticMessageDelegate delegate,
+        size_t minLevel = 0
+    );
+
+    /**
+     * This method queues a request to be released once its bucket allows.
+     * The release delegate may be called before this method returns.
+     *
+     * @param[in] method
+     *     This is the HTTP method of the request.
+     *
+     * @param[in] uri
+     *     This is the URI of the resource requested.
+     *
+     * @param[in] release
+     *     This is the function to call when the request may be sent.
+     *
+     * @return
+     *     A ticket is returned which identifies the request in later
+     *     calls to Withdraw or Complete.  Zero is returned if the rate
+     *     limiter isn't configured, in which case the request is released
+     *     right away, and there's no need to call Withdraw or Complete.
+     */
+    int Enqueue(
+        const std::string& method,
+        const std::string& uri,
+        ReleaseDelegate release
+    );
+
+    /**
+     * This method removes a request which hasn't yet been released.
+     * Requests already released must be finished with Complete instead.
+     *
+     * @param[in] ticket
+     *     This identifies the request to withdraw.
+     *
+     * @return
+     *     An indication of whether or not the request was still waiting
+     *     to be released is returned.
+     */
+    bool Withdraw(int ticket);
+
+    /**
+     * This method is called once a released request is finished, to update
+     * its bucket from the rate limit headers in the response, and release
+     * any requests that may now be sent.
+     *
+     * @param[in] ticket
+     *     This identifies the request which finished.
+     *
+     * @param[in] response
+     *     This is the response to the request, or nullptr if the request
+     *     was abandoned without a response.
+     */
+    void Complete(
+        int ticket,
+        const Discord::Connections::Response* response
+    );
+
+    // Private properties
+private:
+    /**
+     * This is the type of structure that contains the private
+     * properties of the instance.  It is defined in the implementation
+     * and declared here to ensure that it is scoped inside the class.
+     */
+    struct Impl;
+
+    /**
+     * This contains the private properties of the instance.
+     */
+    std::shared_ptr< Impl > impl_;
+};
@@ -0,0 +1,488 @@
+/**
+ * @file ResponseCache.cpp
+ *
+ * This module contains the implementation of the ResponseCache class.
+ *
+ * © 2020 by Richard Walters
+ */
+
+#include "GatewayPayload.hpp"
+#include "ResponseCache.hpp"
+
+#include <iterator>
+#include <list>
+#include <mutex>
+#include <stdlib.h>
+#include <StringExtensions/StringExtensions.hpp>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+
+    /**
+     * This is the most resources for which the generation of their last
+     * invalidation is remembered.  Beyond that, they're all forgotten at
+     * once, and the responses to every request sent before then are
+     * treated as predating a change.
+     */
+    constexpr size_t MAX_INVALIDATED_RESOURCES = 4096;
+
+    /**
+     * This holds what the headers of a response say about how it may
+     * be kept.
+     */
+    struct CachePolicy {
+        /**
+         * This indicates whether or not the response may be kept at all.
+         */
+        bool store = true;
+
+        /**
+         * This is the number of seconds the response may be used without
+         * being revalidated, or a negative number if not given.
+         */
+        double maxAge = -1.0;
+
+        /**
+         * This is the entity tag of the response, if any.
+         */
+        std::string entityTag;
+    };
+
+    /**
+     * This function extracts the caching information from the headers
+     * of the given response.
+     *
+     * @param[in] response
+     *     This is the response from which to extract information.
+     *
+     * @return
+     *     The caching information found in the response is returned.
+     */
+    CachePolicy ParseCachePolicy(const Discord::Connections::Response& response) {
+        CachePolicy policy;
+        for (const auto& header: response.headers) {
+            const auto key = StringExtensions::ToLower(header.key);
+            if (key == "etag") {
+                policy.entityTag = header.value;
+            } else if (key == "cache-control") {
+                for (const auto& directive: StringExtensions::Split(header.value, ',')) {
+                    const auto name = StringExtensions::ToLower(
+                        StringExtensions::Trim(directive)
+                    );
+                    if (name == "no-store") {
+                        policy.store = false;
+                    } else if (name == "no-cache") {
+                        policy.maxAge = 0.0;
+                    } else if (name.compare(0, 8, "max-age=") == 0) {
+                        policy.maxAge = strtod(name.c_str() + 8, NULL);
+                    }
+                }
+            }
+        }
+        return policy;
+    }
+
+    /**
+     * This function returns the path of the resource in the given URI,
+     * without the API prefix, version, or query.  For example,
+     * "https://discord.com/api/v6/channels/1234?x=y" becomes
+     * "/channels/1234".
+     *
+     * @param[in] uri
+     *     This is the URI of the resource.
+     *
+     * @return
+     *     The path of the resource is returned.
+     */
+    std::string GetResourcePath(const std::string& uri) {
+        size_t pathStart = 0;
+        const auto schemeEnd = uri.find("://");
+        if (schemeEnd != std::string::npos) {
+            pathStart = uri.find('/', schemeEnd + 3);
+            if (pathStart == std::string::npos) {
+                return "/";
+            }
+        }
+        auto path = uri.substr(pathStart, uri.find_first_of("?#", pathStart) - pathStart);
+        if (path.compare(0, 5, "/api/") == 0) {
+            path = path.substr(4);
+        }
+        if (
+            (path.length() > 2)
+            && (path[1] == 'v')
+            && (path[2] >= '0')
+            && (path[2] <= '9')
+        ) {
+            const auto versionEnd = path.find('/', 2);
+            path = (
+                (versionEnd == std::string::npos)
+                ? "/"
+                : path.substr(versionEnd)
+            );
+        }
+        return path;
+    }
+
+}
+
+/**
+ * This contains the private properties of a ResponseCache class instance.
+ */
+struct ResponseCache::Impl {
+    // Types
+
+    /**
+     * This holds one response kept by the cache.
+     */
+    struct Entry {
+        /**
+         * This is the key of the request.
+         */
+        std::string key;
+
+        /**
+         * This is the path of the resource, as given to Invalidate.
+         */
+        std::string resource;
+
+        /**
+         * This is the response kept.
+         */
+        Discord::Connections::Response response;
+
+        /**
+         * This is the entity tag of the response, if any.
+         */
+        std::string entityTag;
+
+        /**
+         * This is the time after which the response must be revalidated.
+         */
+        double expiration = 0.0;
+    };
+
+    /**
+     * This is the type of list which holds the responses, with the most
+     * recently used first.
+     */
+    typedef std::list< Entry > Entries;
+
+    // Properties
+
+    /**
+     * This holds the configurable parameters of the cache.
+     */
+    Configuration configuration;
+
+    /**
+     * These are the responses kept, with the most recently used first.
+     */
+    Entries entries;
+
+    /**
+     * This indexes the responses kept by request key.
+     */
+    std::unordered_map< std::string, Entries::iterator > entriesByKey;
+
+    /**
+     * This indexes the responses kept by resource.
+     */
+    std::unordered_multimap< std::string, Entries::iterator > entriesByResource;
+
+    /**
+     * This is incremented each time a resource is reported as changed.
+     */
+    uint64_t generation = 0;
+
+    /**
+     * This holds, for each resource reported as changed, the generation
+     * at which it last was, so that only responses for that resource are
+     * refused if their requests were sent before the change.
+     */
+    std::unordered_map< std::string, uint64_t > invalidatedResources;
+
+    /**
+     * Responses to requests sent before this generation are refused,
+     * whatever their resource, since invalidatedResources was cleared
+     * when it reached this generation.
+     */
+    uint64_t oldestRememberedGeneration = 0;
+
+    /**
+     * This is used to synchronize access to the object.
+     */
+    std::mutex mutex;
+
+    // Methods
+
+    /**
+     * This method returns the time after which a response with the
+     * given caching information must be revalidated.
+     *
+     * @param[in] policy
+     *     This is the caching information of the response.
+     *
+     * @param[in] now
+     *     This is the current time, in seconds.
+     *
+     * @return
+     *     The expiration time of the response is returned.
+     */
+    double GetExpiration(
+        const CachePolicy& policy,
+        double now
+    ) const {
+        return now + (
+            (policy.maxAge >= 0.0)
+            ? policy.maxAge
+            : configuration.defaultMaxAge
+        );
+    }
+
+    /**
+     * This method drops the given response.
+     *
+     * @note
+     *     The mutex must be held while calling this method.
+     *
+     * @param[in] entry
+     *     This refers to the response to drop.
+     */
+    void Erase(Entries::iterator entry) {
+        const auto range = entriesByResource.equal_range(entry->resource);
+        for (auto byResource = range.first; byResource != range.second; ++byResource) {
+            if (byResource->second == entry) {
+                (void)entriesByResource.erase(byResource);
+                break;
+            }
+        }
+        (void)entriesByKey.erase(entry->key);
+        (void)entries.erase(entry);
+    }
+
+    /**
+     * This method drops the least recently used responses until no more
+     * than the configured number are kept.
+     *
+     * @note
+     *     The mutex must be held while calling this method.
+     */
+    void Trim() {
+        while (entries.size() > configuration.capacity) {
+            Erase(std::prev(entries.end()));
+        }
+    }
+};
+
+ResponseCache::~ResponseCache() noexcept = default;
+
+ResponseCache::ResponseCache()
+    : impl_(new Impl())
+{
+}
+
+void ResponseCache::Configure(const Configuration& configuration) {
+    std::lock_guard< decltype(impl_->mutex) > lock(impl_->mutex);
+    impl_->configuration = configuration;
+    impl_->Trim();
+}
+
+bool ResponseCache::IsEnabled() {
+    std::lock_guard< decltype(impl_->mutex) > lock(impl_->mutex);
+    return (impl_->configuration.capacity > 0);
+}
+
+std::string ResponseCache::MakeKey(const Discord::Connections::ResourceRequest& request) {
+    auto key = request.uri;
+    for (const auto& header: request.headers) {
+        key += '\n';
+        key += StringExtensions::ToLower(header.key);
+        key += ':';
+        key += header.value;
+    }
+    return key;
+}
+
+uint64_t ResponseCache::GetGeneration() {
+    std::lock_guard< decltype(impl_->mutex) > lock(impl_->mutex);
+    return impl_->generation;
+}
+
+auto ResponseCache::Find(
+    const std::string& key,
+    double now,
+    Discord::Connections::Response& response,
+    std::string& entityTag
+) -> Lookup {
+    std::lock_guard< decltype(impl_->mutex) > lock(impl_->mutex);
+    const auto byKey = impl_->entriesByKey.find(key);
+    if (byKey == impl_->entriesByKey.end()) {
+        return Lookup::Miss;
+    }
+    const auto entry = byKey->second;
+    if (now >= entry->expiration) {
+        if (entry->entityTag.empty()) {
+            impl_->Erase(entry);
+            return Lookup::Miss;
+        }
+        impl_->entries.splice(impl_->entries.begin(), impl_->entries, entry);
+        response = entry->response;
+        entityTag = entry->entityTag;
+        return Lookup::Stale;
+    }
+    impl_->entries.splice(impl_->entries.begin(), impl_->entries, entry);
+    response = entry->response;
+    return Lookup::Fresh;
+}
+
+void ResponseCache::Store(
+    const std::string& key,
+    const Discord::Connections::Response& response,
+    double now,
+    uint64_t generation
+) {
+    if (response.status != 200) {
+        return;
+    }
+    const auto policy = ParseCachePolicy(response);
+    const auto resource = GetResourcePath(key.substr(0, key.find('\n')));
+    std::lock_guard< decltype(impl_->mutex) > lock(impl_->mutex);
+    const auto expiration = impl_->GetExpiration(policy, now);
+    const auto invalidatedResource = impl_->invalidatedResources.find(resource);
+    if (
+        (impl_->configuration.capacity == 0)
+        || (generation < impl_->oldestRememberedGeneration)
+        || (
+            (invalidatedResource != impl_->invalidatedResources.end())
+            && (invalidatedResource->second > generation)
+        )
+        || !policy.store
+        || (
+            (expiration <= now)
+            && policy.entityTag.empty()
+        )
+    ) {
+        return;
+    }
+    const auto byKey = impl_->entriesByKey.find(key);
+    if (byKey != impl_->entriesByKey.end()) {
+        impl_->Erase(byKey->second);
+    }
+    Impl::Entry entry;
+    entry.key = key;
+    entry.resource = resource;
+    entry.response = response;
+    entry.entityTag = policy.entityTag;
+    entry.expiration = expiration;
+    impl_->entries.push_front(std::move(entry));
+    const auto newEntry = impl_->entries.begin();
+    impl_->entriesByKey[key] = newEntry;
+    (void)impl_->entriesByResource.insert({newEntry->resource, newEntry});
+    impl_->Trim();
+}
+
+void ResponseCache::Refresh(
+    const std::string& key,
+    const Discord::Connections::Response& notModified,
+    double now
+) {
+    const auto policy = ParseCachePolicy(notModified);
+    std::lock_guard< decltype(impl_->mutex) > lock(impl_->mutex);
+    const auto byKey = impl_->entriesByKey.find(key);
+    if (byKey == impl_->entriesByKey.end()) {
+        return;
+    }
+    const auto entry = byKey->second;
+    if (!policy.store) {
+        impl_->Erase(entry);
+        return;
+    }
+    entry->expiration = impl_->GetExpiration(policy, now);
+    if (!policy.entityTag.empty()) {
+        entry->entityTag = policy.entityTag;
+    }
+}
+
+void ResponseCache::Invalidate(const std::string& resource) {
+    std::lock_guard< decltype(impl_->mutex) > lock(impl_->mutex);
+    ++impl_->generation;
+    if (impl_->invalidatedResources.size() >= MAX_INVALIDATED_RESOURCES) {
+        impl_->invalidatedResources.clear();
+        impl_->oldestRememberedGeneration = impl_->generation;
+    }
+    impl_->invalidatedResources[resource] = impl_->generation;
+    auto range = impl_->entriesByResource.equal_range(resource);
+    while (range.first != range.second) {
+        impl_->Erase((range.first++)->second);
+    }
+}
+
+void ResponseCache::InvalidateFromEvent(const std::string& payload) {
+    GatewayPayload::Header header;
+    std::string eventName;
+    if (
+        !GatewayPayload::ScanHeader(payload, header)
+        || (header.opcode != GatewayPayload::OPCODE_DISPATCH)
+        || !GatewayPayload::GetEventName(payload, header, eventName)
+    ) {
+        return;
+    }
+
+    // Identifiers of nested objects can't be told apart from the one of
+    // the object changed, so every resource they might name is dropped.
+    std::vector< uint64_t > guildIds;
+    std::vector< uint64_t > ids;
+    if (
+        (eventName == "CHANNEL_UPDATE")
+        || (eventName == "CHANNEL_DELETE")
+    ) {
+        GatewayPayload::GetSnowflakes(payload, "\"id\"", ids);
+        for (const auto id: ids) {
+            Invalidate("/channels/" + std::to_string(id));
+        }
+        GatewayPayload::GetSnowflakes(payload, "\"guild_id\"", guildIds);
+        for (const auto guildId: guildIds) {
+            Invalidate("/guilds/" + std::to_string(guildId) + "/channels");
+        }
+    } else if (
+        (eventName == "GUILD_UPDATE")
+        || (eventName == "GUILD_DELETE")
+    ) {
+        GatewayPayload::GetSnowflakes(payload, "\"id\"", ids);
+        for (const auto id: ids) {
+            Invalidate("/guilds/" + std::to_string(id));
+            Invalidate("/guilds/" + std::to_string(id) + "/roles");
+            Invalidate("/guilds/" + std::to_string(id) + "/channels");
+        }
+    } else if (
+        (eventName == "GUILD_ROLE_CREATE")
+        || (eventName == "GUILD_ROLE_UPDATE")
+        || (eventName == "GUILD_ROLE_DELETE")
+    ) {
+        GatewayPayload::GetSnowflakes(payload, "\"guild_id\"", guildIds);
+        for (const auto guildId: guildIds) {
+            Invalidate("/guilds/" + std::to_string(guildId));
+            Invalidate("/guilds/" + std::to_string(guildId) + "/roles");
+        }
+    } else if (
+        (eventName == "GUILD_MEMBER_UPDATE")
+        || (eventName == "GUILD_MEMBER_REMOVE")
+    ) {
+        GatewayPayload::GetSnowflakes(payload, "\"guild_id\"", guildIds);
+        GatewayPayload::GetSnowflakes(payload, "\"id\"", ids);
+        for (const auto guildId: guildIds) {
+            for (const auto id: ids) {
+                Invalidate(
+                    "/guilds/" + std::to_string(guildId)
+                    + "/members/" + std::to_string(id)
+                );
+            }
+        }
+    }
+}
+
+size_t ResponseCache::GetSize() {
+    std::lock_guard< decltype(impl_->mutex) > lock(impl_->mutex);
+    return impl_->entries.size();
+}
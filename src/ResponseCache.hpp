@@ -0,0 +1,232 @@
+#pragma once
+
+/**
+ * @file ResponseCache.hpp
+ *
+ * This module declares the ResponseCache class.
+ *
+ * © 2020 by Richard Walters
+ */
+
+#include <Discord/Connections.hpp>
+#include <memory>
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+
+/**
+ * This holds the responses to recent GET requests, so that requests for
+ * the same resource can be answered without going back to Discord.
+ * Responses are kept only while the Cache-Control header of the response
+ * allows it, and stale responses with an entity tag can be revalidated
+ * with a conditional request.  The least recently used response is
+ * dropped to make room once the cache is full.  Responses are also
+ * dropped when a gateway event reports a change to their resource.
+ */
+class ResponseCache {
+    // Types
+public:
+    /**
+     * This holds the configurable parameters of the cache.
+     */
+    struct Configuration {
+        /**
+         * This is the maximum number of responses to keep.  If zero,
+         * no responses are kept.
+         */
+        size_t capacity = 0;
+
+        /**
+         * This is the number of seconds to keep responses which don't
+         * say for how long they may be kept.  Such responses are still
+         * dropped by the gateway events reporting changes to them.
+         */
+        double defaultMaxAge = 0.0;
+    };
+
+    /**
+     * These are the possible outcomes of looking up a response.
+     */
+    enum class Lookup {
+        /**
+         * No response is kept for the request.
+         */
+        Miss,
+
+        /**
+         * A response is kept for the request, and may be used as it is.
+         */
+        Fresh,
+
+        /**
+         * A response is kept for the request, but it must be revalidated
+         * with its entity tag before it's used.
+         */
+        Stale,
+    };
+
+    // Lifecycle Methods
+public:
+    ~ResponseCache() noexcept;
+    ResponseCache(const ResponseCache&) = delete;
+    ResponseCache(ResponseCache&&) noexcept = delete;
+    ResponseCache& operator=(const ResponseCache&) = delete;
+    ResponseCache& operator=(ResponseCache&&) noexcept = delete;
+
+    // Public Methods
+public:
+    /**
+     * This is the constructor of the class.
+     */
+    ResponseCache();
+
+    /**
+     * This method changes the configuration of the cache, dropping
+     * responses if the new capacity is smaller.
+     *
+     * @param[in] configuration
+     *     This holds the configurable parameters of the cache.
+     */
+    void Configure(const Configuration& configuration);
+
+    /**
+     * This method indicates whether or not the cache keeps any responses.
+     *
+     * @return
+     *     An indication of whether or not the cache keeps any responses
+     *     is returned.
+     */
+    bool IsEnabled();
+
+    /**
+     * This method returns the key under which the response to the given
+     * request is kept.  Requests with the same key may share a response.
+     *
+     * @param[in] request
+     *     This is the request for which to make a key.
+     *
+     * @return
+     *     The key of the request is returned.
+     */
+    static std::string MakeKey(const Discord::Connections::ResourceRequest& request);
+
+    /**
+     * This method returns a number which changes each time a resource is
+     * reported as changed.  It's given back to Store, to avoid keeping
+     * responses which may predate a change to their resource.
+     *
+     * @return
+     *     The current invalidation generation is returned.
+     */
+    uint64_t GetGeneration();
+
+    /**
+     * This method looks up the response kept under the given key.
+     *
+     * @param[in] key
+     *     This is the key of the request.
+     *
+     * @param[in] now
+     *     This is the current time, in seconds.
+     *
+     * @param[out] response
+     *     This is where to store a copy of the response, if one is kept.
+     *
+     * @param[out] entityTag
+     *     This is where to store the entity tag of the response, if
+     *     it's stale.
+     *
+     * @return
+     *     The outcome of the lookup is returned.
+     */
+    Lookup Find(
+        const std::string& key,
+        double now,
+        Discord::Connections::Response& response,
+        std::string& entityTag
+    );
+
+    /**
+     * This method keeps the given response under the given key, if the
+     * response allows it.
+     *
+     * @param[in] key
+     *     This is the key of the request.
+     *
+     * @param[in] response
+     *     This is the response to keep.
+     *
+     * @param[in] now
+     *     This is the current time, in seconds.
+     *
+     * @param[in] generation
+     *     This is the invalidation generation obtained before the request
+     *     was sent.  The response isn't kept if its resource has been
+     *     reported as changed since then.
+     */
+    void Store(
+        const std::string& key,
+        const Discord::Connections::Response& response,
+        double now,
+        uint64_t generation
+    );
+
+    /**
+     * This method extends the life of the response kept under the given
+     * key, after Discord confirmed it's still current.
+     *
+     * @param[in] key
+     *     This is the key of the request.
+     *
+     * @param[in] notModified
+     *     This is the "304 Not Modified" response given by Discord.
+     *
+     * @param[in] now
+     *     This is the current time, in seconds.
+     */
+    void Refresh(
+        const std::string& key,
+        const Discord::Connections::Response& notModified,
+        double now
+    );
+
+    /**
+     * This method drops any responses kept for the given resource.
+     *
+     * @param[in] resource
+     *     This is the path of the resource, without the API version,
+     *     such as "/channels/1234".
+     */
+    void Invalidate(const std::string& resource);
+
+    /**
+     * This method drops any responses kept for resources reported as
+     * changed by the given JSON-encoded gateway payload.
+     *
+     * @param[in] payload
+     *     This is the JSON-encoded gateway payload received.
+     */
+    void InvalidateFromEvent(const std::string& payload);
+
+    /**
+     * This method returns the number of responses kept.
+     *
+     * @return
+     *     The number of responses kept is returned.
+     */
+    size_t GetSize();
+
+    // Private properties
+private:
+    /**
+     * This is the type of structure that contains the private
+     * properties of the instance.  It is defined in the implementation
+     * and declared here to ensure that it is scoped inside the class.
+     */
+    struct Impl;
+
+    /**
+     * This contains the private properties of the instance.
+     */
+    std::unique_ptr< Impl > impl_;
+};
@@ -0,0 +1,27 @@
+/**
+ * @file SchedulerTimers.cpp
+ *
+ * This module contains the implementation of the SchedulerTimers class.
+ *
+ * © 2020 by Richard Walters
+ */
+
+#include "SchedulerTimers.hpp"
+
+SchedulerTimers::~SchedulerTimers() noexcept = default;
+
+SchedulerTimers::SchedulerTimers(const std::shared_ptr< Timekeeping::Scheduler >& scheduler)
+    : scheduler_(scheduler)
+{
+}
+
+int SchedulerTimers::Schedule(
+    Callback callback,
+    double due
+) {
+    return scheduler_->Schedule(std::move(callback), due);
+}
+
+void SchedulerTimers::Cancel(int token) {
+    scheduler_->Cancel(token);
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+/**
+ * @file SchedulerTimers.hpp
+ *
+ * This module declares the SchedulerTimers class.
+ *
+ * © 2020 by Richard Walters
+ */
+
+#include "Timers.hpp"
+
+#include <memory>
+#include <Timekeeping/Scheduler.hpp>
+
+/**
+ * This is the implementation of Timers which hands timers to
+ * a Timekeeping::Scheduler.
+ */
+class SchedulerTimers
+    : public Timers
+{
+    // Lifecycle Methods
+public:
+    ~SchedulerTimers() noexcept;
+    SchedulerTimers(const SchedulerTimers&) = delete;
+    SchedulerTimers(SchedulerTimers&&) noexcept = delete;
+    SchedulerTimers& operator=(const SchedulerTimers&) = delete;
+    SchedulerTimers& operator=(SchedulerTimers&&) noexcept = delete;
+
+    // Public Methods
+public:
+    /**
+     * This is the constructor of the class.
+     *
+     * @param[in] scheduler
+     *     This is the scheduler to which to hand timers.
+     */
+    explicit SchedulerTimers(const std::shared_ptr< Timekeeping::Scheduler >& scheduler);
+
+    // Timers
+public:
+    virtual int Schedule(
+        Callback callback,
+        double due
+    ) override;
+    virtual void Cancel(int token) override;
+
+    // Private properties
+private:
+    /**
+     * This is the scheduler to which to hand timers.
+     */
+    std::shared_ptr< Timekeeping::Scheduler > scheduler_;
+};
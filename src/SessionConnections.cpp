@@ -0,0 +1,654 @@
+/**
+ * @file SessionConnections.cpp
+ *
+ * This module contains the implementation of the SessionConnections class.
+ *
+ * © 2020 by Richard Walters
+ */
+
+#include "GatewayPayload.hpp"
+#include "SessionConnections.hpp"
+
+#include <chrono>
+#include <Discord/WebSocket.hpp>
+#include <future>
+#include <inttypes.h>
+#include <mutex>
+#include <stdint.h>
+#include <string>
+
+namespace {
+
+    /**
+     * This is the WebSocket close code used to give up on a connection
+     * while leaving its session resumable.  Discord invalidates the
+     * session if the connection is closed with 1000 or 1001.
+     */
+    constexpr unsigned int CLOSE_CODE_RESUMABLE = 4900;
+
+    /**
+     * This is the WebSocket close code used to close a replacement
+     * connection which went unused.
+     */
+    constexpr unsigned int CLOSE_CODE_NORMAL = 1000;
+
+    /**
+     * This is the maximum number of seconds a replacement connection is
+     * kept waiting for the gateway.  Discord closes connections which
+     * don't identify or send heartbeats for long.
+     */
+    constexpr double MAX_REPLACEMENT_AGE = 20.0;
+
+    /**
+     * This holds what's known about the gateway session, shared by
+     * every WebSocket made for it.
+     */
+    struct SessionState {
+        // Properties
+
+        std::shared_ptr< Timekeeping::Clock > clock;
+        std::shared_ptr< SystemAbstractions::DiagnosticsSender > diagnosticsSender;
+        SessionConnections::Configuration configuration;
+        SessionConnections::DegradedDelegate onDegraded;
+        std::mutex mutex;
+
+        /**
+         * This is the token given in the last IDENTIFY, as encoded
+         * in the payload.
+         */
+        std::string token;
+
+        /**
+         * This is the identifier of the session, given in READY, or empty
+         * if there's no session to resume.
+         */
+        std::string sessionId;
+
+        /**
+         * This is the highest sequence number received.
+         */
+        uint64_t sequence = 0;
+
+        /**
+         * This indicates whether or not any sequence number has been
+         * received in the session.
+         */
+        bool haveSequence = false;
+
+        /**
+         * This is the time the last heartbeat was sent, or a negative
+         * number if it's been acknowledged.
+         */
+        double heartbeatSent = -1.0;
+
+        /**
+         * This is the round trip time of the last heartbeat acknowledged,
+         * or a negative number if there hasn't been one.
+         */
+        double roundTrip = -1.0;
+
+        /**
+         * If metrics are kept, this is where to record the round trip
+         * time of each heartbeat acknowledged.
+         */
+        std::shared_ptr< Metrics::Histogram > roundTrips;
+
+        /**
+         * If metrics are kept, this counts the heartbeats which weren't
+         * acknowledged before the next one was sent.
+         */
+        std::shared_ptr< Metrics::Counter > missedAcks;
+
+        /**
+         * This indicates whether or not the current connection has
+         * already been reported as degraded.
+         */
+        bool degradedReported = false;
+
+        /**
+         * This refers to the WebSocket currently used by the gateway.
+         */
+        std::weak_ptr< Discord::WebSocket > current;
+
+        // Methods
+
+        /**
+         * This method is called with each IDENTIFY the gateway sends,
+         * to turn it into a RESUME if there's a session to resume.
+         *
+         * @param[in,out] message
+         *     This is the JSON-encoded IDENTIFY payload.
+         */
+        void OnIdentify(std::string& message) {
+            std::lock_guard< decltype(mutex) > lock(mutex);
+            (void)GatewayPayload::GetString(message, "\"token\"", token);
+            if (
+                !configuration.resume
+                || sessionId.empty()
+                || !haveSequence
+            ) {
+                return;
+            }
+            diagnosticsSender->SendDiagnosticInformationFormatted(
+                2,
+                "Resuming session %s at sequence %" PRIu64,
+                sessionId.c_str(),
+                sequence
+            );
+            message = (
+                "{\"op\":" + std::to_string(GatewayPayload::OPCODE_RESUME)
+                + ",\"d\":{\"token\":\"" + token
+                + "\",\"session_id\":\"" + sessionId
+                + "\",\"seq\":" + std::to_string(sequence)
+                + "}}"
+            );
+        }
+
+        /**
+         * This method is called with each heartbeat the gateway sends,
+         * to start timing it.  If the last one sent is still waiting to
+         * be acknowledged, the connection may be a zombie, so that's
+         * reported.
+         */
+        void OnHeartbeat() {
+            std::unique_lock< decltype(mutex) > lock(mutex);
+            const auto now = clock->GetCurrentTime();
+            const auto lastSent = heartbeatSent;
+            heartbeatSent = now;
+            if (lastSent < 0.0) {
+                return;
+            }
+            if (missedAcks != nullptr) {
+                missedAcks->Add();
+            }
+            lock.unlock();
+            diagnosticsSender->SendDiagnosticInformationFormatted(
+                SystemAbstractions::DiagnosticsSender::Levels::WARNING,
+                "Heartbeat sent %.3lf seconds ago was never acknowledged",
+                now - lastSent
+            );
+        }
+
+        /**
+         * This method records the given sequence number, if it's the
+         * highest received.  The mutex must be held.
+         *
+         * @param[in] newSequence
+         *     This is the sequence number received.
+         */
+        void RecordSequence(uint64_t newSequence) {
+            if (
+                !haveSequence
+                || (newSequence > sequence)
+            ) {
+                sequence = newSequence;
+                haveSequence = true;
+            }
+        }
+
+        /**
+         * This method is called with the sequence number of each dispatch
+         * dropped as soon as it's received, so that a resume doesn't ask
+         * for it to be replayed.
+         *
+         * @param[in] droppedSequence
+         *     This is the sequence number of the dispatch dropped.
+         */
+        void OnDropped(uint64_t droppedSequence) {
+            std::lock_guard< decltype(mutex) > lock(mutex);
+            RecordSequence(droppedSequence);
+        }
+
+        /**
+         * This method is called with each JSON-encoded payload received,
+         * to follow the session.
+         *
+         * @param[in] message
+         *     This is the JSON-encoded payload received.
+         */
+        void OnReceived(const std::string& message) {
+            GatewayPayload::Header header;
+            (void)GatewayPayload::ScanHeader(message, header);
+            std::unique_lock< decltype(mutex) > lock(mutex);
+            switch (header.opcode) {
+                case GatewayPayload::OPCODE_DISPATCH: {
+                    if (header.hasSequence) {
+                        RecordSequence(header.sequence);
+                    }
+                    if (GatewayPayload::IsEvent(message, header, "READY")) {
+                        (void)GatewayPayload::GetString(message, "\"session_id\"", sessionId);
+                        diagnosticsSender->SendDiagnosticInformationFormatted(
+                            2,
+                            "Session %s started",
+                            sessionId.c_str()
+                        );
+                    } else if (GatewayPayload::IsEvent(message, header, "RESUMED")) {
+                        diagnosticsSender->SendDiagnosticInformationFormatted(
+                            2,
+                            "Session %s resumed",
+                            sessionId.c_str()
+                        );
+                    }
+                } break;
+
+                case GatewayPayload::OPCODE_HEARTBEAT_ACK: {
+                    if (heartbeatSent < 0.0) {
+                        break;
+                    }
+                    roundTrip = clock->GetCurrentTime() - heartbeatSent;
+                    heartbeatSent = -1.0;
+                    if (roundTrips != nullptr) {
+                        roundTrips->Record(roundTrip);
+                    }
+                    if (
+                        (configuration.degradedRoundTrip > 0.0)
+                        && (roundTrip > configuration.degradedRoundTrip)
+                        && !degradedReported
+                    ) {
+                        degradedReported = true;
+                        diagnosticsSender->SendDiagnosticInformationFormatted(
+                            SystemAbstractions::DiagnosticsSender::Levels::WARNING,
+                            "Heartbeat round trip took %.3lf seconds",
+                            roundTrip
+                        );
+                        const auto onDegradedSample = onDegraded;
+                        lock.unlock();
+                        if (onDegradedSample != nullptr) {
+                            onDegradedSample();
+                        }
+                    }
+                } break;
+
+                case GatewayPayload::OPCODE_INVALID_SESSION: {
+                    const bool resumable = (
+                        (header.dataStart != std::string::npos)
+                        && (message.compare(header.dataStart, 4, "true") == 0)
+                    );
+                    if (!resumable) {
+                        sessionId.clear();
+                        haveSequence = false;
+                    }
+                    diagnosticsSender->SendDiagnosticInformationFormatted(
+                        SystemAbstractions::DiagnosticsSender::Levels::WARNING,
+                        "Session invalidated (%s)",
+                        (resumable ? "resumable" : "not resumable")
+                    );
+                    const auto currentSample = current.lock();
+                    lock.unlock();
+                    if (currentSample != nullptr) {
+                        currentSample->Close(CLOSE_CODE_RESUMABLE);
+                    }
+                } break;
+
+                case GatewayPayload::OPCODE_RECONNECT: {
+                    diagnosticsSender->SendDiagnosticInformationString(
+                        2,
+                        "Discord asked for a reconnect"
+                    );
+                    const auto currentSample = current.lock();
+                    lock.unlock();
+                    if (currentSample != nullptr) {
+                        currentSample->Close(CLOSE_CODE_RESUMABLE);
+                    }
+                } break;
+
+                default: break;
+            }
+        }
+    };
+
+    /**
+     * This wraps a WebSocket of a gateway connection in order to follow
+     * the session through the payloads sent and received over it.
+     * Only JSON-encoded payloads are followed.
+     */
+    class SessionWebSocket
+        : public Discord::WebSocket
+    {
+        // Lifecycle Methods
+    public:
+        SessionWebSocket(
+            std::shared_ptr< Discord::WebSocket >&& inner,
+            const std::shared_ptr< SessionState >& state
+        )
+            : inner_(std::move(inner))
+            , state_(state)
+        {
+        }
+
+        // Discord::WebSocket
+    public:
+        virtual void Binary(std::string&& message) override {
+            inner_->Binary(std::move(message));
+        }
+
+        virtual void Close(unsigned int code) override {
+            inner_->Close(code);
+        }
+
+        virtual void Text(std::string&& message) override {
+            switch (GatewayPayload::GetOpcode(message)) {
+                case GatewayPayload::OPCODE_IDENTIFY: {
+                    state_->OnIdentify(message);
+                } break;
+
+                case GatewayPayload::OPCODE_HEARTBEAT: {
+                    state_->OnHeartbeat();
+                } break;
+
+                default: break;
+            }
+            inner_->Text(std::move(message));
+        }
+
+        virtual void RegisterBinaryCallback(ReceiveCallback&& onBinary) override {
+            inner_->RegisterBinaryCallback(std::move(onBinary));
+        }
+
+        virtual void RegisterCloseCallback(CloseCallback&& onClose) override {
+            inner_->RegisterCloseCallback(std::move(onClose));
+        }
+
+        virtual void RegisterTextCallback(ReceiveCallback&& onText) override {
+            if (onText == nullptr) {
+                inner_->RegisterTextCallback(nullptr);
+                return;
+            }
+            const auto sharedOnText = std::make_shared< ReceiveCallback >(std::move(onText));
+            std::weak_ptr< SessionState > stateWeak(state_);
+            inner_->RegisterTextCallback(
+                [sharedOnText, stateWeak](std::string&& message){
+                    const auto state = stateWeak.lock();
+                    if (state != nullptr) {
+                        state->OnReceived(message);
+                    }
+                    (*sharedOnText)(std::move(message));
+                }
+            );
+        }
+
+        // Private properties
+    private:
+        std::shared_ptr< Discord::WebSocket > inner_;
+        std::shared_ptr< SessionState > state_;
+    };
+
+    /**
+     * This function wraps the given WebSocket in order to follow the
+     * given session through it, and makes it the session's current one.
+     *
+     * @param[in] webSocket
+     *     This is the WebSocket to wrap.
+     *
+     * @param[in] state
+     *     This holds what's known about the session.
+     *
+     * @return
+     *     The wrapped WebSocket is returned.
+     */
+    std::shared_ptr< Discord::WebSocket > Adopt(
+        std::shared_ptr< Discord::WebSocket >&& webSocket,
+        const std::shared_ptr< SessionState >& state
+    ) {
+        std::lock_guard< decltype(state->mutex) > lock(state->mutex);
+        state->current = webSocket;
+        state->degradedReported = false;
+        state->heartbeatSent = -1.0;
+        return std::make_shared< SessionWebSocket >(std::move(webSocket), state);
+    }
+
+    /**
+     * This function makes the function to give each WebSocket made for
+     * the given session, to pass it the sequence number of each dispatch
+     * dropped as soon as it's received.
+     *
+     * @param[in] stateWeak
+     *     This refers to what's known about the session.
+     *
+     * @return
+     *     The function to give each WebSocket made is returned.
+     */
+    ::Connections::DroppedSequenceObserver FollowDropped(
+        const std::weak_ptr< SessionState >& stateWeak
+    ) {
+        return [stateWeak](uint64_t sequence){
+            const auto state = stateWeak.lock();
+            if (state != nullptr) {
+                state->OnDropped(sequence);
+            }
+        };
+    }
+
+}
+
+/**
+ * This contains the private properties of a SessionConnections class
+ * instance.
+ */
+struct SessionConnections::Impl {
+    // Properties
+
+    /**
+     * This is the Connections instance used to make requests.
+     */
+    std::shared_ptr< ::Connections > connections;
+
+    /**
+     * If not empty, this is used to wrap each WebSocket made,
+     * before it's followed by the session.
+     */
+    ::Connections::WebSocketDecorator decorator;
+
+    /**
+     * This holds what's known about the gateway session.
+     */
+    std::shared_ptr< SessionState > state = std::make_shared< SessionState >();
+
+    /**
+     * This is used to publish diagnostic messages.
+     */
+    std::shared_ptr< SystemAbstractions::DiagnosticsSender > diagnosticsSender = (
+        std::make_shared< SystemAbstractions::DiagnosticsSender >("Session")
+    );
+
+    /**
+     * This is used to synchronize access to the object.
+     */
+    std::mutex mutex;
+
+    /**
+     * This is the last WebSocket connection request made by the gateway.
+     */
+    WebSocketRequest lastRequest;
+
+    /**
+     * This is the WebSocket opened ahead of time to replace the
+     * current one, if any.
+     */
+    std::shared_ptr< Discord::WebSocket > replacement;
+
+    /**
+     * This is the URI to which the replacement WebSocket is connected.
+     */
+    std::string replacementUri;
+
+    /**
+     * This is the time the replacement WebSocket was opened.
+     */
+    double replacementTime = 0.0;
+};
+
+SessionConnections::~SessionConnections() noexcept {
+    if (impl_->replacement != nullptr) {
+        impl_->replacement->Close(CLOSE_CODE_NORMAL);
+    }
+}
+
+SessionConnections::SessionConnections()
+    : impl_(new Impl())
+{
+    impl_->state->diagnosticsSender = impl_->diagnosticsSender;
+}
+
+void SessionConnections::Configure(
+    const std::shared_ptr< ::Connections >& connections,
+    ::Connections::WebSocketDecorator decorator,
+    const std::shared_ptr< Timekeeping::Clock >& clock,
+    const Configuration& configuration
+) {
+    impl_->connections = connections;
+    impl_->decorator = decorator;
+    std::lock_guard< decltype(impl_->state->mutex) > lock(impl_->state->mutex);
+    impl_->state->clock = clock;
+    impl_->state->configuration = configuration;
+    if (configuration.metrics == nullptr) {
+        impl_->state->roundTrips = nullptr;
+        impl_->state->missedAcks = nullptr;
+    } else {
+        impl_->state->roundTrips = configuration.metrics->GetHistogram(
+            "discordplay_gateway_heartbeat_round_trip_seconds",
+            "Time from sending each heartbeat to its acknowledgement"
+        );
+        impl_->state->missedAcks = configuration.metrics->GetCounter(
+            "discordplay_gateway_heartbeats_unacknowledged_total",
+            "Heartbeats not acknowledged before the next one was sent"
+        );
+    }
+}
+
+void SessionConnections::RegisterDegradedCallback(DegradedDelegate onDegraded) {
+    std::lock_guard< decltype(impl_->state->mutex) > lock(impl_->state->mutex);
+    impl_->state->onDegraded = onDegraded;
+}
+
+SystemAbstractions::DiagnosticsSender::UnsubscribeDelegate SessionConnections::SubscribeToDiagnostics(
+    SystemAbstractions::DiagnosticsSender::DiagnosticMessageDelegate delegate,
+    size_t minLevel
+) {
+    return impl_->diagnosticsSender->SubscribeToDiagnostics(delegate, minLevel);
+}
+
+bool SessionConnections::Prewarm(double timeout) {
+    std::unique_lock< decltype(impl_->mutex) > lock(impl_->mutex);
+    if (impl_->replacement != nullptr) {
+        return true;
+    }
+    if (impl_->lastRequest.uri.empty()) {
+        return false;
+    }
+    const auto request = impl_->lastRequest;
+    lock.unlock();
+    impl_->diagnosticsSender->SendDiagnosticInformationString(
+        2,
+        "Opening replacement connection"
+    );
+    auto transaction = impl_->connections->QueueWebSocketRequest(
+        request,
+        impl_->decorator,
+        FollowDropped(impl_->state)
+    );
+    if (
+        transaction.webSocket.wait_for(std::chrono::duration< double >(timeout))
+        != std::future_status::ready
+    ) {
+        transaction.cancel();
+    }
+    const auto webSocket = transaction.webSocket.get();
+    if (webSocket == nullptr) {
+        impl_->diagnosticsSender->SendDiagnosticInformationString(
+            SystemAbstractions::DiagnosticsSender::Levels::WARNING,
+            "Unable to open replacement connection"
+        );
+        return false;
+    }
+    const auto now = impl_->state->clock->GetCurrentTime();
+    lock.lock();
+    if (impl_->replacement != nullptr) {
+        lock.unlock();
+        webSocket->Close(CLOSE_CODE_NORMAL);
+        return true;
+    }
+    impl_->replacement = webSocket;
+    impl_->replacementUri = request.uri;
+    impl_->replacementTime = now;
+    return true;
+}
+
+bool SessionConnections::SwitchOver() {
+    std::unique_lock< decltype(impl_->mutex) > lock(impl_->mutex);
+    if (impl_->replacement == nullptr) {
+        return false;
+    }
+    lock.unlock();
+    std::unique_lock< decltype(impl_->state->mutex) > stateLock(impl_->state->mutex);
+    const auto current = impl_->state->current.lock();
+    stateLock.unlock();
+    if (current == nullptr) {
+        return false;
+    }
+    impl_->diagnosticsSender->SendDiagnosticInformationString(
+        2,
+        "Switching over to replacement connection"
+    );
+    current->Close(CLOSE_CODE_RESUMABLE);
+    return true;
+}
+
+double SessionConnections::GetRoundTrip() {
+    std::lock_guard< decltype(impl_->state->mutex) > lock(impl_->state->mutex);
+    return impl_->state->roundTrip;
+}
+
+auto SessionConnections::QueueResourceRequest(
+    const ResourceRequest& request
+) -> ResourceRequestTransaction {
+    return impl_->connections->QueueResourceRequest(request);
+}
+
+auto SessionConnections::QueueWebSocketRequest(
+    const WebSocketRequest& request
+) -> WebSocketRequestTransaction {
+    // Hand over the replacement WebSocket opened ahead of time, if there
+    // is one still fresh enough to use.
+    std::unique_lock< decltype(impl_->mutex) > lock(impl_->mutex);
+    impl_->lastRequest = request;
+    auto replacement = std::move(impl_->replacement);
+    impl_->replacement = nullptr;
+    const auto replacementUri = impl_->replacementUri;
+    const auto replacementTime = impl_->replacementTime;
+    lock.unlock();
+    if (replacement != nullptr) {
+        if (
+            (request.uri == replacementUri)
+            && (impl_->state->clock->GetCurrentTime() - replacementTime < MAX_REPLACEMENT_AGE)
+        ) {
+            WebSocketRequestTransaction transaction;
+            std::promise< std::shared_ptr< Discord::WebSocket > > webSocketPromise;
+            transaction.webSocket = webSocketPromise.get_future();
+            webSocketPromise.set_value(Adopt(std::move(replacement), impl_->state));
+            transaction.cancel = []{};
+            return transaction;
+        }
+        replacement->Close(CLOSE_CODE_NORMAL);
+    }
+
+    // Otherwise, make a new connection.
+    const auto decorator = impl_->decorator;
+    std::weak_ptr< SessionState > stateWeak(impl_->state);
+    return impl_->connections->QueueWebSocketRequest(
+        request,
+        [decorator, stateWeak](std::shared_ptr< Discord::WebSocket >&& webSocket)
+            -> std::shared_ptr< Discord::WebSocket >
+        {
+            if (decorator != nullptr) {
+                webSocket = decorator(std::move(webSocket));
+            }
+            const auto state = stateWeak.lock();
+            if (state == nullptr) {
+                return std::move(webSocket);
+            }
+            return Adopt(std::move(webSocket), state);
+        },
+        FollowDropped(stateWeak)
+    );
+}
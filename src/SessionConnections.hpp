@@ -0,0 +1,175 @@
+#pragma once
+
+/**
+ * @file SessionConnections.hpp
+ *
+ * This module declares the SessionConnections class.
+ *
+ * © 2020 by Richard Walters
+ */
+
+#include "Connections.hpp"
+#include "Metrics.hpp"
+
+#include <Discord/Connections.hpp>
+#include <functional>
+#include <memory>
+#include <SystemAbstractions/DiagnosticsSender.hpp>
+#include <Timekeeping/Clock.hpp>
+
+/**
+ * This is the implementation of Discord::Connections given to a gateway
+ * whose session should survive reconnecting.  It follows the session
+ * through the JSON-encoded payloads sent and received, remembering the
+ * session identifier from READY and the last sequence number received,
+ * so that when the gateway sends an IDENTIFY on a later connection, it's
+ * turned into a RESUME instead.  It also times heartbeats, reporting any
+ * not acknowledged before the next one is sent, and can open
+ * a replacement connection ahead of time, to hand to the gateway the next
+ * time it connects.
+ */
+class SessionConnections
+    : public Discord::Connections
+{
+    // Types
+public:
+    /**
+     * This holds the configurable parameters of the object.
+     */
+    struct Configuration {
+        /**
+         * This indicates whether or not to resume the session on later
+         * connections, rather than identify again.
+         */
+        bool resume = true;
+
+        /**
+         * If nonzero, this is the heartbeat round trip time, in seconds,
+         * beyond which the connection is considered to be degraded.
+         */
+        double degradedRoundTrip = 0.0;
+
+        /**
+         * If set, this is the registry in which to keep the round trip
+         * times of heartbeats, and count those never acknowledged.
+         */
+        std::shared_ptr< Metrics > metrics;
+    };
+
+    /**
+     * This is the type of function called when the round trip time of
+     * a heartbeat shows the connection is degraded.  It's called at most
+     * once per connection.
+     */
+    typedef std::function< void() > DegradedDelegate;
+
+    // Lifecycle Methods
+public:
+    ~SessionConnections() noexcept;
+    SessionConnections(const SessionConnections&) = delete;
+    SessionConnections(SessionConnections&&) noexcept = delete;
+    SessionConnections& operator=(const SessionConnections&) = delete;
+    SessionConnections& operator=(SessionConnections&&) noexcept = delete;
+
+    // Public Methods
+public:
+    /**
+     * This is the constructor of the class.
+     */
+    SessionConnections();
+
+    /**
+     * This method sets up the object.
+     *
+     * @param[in] connections
+     *     This is the Connections instance to use to make requests.
+     *
+     * @param[in] decorator
+     *     If not empty, this is used to wrap each WebSocket made,
+     *     before it's followed by the session.
+     *
+     * @param[in] clock
+     *     This is the clock used to time heartbeats.
+     *
+     * @param[in] configuration
+     *     This holds the configurable parameters of the object.
+     */
+    void Configure(
+        const std::shared_ptr< ::Connections >& connections,
+        ::Connections::WebSocketDecorator decorator,
+        const std::shared_ptr< Timekeeping::Clock >& clock,
+        const Configuration& configuration
+    );
+
+    /**
+     * This method sets the function to call when the round trip time
+     * of a heartbeat shows the connection is degraded.
+     *
+     * @param[in] onDegraded
+     *     This is the function to call when the connection is degraded.
+     */
+    void RegisterDegradedCallback(DegradedDelegate onDegraded);
+
+    SystemAbstractions::DiagnosticsSender::UnsubscribeDelegate SubscribeToDiagnostics(
+        SystemAbstractions::DiagnosticsSender::DiagnosticMessageDelegate delegate,
+        size_t minLevel = 0
+    );
+
+    /**
+     * This method opens a replacement for the current WebSocket, to be
+     * handed to the gateway the next time it connects.  It waits for the
+     * connection attempt to finish.
+     *
+     * @param[in] timeout
+     *     This is the maximum number of seconds to wait for the
+     *     replacement to connect.
+     *
+     * @return
+     *     An indication of whether or not a replacement is ready
+     *     is returned.
+     */
+    bool Prewarm(double timeout);
+
+    /**
+     * This method closes the current WebSocket, with a close code which
+     * leaves the session resumable, if a replacement is ready.
+     *
+     * @return
+     *     An indication of whether or not the current WebSocket was
+     *     closed is returned.
+     */
+    bool SwitchOver();
+
+    /**
+     * This method returns the round trip time of the last heartbeat
+     * acknowledged.
+     *
+     * @return
+     *     The round trip time of the last heartbeat, in seconds,
+     *     is returned, or a negative number if there hasn't been one.
+     */
+    double GetRoundTrip();
+
+    // Discord::Connections
+public:
+    virtual ResourceRequestTransaction QueueResourceRequest(
+        const ResourceRequest& request
+    ) override;
+    virtual WebSocketRequestTransaction QueueWebSocketRequest(
+        const WebSocketRequest& request
+    ) override;
+
+    // Private properties
+private:
+    /**
+     * This is the type of structure that contains the private
+     * properties of the instance.  It is defined in the implementation
+     * and declared here to ensure that it is scoped inside the class.
+     */
+    struct Impl;
+
+    /**
+     * This contains the private properties of the instance.
+     */
+    std::unique_ptr< Impl > impl_;
+};
@@ -0,0 +1,269 @@
+/**
+ * @file ShardConnections.cpp
+ *
+ * This module contains the implementation of the ShardConnections class.
+ *
+ * © 2020 by Richard Walters
+ */
+
+#include "GatewayPayload.hpp"
+#include "ShardConnections.hpp"
+
+#include <Discord/WebSocket.hpp>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace {
+
+    /**
+     * This function adds the "shard" field to the data object
+     * of the given JSON-encoded IDENTIFY payload.
+     *
+     * @param[in,out] payload
+     *     This is the JSON-encoded IDENTIFY payload to modify.
+     *
+     * @param[in] shardId
+     *     This is the identifier of the shard.
+     *
+     * @param[in] shardCount
+     *     This is the total number of shards used by the bot.
+     */
+    void AddShard(
+        std::string& payload,
+        size_t shardId,
+        size_t shardCount
+    ) {
+        size_t valueStart;
+        if (
+            !GatewayPayload::FindValue(payload, "\"d\"", valueStart)
+            || (payload[valueStart] != '{')
+        ) {
+            return;
+        }
+        const auto insertPosition = valueStart + 1;
+        const auto next = payload.find_first_not_of(" \t\r\n", insertPosition);
+        const bool empty = (
+            (next != std::string::npos)
+            && (payload[next] == '}')
+        );
+        payload.insert(
+            insertPosition,
+            (
+                "\"shard\":["
+                + std::to_string(shardId)
+                + ","
+                + std::to_string(shardCount)
+                + "]"
+                + (empty ? "" : ",")
+            )
+        );
+    }
+
+    /**
+     * This wraps the WebSocket of a shard's gateway connection in order
+     * to add the shard to the IDENTIFY and hold it back until the shard
+     * may identify.  While the IDENTIFY is held, heartbeats are still
+     * sent, but any other payloads are held behind it so that they go
+     * out in order.
+     */
+    class ShardWebSocket
+        : public Discord::WebSocket
+    {
+        // Lifecycle Methods
+    public:
+        ShardWebSocket(
+            std::shared_ptr< Discord::WebSocket >&& inner,
+            const std::shared_ptr< IdentifyGate >& identifyGate,
+            size_t shardId,
+            size_t shardCount
+        )
+            : state_(std::make_shared< State >())
+        {
+            state_->inner = std::move(inner);
+            state_->identifyGate = identifyGate;
+            state_->shardId = shardId;
+            state_->shardCount = shardCount;
+        }
+
+        // Discord::WebSocket
+    public:
+        virtual void Binary(std::string&& message) override {
+            state_->inner->Binary(std::move(message));
+        }
+
+        virtual void Close(unsigned int code) override {
+            state_->inner->Close(code);
+        }
+
+        virtual void Text(std::string&& message) override {
+            const auto opcode = GatewayPayload::GetOpcode(message);
+            std::unique_lock< decltype(state_->mutex) > lock(state_->mutex);
+            if (opcode == GatewayPayload::OPCODE_IDENTIFY) {
+                AddShard(message, state_->shardId, state_->shardCount);
+                state_->held.push_back(std::move(message));
+                if (state_->holding) {
+                    return;
+                }
+                state_->holding = true;
+                lock.unlock();
+                std::weak_ptr< State > stateWeak(state_);
+                state_->identifyGate->Request(
+                    state_->shardId,
+                    [stateWeak]{
+                        const auto state = stateWeak.lock();
+                        if (state == nullptr) {
+                            return;
+                        }
+                        state->Release();
+                    }
+                );
+                return;
+            }
+            if (
+                state_->holding
+                && (opcode != GatewayPayload::OPCODE_HEARTBEAT)
+            ) {
+                state_->held.push_back(std::move(message));
+                return;
+            }
+            lock.unlock();
+            state_->inner->Text(std::move(message));
+        }
+
+        virtual void RegisterBinaryCallback(ReceiveCallback&& onBinary) override {
+            state_->inner->RegisterBinaryCallback(std::move(onBinary));
+        }
+
+        virtual void RegisterCloseCallback(CloseCallback&& onClose) override {
+            state_->inner->RegisterCloseCallback(std::move(onClose));
+        }
+
+        virtual void RegisterTextCallback(ReceiveCallback&& onText) override {
+            state_->inner->RegisterTextCallback(std::move(onText));
+        }
+
+        // Private Types
+    private:
+        /**
+         * This holds the state of the wrapper, shared with the
+         * delegate given to the identify gate.
+         */
+        struct State {
+            // Properties
+
+            std::shared_ptr< Discord::WebSocket > inner;
+            std::shared_ptr< IdentifyGate > identifyGate;
+            size_t shardId = 0;
+            size_t shardCount = 1;
+            std::mutex mutex;
+            bool holding = false;
+            std::vector< std::string > held;
+
+            // Methods
+
+            /**
+             * This method sends the held IDENTIFY, along with any payloads
+             * held behind it, and stops holding payloads.
+             */
+            void Release() {
+                std::unique_lock< decltype(mutex) > lock(mutex);
+                while (!held.empty()) {
+                    decltype(held) heldSample;
+                    heldSample.swap(held);
+                    lock.unlock();
+                    for (auto& message: heldSample) {
+                        inner->Text(std::move(message));
+                    }
+                    lock.lock();
+                }
+                holding = false;
+            }
+        };
+
+        // Private properties
+    private:
+        std::shared_ptr< State > state_;
+    };
+
+}
+
+/**
+ * This contains the private properties of a ShardConnections class instance.
+ */
+struct ShardConnections::Impl {
+    /**
+     * This is the Connections instance shared by all the shards.
+     */
+    std::shared_ptr< ::Connections > connections;
+
+    /**
+     * This is used to hold back the shard's IDENTIFY until Discord's
+     * session start concurrency limit allows it.
+     */
+    std::shared_ptr< IdentifyGate > identifyGate;
+
+    /**
+     * This is the identifier of the shard.
+     */
+    size_t shardId = 0;
+
+    /**
+     * This is the total number of shards used by the bot.
+     */
+    size_t shardCount = 1;
+};
+
+ShardConnections::~ShardConnections() noexcept = default;
+
+ShardConnections::ShardConnections()
+    : impl_(new Impl())
+{
+}
+
+void ShardConnections::Configure(
+    const std::shared_ptr< ::Connections >& connections,
+    const std::shared_ptr< IdentifyGate >& identifyGate,
+    size_t shardId,
+    size_t shardCount
+) {
+    impl_->connections = connections;
+    impl_->identifyGate = identifyGate;
+    impl_->shardId = shardId;
+    impl_->shardCount = shardCount;
+}
+
+auto ShardConnections::QueueResourceRequest(
+    const ResourceRequest& request
+) -> ResourceRequestTransaction {
+    return impl_->connections->QueueResourceRequest(request);
+}
+
+::Connections::WebSocketDecorator ShardConnections::GetWebSocketDecorator() const {
+    const auto identifyGate = impl_->identifyGate;
+    const auto shardId = impl_->shardId;
+    const auto shardCount = impl_->shardCount;
+    return [
+        identifyGate,
+        shardId,
+        shardCount
+    ](std::shared_ptr< Discord::WebSocket >&& webSocket)
+        -> std::shared_ptr< Discord::WebSocket >
+    {
+        return std::make_shared< ShardWebSocket >(
+            std::move(webSocket),
+            identifyGate,
+            shardId,
+            shardCount
+        );
+    };
+}
+
+auto ShardConnections::QueueWebSocketRequest(
+    const WebSocketRequest& request
+) -> WebSocketRequestTransaction {
+    return impl_->connections->QueueWebSocketRequest(
+        request,
+        GetWebSocketDecorator()
+    );
+}
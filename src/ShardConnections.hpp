@@ -0,0 +1,99 @@
+#pragma once
+
+/**
+ * @file ShardConnections.hpp
+ *
+ * This module declares the ShardConnections class.
+ *
+ * © 2020 by Richard Walters
+ */
+
+#include "Connections.hpp"
+#include "IdentifyGate.hpp"
+
+#include <Discord/Connections.hpp>
+#include <memory>
+#include <stddef.h>
+
+/**
+ * This is the implementation of Discord::Connections given to the gateway
+ * of each shard, when the program runs more than one shard.  It shares one
+ * Connections instance, with its HTTP client, connection pool and rate
+ * limiter, among all the shards.  It adds the shard's identifier to the
+ * IDENTIFY the gateway sends, and holds the IDENTIFY back until the
+ * shared IdentifyGate lets it go.
+ */
+class ShardConnections
+    : public Discord::Connections
+{
+    // Lifecycle Methods
+public:
+    ~ShardConnections() noexcept;
+    ShardConnections(const ShardConnections&) = delete;
+    ShardConnections(ShardConnections&&) noexcept = delete;
+    ShardConnections& operator=(const ShardConnections&) = delete;
+    ShardConnections& operator=(ShardConnections&&) noexcept = delete;
+
+    // Public Methods
+public:
+    /**
+     * This is the constructor of the class.
+     */
+    ShardConnections();
+
+    /**
+     * This method sets up the object.
+     *
+     * @param[in] connections
+     *     This is the Connections instance shared by all the shards.
+     *
+     * @param[in] identifyGate
+     *     This is used to hold back the shard's IDENTIFY until Discord's
+     *     session start concurrency limit allows it.
+     *
+     * @param[in] shardId
+     *     This is the identifier of the shard.
+     *
+     * @param[in] shardCount
+     *     This is the total number of shards used by the bot.
+     */
+    void Configure(
+        const std::shared_ptr< ::Connections >& connections,
+        const std::shared_ptr< IdentifyGate >& identifyGate,
+        size_t shardId,
+        size_t shardCount
+    );
+
+    /**
+     * This method returns the function used to wrap each WebSocket made
+     * for the shard's gateway connection, so that connections made for
+     * the shard in other ways can be wrapped the same way.
+     *
+     * @return
+     *     The function used to wrap the shard's WebSockets is returned.
+     */
+    ::Connections::WebSocketDecorator GetWebSocketDecorator() const;
+
+    // Discord::Connections
+public:
+    virtual ResourceRequestTransaction QueueResourceRequest(
+        const ResourceRequest& request
+    ) override;
+    virtual WebSocketRequestTransaction QueueWebSocketRequest(
+        const WebSocketRequest& request
+    ) override;
+
+    // Private properties
+private:
+    /**
+     * This is the type of structure that contains the private
+     * properties of the instance.  It is defined in the implementation
+     * and declared here to ensure that it is scoped inside the class.
+     */
+    struct Impl;
+
+    /**
+     * This contains the private properties of the instance.
+     */
+    std::unique_ptr< Impl > impl_;
+};
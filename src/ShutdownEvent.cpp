@@ -0,0 +1,120 @@
+/**
+ * @file ShutdownEvent.cpp
+ *
+ * This module contains the implementation of the ShutdownEvent class.
+ *
+ * © 2020 by Richard Walters
+ */
+
+#include "ShutdownEvent.hpp"
+
+#include <atomic>
+
+#ifdef _WIN32
+#include <condition_variable>
+#include <mutex>
+#else /* POSIX */
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#endif /* _WIN32 or POSIX */
+
+/**
+ * This contains the private properties of a ShutdownEvent class instance.
+ */
+struct ShutdownEvent::Impl {
+    /**
+     * This flag is set once the event is set.
+     */
+    std::atomic< bool > set{false};
+
+#ifdef _WIN32
+    /**
+     * This is used to synchronize waiting on the event.
+     */
+    std::mutex mutex;
+
+    /**
+     * This is used to wake threads waiting on the event.
+     */
+    std::condition_variable wakeCondition;
+#else /* POSIX */
+    /**
+     * These are the read and write ends of a pipe to which a byte is
+     * written when the event is set, so that waiting threads can block
+     * on the read end.
+     */
+    int pipeEnds[2] = {-1, -1};
+#endif /* _WIN32 or POSIX */
+};
+
+ShutdownEvent::~ShutdownEvent() noexcept {
+#ifndef _WIN32
+    for (auto pipeEnd: impl_->pipeEnds) {
+        if (pipeEnd >= 0) {
+            (void)close(pipeEnd);
+        }
+    }
+#endif /* _WIN32 */
+}
+
+ShutdownEvent::ShutdownEvent()
+    : impl_(new Impl())
+{
+#ifndef _WIN32
+    if (pipe(impl_->pipeEnds) == 0) {
+        for (auto pipeEnd: impl_->pipeEnds) {
+            (void)fcntl(pipeEnd, F_SETFD, FD_CLOEXEC);
+        }
+        (void)fcntl(impl_->pipeEnds[1], F_SETFL, O_NONBLOCK);
+    }
+#endif /* _WIN32 */
+}
+
+void ShutdownEvent::Set() {
+    if (impl_->set.exchange(true)) {
+        return;
+    }
+#ifdef _WIN32
+    std::lock_guard< decltype(impl_->mutex) > lock(impl_->mutex);
+    impl_->wakeCondition.notify_all();
+#else /* POSIX */
+    if (impl_->pipeEnds[1] >= 0) {
+        const char wake = 0;
+        (void)write(impl_->pipeEnds[1], &wake, 1);
+    }
+#endif /* _WIN32 or POSIX */
+}
+
+bool ShutdownEvent::IsSet() const {
+    return impl_->set.load();
+}
+
+void ShutdownEvent::Wait() {
+#ifdef _WIN32
+    std::unique_lock< decltype(impl_->mutex) > lock(impl_->mutex);
+    impl_->wakeCondition.wait(
+        lock,
+        [this]{ return impl_->set.load(); }
+    );
+#else /* POSIX */
+    // The byte written to the pipe is never read, so the read end stays
+    // readable once the event is set, and every waiter wakes.
+    while (!impl_->set.load()) {
+        if (impl_->pipeEnds[0] < 0) {
+            return;
+        }
+        struct pollfd readEnd;
+        readEnd.fd = impl_->pipeEnds[0];
+        readEnd.events = POLLIN;
+        readEnd.revents = 0;
+        if (
+            (poll(&readEnd, 1, -1) < 0)
+            && (errno != EINTR)
+        ) {
+            return;
+        }
+    }
+#endif /* _WIN32 or POSIX */
+}
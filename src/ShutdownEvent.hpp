@@ -0,0 +1,67 @@
+#pragma once
+
+/**
+ * @file ShutdownEvent.hpp
+ *
+ * This module declares the ShutdownEvent class.
+ *
+ * © 2020 by Richard Walters
+ */
+
+#include <memory>
+
+/**
+ * This is an event which, once set, stays set, and which a thread can
+ * wait on without polling.  It may be set from a signal handler.
+ */
+class ShutdownEvent {
+    // Lifecycle Methods
+public:
+    ~ShutdownEvent() noexcept;
+    ShutdownEvent(const ShutdownEvent&) = delete;
+    ShutdownEvent(ShutdownEvent&&) noexcept = delete;
+    ShutdownEvent& operator=(const ShutdownEvent&) = delete;
+    ShutdownEvent& operator=(ShutdownEvent&&) noexcept = delete;
+
+    // Public Methods
+public:
+    /**
+     * This is the constructor of the class.
+     */
+    ShutdownEvent();
+
+    /**
+     * This method sets the event, waking any thread waiting on it.
+     * On POSIX systems it only makes async-signal-safe calls, so it
+     * may be called from a signal handler.
+     */
+    void Set();
+
+    /**
+     * This method checks whether or not the event has been set.
+     *
+     * @return
+     *     An indication of whether or not the event has been set
+     *     is returned.
+     */
+    bool IsSet() const;
+
+    /**
+     * This method blocks the calling thread until the event is set.
+     */
+    void Wait();
+
+    // Private properties
+private:
+    /**
+     * This is the type of structure that contains the private
+     * properties of the instance.  It is defined in the implementation
+     * and declared here to ensure that it is scoped inside the class.
+     */
+    struct Impl;
+
+    /**
+     * This contains the private properties of the instance.
+     */
+    std::unique_ptr< Impl > impl_;
+};
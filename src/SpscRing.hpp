@@ -0,0 +1,159 @@
+#pragma once
+
+/**
+ * @file SpscRing.hpp
+ *
+ * This module declares and defines the SpscRing template.
+ *
+ * © 2020 by Richard Walters
+ */
+
+#include <atomic>
+#include <memory>
+#include <stddef.h>
+
+/**
+ * This is a bounded, lock-free queue with storage allocated up front,
+ * which is safe to use as long as only one thread pushes and only one
+ * thread pops at any given time.
+ *
+ * @tparam T
+ *     This is the type of element held in the queue.
+ */
+template< typename T > class SpscRing {
+    // Lifecycle Methods
+public:
+    ~SpscRing() noexcept = default;
+    SpscRing(const SpscRing&) = delete;
+    SpscRing(SpscRing&&) noexcept = delete;
+    SpscRing& operator=(const SpscRing&) = delete;
+    SpscRing& operator=(SpscRing&&) noexcept = delete;
+
+    // Public Methods
+public:
+    /**
+     * This is the constructor of the class.
+     *
+     * @param[in] capacity
+     *     This is the maximum number of elements the queue can hold.
+     *     It's rounded up to the next power of two.
+     */
+    explicit SpscRing(size_t capacity)
+        : mask_(RoundUpToPowerOfTwo(capacity) - 1)
+        , slots_(new T[mask_ + 1])
+    {
+    }
+
+    /**
+     * This method adds the given element to the back of the queue,
+     * if there is room for it.  Only one thread may push at a time.
+     *
+     * @param[in] element
+     *     This is the element to add.  It's left untouched if the
+     *     queue is full.
+     *
+     * @return
+     *     An indication of whether or not the element was added
+     *     is returned.
+     */
+    bool TryPush(T&& element) {
+        const auto tail = tail_.load(std::memory_order_relaxed);
+        if (tail - head_.load(std::memory_order_acquire) > mask_) {
+            return false;
+        }
+        slots_[tail & mask_] = std::move(element);
+        tail_.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * This method removes the element at the front of the queue,
+     * if there is one.  Only one thread may pop at a time.
+     *
+     * @param[out] element
+     *     This is where to put the element removed.
+     *
+     * @return
+     *     An indication of whether or not an element was removed
+     *     is returned.
+     */
+    bool TryPop(T& element) {
+        const auto head = head_.load(std::memory_order_relaxed);
+        if (head == tail_.load(std::memory_order_acquire)) {
+            return false;
+        }
+        element = std::move(slots_[head & mask_]);
+        slots_[head & mask_] = T();
+        head_.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * This method checks whether or not the queue is empty.  The answer
+     * is only reliable from the popping thread, or while pushing is
+     * known not to be happening.
+     *
+     * @return
+     *     An indication of whether or not the queue is empty is returned.
+     */
+    bool IsEmpty() const {
+        return (
+            head_.load(std::memory_order_acquire)
+            == tail_.load(std::memory_order_acquire)
+        );
+    }
+
+    // Private Methods
+private:
+    /**
+     * This function returns the smallest power of two which is
+     * at least the given value.
+     *
+     * @param[in] value
+     *     This is the value to round up.
+     *
+     * @return
+     *     The smallest power of two which is at least the given value
+     *     is returned.
+     */
+    static size_t RoundUpToPowerOfTwo(size_t value) {
+        size_t result = 1;
+        while (result < value) {
+            result <<= 1;
+        }
+        return result;
+    }
+
+    // Private properties
+private:
+    /**
+     * This is used to map the ever-increasing head and tail counters
+     * onto slot indexes.
+     */
+    const size_t mask_;
+
+    /**
+     * This holds the elements of the queue.
+     */
+    const std::unique_ptr< T[] > slots_;
+
+    /**
+     * This counts the elements which have been popped.  It's only
+     * written by the popping thread.
+     */
+    std::atomic< size_t > head_{0};
+
+    /**
+     * This keeps the two counters on separate cache lines, so that the
+     * pushing and popping threads don't contend over them.  Padding is
+     * used rather than alignas, since over-aligned types can't be
+     * allocated with operator new before C++17.
+     */
+    char padding_[64 - sizeof(std::atomic< size_t >)];
+
+    /**
+     * This counts the elements which have been pushed.  It's only
+     * written by the pushing thread.
+     */
+    std::atomic< size_t > tail_{0};
+};
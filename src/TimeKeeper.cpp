@@ -8,17 +8,72 @@
 
 #include "TimeKeeper.hpp"
 
-#include <SystemAbstractions/Time.hpp>
+#include <chrono>
+
+#ifdef __linux__
 #include <time.h>
+#endif /* __linux__ */
+
+namespace {
+
+    /**
+     * This function reads the given clock of the operating system.
+     * On Linux, both clocks used here are read through the vDSO,
+     * without a system call.
+     *
+     * @param[in] clockId
+     *     This identifies the clock to read.
+     *
+     * @return
+     *     The current value of the clock, in nanoseconds, is returned.
+     */
+#ifdef __linux__
+    uint64_t ReadClock(clockid_t clockId) {
+        struct timespec now;
+        (void)clock_gettime(clockId, &now);
+        return (
+            (uint64_t)now.tv_sec * 1000000000
+            + (uint64_t)now.tv_nsec
+        );
+    }
+#endif /* __linux__ */
+
+    /**
+     * This function returns the current value of the monotonic clock.
+     *
+     * @return
+     *     The current value of the monotonic clock, in nanoseconds,
+     *     is returned.
+     */
+    uint64_t ReadMonotonicClock() {
+#ifdef __linux__
+        return ReadClock(CLOCK_MONOTONIC);
+#else /* not __linux__ */
+        return (uint64_t)std::chrono::duration_cast< std::chrono::nanoseconds >(
+            std::chrono::steady_clock::now().time_since_epoch()
+        ).count();
+#endif /* __linux__ or not */
+    }
+
+}
 
 /**
  * This contains the private properties of a TimeKeeper class instance.
  */
 struct TimeKeeper::Impl {
     /**
-     * This is used to interface with the operating system's notion of time.
+     * This is the value of the monotonic clock, in nanoseconds, at the
+     * time the object was made.
      */
-    SystemAbstractions::Time time;
+    uint64_t monotonicBase = ReadMonotonicClock();
+
+    /**
+     * This is the wall-clock time, in seconds since the UNIX epoch,
+     * at the time the object was made.
+     */
+    double wallClockEpoch = std::chrono::duration< double >(
+        std::chrono::system_clock::now().time_since_epoch()
+    ).count();
 };
 
 TimeKeeper::~TimeKeeper() noexcept = default;
@@ -28,8 +83,25 @@ TimeKeeper::TimeKeeper()
 {
 }
 
+uint64_t TimeKeeper::GetMonotonicNanoseconds() const {
+    return ReadMonotonicClock();
+}
+
+uint64_t TimeKeeper::GetCoarseMonotonicNanoseconds() const {
+#if defined(__linux__) && defined(CLOCK_MONOTONIC_COARSE)
+    return ReadClock(CLOCK_MONOTONIC_COARSE);
+#else /* no coarse clock */
+    return ReadMonotonicClock();
+#endif /* coarse clock or not */
+}
+
+double TimeKeeper::GetWallClockEpoch() const {
+    return impl_->wallClockEpoch;
+}
+
 double TimeKeeper::GetCurrentTime() {
-    static const auto startTimeHighRes = impl_->time.GetTime();
-    static const auto startTimeReal = (double)time(NULL);
-    return startTimeReal + (impl_->time.GetTime() - startTimeHighRes);
+    return (
+        impl_->wallClockEpoch
+        + (double)(ReadMonotonicClock() - impl_->monotonicBase) / 1e9
+    );
 }
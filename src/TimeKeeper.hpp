@@ -11,10 +11,14 @@
 #include <Timekeeping/Clock.hpp>
 #include <Http/TimeKeeper.hpp>
 #include <memory>
+#include <stdint.h>
 
 /**
  * This is the implementation of Timekeeping::Clock and Http::TimeKeeper used
- * by the application.
+ * by the application.  Time is measured with the operating system's
+ * monotonic clock, which is read without a system call where the platform
+ * supports it, and converted to wall-clock time by adding the epoch
+ * captured, to sub-second precision, when the object is made.
  */
 class TimeKeeper
     : public Timekeeping::Clock
@@ -35,6 +39,39 @@ public:
      */
     TimeKeeper();
 
+    /**
+     * This method returns the current value of the monotonic clock,
+     * to nanosecond resolution.
+     *
+     * @return
+     *     The current value of the monotonic clock, in nanoseconds since
+     *     an arbitrary point in the past, is returned.
+     */
+    uint64_t GetMonotonicNanoseconds() const;
+
+    /**
+     * This method returns the current value of the monotonic clock, as
+     * cheaply as the platform allows, at the cost of resolution (on Linux,
+     * this is CLOCK_MONOTONIC_COARSE, which is only updated once per
+     * kernel tick).  It's on the same scale as GetMonotonicNanoseconds.
+     *
+     * @return
+     *     The current value of the monotonic clock, in nanoseconds since
+     *     an arbitrary point in the past, is returned.
+     */
+    uint64_t GetCoarseMonotonicNanoseconds() const;
+
+    /**
+     * This method returns the wall-clock time at which the object
+     * was made, which is added to the time measured by the monotonic
+     * clock to get the current time.
+     *
+     * @return
+     *     The wall-clock time at which the object was made, in seconds
+     *     since the UNIX epoch, is returned.
+     */
+    double GetWallClockEpoch() const;
+
     // Timekeeping::Clock
     // Http::TimeKeeper
 public:
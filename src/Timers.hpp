@@ -0,0 +1,59 @@
+#pragma once
+
+/**
+ * @file Timers.hpp
+ *
+ * This module declares the Timers interface.
+ *
+ * © 2020 by Richard Walters
+ */
+
+#include <functional>
+
+/**
+ * This is the interface to an object which calls functions at given times,
+ * used by the components of the application which need timers.  Times
+ * are on the scale of the clock given to the implementation.
+ */
+class Timers {
+    // Types
+public:
+    /**
+     * This is the type of function called when a timer fires.
+     */
+    typedef std::function< void() > Callback;
+
+    // Lifecycle Methods
+public:
+    virtual ~Timers() noexcept = default;
+
+    // Public Methods
+public:
+    /**
+     * This method sets up a timer to call the given function at the
+     * given time.
+     *
+     * @param[in] callback
+     *     This is the function to call when the timer fires.
+     *
+     * @param[in] due
+     *     This is the time at which the timer should fire.
+     *
+     * @return
+     *     A token which can be given to Cancel to cancel the timer
+     *     is returned.
+     */
+    virtual int Schedule(
+        Callback callback,
+        double due
+    ) = 0;
+
+    /**
+     * This method cancels the timer with the given token, if it
+     * hasn't already fired.
+     *
+     * @param[in] token
+     *     This is the token returned by Schedule for the timer.
+     */
+    virtual void Cancel(int token) = 0;
+};
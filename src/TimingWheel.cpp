@@ -0,0 +1,462 @@
+/**
+ * @file TimingWheel.cpp
+ *
+ * This module contains the implementation of the TimingWheel class.
+ *
+ * © 2020 by Richard Walters
+ */
+
+#include "TimingWheel.hpp"
+
+#include <chrono>
+#include <condition_variable>
+#include <math.h>
+#include <mutex>
+#include <stdint.h>
+#include <thread>
+#include <vector>
+
+namespace {
+
+    /**
+     * This is the number of bits of the tick count covered by each level
+     * of the wheel.
+     */
+    constexpr unsigned int SLOT_BITS = 8;
+
+    /**
+     * This is the number of slots in each level of the wheel.
+     */
+    constexpr size_t SLOTS = (size_t)1 << SLOT_BITS;
+
+    /**
+     * This is the number of levels of the wheel.  With 8 bits per level,
+     * four levels cover 2^32 ticks, which is over a year at 10 ms per tick.
+     * Timers due further out than that are parked in the top level,
+     * and placed again each time their slot comes around.
+     */
+    constexpr size_t LEVELS = 4;
+
+    /**
+     * This is the number of bits of a timer token used to hold
+     * the index of the timer.
+     */
+    constexpr unsigned int INDEX_BITS = 20;
+
+    /**
+     * This is the largest number of timers which may be pending at once.
+     */
+    constexpr size_t MAX_TIMERS = (size_t)1 << INDEX_BITS;
+
+    /**
+     * This selects the bits of a timer's generation which fit in a timer
+     * token, above the index, while keeping the token positive.
+     */
+    constexpr uint32_t GENERATION_MASK = ((uint32_t)1 << (31 - INDEX_BITS)) - 1;
+
+    /**
+     * This is used to mark the end of a list of timers.
+     */
+    constexpr uint32_t NONE = UINT32_MAX;
+
+    /**
+     * This holds a timer, as a node in the list of timers in one slot
+     * of the wheel.
+     */
+    struct Timer {
+        /**
+         * This is the function to call when the timer fires.
+         */
+        Timers::Callback callback;
+
+        /**
+         * This is the tick in which the timer is due.
+         */
+        uint64_t dueTick = 0;
+
+        /**
+         * This is incremented each time the node is reused, so that a
+         * token given out for a previous use can't cancel the current one.
+         */
+        uint32_t generation = 1;
+
+        /**
+         * This is the index of the previous timer in the slot's list.
+         */
+        uint32_t previous = NONE;
+
+        /**
+         * This is the index of the next timer in the slot's list.
+         */
+        uint32_t next = NONE;
+
+        /**
+         * This is the level of the slot holding the timer.
+         */
+        uint8_t level = 0;
+
+        /**
+         * This is the index of the slot holding the timer within its level.
+         */
+        uint8_t slot = 0;
+
+        /**
+         * This flag is set while the timer is pending.
+         */
+        bool pending = false;
+    };
+
+}
+
+/**
+ * This contains the private properties of a TimingWheel class instance.
+ */
+struct TimingWheel::Impl {
+    // Properties
+
+    /**
+     * This is the clock on whose scale timers are given.
+     */
+    std::shared_ptr< Timekeeping::Clock > clock;
+
+    /**
+     * This is the length of a tick, in seconds.
+     */
+    double tick = 0.01;
+
+    /**
+     * This is the time, on the clock's scale, at which tick zero began.
+     */
+    double startTime = 0.0;
+
+    /**
+     * This is the last tick processed.  Every timer due in this tick
+     * or earlier has been fired.
+     */
+    uint64_t currentTick = 0;
+
+    /**
+     * This holds every timer node, pending or free.
+     */
+    std::vector< Timer > timers;
+
+    /**
+     * These are the indexes of the timer nodes which are free.
+     */
+    std::vector< uint32_t > freeTimers;
+
+    /**
+     * This holds the index of the first timer in each slot
+     * of each level of the wheel.
+     */
+    uint32_t slotHeads[LEVELS][SLOTS];
+
+    /**
+     * This is the number of timers pending.
+     */
+    size_t pendingCount = 0;
+
+    /**
+     * This is used to synchronize access to the object.
+     */
+    std::mutex mutex;
+
+    /**
+     * This is used to wake the thread which fires timers when a timer is
+     * set up, or when the thread should stop.
+     */
+    std::condition_variable wakeCondition;
+
+    /**
+     * This flag tells the thread which fires timers to stop.
+     */
+    bool stopping = false;
+
+    /**
+     * This is the thread which fires timers.
+     */
+    std::thread worker;
+
+    // Methods
+
+    Impl() {
+        for (auto& level: slotHeads) {
+            for (auto& slotHead: level) {
+                slotHead = NONE;
+            }
+        }
+    }
+
+    /**
+     * This method returns the tick which contains the given time.
+     *
+     * @param[in] time
+     *     This is the time on the clock's scale.
+     *
+     * @return
+     *     The tick which contains the given time is returned.
+     */
+    uint64_t TickOf(double time) const {
+        const auto ticks = (time - startTime) / tick;
+        return (ticks <= 0.0) ? 0 : (uint64_t)ticks;
+    }
+
+    /**
+     * This method puts the given timer in the slot of the wheel which
+     * covers the tick in which it's due.
+     *
+     * @param[in] index
+     *     This is the index of the timer to place.
+     */
+    void Place(uint32_t index) {
+        auto& timer = timers[index];
+        const auto delta = timer.dueTick - currentTick;
+        size_t level = 0;
+        while (
+            (level + 1 < LEVELS)
+            && (delta >= ((uint64_t)1 << (SLOT_BITS * (level + 1))))
+        ) {
+            ++level;
+        }
+        auto slotTick = timer.dueTick;
+        if (
+            (level + 1 == LEVELS)
+            && (delta >= ((uint64_t)1 << (SLOT_BITS * LEVELS)))
+        ) {
+            slotTick = currentTick + ((uint64_t)1 << (SLOT_BITS * LEVELS)) - 1;
+        }
+        const auto slot = (size_t)((slotTick >> (SLOT_BITS * level)) & (SLOTS - 1));
+        timer.level = (uint8_t)level;
+        timer.slot = (uint8_t)slot;
+        timer.previous = NONE;
+        timer.next = slotHeads[level][slot];
+        if (timer.next != NONE) {
+            timers[timer.next].previous = index;
+        }
+        slotHeads[level][slot] = index;
+    }
+
+    /**
+     * This method takes the given timer out of the slot holding it.
+     *
+     * @param[in] index
+     *     This is the index of the timer to remove.
+     */
+    void Unlink(uint32_t index) {
+        auto& timer = timers[index];
+        if (timer.previous == NONE) {
+            slotHeads[timer.level][timer.slot] = timer.next;
+        } else {
+            timers[timer.previous].next = timer.next;
+        }
+        if (timer.next != NONE) {
+            timers[timer.next].previous = timer.previous;
+        }
+    }
+
+    /**
+     * This method returns the given timer node to the free list.
+     *
+     * @param[in] index
+     *     This is the index of the timer node to free.
+     */
+    void Free(uint32_t index) {
+        auto& timer = timers[index];
+        timer.pending = false;
+        timer.callback = nullptr;
+        if ((++timer.generation & GENERATION_MASK) == 0) {
+            ++timer.generation;
+        }
+        freeTimers.push_back(index);
+        --pendingCount;
+    }
+
+    /**
+     * This method moves on to the next tick.  Timers in higher levels
+     * whose slots come around are placed again, lower down, and the
+     * callbacks of the timers due in the new tick are collected.
+     *
+     * @param[in,out] fired
+     *     This is where to collect the callbacks of the timers due.
+     */
+    void Advance(std::vector< Callback >& fired) {
+        ++currentTick;
+        for (size_t level = LEVELS - 1; level > 0; --level) {
+            const auto shift = SLOT_BITS * level;
+            if ((currentTick & (((uint64_t)1 << shift) - 1)) != 0) {
+                continue;
+            }
+            const auto slot = (size_t)((currentTick >> shift) & (SLOTS - 1));
+            auto index = slotHeads[level][slot];
+            slotHeads[level][slot] = NONE;
+            while (index != NONE) {
+                const auto next = timers[index].next;
+                Place(index);
+                index = next;
+            }
+        }
+        const auto slot = (size_t)(currentTick & (SLOTS - 1));
+        auto index = slotHeads[0][slot];
+        slotHeads[0][slot] = NONE;
+        while (index != NONE) {
+            const auto next = timers[index].next;
+            fired.push_back(std::move(timers[index].callback));
+            Free(index);
+            index = next;
+        }
+    }
+
+    /**
+     * This method returns the next tick in which the thread which fires
+     * timers should wake up.  It's the next tick with timers due, if that's
+     * before the lowest level of the wheel comes around again, or the tick
+     * when it does (so that timers in higher levels can be placed lower),
+     * otherwise.
+     *
+     * @return
+     *     The next tick in which to wake up is returned.
+     */
+    uint64_t NextWakeTick() const {
+        const auto wrapTick = (currentTick | (SLOTS - 1)) + 1;
+        for (auto tickToCheck = currentTick + 1; tickToCheck < wrapTick; ++tickToCheck) {
+            if (slotHeads[0][tickToCheck & (SLOTS - 1)] != NONE) {
+                return tickToCheck;
+            }
+        }
+        return wrapTick;
+    }
+
+    /**
+     * This is the body of the thread which fires timers.
+     */
+    void Worker() {
+        std::vector< Callback > fired;
+        std::unique_lock< decltype(mutex) > lock(mutex);
+        while (!stopping) {
+            const auto nowTick = TickOf(clock->GetCurrentTime());
+            if (pendingCount == 0) {
+                if (nowTick > currentTick) {
+                    currentTick = nowTick;
+                }
+            } else {
+                while (currentTick < nowTick) {
+                    Advance(fired);
+                }
+            }
+            if (!fired.empty()) {
+                lock.unlock();
+                for (auto& callback: fired) {
+                    callback();
+                }
+                fired.clear();
+                lock.lock();
+                continue;
+            }
+            if (pendingCount == 0) {
+                wakeCondition.wait(lock);
+            } else {
+                const auto wakeTime = startTime + (double)NextWakeTick() * tick;
+                const auto delay = wakeTime - clock->GetCurrentTime();
+                if (delay > 0.0) {
+                    (void)wakeCondition.wait_for(
+                        lock,
+                        std::chrono::duration< double >(delay)
+                    );
+                }
+            }
+        }
+    }
+};
+
+TimingWheel::~TimingWheel() noexcept {
+    {
+        std::lock_guard< decltype(impl_->mutex) > lock(impl_->mutex);
+        impl_->stopping = true;
+        impl_->wakeCondition.notify_all();
+    }
+    impl_->worker.join();
+}
+
+TimingWheel::TimingWheel(
+    const std::shared_ptr< Timekeeping::Clock >& clock,
+    double tick
+)
+    : impl_(new Impl())
+{
+    impl_->clock = clock;
+    impl_->tick = tick;
+    impl_->startTime = clock->GetCurrentTime();
+    impl_->worker = std::thread(&Impl::Worker, impl_.get());
+}
+
+size_t TimingWheel::GetPendingCount() {
+    std::lock_guard< decltype(impl_->mutex) > lock(impl_->mutex);
+    return impl_->pendingCount;
+}
+
+int TimingWheel::Schedule(
+    Callback callback,
+    double due
+) {
+    std::lock_guard< decltype(impl_->mutex) > lock(impl_->mutex);
+    uint32_t index;
+    if (impl_->freeTimers.empty()) {
+        if (impl_->timers.size() >= MAX_TIMERS) {
+            return 0;
+        }
+        index = (uint32_t)impl_->timers.size();
+        impl_->timers.emplace_back();
+    } else {
+        index = impl_->freeTimers.back();
+        impl_->freeTimers.pop_back();
+    }
+    auto& timer = impl_->timers[index];
+    timer.callback = std::move(callback);
+    timer.pending = true;
+    if (impl_->pendingCount == 0) {
+        const auto nowTick = impl_->TickOf(impl_->clock->GetCurrentTime());
+        if (nowTick > impl_->currentTick) {
+            impl_->currentTick = nowTick;
+        }
+    }
+
+    // A timer is due in the tick after the one containing its due time,
+    // so that it never fires early.  A timer already due is fired
+    // in the next tick, which includes one due before the wheel started
+    // (converting a negative tick count would be undefined).
+    if (due <= impl_->startTime) {
+        timer.dueTick = impl_->currentTick + 1;
+    } else {
+        const auto dueTick = (uint64_t)ceil((due - impl_->startTime) / impl_->tick);
+        timer.dueTick = (
+            (dueTick <= impl_->currentTick)
+            ? impl_->currentTick + 1
+            : dueTick
+        );
+    }
+    impl_->Place(index);
+    ++impl_->pendingCount;
+    impl_->wakeCondition.notify_one();
+    return (int)(
+        ((timer.generation & GENERATION_MASK) << INDEX_BITS)
+        | index
+    );
+}
+
+void TimingWheel::Cancel(int token) {
+    const auto index = (uint32_t)token & (uint32_t)(MAX_TIMERS - 1);
+    const auto generation = (uint32_t)token >> INDEX_BITS;
+    std::lock_guard< decltype(impl_->mutex) > lock(impl_->mutex);
+    if (index >= impl_->timers.size()) {
+        return;
+    }
+    auto& timer = impl_->timers[index];
+    if (
+        !timer.pending
+        || ((timer.generation & GENERATION_MASK) != generation)
+    ) {
+        return;
+    }
+    impl_->Unlink(index);
+    impl_->Free(index);
+}
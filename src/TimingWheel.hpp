@@ -0,0 +1,82 @@
+#pragma once
+
+/**
+ * @file TimingWheel.hpp
+ *
+ * This module declares the TimingWheel class.
+ *
+ * © 2020 by Richard Walters
+ */
+
+#include "Timers.hpp"
+
+#include <memory>
+#include <stddef.h>
+#include <Timekeeping/Clock.hpp>
+
+/**
+ * This is the implementation of Timers which keeps timers in a hierarchical
+ * timing wheel, so that setting up and canceling a timer take constant time
+ * no matter how many timers there are.  Time is divided into ticks, and
+ * every timer due in the same tick is fired together, from a thread owned
+ * by the wheel.  Timers never fire early, but may fire up to one tick late.
+ */
+class TimingWheel
+    : public Timers
+{
+    // Lifecycle Methods
+public:
+    ~TimingWheel() noexcept;
+    TimingWheel(const TimingWheel&) = delete;
+    TimingWheel(TimingWheel&&) noexcept = delete;
+    TimingWheel& operator=(const TimingWheel&) = delete;
+    TimingWheel& operator=(TimingWheel&&) noexcept = delete;
+
+    // Public Methods
+public:
+    /**
+     * This is the constructor of the class.  It starts the thread which
+     * fires timers.
+     *
+     * @param[in] clock
+     *     This is the clock on whose scale timers are given.
+     *
+     * @param[in] tick
+     *     This is the length of a tick, in seconds.
+     */
+    explicit TimingWheel(
+        const std::shared_ptr< Timekeeping::Clock >& clock,
+        double tick = 0.01
+    );
+
+    /**
+     * This method returns the number of timers which are set up
+     * and haven't yet fired or been canceled.
+     *
+     * @return
+     *     The number of timers pending is returned.
+     */
+    size_t GetPendingCount();
+
+    // Timers
+public:
+    virtual int Schedule(
+        Callback callback,
+        double due
+    ) override;
+    virtual void Cancel(int token) override;
+
+    // Private properties
+private:
+    /**
+     * This is the type of structure that contains the private
+     * properties of the instance.  It is defined in the implementation
+     * and declared here to ensure that it is scoped inside the class.
+     */
+    struct Impl;
+
+    /**
+     * This contains the private properties of the instance.
+     */
+    std::unique_ptr< Impl > impl_;
+};
@@ -0,0 +1,147 @@
+/**
+ * @file TrustStore.cpp
+ *
+ * This module contains the implementations of the TrustStore class.
+ *
+ * © 2020 by Richard Walters
+ */
+
+#include "TrustStore.hpp"
+
+#include <stddef.h>
+#include <stdio.h>
+#include <string>
+#include <SystemAbstractions/DiagnosticsSender.hpp>
+
+namespace {
+
+    /**
+     * This is the line which begins each PEM-encoded certificate.
+     */
+    const std::string PEM_BEGIN = "-----BEGIN CERTIFICATE-----";
+
+    /**
+     * This is the line which ends each PEM-encoded certificate.
+     */
+    const std::string PEM_END = "-----END CERTIFICATE-----";
+
+    /**
+     * This function reads the entire contents of the given file straight
+     * into the given string, without any intermediate buffer.
+     *
+     * @param[in] path
+     *     This is the path to the file to read.
+     *
+     * @param[out] contents
+     *     This is where to store the contents of the file.
+     *
+     * @return
+     *     An indication of whether or not the file was read successfully
+     *     is returned.
+     */
+    bool ReadFile(
+        const std::string& path,
+        std::string& contents
+    ) {
+        const auto file = fopen(path.c_str(), "rb");
+        if (file == NULL) {
+            return false;
+        }
+        long size = -1;
+        if (fseek(file, 0, SEEK_END) == 0) {
+            size = ftell(file);
+        }
+        if (
+            (size <= 0)
+            || (fseek(file, 0, SEEK_SET) != 0)
+        ) {
+            (void)fclose(file);
+            return false;
+        }
+        contents.resize((size_t)size);
+        const auto amountRead = fread(&contents[0], 1, contents.size(), file);
+        (void)fclose(file);
+        return (amountRead == contents.size());
+    }
+
+}
+
+/**
+ * This contains the private properties of a TrustStore class instance.
+ */
+struct TrustStore::Impl {
+    /**
+     * This is the PEM-encoded certificate bundle.
+     */
+    std::string pem;
+
+    /**
+     * This is the number of certificates in the bundle.
+     */
+    size_t certificateCount = 0;
+};
+
+TrustStore::~TrustStore() noexcept = default;
+
+TrustStore::TrustStore()
+    : impl_(new Impl())
+{
+}
+
+bool TrustStore::Load(
+    const std::string& path,
+    const SystemAbstractions::DiagnosticsSender& diagnosticsSender
+) {
+    std::string pem;
+    if (!ReadFile(path, pem)) {
+        diagnosticsSender.SendDiagnosticInformationFormatted(
+            SystemAbstractions::DiagnosticsSender::Levels::ERROR,
+            "unable to read root CA certificates file '%s'",
+            path.c_str()
+        );
+        return false;
+    }
+    size_t certificateCount = 0;
+    size_t position = 0;
+    for (;;) {
+        const auto begin = pem.find(PEM_BEGIN, position);
+        if (begin == std::string::npos) {
+            break;
+        }
+        const auto end = pem.find(PEM_END, begin + PEM_BEGIN.length());
+        if (end == std::string::npos) {
+            diagnosticsSender.SendDiagnosticInformationFormatted(
+                SystemAbstractions::DiagnosticsSender::Levels::ERROR,
+                "root CA certificates file '%s' has an unterminated certificate",
+                path.c_str()
+            );
+            return false;
+        }
+        ++certificateCount;
+        position = end + PEM_END.length();
+    }
+    if (certificateCount == 0) {
+        diagnosticsSender.SendDiagnosticInformationFormatted(
+            SystemAbstractions::DiagnosticsSender::Levels::ERROR,
+            "root CA certificates file '%s' has no certificates",
+            path.c_str()
+        );
+        return false;
+    }
+    impl_->pem = std::move(pem);
+    impl_->certificateCount = certificateCount;
+    diagnosticsSender.SendDiagnosticInformationFormatted(
+        1,
+        "Loaded %zu root CA certificates",
+        certificateCount
+    );
+    return true;
+}
+
+const std::string& TrustStore::GetPem() const {
+    return impl_->pem;
+}
+
+size_t TrustStore::GetCertificateCount() const {
+    return impl_->certificateCount;
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+/**
+ * @file TrustStore.hpp
+ *
+ * This module declares the TrustStore class.
+ *
+ * © 2020 by Richard Walters
+ */
+
+#include <memory>
+#include <stddef.h>
+#include <string>
+#include <SystemAbstractions/DiagnosticsSender.hpp>
+
+/**
+ * This holds the trusted certificate authority (CA) certificate bundle,
+ * loaded and checked once, and shared by every connection which needs it.
+ */
+class TrustStore {
+    // Lifecycle Methods
+public:
+    ~TrustStore() noexcept;
+    TrustStore(const TrustStore&) = delete;
+    TrustStore(TrustStore&&) noexcept = delete;
+    TrustStore& operator=(const TrustStore&) = delete;
+    TrustStore& operator=(TrustStore&&) noexcept = delete;
+
+    // Public Methods
+public:
+    /**
+     * This is the constructor of the class.
+     */
+    TrustStore();
+
+    /**
+     * This method loads the certificate bundle from the given file,
+     * mapping the file into memory where the platform supports it.
+     * The bundle is checked to make sure it contains at least one
+     * complete PEM-encoded certificate.
+     *
+     * @param[in] path
+     *     This is the path to the certificate bundle file.
+     *
+     * @param[in] diagnosticsSender
+     *     This is the object to use to publish any diagnostic messages.
+     *
+     * @return
+     *     An indication of whether or not the bundle was loaded
+     *     successfully is returned.
+     */
+    bool Load(
+        const std::string& path,
+        const SystemAbstractions::DiagnosticsSender& diagnosticsSender
+    );
+
+    /**
+     * This method returns the PEM-encoded certificate bundle.
+     *
+     * @return
+     *     The PEM-encoded certificate bundle is returned.
+     */
+    const std::string& GetPem() const;
+
+    /**
+     * This method returns the number of certificates in the bundle.
+     *
+     * @return
+     *     The number of certificates in the bundle is returned.
+     */
+    size_t GetCertificateCount() const;
+
+    // Private properties
+private:
+    /**
+     * This is the type of structure that contains the private
+     * properties of the instance.  It is defined in the implementation
+     * and declared here to ensure that it is scoped inside the class.
+     */
+    struct Impl;
+
+    /**
+     * This contains the private properties of the instance.
+     */
+    std::unique_ptr< Impl > impl_;
+};
@@ -0,0 +1,921 @@
+/**
+ * @file UdpMediaTransport.cpp
+ *
+ * This module contains the implementation of the UdpMediaTransport class.
+ *
+ * © 2020 by Richard Walters
+ */
+
+#include "UdpMediaTransport.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string.h>
+#include <SystemAbstractions/NetworkConnection.hpp>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else /* not _WIN32 */
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+#endif /* _WIN32 or not */
+
+#ifdef __linux__
+#include <netinet/udp.h>
+#endif /* __linux__ */
+
+namespace {
+
+#ifdef _WIN32
+    /**
+     * This is the type of the operating system's handle to a socket.
+     */
+    typedef SOCKET SocketHandle;
+
+    /**
+     * This is the value of a socket handle which refers to no socket.
+     */
+    const SocketHandle INVALID_SOCKET_HANDLE = INVALID_SOCKET;
+#else /* not _WIN32 */
+    /**
+     * This is the type of the operating system's handle to a socket.
+     */
+    typedef int SocketHandle;
+
+    /**
+     * This is the value of a socket handle which refers to no socket.
+     */
+    constexpr SocketHandle INVALID_SOCKET_HANDLE = -1;
+#endif /* _WIN32 or not */
+
+    /**
+     * This is the size of an RTP header without any contributing
+     * sources or extensions, which is all Discord uses.
+     */
+    constexpr size_t RTP_HEADER_SIZE = 12;
+
+    /**
+     * This is the first byte of each RTP header: version 2, without
+     * padding, extensions, or contributing sources.
+     */
+    constexpr uint8_t RTP_VERSION_BYTE = 0x80;
+
+    /**
+     * Packets due within this many nanoseconds of the earliest one due
+     * are sent along with it, so that streams whose frames fall due at
+     * about the same time share a system call.
+     */
+    constexpr uint64_t SEND_SLACK_NANOSECONDS = 500000;
+
+    /**
+     * This is the most segments the kernel accepts in one datagram sent
+     * with generic segmentation offload.
+     */
+    constexpr size_t MAX_SEGMENTS = 64;
+
+    /**
+     * This is the most bytes sent in one datagram with generic
+     * segmentation offload, which must fit in a single IP datagram
+     * before being split.
+     */
+    constexpr size_t MAX_SEGMENTED_BYTES = 65000;
+
+    /**
+     * This is the size asked for the socket's send and receive buffers,
+     * so that a batch for hundreds of streams doesn't overrun them.
+     */
+    constexpr int SOCKET_BUFFER_SIZE = 1 << 21;
+
+    /**
+     * This is how long, in milliseconds, the receiving thread waits for
+     * packets at a time, before checking whether it should stop.
+     */
+    constexpr int RECEIVE_TIMEOUT_MILLISECONDS = 100;
+
+    /**
+     * This function closes the given socket.
+     *
+     * @param[in] socketHandle
+     *     This is the handle of the socket to close.
+     */
+    void CloseSocket(SocketHandle socketHandle) {
+#ifdef _WIN32
+        (void)closesocket(socketHandle);
+#else /* not _WIN32 */
+        (void)close(socketHandle);
+#endif /* _WIN32 or not */
+    }
+
+    /**
+     * This function sets how long receiving from the given socket waits
+     * for a packet to arrive.
+     *
+     * @param[in] socketHandle
+     *     This is the handle of the socket to set up.
+     *
+     * @param[in] milliseconds
+     *     This is the number of milliseconds to wait.
+     */
+    void SetReceiveTimeout(
+        SocketHandle socketHandle,
+        int milliseconds
+    ) {
+#ifdef _WIN32
+        const DWORD timeout = (DWORD)milliseconds;
+#else /* not _WIN32 */
+        struct timeval timeout;
+        timeout.tv_sec = milliseconds / 1000;
+        timeout.tv_usec = (milliseconds % 1000) * 1000;
+#endif /* _WIN32 or not */
+        (void)setsockopt(
+            socketHandle,
+            SOL_SOCKET,
+            SO_RCVTIMEO,
+            (const char*)&timeout,
+            sizeof(timeout)
+        );
+    }
+
+    /**
+     * This function stores the given value in the given place, in
+     * network byte order (big-endian).
+     *
+     * @param[out] destination
+     *     This is where to store the value.
+     *
+     * @param[in] value
+     *     This is the value to store.
+     *
+     * @param[in] size
+     *     This is the number of bytes in which to store the value.
+     */
+    void PutBigEndian(
+        uint8_t* destination,
+        uint32_t value,
+        size_t size
+    ) {
+        for (size_t i = size; i > 0; --i) {
+            destination[i - 1] = (uint8_t)value;
+            value >>= 8;
+        }
+    }
+
+    /**
+     * This function checks whether or not the two given socket addresses
+     * are the same.
+     *
+     * @param[in] a
+     *     This is the first address to compare.
+     *
+     * @param[in] b
+     *     This is the second address to compare.
+     *
+     * @return
+     *     An indication of whether or not the addresses are the same
+     *     is returned.
+     */
+    bool IsSameAddress(
+        const sockaddr_in& a,
+        const sockaddr_in& b
+    ) {
+        return (
+            (a.sin_addr.s_addr == b.sin_addr.s_addr)
+            && (a.sin_port == b.sin_port)
+        );
+    }
+
+    /**
+     * This function orders the two given socket addresses, for sorting.
+     *
+     * @param[in] a
+     *     This is the first address to compare.
+     *
+     * @param[in] b
+     *     This is the second address to compare.
+     *
+     * @return
+     *     An indication of whether or not the first address goes
+     *     before the second is returned.
+     */
+    bool IsAddressBefore(
+        const sockaddr_in& a,
+        const sockaddr_in& b
+    ) {
+        if (a.sin_addr.s_addr != b.sin_addr.s_addr) {
+            return (a.sin_addr.s_addr < b.sin_addr.s_addr);
+        }
+        return (a.sin_port < b.sin_port);
+    }
+
+}
+
+/**
+ * This contains the private properties of a UdpMediaTransport class
+ * instance.
+ */
+struct UdpMediaTransport::Impl {
+    // Types
+
+    /**
+     * This holds the state of one stream of packets.
+     */
+    struct Stream {
+        /**
+         * This is the address of the voice server to which to send
+         * the stream's packets.
+         */
+        sockaddr_in address;
+
+        /**
+         * This is the synchronization source of the stream.
+         */
+        uint32_t ssrc = 0;
+
+        /**
+         * This is the RTP sequence number to give the next packet.
+         */
+        uint16_t sequence = 0;
+
+        /**
+         * This is the RTP timestamp to give the next packet.
+         */
+        uint32_t timestamp = 0;
+
+        /**
+         * This is the time, on the monotonic clock, in nanoseconds,
+         * at which the next packet is due to be sent.
+         */
+        uint64_t nextDue = 0;
+
+        /**
+         * If not null, this is called to encrypt each packet.
+         */
+        std::shared_ptr< Sealer > sealer;
+    };
+
+    /**
+     * This identifies a packet in the ring which is waiting to be sent.
+     */
+    struct PendingPacket {
+        /**
+         * This is the time, on the monotonic clock, in nanoseconds,
+         * at which the packet is due to be sent.
+         */
+        uint64_t due;
+
+        /**
+         * This is the index of the buffer holding the packet.
+         */
+        size_t slot;
+
+        /**
+         * This is the size of the packet, in bytes.
+         */
+        size_t size;
+
+        /**
+         * This is the address to which to send the packet.
+         */
+        sockaddr_in address;
+    };
+
+    /**
+     * This orders pending packets in a heap with the one due
+     * first on top.
+     */
+    struct DueLater {
+        bool operator()(
+            const PendingPacket& a,
+            const PendingPacket& b
+        ) const {
+            return (a.due > b.due);
+        }
+    };
+
+    /**
+     * This is a run of packets in a batch sent with one message.
+     */
+    struct Segments {
+        size_t first;
+        size_t count;
+    };
+
+    // Properties
+
+    SystemAbstractions::DiagnosticsSender diagnosticsSender;
+    std::shared_ptr< TimeKeeper > timeKeeper;
+    Configuration configuration;
+    uint64_t frameNanoseconds = 0;
+    SocketHandle socketHandle = INVALID_SOCKET_HANDLE;
+    std::mutex mutex;
+    std::condition_variable wakeCondition;
+    bool stopping = false;
+    std::thread senderThread;
+    std::thread receiverThread;
+    std::unordered_map< int, Stream > streams;
+    int nextStreamId = 1;
+    std::shared_ptr< ReceiveDelegate > onReceive;
+    Statistics statistics;
+
+    /**
+     * This holds the buffers of the packet ring, one after another.
+     */
+    std::vector< uint8_t > packetMemory;
+
+    /**
+     * These are the indexes of the buffers not holding a packet.
+     */
+    std::vector< size_t > freeSlots;
+
+    /**
+     * This is a heap of the packets waiting to be sent, with the one
+     * due first on top.  Room for every buffer is reserved up front.
+     */
+    std::vector< PendingPacket > pending;
+
+    /**
+     * These are the packets being sent by the sending thread.
+     */
+    std::vector< PendingPacket > batch;
+
+    /**
+     * These are the runs of packets of the batch sent together.
+     */
+    std::vector< Segments > segments;
+
+    /**
+     * This indicates whether or not generic segmentation offload is
+     * used.  It's turned off if the kernel turns out not to support it.
+     */
+    bool segmentationOffload = false;
+
+    /**
+     * This holds the buffers into which packets are received.
+     */
+    std::vector< uint8_t > receiveMemory;
+
+#ifdef __linux__
+    std::vector< mmsghdr > sendMessages;
+    std::vector< iovec > sendVectors;
+    std::vector< char > sendControl;
+    std::vector< mmsghdr > receiveMessages;
+    std::vector< iovec > receiveVectors;
+#endif /* __linux__ */
+
+    // Methods
+
+    Impl()
+        : diagnosticsSender("UdpMediaTransport")
+    {
+    }
+
+    /**
+     * This method returns the start of the given buffer in the ring.
+     *
+     * @param[in] slot
+     *     This is the index of the buffer.
+     *
+     * @return
+     *     The start of the buffer is returned.
+     */
+    uint8_t* GetSlot(size_t slot) {
+        return &packetMemory[slot * configuration.packetSize];
+    }
+
+    /**
+     * This method sends the given packet on its own.
+     *
+     * @param[in] packet
+     *     This is the packet to send.
+     *
+     * @return
+     *     An indication of whether or not the packet was sent
+     *     is returned.
+     */
+    bool SendOne(const PendingPacket& packet) {
+        return (
+            sendto(
+                socketHandle,
+                (const char*)GetSlot(packet.slot),
+#ifdef _WIN32
+                (int)packet.size,
+#else /* not _WIN32 */
+                packet.size,
+#endif /* _WIN32 or not */
+                0,
+                (const sockaddr*)&packet.address,
+                sizeof(packet.address)
+            ) >= 0
+        );
+    }
+
+    /**
+     * This method groups the packets of the batch into runs to be sent
+     * together, each run going to one address, as a single datagram for
+     * the kernel to split, if generic segmentation offload is used.  The
+     * batch is first sorted by address, keeping the packets for each
+     * address in order.
+     */
+    void GroupBatch() {
+        for (size_t i = 1; i < batch.size(); ++i) {
+            for (
+                size_t j = i;
+                (j > 0) && IsAddressBefore(batch[j].address, batch[j - 1].address);
+                --j
+            ) {
+                std::swap(batch[j], batch[j - 1]);
+            }
+        }
+        segments.clear();
+        for (size_t i = 0; i < batch.size(); ++i) {
+            if (
+                segmentationOffload
+                && !segments.empty()
+            ) {
+                auto& run = segments.back();
+                const auto& first = batch[run.first];
+                if (
+                    IsSameAddress(first.address, batch[i].address)
+                    && (first.size == batch[i].size)
+                    && (run.count < MAX_SEGMENTS)
+                    && ((run.count + 1) * first.size <= MAX_SEGMENTED_BYTES)
+                ) {
+                    ++run.count;
+                    continue;
+                }
+            }
+            segments.push_back({i, 1});
+        }
+    }
+
+    /**
+     * This method sends the packets of the batch.
+     *
+     * @param[out] sent
+     *     This is where to store the number of packets sent.
+     *
+     * @param[out] calls
+     *     This is where to store the number of system calls made.
+     */
+    void SendBatch(
+        size_t& sent,
+        size_t& calls
+    ) {
+        sent = 0;
+        calls = 0;
+        GroupBatch();
+#ifdef __linux__
+        const auto controlSize = CMSG_SPACE(sizeof(uint16_t));
+        for (size_t i = 0; i < batch.size(); ++i) {
+            sendVectors[i].iov_base = GetSlot(batch[i].slot);
+            sendVectors[i].iov_len = batch[i].size;
+        }
+        for (size_t i = 0; i < segments.size(); ++i) {
+            const auto& run = segments[i];
+            auto& header = sendMessages[i].msg_hdr;
+            (void)memset(&sendMessages[i], 0, sizeof(sendMessages[i]));
+            header.msg_name = &batch[run.first].address;
+            header.msg_namelen = sizeof(batch[run.first].address);
+            header.msg_iov = &sendVectors[run.first];
+            header.msg_iovlen = run.count;
+#ifdef UDP_SEGMENT
+            if (run.count > 1) {
+                const auto control = &sendControl[i * controlSize];
+                (void)memset(control, 0, controlSize);
+                header.msg_control = control;
+                header.msg_controllen = controlSize;
+                const auto message = CMSG_FIRSTHDR(&header);
+                message->cmsg_level = IPPROTO_UDP;
+                message->cmsg_type = UDP_SEGMENT;
+                message->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+                const auto segmentSize = (uint16_t)batch[run.first].size;
+                (void)memcpy(CMSG_DATA(message), &segmentSize, sizeof(segmentSize));
+            }
+#endif /* UDP_SEGMENT */
+        }
+        size_t next = 0;
+        while (next < segments.size()) {
+            const auto result = sendmmsg(
+                socketHandle,
+                &sendMessages[next],
+                (unsigned int)(segments.size() - next),
+                0
+            );
+            ++calls;
+            if (result < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                const auto& run = segments[next];
+                if (run.count > 1) {
+                    // The kernel may not support segmentation offload,
+                    // so give up on it and send the run one by one.
+                    if (segmentationOffload) {
+                        segmentationOffload = false;
+                        diagnosticsSender.SendDiagnosticInformationFormatted(
+                            SystemAbstractions::DiagnosticsSender::Levels::WARNING,
+                            "Segmentation offload failed (%s); sending packets one by one",
+                            strerror(errno)
+                        );
+                    }
+                    for (size_t i = 0; i < run.count; ++i) {
+                        ++calls;
+                        if (SendOne(batch[run.first + i])) {
+                            ++sent;
+                        }
+                    }
+                }
+                ++next;
+                continue;
+            }
+            for (int i = 0; i < result; ++i) {
+                sent += segments[next + i].count;
+            }
+            next += (size_t)result;
+        }
+#else /* not __linux__ */
+        for (const auto& packet: batch) {
+            ++calls;
+            if (SendOne(packet)) {
+                ++sent;
+            }
+        }
+#endif /* __linux__ or not */
+    }
+
+    /**
+     * This is the body of the thread which sends packets as they
+     * fall due.
+     */
+    void RunSender() {
+        std::unique_lock< decltype(mutex) > lock(mutex);
+        while (!stopping) {
+            if (pending.empty()) {
+                wakeCondition.wait(lock);
+                continue;
+            }
+            const auto now = timeKeeper->GetMonotonicNanoseconds();
+            const auto due = pending.front().due;
+            if (due > now + SEND_SLACK_NANOSECONDS) {
+                (void)wakeCondition.wait_for(lock, std::chrono::nanoseconds(due - now));
+                continue;
+            }
+            batch.clear();
+            while (
+                !pending.empty()
+                && (pending.front().due <= now + SEND_SLACK_NANOSECONDS)
+                && (batch.size() < configuration.maxBatch)
+            ) {
+                std::pop_heap(pending.begin(), pending.end(), DueLater());
+                batch.push_back(pending.back());
+                pending.pop_back();
+            }
+            lock.unlock();
+            size_t sent, calls;
+            SendBatch(sent, calls);
+            lock.lock();
+            for (const auto& packet: batch) {
+                freeSlots.push_back(packet.slot);
+                if (packet.due < now) {
+                    const auto lateness = now - packet.due;
+                    if (lateness > frameNanoseconds / 4) {
+                        ++statistics.late;
+                    }
+                    statistics.maxLateness = std::max(
+                        statistics.maxLateness,
+                        (double)lateness / 1e9
+                    );
+                }
+            }
+            statistics.sent += sent;
+            statistics.sendCalls += calls;
+            statistics.dropped += batch.size() - sent;
+        }
+    }
+
+    /**
+     * This is the body of the thread which receives packets.
+     */
+    void RunReceiver() {
+        const auto packetSize = configuration.packetSize;
+        const auto maxBatch = configuration.maxBatch;
+        std::unique_lock< decltype(mutex) > lock(mutex);
+        while (!stopping) {
+            lock.unlock();
+#ifdef __linux__
+            for (size_t i = 0; i < maxBatch; ++i) {
+                receiveVectors[i].iov_base = &receiveMemory[i * packetSize];
+                receiveVectors[i].iov_len = packetSize;
+                (void)memset(&receiveMessages[i], 0, sizeof(receiveMessages[i]));
+                receiveMessages[i].msg_hdr.msg_iov = &receiveVectors[i];
+                receiveMessages[i].msg_hdr.msg_iovlen = 1;
+            }
+            const auto result = recvmmsg(
+                socketHandle,
+                receiveMessages.data(),
+                (unsigned int)maxBatch,
+                MSG_WAITFORONE,
+                NULL
+            );
+            const size_t received = ((result > 0) ? (size_t)result : 0);
+#else /* not __linux__ */
+            const auto result = recvfrom(
+                socketHandle,
+                (char*)receiveMemory.data(),
+                (int)packetSize,
+                0,
+                NULL,
+                NULL
+            );
+            const size_t received = ((result > 0) ? 1 : 0);
+#endif /* __linux__ or not */
+            lock.lock();
+            if (received == 0) {
+                continue;
+            }
+            statistics.received += received;
+            const auto onReceiveSample = onReceive;
+            lock.unlock();
+            if (onReceiveSample != nullptr) {
+                for (size_t i = 0; i < received; ++i) {
+#ifdef __linux__
+                    const size_t size = receiveMessages[i].msg_len;
+#else /* not __linux__ */
+                    const size_t size = (size_t)result;
+#endif /* __linux__ or not */
+                    (*onReceiveSample)(&receiveMemory[i * packetSize], size);
+                }
+            }
+            lock.lock();
+        }
+    }
+};
+
+UdpMediaTransport::~UdpMediaTransport() noexcept {
+    Close();
+}
+
+UdpMediaTransport::UdpMediaTransport()
+    : impl_(new Impl())
+{
+}
+
+SystemAbstractions::DiagnosticsSender::UnsubscribeDelegate UdpMediaTransport::SubscribeToDiagnostics(
+    SystemAbstractions::DiagnosticsSender::DiagnosticMessageDelegate delegate,
+    size_t minLevel
+) {
+    return impl_->diagnosticsSender.SubscribeToDiagnostics(delegate, minLevel);
+}
+
+bool UdpMediaTransport::Open(
+    const std::shared_ptr< TimeKeeper >& timeKeeper,
+    const Configuration& configuration,
+    uint16_t localPort
+) {
+    Close();
+    if (
+        (configuration.packetCount == 0)
+        || (configuration.packetSize <= RTP_HEADER_SIZE)
+        || (configuration.maxBatch == 0)
+    ) {
+        impl_->diagnosticsSender.SendDiagnosticInformationString(
+            SystemAbstractions::DiagnosticsSender::Levels::ERROR,
+            "Invalid media transport configuration"
+        );
+        return false;
+    }
+#ifdef _WIN32
+    WSADATA wsaData;
+    if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0) {
+        impl_->diagnosticsSender.SendDiagnosticInformationString(
+            SystemAbstractions::DiagnosticsSender::Levels::ERROR,
+            "Unable to start Windows sockets"
+        );
+        return false;
+    }
+#endif /* _WIN32 */
+    const auto socketHandle = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (socketHandle == INVALID_SOCKET_HANDLE) {
+        impl_->diagnosticsSender.SendDiagnosticInformationString(
+            SystemAbstractions::DiagnosticsSender::Levels::ERROR,
+            "Unable to open UDP socket"
+        );
+#ifdef _WIN32
+        (void)WSACleanup();
+#endif /* _WIN32 */
+        return false;
+    }
+    (void)setsockopt(socketHandle, SOL_SOCKET, SO_SNDBUF, (const char*)&SOCKET_BUFFER_SIZE, sizeof(SOCKET_BUFFER_SIZE));
+    (void)setsockopt(socketHandle, SOL_SOCKET, SO_RCVBUF, (const char*)&SOCKET_BUFFER_SIZE, sizeof(SOCKET_BUFFER_SIZE));
+    SetReceiveTimeout(socketHandle, RECEIVE_TIMEOUT_MILLISECONDS);
+    sockaddr_in localAddress;
+    (void)memset(&localAddress, 0, sizeof(localAddress));
+    localAddress.sin_family = AF_INET;
+    localAddress.sin_addr.s_addr = htonl(INADDR_ANY);
+    localAddress.sin_port = htons(localPort);
+    if (bind(socketHandle, (const sockaddr*)&localAddress, sizeof(localAddress)) != 0) {
+        impl_->diagnosticsSender.SendDiagnosticInformationFormatted(
+            SystemAbstractions::DiagnosticsSender::Levels::ERROR,
+            "Unable to bind UDP socket to port %u",
+            (unsigned int)localPort
+        );
+        CloseSocket(socketHandle);
+#ifdef _WIN32
+        (void)WSACleanup();
+#endif /* _WIN32 */
+        return false;
+    }
+
+    // Allocate everything the threads use up front, so that sending and
+    // receiving packets never allocates memory.
+    std::lock_guard< decltype(impl_->mutex) > lock(impl_->mutex);
+    impl_->timeKeeper = timeKeeper;
+    impl_->configuration = configuration;
+    impl_->frameNanoseconds = (uint64_t)(configuration.frameDuration * 1e9);
+    impl_->socketHandle = socketHandle;
+    impl_->segmentationOffload = configuration.segmentationOffload;
+    impl_->statistics = Statistics();
+    impl_->packetMemory.assign(configuration.packetCount * configuration.packetSize, 0);
+    impl_->freeSlots.clear();
+    impl_->freeSlots.reserve(configuration.packetCount);
+    for (size_t i = configuration.packetCount; i > 0; --i) {
+        impl_->freeSlots.push_back(i - 1);
+    }
+    impl_->pending.clear();
+    impl_->pending.reserve(configuration.packetCount);
+    impl_->batch.clear();
+    impl_->batch.reserve(configuration.maxBatch);
+    impl_->segments.clear();
+    impl_->segments.reserve(configuration.maxBatch);
+    impl_->receiveMemory.assign(configuration.maxBatch * configuration.packetSize, 0);
+#ifdef __linux__
+    impl_->sendMessages.resize(configuration.maxBatch);
+    impl_->sendVectors.resize(configuration.maxBatch);
+    impl_->sendControl.assign(configuration.maxBatch * CMSG_SPACE(sizeof(uint16_t)), 0);
+    impl_->receiveMessages.resize(configuration.maxBatch);
+    impl_->receiveVectors.resize(configuration.maxBatch);
+#endif /* __linux__ */
+    impl_->stopping = false;
+    impl_->senderThread = std::thread(&Impl::RunSender, impl_.get());
+    impl_->receiverThread = std::thread(&Impl::RunReceiver, impl_.get());
+    return true;
+}
+
+void UdpMediaTransport::Close() {
+    std::unique_lock< decltype(impl_->mutex) > lock(impl_->mutex);
+    if (impl_->socketHandle == INVALID_SOCKET_HANDLE) {
+        return;
+    }
+    impl_->stopping = true;
+    impl_->wakeCondition.notify_all();
+    lock.unlock();
+    impl_->senderThread.join();
+    impl_->receiverThread.join();
+    lock.lock();
+    CloseSocket(impl_->socketHandle);
+    impl_->socketHandle = INVALID_SOCKET_HANDLE;
+    impl_->streams.clear();
+    impl_->pending.clear();
+#ifdef _WIN32
+    (void)WSACleanup();
+#endif /* _WIN32 */
+}
+
+uint16_t UdpMediaTransport::GetLocalPort() {
+    std::lock_guard< decltype(impl_->mutex) > lock(impl_->mutex);
+    if (impl_->socketHandle == INVALID_SOCKET_HANDLE) {
+        return 0;
+    }
+    sockaddr_in localAddress;
+    socklen_t localAddressLength = sizeof(localAddress);
+    if (getsockname(impl_->socketHandle, (sockaddr*)&localAddress, &localAddressLength) != 0) {
+        return 0;
+    }
+    return ntohs(localAddress.sin_port);
+}
+
+int UdpMediaTransport::AddStream(
+    const std::string& host,
+    uint16_t port,
+    uint32_t ssrc,
+    Sealer sealer
+) {
+    const auto address = SystemAbstractions::NetworkConnection::GetAddressOfHost(host);
+    if (address == 0) {
+        impl_->diagnosticsSender.SendDiagnosticInformationFormatted(
+            SystemAbstractions::DiagnosticsSender::Levels::WARNING,
+            "Unable to resolve voice server %s",
+            host.c_str()
+        );
+        return 0;
+    }
+    Impl::Stream stream;
+    (void)memset(&stream.address, 0, sizeof(stream.address));
+    stream.address.sin_family = AF_INET;
+    stream.address.sin_addr.s_addr = htonl(address);
+    stream.address.sin_port = htons(port);
+    stream.ssrc = ssrc;
+    if (sealer != nullptr) {
+        stream.sealer = std::make_shared< Sealer >(std::move(sealer));
+    }
+    std::lock_guard< decltype(impl_->mutex) > lock(impl_->mutex);
+    const auto streamId = impl_->nextStreamId++;
+    impl_->streams[streamId] = std::move(stream);
+    return streamId;
+}
+
+void UdpMediaTransport::RemoveStream(int streamId) {
+    std::lock_guard< decltype(impl_->mutex) > lock(impl_->mutex);
+    (void)impl_->streams.erase(streamId);
+}
+
+bool UdpMediaTransport::SendFrame(
+    int streamId,
+    const uint8_t* frame,
+    size_t size
+) {
+    // Claim a buffer, and the stream's next place in its sequence.
+    std::unique_lock< decltype(impl_->mutex) > lock(impl_->mutex);
+    const auto packetSize = impl_->configuration.packetSize;
+    const auto stream = impl_->streams.find(streamId);
+    if (
+        (stream == impl_->streams.end())
+        || (size > packetSize - RTP_HEADER_SIZE)
+        || impl_->freeSlots.empty()
+    ) {
+        ++impl_->statistics.dropped;
+        return false;
+    }
+    const auto slot = impl_->freeSlots.back();
+    impl_->freeSlots.pop_back();
+    Impl::PendingPacket pendingPacket;
+    pendingPacket.slot = slot;
+    pendingPacket.address = stream->second.address;
+    const auto now = impl_->timeKeeper->GetMonotonicNanoseconds();
+    pendingPacket.due = std::max(stream->second.nextDue, now);
+    stream->second.nextDue = pendingPacket.due + impl_->frameNanoseconds;
+    const auto sequence = stream->second.sequence++;
+    const auto timestamp = stream->second.timestamp;
+    stream->second.timestamp += impl_->configuration.samplesPerFrame;
+    const auto ssrc = stream->second.ssrc;
+    const auto sealer = stream->second.sealer;
+    const auto payloadType = impl_->configuration.payloadType;
+    const auto packet = impl_->GetSlot(slot);
+    lock.unlock();
+
+    // Frame and seal the packet in its buffer, without holding the lock,
+    // since no one else touches the buffer until it's queued.
+    packet[0] = RTP_VERSION_BYTE;
+    packet[1] = payloadType;
+    PutBigEndian(&packet[2], sequence, 2);
+    PutBigEndian(&packet[4], timestamp, 4);
+    PutBigEndian(&packet[8], ssrc, 4);
+    (void)memcpy(&packet[RTP_HEADER_SIZE], frame, size);
+    pendingPacket.size = RTP_HEADER_SIZE + size;
+    if (sealer != nullptr) {
+        pendingPacket.size = (*sealer)(packet, RTP_HEADER_SIZE, size, packetSize);
+    }
+
+    // Queue the packet, waking the sending thread if it's now the
+    // first one due.
+    lock.lock();
+    if (
+        (pendingPacket.size == 0)
+        || (pendingPacket.size > packetSize)
+        || (impl_->socketHandle == INVALID_SOCKET_HANDLE)
+    ) {
+        impl_->freeSlots.push_back(slot);
+        ++impl_->statistics.dropped;
+        return false;
+    }
+    impl_->pending.push_back(pendingPacket);
+    std::push_heap(impl_->pending.begin(), impl_->pending.end(), Impl::DueLater());
+    if (impl_->pending.front().slot == slot) {
+        impl_->wakeCondition.notify_one();
+    }
+    return true;
+}
+
+void UdpMediaTransport::RegisterReceiveDelegate(ReceiveDelegate onReceive) {
+    std::lock_guard< decltype(impl_->mutex) > lock(impl_->mutex);
+    if (onReceive == nullptr) {
+        impl_->onReceive = nullptr;
+    } else {
+        impl_->onReceive = std::make_shared< ReceiveDelegate >(std::move(onReceive));
+    }
+}
+
+auto UdpMediaTransport::GetStatistics() -> Statistics {
+    std::lock_guard< decltype(impl_->mutex) > lock(impl_->mutex);
+    return impl_->statistics;
+}
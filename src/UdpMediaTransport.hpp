@@ -0,0 +1,327 @@
+#pragma once
+
+/**
+ * @file UdpMediaTransport.hpp
+ *
+ * This module declares the UdpMediaTransport class.
+ *
+ * © 2020 by Richard Walters
+ */
+
+#include "TimeKeeper.hpp"
+
+#include <functional>
+#include <memory>
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <SystemAbstractions/DiagnosticsSender.hpp>
+
+/**
+ * This sends and receives the RTP packets which carry voice audio, over
+ * a single UDP socket shared by any number of streams, each going to a
+ * voice server with its own synchronization source (SSRC).  Frames queued
+ * for a stream are framed in place in a preallocated ring of packet
+ * buffers, handed to the stream's sealer to be encrypted where they lie,
+ * and sent by a thread of the transport's own one frame duration apart,
+ * as measured by the TimeKeeper's monotonic clock, so that callers may
+ * queue frames ahead of time without the audio arriving in bursts.
+ * Packets due at about the same time are sent together, with sendmmsg on
+ * Linux, and with UDP generic segmentation offload where the kernel
+ * supports it; packets received are taken in batches with recvmmsg.
+ */
+class UdpMediaTransport {
+    // Types
+public:
+    /**
+     * This holds the configurable parameters of the transport.
+     */
+    struct Configuration {
+        /**
+         * This is the number of packet buffers in the ring shared by all
+         * streams.  Frames queued while every buffer is waiting to be
+         * sent are dropped.
+         */
+        size_t packetCount = 4096;
+
+        /**
+         * This is the size of each packet buffer, in bytes, which limits
+         * the size of each packet, once sealed.  The default is the largest
+         * UDP payload which fits in an Ethernet frame.
+         */
+        size_t packetSize = 1472;
+
+        /**
+         * This is the most packets sent or received in one system call.
+         */
+        size_t maxBatch = 64;
+
+        /**
+         * This is the number of seconds of audio in each frame, which is
+         * also how far apart the packets of each stream are sent.
+         */
+        double frameDuration = 0.020;
+
+        /**
+         * This is the amount by which the RTP timestamp advances with
+         * each frame.  The default is 20 milliseconds at 48 kHz.
+         */
+        uint32_t samplesPerFrame = 960;
+
+        /**
+         * This is the RTP payload type given in each packet.  Discord
+         * uses 120 for Opus.
+         */
+        uint8_t payloadType = 120;
+
+        /**
+         * This indicates whether or not to use UDP generic segmentation
+         * offload, where available, to send packets of the same size
+         * going to the same place as a single datagram for the kernel
+         * to split.
+         */
+        bool segmentationOffload = true;
+    };
+
+    /**
+     * This is the type of function called to encrypt a packet in place,
+     * in the buffer it will be sent from.
+     *
+     * @param[in,out] packet
+     *     This is the start of the packet, beginning with its RTP header,
+     *     which is followed by the payload to encrypt.
+     *
+     * @param[in] headerSize
+     *     This is the size of the RTP header, in bytes.
+     *
+     * @param[in] payloadSize
+     *     This is the size of the payload, in bytes.
+     *
+     * @param[in] capacity
+     *     This is the size of the buffer holding the packet, in bytes,
+     *     which limits how much the packet may grow (by an authentication
+     *     tag or nonce, for example).
+     *
+     * @return
+     *     The size of the sealed packet is returned, or zero if the packet
+     *     couldn't be sealed and should be dropped.
+     */
+    typedef std::function<
+        size_t(
+            uint8_t* packet,
+            size_t headerSize,
+            size_t payloadSize,
+            size_t capacity
+        )
+    > Sealer;
+
+    /**
+     * This is the type of function called with each packet received.
+     * It's called on the transport's receiving thread, with the packet
+     * in a buffer which may be decrypted in place, but which is reused
+     * once the function returns.
+     *
+     * @param[in,out] packet
+     *     This is the start of the packet.
+     *
+     * @param[in] size
+     *     This is the size of the packet, in bytes.
+     */
+    typedef std::function<
+        void(
+            uint8_t* packet,
+            size_t size
+        )
+    > ReceiveDelegate;
+
+    /**
+     * This holds statistics about the transport.
+     */
+    struct Statistics {
+        /**
+         * This is the number of packets sent.
+         */
+        size_t sent = 0;
+
+        /**
+         * This is the number of system calls made to send packets.
+         */
+        size_t sendCalls = 0;
+
+        /**
+         * This is the number of frames dropped, because the ring was full,
+         * the packet couldn't be sealed, or it couldn't be sent.
+         */
+        size_t dropped = 0;
+
+        /**
+         * This is the number of packets sent more than a quarter of a
+         * frame duration after they were due.
+         */
+        size_t late = 0;
+
+        /**
+         * This is the longest a packet has been sent after it was due,
+         * in seconds.
+         */
+        double maxLateness = 0.0;
+
+        /**
+         * This is the number of packets received.
+         */
+        size_t received = 0;
+    };
+
+    // Lifecycle Methods
+public:
+    ~UdpMediaTransport() noexcept;
+    UdpMediaTransport(const UdpMediaTransport&) = delete;
+    UdpMediaTransport(UdpMediaTransport&&) noexcept = delete;
+    UdpMediaTransport& operator=(const UdpMediaTransport&) = delete;
+    UdpMediaTransport& operator=(UdpMediaTransport&&) noexcept = delete;
+
+    // Public Methods
+public:
+    /**
+     * This is the constructor of the class.
+     */
+    UdpMediaTransport();
+
+    SystemAbstractions::DiagnosticsSender::UnsubscribeDelegate SubscribeToDiagnostics(
+        SystemAbstractions::DiagnosticsSender::DiagnosticMessageDelegate delegate,
+        size_t minLevel = 0
+    );
+
+    /**
+     * This method opens the socket, allocates the packet ring, and starts
+     * the threads which send and receive packets.
+     *
+     * @param[in] timeKeeper
+     *     This is the clock used to pace the packets sent.
+     *
+     * @param[in] configuration
+     *     This holds the configurable parameters of the transport.
+     *
+     * @param[in] localPort
+     *     This is the local port to which to bind the socket,
+     *     or zero to have one picked.
+     *
+     * @return
+     *     An indication of whether or not the transport was opened
+     *     is returned.
+     */
+    bool Open(
+        const std::shared_ptr< TimeKeeper >& timeKeeper,
+        const Configuration& configuration,
+        uint16_t localPort = 0
+    );
+
+    /**
+     * This method stops the threads and closes the socket.  Packets still
+     * waiting to be sent are discarded.
+     */
+    void Close();
+
+    /**
+     * This method returns the local port to which the socket is bound,
+     * which is needed for Discord's IP discovery.
+     *
+     * @return
+     *     The local port of the socket is returned, or zero if the
+     *     transport isn't open.
+     */
+    uint16_t GetLocalPort();
+
+    /**
+     * This method sets up a stream of packets to the given voice server.
+     * The host name is resolved before returning.
+     *
+     * @param[in] host
+     *     This is the host name or address of the voice server.
+     *
+     * @param[in] port
+     *     This is the UDP port of the voice server.
+     *
+     * @param[in] ssrc
+     *     This is the synchronization source given to the stream
+     *     by the voice server.
+     *
+     * @param[in] sealer
+     *     If not empty, this is called to encrypt each packet
+     *     of the stream.
+     *
+     * @return
+     *     An identifier of the stream is returned, or zero if the host
+     *     couldn't be resolved.
+     */
+    int AddStream(
+        const std::string& host,
+        uint16_t port,
+        uint32_t ssrc,
+        Sealer sealer
+    );
+
+    /**
+     * This method ends the given stream.  Packets of the stream already
+     * queued are still sent.
+     *
+     * @param[in] streamId
+     *     This identifies the stream to end.
+     */
+    void RemoveStream(int streamId);
+
+    /**
+     * This method queues the given frame to be sent on the given stream,
+     * one frame duration after the last frame queued for the stream, or
+     * right away if that time has passed.  The frame is copied once,
+     * straight into the packet buffer it's sealed and sent from.
+     *
+     * @param[in] streamId
+     *     This identifies the stream on which to send the frame.
+     *
+     * @param[in] frame
+     *     This is the start of the encoded frame.
+     *
+     * @param[in] size
+     *     This is the size of the encoded frame, in bytes.
+     *
+     * @return
+     *     An indication of whether or not the frame was queued
+     *     is returned.
+     */
+    bool SendFrame(
+        int streamId,
+        const uint8_t* frame,
+        size_t size
+    );
+
+    /**
+     * This method sets the function to call with each packet received.
+     *
+     * @param[in] onReceive
+     *     This is the function to call with each packet received.
+     */
+    void RegisterReceiveDelegate(ReceiveDelegate onReceive);
+
+    /**
+     * This method returns statistics about the transport.
+     *
+     * @return
+     *     Statistics about the transport are returned.
+     */
+    Statistics GetStatistics();
+
+    // Private properties
+private:
+    /**
+     * This is the type of structure that contains the private
+     * properties of the instance.  It is defined in the implementation
+     * and declared here to ensure that it is scoped inside the class.
+     */
+    struct Impl;
+
+    /**
+     * This contains the private properties of the instance.
+     */
+    std::unique_ptr< Impl > impl_;
+};
@@ -7,12 +7,510 @@
  */
 
 #include "Diagnostics.hpp"
+#include "GatewayPayload.hpp"
+#include "SpscRing.hpp"
 #include "WebSocket.hpp"
+#include "ZlibStream.hpp"
 
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
 #include <mutex>
 #include <stddef.h>
+#include <stdint.h>
+#include <thread>
 #include <vector>
 
+namespace {
+
+    /**
+     * This is the first byte of every payload in Discord's
+     * External Term Format (ETF) encoding.
+     */
+    constexpr uint8_t ETF_VERSION = 131;
+
+    /**
+     * This is the WebSocket close code used when a message received
+     * can't be decoded.
+     */
+    constexpr unsigned int CLOSE_CODE_INVALID_PAYLOAD = 1007;
+
+    /**
+     * This is the WebSocket close code used when the inbound queue
+     * overflows and the connection is closed so that the session can be
+     * resumed.  Discord invalidates the session when a client closes with
+     * 1000 or 1001, but not with a code like this one.
+     */
+    constexpr unsigned int CLOSE_CODE_RESUME = 4000;
+
+    /**
+     * This is the maximum number of messages of each kind to hold
+     * while waiting for a callback to be registered.
+     */
+    constexpr size_t INBOUND_BACKLOG_CAPACITY = 1024;
+
+    /**
+     * This is the type of function called to deliver a message.
+     */
+    typedef Discord::WebSocket::ReceiveCallback ReceiveCallback;
+
+    /**
+     * This hands off messages of one kind (text or binary) from the
+     * thread receiving them to the registered callback.  Once a callback
+     * is registered and any backlog is drained, messages are delivered
+     * straight through a shared pointer to the callback, loaded
+     * atomically, without taking the channel's locks.  Until then,
+     * they're held in a bounded, preallocated ring.
+     */
+    struct InboundChannel {
+        // Properties
+
+        /**
+         * This is used to synchronize switching between holding messages
+         * in the backlog and delivering them directly.
+         */
+        std::mutex mutex;
+
+        /**
+         * This is used to make sure only one thread at a time registers
+         * a callback, so that only one thread drains the backlog.
+         */
+        std::mutex registrationMutex;
+
+        /**
+         * This flag is set once a callback is registered and the backlog
+         * has been drained, so that messages may be delivered directly.
+         */
+        std::atomic< bool > direct{false};
+
+        /**
+         * This points to the callback most recently registered, if any.
+         * It's only ever accessed atomically.  A callback replaced is
+         * freed once the receiving thread is no longer calling it through
+         * a copy of the pointer loaded before it was replaced.
+         */
+        std::shared_ptr< const ReceiveCallback > callback;
+
+        /**
+         * This holds messages received while no callback is registered,
+         * or before the backlog has been drained.
+         */
+        SpscRing< std::string > backlog;
+
+        /**
+         * If metrics are kept, this counts the messages held
+         * in the backlog.
+         */
+        std::shared_ptr< Metrics::Gauge > backlogDepth;
+
+        // Methods
+
+        InboundChannel()
+            : backlog(INBOUND_BACKLOG_CAPACITY)
+        {
+        }
+
+        ~InboundChannel() noexcept {
+            if (backlogDepth == nullptr) {
+                return;
+            }
+            std::string data;
+            while (backlog.TryPop(data)) {
+                backlogDepth->Add(-1);
+            }
+        }
+
+        /**
+         * This method is called by the thread receiving messages,
+         * to deliver the given message, or hold it in the backlog.
+         *
+         * @param[in] data
+         *     This is the message to deliver.
+         *
+         * @return
+         *     An indication of whether or not the message was delivered
+         *     or held is returned.  If the backlog is full, the message
+         *     is dropped, and false is returned.
+         */
+        bool Receive(std::string&& data) {
+            if (direct.load(std::memory_order_acquire)) {
+                const auto callbackSample = std::atomic_load(&callback);
+                if (callbackSample != nullptr) {
+                    (*callbackSample)(std::move(data));
+                    return true;
+                }
+            }
+            std::unique_lock< decltype(mutex) > lock(mutex);
+            if (direct.load(std::memory_order_relaxed)) {
+                const auto callbackSample = std::atomic_load(&callback);
+                lock.unlock();
+                (*callbackSample)(std::move(data));
+                return true;
+            }
+            if (!backlog.TryPush(std::move(data))) {
+                return false;
+            }
+            if (backlogDepth != nullptr) {
+                backlogDepth->Add(1);
+            }
+            return true;
+        }
+
+        /**
+         * This method registers the given callback, delivering to it any
+         * messages held in the backlog before allowing any new messages
+         * to be delivered directly.
+         *
+         * @param[in] newCallback
+         *     This is the callback to register.  If it's empty, messages
+         *     are held in the backlog again until another callback
+         *     is registered.
+         */
+        void Register(ReceiveCallback&& newCallback) {
+            std::lock_guard< decltype(registrationMutex) > registrationLock(registrationMutex);
+            std::unique_lock< decltype(mutex) > lock(mutex);
+            if (newCallback == nullptr) {
+                direct.store(false, std::memory_order_release);
+                std::atomic_store(&callback, std::shared_ptr< const ReceiveCallback >());
+                return;
+            }
+            const auto callbackSample = std::make_shared< const ReceiveCallback >(std::move(newCallback));
+            std::atomic_store(&callback, callbackSample);
+            while (!direct.load(std::memory_order_relaxed)) {
+                lock.unlock();
+                std::string data;
+                while (backlog.TryPop(data)) {
+                    if (backlogDepth != nullptr) {
+                        backlogDepth->Add(-1);
+                    }
+                    (*callbackSample)(std::move(data));
+                }
+                lock.lock();
+                if (backlog.IsEmpty()) {
+                    direct.store(true, std::memory_order_release);
+                }
+            }
+        }
+    };
+
+    /**
+     * This is used to give each adapter a unique key with which to
+     * dispatch the messages it receives.
+     */
+    std::atomic< uint64_t > nextDispatchKey{1};
+
+    /**
+     * This is the task dispatched to deliver one received message
+     * to a registered callback.
+     */
+    struct DispatchedMessage {
+        /**
+         * This is the callback to which to deliver the message.
+         */
+        std::shared_ptr< ReceiveCallback > callback;
+
+        /**
+         * This is the message to deliver.
+         */
+        std::string message;
+
+        void operator()() {
+            (*callback)(std::move(message));
+        }
+    };
+
+    /**
+     * This function wraps the given callback so that the messages given
+     * to it are delivered through the given dispatcher.  Every message of
+     * a connection is dispatched with the connection's key, since the
+     * callbacks are those of the gateway, which needs them one at a time
+     * and in order.
+     *
+     * @param[in] callback
+     *     This is the callback to wrap.
+     *
+     * @param[in] dispatcher
+     *     This is the dispatcher through which to deliver messages.
+     *
+     * @param[in] connectionKey
+     *     This is the key with which to dispatch messages.
+     *
+     * @return
+     *     The wrapped callback is returned.
+     */
+    ReceiveCallback DispatchThrough(
+        ReceiveCallback&& callback,
+        const std::shared_ptr< EventDispatcher >& dispatcher,
+        uint64_t connectionKey
+    ) {
+        if (callback == nullptr) {
+            return nullptr;
+        }
+        const auto sharedCallback = std::make_shared< ReceiveCallback >(std::move(callback));
+        return [
+            sharedCallback,
+            dispatcher,
+            connectionKey
+        ](std::string&& message){
+            DispatchedMessage task;
+            task.callback = sharedCallback;
+            task.message = std::move(message);
+            dispatcher->Dispatch(connectionKey, std::move(task));
+        };
+    }
+
+    /**
+     * This function wraps the given close callback so that it's called
+     * through the given dispatcher, after every message the connection
+     * received before closing.
+     *
+     * @param[in] callback
+     *     This is the callback to wrap.
+     *
+     * @param[in] dispatcher
+     *     This is the dispatcher through which to call the callback.
+     *
+     * @param[in] connectionKey
+     *     This is the key with which the connection's messages
+     *     are dispatched.
+     *
+     * @return
+     *     The wrapped callback is returned.
+     */
+    WebSocket::CloseCallback DispatchCloseThrough(
+        WebSocket::CloseCallback&& callback,
+        const std::shared_ptr< EventDispatcher >& dispatcher,
+        uint64_t connectionKey
+    ) {
+        if (callback == nullptr) {
+            return nullptr;
+        }
+        const auto sharedCallback = std::make_shared< WebSocket::CloseCallback >(std::move(callback));
+        return [
+            sharedCallback,
+            dispatcher,
+            connectionKey
+        ]{
+            dispatcher->Dispatch(
+                connectionKey,
+                [sharedCallback]{
+                    (*sharedCallback)();
+                }
+            );
+        };
+    }
+
+    /**
+     * This identifies a kind of gateway event to drop when received.
+     */
+    struct DroppedEvent {
+        /**
+         * This is the name of the event.
+         */
+        std::string name;
+
+        /**
+         * If metrics are kept, this counts the events dropped.
+         */
+        std::shared_ptr< Metrics::Counter > dropped;
+    };
+
+    /**
+     * These are the kinds of entries in the inbound queue.
+     */
+    enum class InboundKind {
+        Text,
+        Binary,
+        Close,
+    };
+
+    /**
+     * This is an entry in the inbound queue.
+     */
+    struct InboundMessage {
+        /**
+         * This is the kind of entry.
+         */
+        InboundKind kind;
+
+        /**
+         * This indicates whether or not the message may be dropped
+         * when the queue overflows.
+         */
+        bool droppable = false;
+
+        /**
+         * This is the content of the message.
+         */
+        std::string data;
+    };
+
+    /**
+     * This holds messages received until the adapter's delivery thread
+     * hands them to their callbacks.  It's shared between the adapter and
+     * the delivery thread, so that the thread can still check whether
+     * it should stop after the adapter is destroyed while it's
+     * delivering a message.
+     */
+    struct InboundQueue {
+        /**
+         * This is used to synchronize access to the queue.
+         */
+        std::mutex mutex;
+
+        /**
+         * This is notified when an entry is added to the queue,
+         * or the delivery thread should stop.
+         */
+        std::condition_variable ready;
+
+        /**
+         * This is notified when the queue drains down to its low
+         * watermark after being blocked, or the delivery thread
+         * should stop.
+         */
+        std::condition_variable roomAvailable;
+
+        /**
+         * These are the entries waiting to be delivered.
+         */
+        std::deque< InboundMessage > messages;
+
+        /**
+         * This is the high watermark of the queue.
+         */
+        size_t capacity = 0;
+
+        /**
+         * This is the low watermark of the queue.
+         */
+        size_t lowWatermark = 0;
+
+        /**
+         * This selects what to do when the queue reaches its
+         * high watermark.
+         */
+        WebSocket::InboundOverflowPolicy overflowPolicy = WebSocket::InboundOverflowPolicy::Reconnect;
+
+        /**
+         * This indicates whether or not the thread receiving messages
+         * is held up until the queue drains down to its low watermark.
+         */
+        bool blocked = false;
+
+        /**
+         * This indicates whether or not the queue overflowed and the
+         * connection is being closed, in which case messages received
+         * are discarded.
+         */
+        bool overflowed = false;
+
+        /**
+         * This indicates whether or not the delivery thread should stop.
+         */
+        bool stopping = false;
+
+        /**
+         * If metrics are kept, this counts the entries in the queue.
+         */
+        std::shared_ptr< Metrics::Gauge > depth;
+
+        /**
+         * If metrics are kept, this counts the messages dropped
+         * because the queue overflowed.
+         */
+        std::shared_ptr< Metrics::Counter > dropped;
+
+        // Methods
+
+        /**
+         * This method drops the oldest droppable messages in the queue
+         * until it's down to its low watermark, or there are no more
+         * messages which may be dropped.
+         *
+         * @note
+         *     The mutex must be held while calling this method.
+         *
+         * @return
+         *     The number of messages dropped is returned.
+         */
+        size_t DropOldest() {
+            size_t numDropped = 0;
+            auto message = messages.begin();
+            while (
+                (messages.size() > lowWatermark)
+                && (message != messages.end())
+            ) {
+                if (message->droppable) {
+                    message = messages.erase(message);
+                    ++numDropped;
+                } else {
+                    ++message;
+                }
+            }
+            if (depth != nullptr) {
+                depth->Add(-(int64_t)numDropped);
+            }
+            if (dropped != nullptr) {
+                dropped->Add(numDropped);
+            }
+            return numDropped;
+        }
+
+        /**
+         * This method empties the queue.
+         *
+         * @note
+         *     The mutex must be held while calling this method.
+         */
+        void Clear() {
+            if (depth != nullptr) {
+                depth->Add(-(int64_t)messages.size());
+            }
+            messages.clear();
+        }
+    };
+
+    /**
+     * This function checks whether or not the given text message is
+     * one which may be dropped when the inbound queue overflows.
+     *
+     * @param[in] data
+     *     This is the text message to check.
+     *
+     * @return
+     *     An indication of whether or not the message may be dropped
+     *     is returned.
+     */
+    bool IsDroppable(const std::string& data) {
+        GatewayPayload::Header header;
+        return (
+            GatewayPayload::ScanHeader(data, header)
+            && (header.opcode == GatewayPayload::OPCODE_DISPATCH)
+            && !GatewayPayload::IsEvent(data, header, "READY")
+            && !GatewayPayload::IsEvent(data, header, "RESUMED")
+        );
+    }
+
+    /**
+     * This holds a message waiting to be sent.
+     */
+    struct OutboundMessage {
+        /**
+         * This indicates whether the message is binary or text.
+         */
+        bool binary;
+
+        /**
+         * This is the content of the message.
+         */
+        std::string data;
+    };
+
+}
+
 /**
  * This contains the private properties of a WebSocket class instance.
  */
@@ -24,8 +522,39 @@ struct WebSocket::Impl {
     SystemAbstractions::DiagnosticsSender diagnosticsSender;
     std::recursive_mutex mutex;
     CloseCallback onClose;
-    ReceiveCallback onText;
-    std::vector< std::string > storedData;
+    InboundChannel binaryChannel;
+    InboundChannel textChannel;
+    std::unique_ptr< ZlibStream > zlibStream;
+    std::shared_ptr< EventDispatcher > dispatcher;
+    std::function< void(const std::string& message) > textObserver;
+    std::vector< DroppedEvent > droppedEvents;
+    std::function< void(uint64_t sequence) > droppedSequenceObserver;
+    std::shared_ptr< Metrics::Counter > textFramesReceived;
+    std::shared_ptr< Metrics::Counter > binaryFramesReceived;
+    std::shared_ptr< Metrics::Counter > bytesReceived;
+    const uint64_t dispatchKey = nextDispatchKey++;
+    std::mutex outboundMutex;
+    std::vector< OutboundMessage > outbound;
+    std::vector< OutboundMessage > sending;
+    bool flushing = false;
+
+    /**
+     * This is the WebSocket through which messages are sent.  It's the
+     * same as the adaptee, but it's only ever accessed atomically, so
+     * that senders don't need the adapter's mutex, which may be held by
+     * the threads receiving messages or closing the connection.
+     */
+    std::shared_ptr< WebSockets::WebSocket > sendTarget;
+
+    /**
+     * If not null, this is a heartbeat waiting to be sent ahead of
+     * any other messages waiting.  Only the latest heartbeat is kept,
+     * since it carries the latest sequence number.
+     */
+    std::atomic< std::string* > pendingHeartbeat{nullptr};
+
+    std::shared_ptr< InboundQueue > inboundQueue;
+    std::thread inboundThread;
 
     // Methods
 
@@ -34,10 +563,421 @@ struct WebSocket::Impl {
     {
     }
 
-    void OnBinary(
-        std::string&& data,
-        std::unique_lock< decltype(mutex) >& lock
+    ~Impl() noexcept {
+        delete pendingHeartbeat.exchange(nullptr);
+        if (inboundQueue == nullptr) {
+            return;
+        }
+        std::unique_lock< decltype(inboundQueue->mutex) > lock(inboundQueue->mutex);
+        inboundQueue->stopping = true;
+        inboundQueue->Clear();
+        inboundQueue->ready.notify_all();
+        inboundQueue->roomAvailable.notify_all();
+        lock.unlock();
+        if (inboundThread.get_id() == std::this_thread::get_id()) {
+            inboundThread.detach();
+        } else {
+            inboundThread.join();
+        }
+    }
+
+    /**
+     * This is the body of the thread which delivers the messages in the
+     * inbound queue to their callbacks.
+     *
+     * @param[in] queue
+     *     This is the inbound queue.
+     *
+     * @param[in] weakImpl
+     *     This refers to the adapter whose callbacks to call.
+     */
+    static void DeliverInbound(
+        std::shared_ptr< InboundQueue > queue,
+        std::weak_ptr< Impl > weakImpl
+    ) {
+        std::unique_lock< decltype(queue->mutex) > lock(queue->mutex);
+        for (;;) {
+            queue->ready.wait(
+                lock,
+                [queue]{
+                    return (
+                        queue->stopping
+                        || !queue->messages.empty()
+                    );
+                }
+            );
+            if (queue->stopping) {
+                return;
+            }
+            auto message = std::move(queue->messages.front());
+            queue->messages.pop_front();
+            if (queue->depth != nullptr) {
+                queue->depth->Add(-1);
+            }
+            const auto unblocked = (
+                queue->blocked
+                && (queue->messages.size() <= queue->lowWatermark)
+            );
+            if (unblocked) {
+                queue->blocked = false;
+                queue->roomAvailable.notify_all();
+            }
+            lock.unlock();
+            {
+                auto impl = weakImpl.lock();
+                if (impl != nullptr) {
+                    if (unblocked) {
+                        impl->diagnosticsSender.SendDiagnosticInformationString(
+                            1,
+                            "Inbound queue drained; reading resumed"
+                        );
+                    }
+                    impl->DeliverNow(std::move(message));
+                }
+            }
+            lock.lock();
+        }
+    }
+
+    /**
+     * This method delivers the given entry of the inbound queue.
+     *
+     * @param[in] message
+     *     This is the entry to deliver.
+     */
+    void DeliverNow(InboundMessage&& message) {
+        switch (message.kind) {
+            case InboundKind::Text: {
+                Deliver(textChannel, std::move(message.data));
+            } break;
+
+            case InboundKind::Binary: {
+                Deliver(binaryChannel, std::move(message.data));
+            } break;
+
+            case InboundKind::Close:
+            default: {
+                std::unique_lock< decltype(mutex) > lock(mutex);
+                OnClose(lock);
+            } break;
+        }
+    }
+
+    /**
+     * This method is called by the thread receiving messages to put the
+     * given entry in the inbound queue, doing whatever the overflow
+     * policy calls for if the queue is at its high watermark.  Close
+     * entries are always queued, so that they're delivered after every
+     * message received before them.
+     *
+     * @note
+     *     The adapter's mutex must not be held while calling this method,
+     *     since it may wait for the delivery thread, which takes it.
+     *
+     * @param[in] kind
+     *     This is the kind of entry.
+     *
+     * @param[in] data
+     *     This is the content of the message.
+     */
+    void Enqueue(
+        InboundKind kind,
+        std::string&& data
+    ) {
+        auto& queue = *inboundQueue;
+        InboundMessage message;
+        message.kind = kind;
+        message.droppable = (
+            (kind == InboundKind::Text)
+            && (queue.overflowPolicy == InboundOverflowPolicy::DropOldest)
+            && IsDroppable(data)
+        );
+        message.data = std::move(data);
+        std::unique_lock< decltype(queue.mutex) > lock(queue.mutex);
+        if (kind != InboundKind::Close) {
+            if (
+                queue.overflowed
+                || queue.stopping
+            ) {
+                return;
+            }
+            if (queue.messages.size() >= queue.capacity) {
+                switch (queue.overflowPolicy) {
+                    case InboundOverflowPolicy::Block:
+                    default: {
+                        queue.blocked = true;
+                        lock.unlock();
+                        diagnosticsSender.SendDiagnosticInformationFormatted(
+                            SystemAbstractions::DiagnosticsSender::Levels::WARNING,
+                            "Inbound queue reached %zu messages; reading, and sending, held back",
+                            queue.capacity
+                        );
+                        lock.lock();
+                        queue.roomAvailable.wait(
+                            lock,
+                            [&queue]{
+                                return (
+                                    !queue.blocked
+                                    || queue.stopping
+                                );
+                            }
+                        );
+                        if (queue.stopping) {
+                            return;
+                        }
+                    } break;
+
+                    case InboundOverflowPolicy::DropOldest: {
+                        const auto numDropped = queue.DropOldest();
+                        lock.unlock();
+                        diagnosticsSender.SendDiagnosticInformationFormatted(
+                            SystemAbstractions::DiagnosticsSender::Levels::WARNING,
+                            "Inbound queue reached %zu messages; dropped %zu dispatches",
+                            queue.capacity,
+                            numDropped
+                        );
+                        lock.lock();
+                    } break;
+
+                    case InboundOverflowPolicy::Reconnect: {
+                        queue.overflowed = true;
+                        queue.Clear();
+                        lock.unlock();
+                        diagnosticsSender.SendDiagnosticInformationFormatted(
+                            SystemAbstractions::DiagnosticsSender::Levels::WARNING,
+                            "Inbound queue reached %zu messages; closing to resume",
+                            queue.capacity
+                        );
+                        std::lock_guard< decltype(mutex) > adapteeLock(mutex);
+                        if (adaptee != nullptr) {
+                            adaptee->Close(CLOSE_CODE_RESUME);
+                        }
+                        return;
+                    }
+                }
+            }
+        }
+        queue.messages.push_back(std::move(message));
+        if (queue.depth != nullptr) {
+            queue.depth->Add(1);
+        }
+        queue.ready.notify_one();
+    }
+
+    /**
+     * This method hands over a message received, either by putting it
+     * in the inbound queue, if there is one, or by delivering it
+     * through the given channel.
+     *
+     * @param[in,out] channel
+     *     This is the channel through which to deliver the message.
+     *
+     * @param[in] kind
+     *     This is the kind of message.
+     *
+     * @param[in] data
+     *     This is the message to deliver.
+     */
+    void Receive(
+        InboundChannel& channel,
+        InboundKind kind,
+        std::string&& data
+    ) {
+        if (inboundQueue == nullptr) {
+            Deliver(channel, std::move(data));
+        } else {
+            Enqueue(kind, std::move(data));
+        }
+    }
+
+    /**
+     * This method counts a frame received, if metrics are kept.
+     *
+     * @param[in] framesReceived
+     *     This is the counter of frames of the kind received.
+     *
+     * @param[in] size
+     *     This is the size of the frame's payload, in bytes.
+     */
+    void CountFrame(
+        const std::shared_ptr< Metrics::Counter >& framesReceived,
+        size_t size
+    ) {
+        if (framesReceived == nullptr) {
+            return;
+        }
+        framesReceived->Add();
+        bytesReceived->Add(size);
+    }
+
+    /**
+     * This method checks whether or not the given text message is a
+     * dispatch of one of the events configured to be dropped, counting
+     * it and passing its sequence number to the observer if so.
+     *
+     * @param[in] data
+     *     This is the text message to check.
+     *
+     * @return
+     *     An indication of whether or not the message should be dropped
+     *     is returned.
+     */
+    bool IsDropped(const std::string& data) {
+        GatewayPayload::Header header;
+        if (
+            !GatewayPayload::ScanHeader(data, header)
+            || (header.opcode != GatewayPayload::OPCODE_DISPATCH)
+        ) {
+            return false;
+        }
+        for (const auto& droppedEvent: droppedEvents) {
+            if (GatewayPayload::IsEvent(data, header, droppedEvent.name.c_str())) {
+                if (droppedEvent.dropped != nullptr) {
+                    droppedEvent.dropped->Add();
+                }
+                if (
+                    header.hasSequence
+                    && (droppedSequenceObserver != nullptr)
+                ) {
+                    droppedSequenceObserver(header.sequence);
+                }
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /**
+     * This method delivers a message received through the given channel,
+     * reporting if it had to be dropped because the channel's backlog
+     * is full.
+     *
+     * @param[in,out] channel
+     *     This is the channel through which to deliver the message.
+     *
+     * @param[in] data
+     *     This is the message to deliver.
+     */
+    void Deliver(
+        InboundChannel& channel,
+        std::string&& data
     ) {
+        if (!channel.Receive(std::move(data))) {
+            diagnosticsSender.SendDiagnosticInformationString(
+                SystemAbstractions::DiagnosticsSender::Levels::WARNING,
+                "Inbound backlog full; message dropped"
+            );
+        }
+    }
+
+    /**
+     * This method sends the heartbeat waiting in the heartbeat slot,
+     * if any.
+     *
+     * @param[in] target
+     *     This is the WebSocket through which to send the heartbeat.
+     */
+    void SendPendingHeartbeat(const std::shared_ptr< WebSockets::WebSocket >& target) {
+        std::unique_ptr< std::string > heartbeat(pendingHeartbeat.exchange(nullptr));
+        if (heartbeat != nullptr) {
+            target->SendText(*heartbeat);
+        }
+    }
+
+    /**
+     * This method queues the given message to be sent.  If no other
+     * thread is already sending, this thread sends everything queued,
+     * including anything queued by other threads while it's sending,
+     * so that a burst of small messages goes out back to back.  Messages
+     * are sent without holding the adapter's mutex, so senders don't
+     * hold up inbound delivery or each other.  Heartbeats skip the queue:
+     * they're put in a slot of their own, which the sending thread checks
+     * before each message, so that a heartbeat never waits for more than
+     * the message being sent when it's queued.
+     *
+     * @param[in] binary
+     *     This indicates whether the message is binary or text.
+     *
+     * @param[in] data
+     *     This is the content of the message.
+     */
+    void Send(
+        bool binary,
+        std::string&& data
+    ) {
+        const auto target = std::atomic_load(&sendTarget);
+        if (target == nullptr) {
+            return;
+        }
+        const auto heartbeat = (
+            !binary
+            && (GatewayPayload::GetOpcode(data) == GatewayPayload::OPCODE_HEARTBEAT)
+        );
+        if (heartbeat) {
+            delete pendingHeartbeat.exchange(new std::string(std::move(data)));
+        }
+        std::unique_lock< decltype(outboundMutex) > lock(outboundMutex);
+        if (!heartbeat) {
+            outbound.push_back({binary, std::move(data)});
+        }
+        if (flushing) {
+            return;
+        }
+        flushing = true;
+        do {
+            sending.swap(outbound);
+            lock.unlock();
+            SendPendingHeartbeat(target);
+            for (const auto& message: sending) {
+                if (message.binary) {
+                    target->SendBinary(message.data);
+                } else {
+                    target->SendText(message.data);
+                }
+                SendPendingHeartbeat(target);
+            }
+            lock.lock();
+            sending.clear();
+        } while (
+            !outbound.empty()
+            || (pendingHeartbeat.load() != nullptr)
+        );
+        flushing = false;
+    }
+
+    void OnBinary(std::string&& data) {
+        if (zlibStream == nullptr) {
+            Receive(binaryChannel, InboundKind::Binary, std::move(data));
+            return;
+        }
+        std::string payload;
+        switch (zlibStream->Push(std::move(data), payload)) {
+            case ZlibStream::Result::Incomplete: {
+            } break;
+
+            case ZlibStream::Result::Complete: {
+                if (
+                    !payload.empty()
+                    && ((uint8_t)payload[0] == ETF_VERSION)
+                ) {
+                    Receive(binaryChannel, InboundKind::Binary, std::move(payload));
+                } else {
+                    OnText(std::move(payload));
+                }
+            } break;
+
+            case ZlibStream::Result::Error:
+            default: {
+                diagnosticsSender.SendDiagnosticInformationString(
+                    SystemAbstractions::DiagnosticsSender::Levels::ERROR,
+                    "Unable to decompress message"
+                );
+                std::lock_guard< decltype(mutex) > lock(mutex);
+                if (adaptee != nullptr) {
+                    adaptee->Close(CLOSE_CODE_INVALID_PAYLOAD);
+                }
+            } break;
+        }
     }
 
     void OnClose(
@@ -71,24 +1011,24 @@ struct WebSocket::Impl {
     ) {
     }
 
-    void OnText(
-        std::string&& data,
-        std::unique_lock< decltype(mutex) >& lock
-    ) {
-        diagnosticsSender.SendDiagnosticInformationFormatted(
+    void OnText(std::string&& data) {
+        if (
+            !droppedEvents.empty()
+            && IsDropped(data)
+        ) {
+            return;
+        }
+        DIAG_FORMATTED(
+            diagnosticsSender,
+            DIAG_THRESHOLD_WEB_SOCKET_WRAPPER,
             0,
             "Received Text Message: %s",
             data.c_str()
         );
-        decltype(onText) onTextSample(onText);
-        lock.unlock();
-        if (onTextSample == nullptr) {
-            lock.lock();
-            storedData.push_back(std::move(data));
-        } else {
-            onTextSample(std::move(data));
-            lock.lock();
+        if (textObserver != nullptr) {
+            textObserver(data);
         }
+        Receive(textChannel, InboundKind::Text, std::move(data));
     }
 };
 
@@ -107,9 +1047,87 @@ SystemAbstractions::DiagnosticsSender::UnsubscribeDelegate WebSocket::SubscribeT
     return impl_->diagnosticsSender.SubscribeToDiagnostics(delegate, minLevel);
 }
 
-void WebSocket::Configure(std::shared_ptr< WebSockets::WebSocket >&& adaptee) {
+void WebSocket::Configure(
+    std::shared_ptr< WebSockets::WebSocket >&& adaptee,
+    const Configuration& configuration
+) {
     std::lock_guard< decltype(impl_->mutex) > lock(impl_->mutex);
+    if (configuration.zlibStream) {
+        impl_->zlibStream.reset(new ZlibStream());
+    }
+    impl_->dispatcher = configuration.dispatcher;
+    impl_->textObserver = configuration.textObserver;
+    impl_->droppedSequenceObserver = configuration.droppedSequenceObserver;
+    impl_->droppedEvents.clear();
+    for (const auto& eventName: configuration.droppedEvents) {
+        DroppedEvent droppedEvent;
+        droppedEvent.name = eventName;
+        if (configuration.metrics != nullptr) {
+            droppedEvent.dropped = configuration.metrics->GetCounter(
+                "discordplay_gateway_events_dropped_total",
+                "Gateway events dropped as soon as they were received",
+                {{"event", eventName}}
+            );
+        }
+        impl_->droppedEvents.push_back(std::move(droppedEvent));
+    }
+    if (configuration.metrics != nullptr) {
+        impl_->textFramesReceived = configuration.metrics->GetCounter(
+            "discordplay_gateway_frames_received_total",
+            "WebSocket frames received over gateway connections",
+            {{"type", "text"}}
+        );
+        impl_->binaryFramesReceived = configuration.metrics->GetCounter(
+            "discordplay_gateway_frames_received_total",
+            "WebSocket frames received over gateway connections",
+            {{"type", "binary"}}
+        );
+        impl_->bytesReceived = configuration.metrics->GetCounter(
+            "discordplay_gateway_bytes_received_total",
+            "Payload bytes of WebSocket frames received over gateway connections"
+        );
+        impl_->textChannel.backlogDepth = configuration.metrics->GetGauge(
+            "discordplay_gateway_inbound_backlog",
+            "Messages received and held waiting for a callback to be registered",
+            {{"type", "text"}}
+        );
+        impl_->binaryChannel.backlogDepth = configuration.metrics->GetGauge(
+            "discordplay_gateway_inbound_backlog",
+            "Messages received and held waiting for a callback to be registered",
+            {{"type", "binary"}}
+        );
+    }
+    if (
+        (configuration.inboundQueueCapacity > 0)
+        && (impl_->inboundQueue == nullptr)
+    ) {
+        impl_->inboundQueue = std::make_shared< InboundQueue >();
+        auto& queue = *impl_->inboundQueue;
+        queue.capacity = configuration.inboundQueueCapacity;
+        queue.lowWatermark = (
+            (configuration.inboundLowWatermark == 0)
+            ? configuration.inboundQueueCapacity / 2
+            : std::min(configuration.inboundLowWatermark, configuration.inboundQueueCapacity)
+        );
+        queue.overflowPolicy = configuration.inboundOverflowPolicy;
+        if (configuration.metrics != nullptr) {
+            queue.depth = configuration.metrics->GetGauge(
+                "discordplay_gateway_inbound_queue_depth",
+                "Messages received and waiting in the inbound queue to be delivered"
+            );
+            queue.dropped = configuration.metrics->GetCounter(
+                "discordplay_gateway_inbound_dropped_total",
+                "Dispatch events dropped because the inbound queue overflowed"
+            );
+        }
+        impl_->inboundThread = std::thread(
+            &Impl::DeliverInbound,
+            impl_->inboundQueue,
+            std::weak_ptr< Impl >(impl_)
+        );
+    }
     impl_->adaptee = std::move(adaptee);
+    std::atomic_store(&impl_->sendTarget, impl_->adaptee);
     impl_->adaptee->SubscribeToDiagnostics(
         impl_->diagnosticsSender.Chain(),
         DIAG_LEVEL_WEB_SOCKET
@@ -137,16 +1155,16 @@ void WebSocket::Configure(std::shared_ptr< WebSockets::WebSocket >&& adaptee) {
             if (impl == nullptr) {
                 return;
             }
-            std::unique_lock< decltype(impl->mutex) > lock(impl->mutex);
-            impl->OnText(std::move(data), lock);
+            impl->CountFrame(impl->textFramesReceived, data.size());
+            impl->OnText(std::move(data));
         },
         [weakImpl](std::string&& data){  // binary
             auto impl = weakImpl.lock();
             if (impl == nullptr) {
                 return;
             }
-            std::unique_lock< decltype(impl->mutex) > lock(impl->mutex);
-            impl->OnBinary(std::move(data), lock);
+            impl->CountFrame(impl->binaryFramesReceived, data.size());
+            impl->OnBinary(std::move(data));
         },
         [weakImpl](                      // close
             unsigned int code,
@@ -156,6 +1174,10 @@ void WebSocket::Configure(std::shared_ptr< WebSockets::WebSocket >&& adaptee) {
             if (impl == nullptr) {
                 return;
             }
+            if (impl->inboundQueue != nullptr) {
+                impl->Enqueue(InboundKind::Close, std::string());
+                return;
+            }
             std::unique_lock< decltype(impl->mutex) > lock(impl->mutex);
             impl->OnClose(lock);
         }
@@ -163,6 +1185,7 @@ void WebSocket::Configure(std::shared_ptr< WebSockets::WebSocket >&& adaptee) {
 }
 
 void WebSocket::Binary(std::string&& message) {
+    impl_->Send(true, std::move(message));
 }
 
 void WebSocket::Close(unsigned int code) {
@@ -174,18 +1197,32 @@ void WebSocket::Close(unsigned int code) {
 }
 
 void WebSocket::Text(std::string&& message) {
-    std::lock_guard< decltype(impl_->mutex) > lock(impl_->mutex);
-    if (impl_->adaptee == nullptr) {
-        return;
-    }
-    impl_->adaptee->SendText(message);
+    impl_->Send(false, std::move(message));
 }
 
 void WebSocket::RegisterBinaryCallback(ReceiveCallback&& onBinary) {
+    std::unique_lock< decltype(impl_->mutex) > lock(impl_->mutex);
+    const auto dispatcher = impl_->dispatcher;
+    lock.unlock();
+    if (dispatcher != nullptr) {
+        onBinary = DispatchThrough(
+            std::move(onBinary),
+            dispatcher,
+            impl_->dispatchKey
+        );
+    }
+    impl_->binaryChannel.Register(std::move(onBinary));
 }
 
 void WebSocket::RegisterCloseCallback(CloseCallback&& onClose) {
     std::unique_lock< decltype(impl_->mutex) > lock(impl_->mutex);
+    if (impl_->dispatcher != nullptr) {
+        onClose = DispatchCloseThrough(
+            std::move(onClose),
+            impl_->dispatcher,
+            impl_->dispatchKey
+        );
+    }
     impl_->onClose = std::move(onClose);
     if (
         impl_->closed
@@ -199,17 +1236,14 @@ void WebSocket::RegisterCloseCallback(CloseCallback&& onClose) {
 
 void WebSocket::RegisterTextCallback(ReceiveCallback&& onText) {
     std::unique_lock< decltype(impl_->mutex) > lock(impl_->mutex);
-    impl_->onText = std::move(onText);
-    if (
-        !impl_->storedData.empty()
-        && (impl_->onText != nullptr)
-    ) {
-        decltype(impl_->storedData) storedData;
-        storedData.swap(impl_->storedData);
-        decltype(impl_->onText) onTextSample(impl_->onText);
-        lock.unlock();
-        for (auto& message: storedData) {
-            onTextSample(std::move(message));
-        }
+    const auto dispatcher = impl_->dispatcher;
+    lock.unlock();
+    if (dispatcher != nullptr) {
+        onText = DispatchThrough(
+            std::move(onText),
+            dispatcher,
+            impl_->dispatchKey
+        );
     }
+    impl_->textChannel.Register(std::move(onText));
 }
@@ -8,9 +8,16 @@
  * © 2020 by Richard Walters
  */
 
+#include "EventDispatcher.hpp"
+#include "Metrics.hpp"
+
 #include <Discord/WebSocket.hpp>
+#include <functional>
 #include <memory>
+#include <stdint.h>
+#include <string>
 #include <SystemAbstractions/DiagnosticsSender.hpp>
+#include <vector>
 #include <WebSockets/WebSocket.hpp>
 
 /**
@@ -20,6 +27,117 @@
 class WebSocket
     : public Discord::WebSocket
 {
+    // Types
+public:
+    /**
+     * These are the ways the adapter can respond when its inbound queue
+     * reaches its high watermark.
+     */
+    enum class InboundOverflowPolicy {
+        /**
+         * Stop reading from the connection until the queue drains down
+         * to its low watermark, so that TCP flow control holds back the
+         * server.
+         *
+         * @warning
+         *     This holds up the thread receiving messages, which is also
+         *     the one sending them, so no heartbeats or other messages
+         *     are sent while the queue drains.  For gateway connections,
+         *     a long enough wait makes Discord drop the connection.
+         */
+        Block,
+
+        /**
+         * Drop the oldest dispatch events in the queue, other than READY
+         * and RESUMED, until it's down to its low watermark.  Other
+         * messages, including all binary (ETF-encoded) ones, are never
+         * dropped.
+         */
+        DropOldest,
+
+        /**
+         * Discard the queue and close the connection with a code which
+         * keeps the session resumable, so that the gateway session can
+         * reconnect and have Discord replay the events missed.
+         */
+        Reconnect,
+    };
+
+    /**
+     * This holds the configurable parameters of the adapter.
+     */
+    struct Configuration {
+        /**
+         * This indicates whether or not the connection uses Discord's
+         * "zlib-stream" transport compression, in which case binary
+         * messages received are decompressed, and each complete payload
+         * is delivered as text (JSON encoding) or binary (ETF encoding).
+         */
+        bool zlibStream = false;
+
+        /**
+         * If set, this is used to run the callbacks registered for
+         * received messages on a pool of worker threads, rather than on
+         * the thread receiving them.  The messages of each connection,
+         * and the closing of the connection, are run in order, one at
+         * a time, while those of different connections run in parallel.
+         */
+        std::shared_ptr< EventDispatcher > dispatcher;
+
+        /**
+         * If set, this is called with each text message received, on the
+         * thread receiving it, before the message is delivered.
+         */
+        std::function< void(const std::string& message) > textObserver;
+
+        /**
+         * These are the names of gateway events to drop as soon as they're
+         * received, before they're observed, dispatched, or decoded.  Only
+         * the top level of each text message is scanned to find its
+         * event name.
+         */
+        std::vector< std::string > droppedEvents;
+
+        /**
+         * If set, this is called with the sequence number of each dispatch
+         * dropped because its event is one of the dropped events, on the
+         * thread receiving it, so that the sequence numbers of dropped
+         * dispatches can still be followed.
+         */
+        std::function< void(uint64_t sequence) > droppedSequenceObserver;
+
+        /**
+         * If not zero, messages received are put in a queue of this many
+         * messages at most (the high watermark), and delivered from there
+         * on a thread of the adapter's own, so that a slow callback
+         * doesn't hold up the thread receiving them.  If zero, messages
+         * are delivered on the thread receiving them.
+         */
+        size_t inboundQueueCapacity = 0;
+
+        /**
+         * Once the inbound queue reaches its high watermark, this is the
+         * number of messages it's brought back down to before reading or
+         * queuing resumes normally.  If zero, half the capacity is used.
+         */
+        size_t inboundLowWatermark = 0;
+
+        /**
+         * This selects what to do when the inbound queue reaches its
+         * high watermark.  The default closes the connection to resume,
+         * which loses no events and keeps heartbeats going, unlike
+         * InboundOverflowPolicy::Block.
+         */
+        InboundOverflowPolicy inboundOverflowPolicy = InboundOverflowPolicy::Reconnect;
+
+        /**
+         * If set, this is the registry in which to count the frames and
+         * bytes received, the messages held waiting for a callback, and
+         * the messages in the inbound queue.
+         */
+        std::shared_ptr< Metrics > metrics;
+    };
+
     // Lifecycle Methods
 public:
     ~WebSocket() noexcept;
@@ -40,7 +158,10 @@ public:
         size_t minLevel = 0
     );
 
-    void Configure(std::shared_ptr< WebSockets::WebSocket >&& adaptee);
+    void Configure(
+        std::shared_ptr< WebSockets::WebSocket >&& adaptee,
+        const Configuration& configuration
+    );
 
     // Discord::WebSocket
 public:
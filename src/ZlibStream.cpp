@@ -0,0 +1,160 @@
+/**
+ * @file ZlibStream.cpp
+ *
+ * This module contains the implementations of the ZlibStream class.
+ *
+ * © 2020 by Richard Walters
+ */
+
+#include "ZlibStream.hpp"
+
+#include <stddef.h>
+#include <string.h>
+#include <string>
+#include <zlib.h>
+
+namespace {
+
+    /**
+     * This is the suffix which marks the end of each payload in the stream.
+     */
+    const char ZLIB_SUFFIX[] = {'\x00', '\x00', '\xff', '\xff'};
+
+    /**
+     * This is the number of bytes by which to grow the output buffer
+     * each time it fills up while decompressing.
+     */
+    constexpr size_t OUTPUT_CHUNK_SIZE = 16384;
+
+}
+
+/**
+ * This contains the private properties of a ZlibStream class instance.
+ */
+struct ZlibStream::Impl {
+    // Properties
+
+    /**
+     * This is the inflate context, kept for the life of the stream.
+     */
+    z_stream zs;
+
+    /**
+     * This holds compressed data received until it completes a payload.
+     */
+    std::string buffer;
+
+    /**
+     * This is set if the stream could not be decompressed.
+     */
+    bool broken = false;
+
+    /**
+     * This is how many times larger than its compressed data the most
+     * recent payload was, used to guess how much room to set aside for
+     * the next one, so that large payloads are decompressed into a
+     * buffer allocated once, rather than grown a chunk at a time.
+     */
+    double expansion = 0.0;
+
+    // Methods
+
+    Impl() {
+        memset(&zs, 0, sizeof(zs));
+        broken = (inflateInit(&zs) != Z_OK);
+    }
+
+    ~Impl() noexcept {
+        if (!broken) {
+            (void)inflateEnd(&zs);
+        }
+    }
+
+    /**
+     * This method decompresses the given data, which must end on
+     * a flush boundary of the stream.
+     *
+     * @param[in] input
+     *     This is the compressed data to decompress.
+     *
+     * @param[out] output
+     *     This is where to store the decompressed data.
+     *
+     * @return
+     *     An indication of whether or not the data was decompressed
+     *     successfully is returned.
+     */
+    bool Inflate(
+        const std::string& input,
+        std::string& output
+    ) {
+        output.clear();
+        if (expansion > 0.0) {
+            output.reserve((size_t)(input.length() * expansion * 1.125) + OUTPUT_CHUNK_SIZE);
+        }
+        zs.next_in = (Bytef*)input.data();
+        zs.avail_in = (uInt)input.length();
+        size_t produced = 0;
+        do {
+            output.resize(produced + OUTPUT_CHUNK_SIZE);
+            zs.next_out = (Bytef*)&output[produced];
+            zs.avail_out = (uInt)OUTPUT_CHUNK_SIZE;
+            const auto result = inflate(&zs, Z_SYNC_FLUSH);
+            if (
+                (result != Z_OK)
+                && (result != Z_BUF_ERROR)
+            ) {
+                return false;
+            }
+            produced += OUTPUT_CHUNK_SIZE - zs.avail_out;
+        } while (
+            (zs.avail_in > 0)
+            || (zs.avail_out == 0)
+        );
+        output.resize(produced);
+        if (!input.empty()) {
+            expansion = (double)produced / (double)input.length();
+        }
+        return true;
+    }
+};
+
+ZlibStream::~ZlibStream() noexcept = default;
+
+ZlibStream::ZlibStream()
+    : impl_(new Impl())
+{
+}
+
+auto ZlibStream::Push(
+    std::string&& data,
+    std::string& payload
+) -> Result {
+    if (impl_->broken) {
+        return Result::Error;
+    }
+    if (impl_->buffer.empty()) {
+        impl_->buffer = std::move(data);
+    } else {
+        impl_->buffer += data;
+    }
+    if (
+        (impl_->buffer.length() < sizeof(ZLIB_SUFFIX))
+        || (
+            memcmp(
+                impl_->buffer.data() + impl_->buffer.length() - sizeof(ZLIB_SUFFIX),
+                ZLIB_SUFFIX,
+                sizeof(ZLIB_SUFFIX)
+            ) != 0
+        )
+    ) {
+        return Result::Incomplete;
+    }
+    const auto inflated = impl_->Inflate(impl_->buffer, payload);
+    impl_->buffer.clear();
+    if (!inflated) {
+        impl_->broken = true;
+        return Result::Error;
+    }
+    return Result::Complete;
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+/**
+ * @file ZlibStream.hpp
+ *
+ * This module declares the ZlibStream class.
+ *
+ * © 2020 by Richard Walters
+ */
+
+#include <memory>
+#include <string>
+
+/**
+ * This decompresses a Discord "zlib-stream" transport, where a single zlib
+ * stream spans every message on a WebSocket, and each complete payload is
+ * flushed with a Z_SYNC_FLUSH, marked by the suffix 00 00 FF FF.  One
+ * inflate context is kept for the life of the stream, since each payload
+ * depends on the ones before it.
+ */
+class ZlibStream {
+    // Types
+public:
+    /**
+     * These are the possible outcomes of pushing data into the stream.
+     */
+    enum class Result {
+        /**
+         * The data was buffered, but doesn't yet complete a payload.
+         */
+        Incomplete,
+
+        /**
+         * The data completed a payload, which was decompressed.
+         */
+        Complete,
+
+        /**
+         * The data couldn't be decompressed, and the stream is unusable.
+         */
+        Error,
+    };
+
+    // Lifecycle Methods
+public:
+    ~ZlibStream() noexcept;
+    ZlibStream(const ZlibStream&) = delete;
+    ZlibStream(ZlibStream&&) noexcept = delete;
+    ZlibStream& operator=(const ZlibStream&) = delete;
+    ZlibStream& operator=(ZlibStream&&) noexcept = delete;
+
+    // Public Methods
+public:
+    /**
+     * This is the constructor of the class.
+     */
+    ZlibStream();
+
+    /**
+     * This method adds the given compressed data to the stream, and
+     * decompresses the buffered data if it now completes a payload.
+     *
+     * @param[in] data
+     *     This is the compressed data to add to the stream.
+     *
+     * @param[out] payload
+     *     If a payload is completed, this is where to store it.
+     *
+     * @return
+     *     The outcome of adding the data is returned.
+     */
+    Result Push(
+        std::string&& data,
+        std::string& payload
+    );
+
+    // Private properties
+private:
+    /**
+     * This is the type of structure that contains the private
+     * properties of the instance.  It is defined in the implementation
+     * and declared here to ensure that it is scoped inside the class.
+     */
+    struct Impl;
+
+    /**
+     * This contains the private properties of the instance.
+     */
+    std::unique_ptr< Impl > impl_;
+};
@@ -7,31 +7,58 @@
  * © 2020 by Richard Walters
  */
 
+#include "AsyncDiagnosticsReporter.hpp"
+#include "ConnectionPool.hpp"
 #include "Connections.hpp"
 #include "Diagnostics.hpp"
+#include "EventDispatcher.hpp"
+#include "GatewayCache.hpp"
+#include "GatewaySession.hpp"
+#include "IdentifyGate.hpp"
+#include "Metrics.hpp"
+#include "ResponseCache.hpp"
+#include "SchedulerTimers.hpp"
+#include "ShardConnections.hpp"
+#include "ShutdownEvent.hpp"
 #include "TimeKeeper.hpp"
+#include "TimingWheel.hpp"
+#include "TrustStore.hpp"
+#include "WebSocket.hpp"
 
 #include <Discord/Gateway.hpp>
 #include <Http/Client.hpp>
+#include <future>
 #include <Http/Request.hpp>
 #include <HttpNetworkTransport/HttpClientNetworkTransport.hpp>
 #include <memory>
+#include <mutex>
 #include <signal.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string>
 #include <StringExtensions/StringExtensions.hpp>
-#include <SystemAbstractions/DiagnosticsStreamReporter.hpp>
 #include <SystemAbstractions/File.hpp>
 #include <SystemAbstractions/NetworkConnection.hpp>
 #include <thread>
 #include <Timekeeping/Scheduler.hpp>
 #include <TlsDecorator/TlsDecorator.hpp>
+#include <Uri/Uri.hpp>
+#include <vector>
 #include <WebSockets/WebSocket.hpp>
 
 namespace {
 
+    /**
+     * This is the host name of the server providing Discord's API.
+     */
+    const char* const API_SERVER_NAME = "discord.com";
+
+    /**
+     * This is the port number of secure web servers.
+     */
+    constexpr uint16_t HTTPS_PORT = 443;
+
     /**
      * This function prints to the standard error stream information
      * about how to use this program.
@@ -40,17 +67,114 @@ namespace {
         fprintf(
             stderr,
             (
-                "Usage: DiscordPlay\n"
+                "Usage: DiscordPlay [options]\n"
                 "\n"
                 "Perform Discord experiment.\n"
+                "\n"
+                "Options:\n"
+                "  --pool-max-idle <count>\n"
+                "      Keep at most this many idle connections to each server\n"
+                "      for reuse (default: 4).\n"
+                "  --pool-idle-timeout <seconds>\n"
+                "      Close idle connections after this many seconds\n"
+                "      instead of reusing them (default: 60).\n"
+                "  --pool-spares <count>\n"
+                "      Keep this many spare connections, with their TLS\n"
+                "      handshakes done, ready for each server, up to\n"
+                "      --pool-max-idle (default: 0).\n"
+                "  --zlib-stream\n"
+                "      Use zlib-stream transport compression for the\n"
+                "      gateway connection.\n"
+                "  --shard-count <count>\n"
+                "      Run in sharded mode, with this many shards in total\n"
+                "      across all processes.\n"
+                "  --shards <first>-<last>\n"
+                "      Run only this range of shards in this process\n"
+                "      (default: all of them).\n"
+                "  --max-concurrency <count>\n"
+                "      Let this many shards identify every 5 seconds, as\n"
+                "      given by Discord's session start limit (default: 1).\n"
+                "  --dispatch-workers <count>\n"
+                "      Handle gateway events on a pool of this many worker\n"
+                "      threads, in order per connection (default: 0,\n"
+                "      meaning events are handled on the thread receiving\n"
+                "      them).\n"
+                "  --timing-wheel\n"
+                "      Keep the timers used for rate limiting and identify\n"
+                "      pacing in a timing wheel, rather than in a\n"
+                "      scheduler.\n"
+                "  --coalesce-gets\n"
+                "      Merge GET requests identical to one already in\n"
+                "      flight into it, sharing its response.\n"
+                "  --response-cache <entries>\n"
+                "      Keep the responses to this many recent GET requests\n"
+                "      to answer identical ones (default: 0).\n"
+                "  --response-cache-max-age <seconds>\n"
+                "      Keep cached responses which don't say for how long\n"
+                "      they may be kept for this many seconds, or until\n"
+                "      a gateway event reports a change (default: 0).\n"
+                "  --reconnect\n"
+                "      Connect again, resuming the session, whenever the\n"
+                "      gateway connection is lost, rather than exiting.\n"
+                "  --prewarm-round-trip <seconds>\n"
+                "      With --reconnect, open a replacement gateway\n"
+                "      connection and switch over to it whenever a\n"
+                "      heartbeat takes longer than this to be\n"
+                "      acknowledged (default: 0, meaning never).\n"
+                "  --metrics <path>\n"
+                "      Keep counters, gauges, and latency percentiles, and\n"
+                "      write them to this file in the Prometheus text\n"
+                "      format, for a textfile collector to pick up.\n"
+                "  --metrics-interval <seconds>\n"
+                "      With --metrics, write them this often\n"
+                "      (default: 10).\n"
+                "  --drop-events <name>[,<name>...]\n"
+                "      Drop gateway events with these names (such as\n"
+                "      PRESENCE_UPDATE or TYPING_START) as soon as\n"
+                "      they're received, without decoding them.\n"
+                "  --gateway-cache <path>\n"
+                "      Keep the gateway URL in this file, so that the\n"
+                "      next run can open its gateway connections ahead\n"
+                "      of time, without asking Discord for it first.\n"
+                "  --gateway-cache-max-age <seconds>\n"
+                "      With --gateway-cache, use the gateway URL kept\n"
+                "      for this long (default: 3600).\n"
+                "  --max-requests-in-flight <count>\n"
+                "      Let at most this many resource requests through to\n"
+                "      the rate limiter at once, holding back the rest in\n"
+                "      lanes by priority, so that critical requests (the\n"
+                "      gateway URL and interaction responses) go ahead of\n"
+                "      bulk ones (default: 0, meaning no limit).\n"
+                "  --bulk-requests-in-flight <count>\n"
+                "      Let at most this many bulk resource requests (such\n"
+                "      as message purges and role changes) through at once\n"
+                "      (default: 4, with 0 meaning no limit).\n"
+                "  --inbound-queue <count>\n"
+                "      Queue up to this many gateway messages received,\n"
+                "      delivering them on a thread of their own, so that\n"
+                "      slow handling doesn't hold up the connection\n"
+                "      (default: 0, meaning no queue).\n"
+                "  --inbound-low-watermark <count>\n"
+                "      With --inbound-queue, once the queue is full, bring\n"
+                "      it back down to this many messages before carrying\n"
+                "      on (default: half the queue).\n"
+                "  --inbound-overflow block|drop|reconnect\n"
+                "      With --inbound-queue, when the queue is full, close\n"
+                "      the connection so that, with --reconnect, the\n"
+                "      session is resumed (reconnect), drop the oldest\n"
+                "      dispatch events (drop), or stop reading from the\n"
+                "      connection (block), which also stops heartbeats\n"
+                "      and other messages being sent until the queue\n"
+                "      drains, so Discord may drop the connection\n"
+                "      (default: reconnect).\n"
             )
         );
     }
 
     /**
-     * This flag indicates whether or not the web client should shut down.
+     * This is the event set when the program should shut down.
      */
-    bool shutDown = false;
+    ShutdownEvent* shutdownEvent = nullptr;
 
     /**
      * This contains variables set through the operating system environment
@@ -58,21 +182,65 @@ namespace {
      */
     struct Environment {
         Discord::Gateway::Configuration configuration;
+        ConnectionPool::Configuration connectionPool;
+        WebSocket::Configuration webSocket;
+        size_t shardCount = 0;
+        size_t firstShard = 0;
+        size_t lastShard = 0;
+        bool shardRangeGiven = false;
+        size_t maxConcurrency = 1;
+        size_t dispatchWorkers = 0;
+        bool timingWheel = false;
+        bool coalesceGets = false;
+        ResponseCache::Configuration responseCache;
+        GatewaySession::Configuration session;
+        std::string metricsPath;
+        double metricsInterval = 10.0;
+        std::string gatewayCachePath;
+        double gatewayCacheMaxAge = 3600.0;
+        size_t maxRequestsInFlight = 0;
+        size_t bulkRequestsInFlight = 4;
     };
 
     /**
      * This function is set up to be called when the SIGINT signal is
-     * received by the program.  It just sets the "shutDown" flag
-     * and relies on the program to be polling the flag to detect
-     * when it's been set.
+     * received by the program.  It just sets the shutdown event,
+     * which wakes the main thread waiting on it.
      *
      * @param[in] sig
      *     This is the signal for which this function was called.
      */
     void InterruptHandler(int) {
-        shutDown = true;
+        if (shutdownEvent != nullptr) {
+            shutdownEvent->Set();
+        }
     }
 
+    /**
+     * This installs InterruptHandler for SIGINT, pointed at the given
+     * shutdown event, for as long as it exists.  When it's destroyed, on
+     * any path out of main, the previous handler is put back and the
+     * event is let go, so that a signal received while the program exits
+     * never sets an event which no longer exists.
+     */
+    struct InterruptHandlerInstallation {
+        typedef void (*SignalHandler)(int);
+        SignalHandler previousInterruptHandler;
+
+        explicit InterruptHandlerInstallation(ShutdownEvent& shutdown) {
+            shutdownEvent = &shutdown;
+            previousInterruptHandler = signal(SIGINT, InterruptHandler);
+        }
+
+        ~InterruptHandlerInstallation() {
+            (void)signal(SIGINT, previousInterruptHandler);
+            shutdownEvent = nullptr;
+        }
+
+        InterruptHandlerInstallation(const InterruptHandlerInstallation&) = delete;
+        InterruptHandlerInstallation& operator=(const InterruptHandlerInstallation&) = delete;
+    };
+
     /**
      * This function updates the program environment to incorporate
      * any applicable command-line arguments.
@@ -103,12 +271,335 @@ namespace {
             const std::string arg(argv[i]);
             switch (state) {
                 case 0: { // next argument
+                    if (arg == "--pool-max-idle") {
+                        state = 1;
+                    } else if (arg == "--pool-idle-timeout") {
+                        state = 2;
+                    } else if (arg == "--pool-spares") {
+                        state = 3;
+                    } else if (arg == "--zlib-stream") {
+                        environment.webSocket.zlibStream = true;
+                    } else if (arg == "--shard-count") {
+                        state = 4;
+                    } else if (arg == "--shards") {
+                        state = 5;
+                    } else if (arg == "--max-concurrency") {
+                        state = 6;
+                    } else if (arg == "--dispatch-workers") {
+                        state = 7;
+                    } else if (arg == "--timing-wheel") {
+                        environment.timingWheel = true;
+                    } else if (arg == "--coalesce-gets") {
+                        environment.coalesceGets = true;
+                    } else if (arg == "--response-cache") {
+                        state = 8;
+                    } else if (arg == "--response-cache-max-age") {
+                        state = 9;
+                    } else if (arg == "--reconnect") {
+                        environment.session.reconnect = true;
+                    } else if (arg == "--prewarm-round-trip") {
+                        state = 10;
+                    } else if (arg == "--metrics") {
+                        state = 11;
+                    } else if (arg == "--metrics-interval") {
+                        state = 12;
+                    } else if (arg == "--drop-events") {
+                        state = 13;
+                    } else if (arg == "--gateway-cache") {
+                        state = 14;
+                    } else if (arg == "--gateway-cache-max-age") {
+                        state = 15;
+                    } else if (arg == "--max-requests-in-flight") {
+                        state = 16;
+                    } else if (arg == "--bulk-requests-in-flight") {
+                        state = 17;
+                    } else if (arg == "--inbound-queue") {
+                        state = 18;
+                    } else if (arg == "--inbound-low-watermark") {
+                        state = 19;
+                    } else if (arg == "--inbound-overflow") {
+                        state = 20;
+                    } else {
+                        diagnosticsSender.SendDiagnosticInformationFormatted(
+                            SystemAbstractions::DiagnosticsSender::Levels::ERROR,
+                            "unrecognized option '%s'",
+                            arg.c_str()
+                        );
+                        return false;
+                    }
+                } break;
+
+                case 1: { // --pool-max-idle
+                    if (sscanf(arg.c_str(), "%zu", &environment.connectionPool.maxIdleConnections) != 1) {
+                        diagnosticsSender.SendDiagnosticInformationFormatted(
+                            SystemAbstractions::DiagnosticsSender::Levels::ERROR,
+                            "invalid idle connection count '%s'",
+                            arg.c_str()
+                        );
+                        return false;
+                    }
+                    state = 0;
+                } break;
+
+                case 2: { // --pool-idle-timeout
+                    if (sscanf(arg.c_str(), "%lf", &environment.connectionPool.idleTimeout) != 1) {
+                        diagnosticsSender.SendDiagnosticInformationFormatted(
+                            SystemAbstractions::DiagnosticsSender::Levels::ERROR,
+                            "invalid idle connection timeout '%s'",
+                            arg.c_str()
+                        );
+                        return false;
+                    }
+                    state = 0;
+                } break;
+
+                case 3: { // --pool-spares
+                    if (sscanf(arg.c_str(), "%zu", &environment.connectionPool.spareConnections) != 1) {
+                        diagnosticsSender.SendDiagnosticInformationFormatted(
+                            SystemAbstractions::DiagnosticsSender::Levels::ERROR,
+                            "invalid spare connection count '%s'",
+                            arg.c_str()
+                        );
+                        return false;
+                    }
+                    state = 0;
+                } break;
+
+                case 4: { // --shard-count
+                    if (
+                        (sscanf(arg.c_str(), "%zu", &environment.shardCount) != 1)
+                        || (environment.shardCount == 0)
+                    ) {
+                        diagnosticsSender.SendDiagnosticInformationFormatted(
+                            SystemAbstractions::DiagnosticsSender::Levels::ERROR,
+                            "invalid shard count '%s'",
+                            arg.c_str()
+                        );
+                        return false;
+                    }
+                    state = 0;
+                } break;
+
+                case 5: { // --shards
+                    if (
+                        (sscanf(arg.c_str(), "%zu-%zu", &environment.firstShard, &environment.lastShard) != 2)
+                        || (environment.firstShard > environment.lastShard)
+                    ) {
+                        diagnosticsSender.SendDiagnosticInformationFormatted(
+                            SystemAbstractions::DiagnosticsSender::Levels::ERROR,
+                            "invalid shard range '%s'",
+                            arg.c_str()
+                        );
+                        return false;
+                    }
+                    environment.shardRangeGiven = true;
+                    state = 0;
+                } break;
+
+                case 6: { // --max-concurrency
+                    if (
+                        (sscanf(arg.c_str(), "%zu", &environment.maxConcurrency) != 1)
+                        || (environment.maxConcurrency == 0)
+                    ) {
+                        diagnosticsSender.SendDiagnosticInformationFormatted(
+                            SystemAbstractions::DiagnosticsSender::Levels::ERROR,
+                            "invalid maximum concurrency '%s'",
+                            arg.c_str()
+                        );
+                        return false;
+                    }
+                    state = 0;
+                } break;
+
+                case 7: { // --dispatch-workers
+                    if (sscanf(arg.c_str(), "%zu", &environment.dispatchWorkers) != 1) {
+                        diagnosticsSender.SendDiagnosticInformationFormatted(
+                            SystemAbstractions::DiagnosticsSender::Levels::ERROR,
+                            "invalid dispatch worker count '%s'",
+                            arg.c_str()
+                        );
+                        return false;
+                    }
+                    state = 0;
+                } break;
+
+                case 8: { // --response-cache
+                    if (sscanf(arg.c_str(), "%zu", &environment.responseCache.capacity) != 1) {
+                        diagnosticsSender.SendDiagnosticInformationFormatted(
+                            SystemAbstractions::DiagnosticsSender::Levels::ERROR,
+                            "invalid response cache size '%s'",
+                            arg.c_str()
+                        );
+                        return false;
+                    }
+                    state = 0;
+                } break;
+
+                case 9: { // --response-cache-max-age
+                    if (sscanf(arg.c_str(), "%lf", &environment.responseCache.defaultMaxAge) != 1) {
+                        diagnosticsSender.SendDiagnosticInformationFormatted(
+                            SystemAbstractions::DiagnosticsSender::Levels::ERROR,
+                            "invalid response cache max age '%s'",
+                            arg.c_str()
+                        );
+                        return false;
+                    }
+                    state = 0;
+                } break;
+
+                case 10: { // --prewarm-round-trip
+                    if (sscanf(arg.c_str(), "%lf", &environment.session.prewarmRoundTrip) != 1) {
+                        diagnosticsSender.SendDiagnosticInformationFormatted(
+                            SystemAbstractions::DiagnosticsSender::Levels::ERROR,
+                            "invalid prewarm round trip time '%s'",
+                            arg.c_str()
+                        );
+                        return false;
+                    }
+                    state = 0;
+                } break;
+
+                case 11: { // --metrics
+                    environment.metricsPath = arg;
+                    state = 0;
+                } break;
+
+                case 12: { // --metrics-interval
+                    if (
+                        (sscanf(arg.c_str(), "%lf", &environment.metricsInterval) != 1)
+                        || (environment.metricsInterval <= 0.0)
+                    ) {
+                        diagnosticsSender.SendDiagnosticInformationFormatted(
+                            SystemAbstractions::DiagnosticsSender::Levels::ERROR,
+                            "invalid metrics interval '%s'",
+                            arg.c_str()
+                        );
+                        return false;
+                    }
+                    state = 0;
+                } break;
+
+                case 13: { // --drop-events
+                    for (const auto& eventName: StringExtensions::Split(arg, ',')) {
+                        const auto trimmedEventName = StringExtensions::Trim(eventName);
+                        if (!trimmedEventName.empty()) {
+                            environment.webSocket.droppedEvents.push_back(trimmedEventName);
+                        }
+                    }
+                    state = 0;
+                } break;
+
+                case 14: { // --gateway-cache
+                    environment.gatewayCachePath = arg;
+                    state = 0;
+                } break;
+
+                case 15: { // --gateway-cache-max-age
+                    if (sscanf(arg.c_str(), "%lf", &environment.gatewayCacheMaxAge) != 1) {
+                        diagnosticsSender.SendDiagnosticInformationFormatted(
+                            SystemAbstractions::DiagnosticsSender::Levels::ERROR,
+                            "invalid gateway cache max age '%s'",
+                            arg.c_str()
+                        );
+                        return false;
+                    }
+                    state = 0;
+                } break;
+
+                case 16: { // --max-requests-in-flight
+                    if (sscanf(arg.c_str(), "%zu", &environment.maxRequestsInFlight) != 1) {
+                        diagnosticsSender.SendDiagnosticInformationFormatted(
+                            SystemAbstractions::DiagnosticsSender::Levels::ERROR,
+                            "invalid maximum requests in flight '%s'",
+                            arg.c_str()
+                        );
+                        return false;
+                    }
+                    state = 0;
+                } break;
+
+                case 17: { // --bulk-requests-in-flight
+                    if (sscanf(arg.c_str(), "%zu", &environment.bulkRequestsInFlight) != 1) {
+                        diagnosticsSender.SendDiagnosticInformationFormatted(
+                            SystemAbstractions::DiagnosticsSender::Levels::ERROR,
+                            "invalid maximum bulk requests in flight '%s'",
+                            arg.c_str()
+                        );
+                        return false;
+                    }
+                    state = 0;
+                } break;
+
+                case 18: { // --inbound-queue
+                    if (sscanf(arg.c_str(), "%zu", &environment.webSocket.inboundQueueCapacity) != 1) {
+                        diagnosticsSender.SendDiagnosticInformationFormatted(
+                            SystemAbstractions::DiagnosticsSender::Levels::ERROR,
+                            "invalid inbound queue size '%s'",
+                            arg.c_str()
+                        );
+                        return false;
+                    }
+                    state = 0;
+                } break;
+
+                case 19: { // --inbound-low-watermark
+                    if (sscanf(arg.c_str(), "%zu", &environment.webSocket.inboundLowWatermark) != 1) {
+                        diagnosticsSender.SendDiagnosticInformationFormatted(
+                            SystemAbstractions::DiagnosticsSender::Levels::ERROR,
+                            "invalid inbound queue low watermark '%s'",
+                            arg.c_str()
+                        );
+                        return false;
+                    }
+                    state = 0;
+                } break;
+
+                case 20: { // --inbound-overflow
+                    if (arg == "block") {
+                        environment.webSocket.inboundOverflowPolicy = WebSocket::InboundOverflowPolicy::Block;
+                    } else if (arg == "drop") {
+                        environment.webSocket.inboundOverflowPolicy = WebSocket::InboundOverflowPolicy::DropOldest;
+                    } else if (arg == "reconnect") {
+                        environment.webSocket.inboundOverflowPolicy = WebSocket::InboundOverflowPolicy::Reconnect;
+                    } else {
+                        diagnosticsSender.SendDiagnosticInformationFormatted(
+                            SystemAbstractions::DiagnosticsSender::Levels::ERROR,
+                            "invalid inbound overflow policy '%s'",
+                            arg.c_str()
+                        );
+                        return false;
+                    }
                     state = 0;
                 } break;
 
                 default: break;
             }
         }
+        if (state != 0) {
+            diagnosticsSender.SendDiagnosticInformationString(
+                SystemAbstractions::DiagnosticsSender::Levels::ERROR,
+                "missing value for last option"
+            );
+            return false;
+        }
+        if (environment.shardRangeGiven) {
+            if (environment.shardCount == 0) {
+                diagnosticsSender.SendDiagnosticInformationString(
+                    SystemAbstractions::DiagnosticsSender::Levels::ERROR,
+                    "shard range given without shard count"
+                );
+                return false;
+            }
+            if (environment.lastShard >= environment.shardCount) {
+                diagnosticsSender.SendDiagnosticInformationString(
+                    SystemAbstractions::DiagnosticsSender::Levels::ERROR,
+                    "shard range exceeds shard count"
+                );
+                return false;
+            }
+        } else if (environment.shardCount > 0) {
+            environment.lastShard = environment.shardCount - 1;
+        }
         return true;
     }
 
@@ -117,7 +608,7 @@ namespace {
      * bundle from the file system, where it's expected to be sitting
      * side-by-side the program's image, with the name "cert.pem".
      *
-     * @param[out] caCerts
+     * @param[out] trustStore
      *     This is where to store the loaded CA certificate bundle.
      *
      * @param[in] diagnosticsSender
@@ -127,33 +618,19 @@ namespace {
      *     An indication of whether or not the function succeeded is returned.
      */
     bool LoadCaCerts(
-        std::string& caCerts,
+        std::shared_ptr< const TrustStore >& trustStore,
         const SystemAbstractions::DiagnosticsSender& diagnosticsSender
     ) {
-        SystemAbstractions::File caCertsFile(
-            SystemAbstractions::File::GetExeParentDirectory()
-            + "/cert.pem"
-        );
-        if (!caCertsFile.OpenReadOnly()) {
-            diagnosticsSender.SendDiagnosticInformationFormatted(
-                SystemAbstractions::DiagnosticsSender::Levels::ERROR,
-                "unable to open root CA certificates file '%s'",
-                caCertsFile.GetPath().c_str()
-            );
-            return false;
-        }
-        std::vector< uint8_t > caCertsBuffer(caCertsFile.GetSize());
-        if (caCertsFile.Read(caCertsBuffer) != caCertsBuffer.size()) {
-            diagnosticsSender.SendDiagnosticInformationString(
-                SystemAbstractions::DiagnosticsSender::Levels::ERROR,
-                "unable to read root CA certificates file"
-            );
+        const auto newTrustStore = std::make_shared< TrustStore >();
+        if (
+            !newTrustStore->Load(
+                SystemAbstractions::File::GetExeParentDirectory() + "/cert.pem",
+                diagnosticsSender
+            )
+        ) {
             return false;
         }
-        caCerts.assign(
-            (const char*)caCertsBuffer.data(),
-            caCertsBuffer.size()
-        );
+        trustStore = newTrustStore;
         return true;
     }
 
@@ -163,13 +640,22 @@ namespace {
      * @param[in,out] client
      *     This is the client to start.
      *
+     * @param[in] timeKeeper
+     *     This is the object used to tell time.
+     *
+     * @param[out] connectionPool
+     *     This is where to store the pool of connections made for
+     *     the client.
+     *
      * @param[in] environment
      *     This contains variables set through the operating system
      *     environment or the command-line arguments.
      *
-     * @param[in] caCerts
-     *     This is the trusted certificate authority (CA) certificate bundle to
-     *     use to verify certificates at the TLS layer.
+     * @param[in] trustStore
+     *     This will hold the trusted certificate authority (CA) certificate
+     *     bundle to use to verify certificates at the TLS layer, once it's
+     *     loaded.  It's shared by every connection rather than copied into
+     *     each one, and connections made before it's loaded wait for it.
      *
      * @param[in] diagnosticsSender
      *     This is the object to use to publish any diagnostic messages.
@@ -180,8 +666,9 @@ namespace {
     bool StartClient(
         Http::Client& client,
         const std::shared_ptr< TimeKeeper >& timeKeeper,
+        std::shared_ptr< ConnectionPool >& connectionPool,
         const Environment& environment,
-        const std::string& caCerts,
+        const std::shared_future< std::shared_ptr< const TrustStore > >& trustStore,
         const SystemAbstractions::DiagnosticsSender& diagnosticsSender
     ) {
         auto transport = std::make_shared< HttpNetworkTransport::HttpClientNetworkTransport >();
@@ -191,10 +678,10 @@ namespace {
             DIAG_LEVEL_NETWORK_TRANSPORT
         );
         Http::Client::MobilizationDependencies deps;
-        transport->SetConnectionFactory(
+        connectionPool = std::make_shared< ConnectionPool >(
             [
                 diagnosticMessageDelegate,
-                caCerts
+                trustStore
             ](
                 const std::string& scheme,
                 const std::string& serverName
@@ -208,8 +695,12 @@ namespace {
                     (scheme == "https")
                     || (scheme == "wss")
                 ) {
+                    const auto trustStoreSample = trustStore.get();
+                    if (trustStoreSample == nullptr) {
+                        return nullptr;
+                    }
                     const auto tlsDecorator = std::make_shared< TlsDecorator::TlsDecorator >();
-                    tlsDecorator->ConfigureAsClient(connection, caCerts, serverName);
+                    tlsDecorator->ConfigureAsClient(connection, trustStoreSample->GetPem(), serverName);
                     tlsDecorator->SubscribeToDiagnostics(
                         diagnosticMessageDelegate,
                         DIAG_LEVEL_TLS_DECORATOR
@@ -218,6 +709,25 @@ namespace {
                 } else {
                     return connection;
                 }
+            },
+            timeKeeper
+        );
+        connectionPool->Configure(environment.connectionPool);
+        connectionPool->SubscribeToDiagnostics(
+            diagnosticMessageDelegate,
+            DIAG_LEVEL_CONNECTION_POOL
+        );
+        std::weak_ptr< ConnectionPool > connectionPoolWeak(connectionPool);
+        transport->SetConnectionFactory(
+            [connectionPoolWeak](
+                const std::string& scheme,
+                const std::string& serverName
+            ) -> std::shared_ptr< SystemAbstractions::INetworkConnection > {
+                const auto connectionPool = connectionPoolWeak.lock();
+                if (connectionPool == nullptr) {
+                    return nullptr;
+                }
+                return connectionPool->Acquire(scheme, serverName);
             }
         );
         deps.transport = transport;
@@ -236,6 +746,125 @@ namespace {
         client.Demobilize();
     }
 
+    /**
+     * This function writes the current values of the given metrics to
+     * the file at the given path, in the Prometheus text format.  The
+     * metrics are written to a temporary file first, which then replaces
+     * the file at the given path, so that anything reading the file never
+     * sees a partial dump.
+     *
+     * @param[in] metrics
+     *     These are the metrics to write.
+     *
+     * @param[in] path
+     *     This is the path of the file to which to write the metrics.
+     *
+     * @param[in] diagnosticsSender
+     *     This is the object to use to publish any diagnostic messages.
+     */
+    void WriteMetrics(
+        Metrics& metrics,
+        const std::string& path,
+        const SystemAbstractions::DiagnosticsSender& diagnosticsSender
+    ) {
+        const auto text = metrics.Render();
+        const auto temporaryPath = path + ".tmp";
+        const auto file = fopen(temporaryPath.c_str(), "wb");
+        if (file == NULL) {
+            diagnosticsSender.SendDiagnosticInformationFormatted(
+                SystemAbstractions::DiagnosticsSender::Levels::WARNING,
+                "unable to open metrics file '%s'",
+                temporaryPath.c_str()
+            );
+            return;
+        }
+        const auto written = fwrite(text.data(), 1, text.size(), file);
+        (void)fclose(file);
+        if (written != text.size()) {
+            diagnosticsSender.SendDiagnosticInformationFormatted(
+                SystemAbstractions::DiagnosticsSender::Levels::WARNING,
+                "unable to write metrics file '%s'",
+                temporaryPath.c_str()
+            );
+            (void)remove(temporaryPath.c_str());
+            return;
+        }
+#ifdef _WIN32
+        (void)remove(path.c_str());
+#endif /* _WIN32 */
+        if (rename(temporaryPath.c_str(), path.c_str()) != 0) {
+            diagnosticsSender.SendDiagnosticInformationFormatted(
+                SystemAbstractions::DiagnosticsSender::Levels::WARNING,
+                "unable to replace metrics file '%s'",
+                path.c_str()
+            );
+        }
+    }
+
+    /**
+     * This holds what's needed to write out the metrics periodically.
+     */
+    struct MetricsWriter {
+        std::shared_ptr< Timers > timers;
+        std::shared_ptr< TimeKeeper > timeKeeper;
+        std::shared_ptr< Metrics > metrics;
+        std::shared_ptr< SystemAbstractions::DiagnosticsSender > diagnosticsSender;
+        std::string path;
+        double interval = 10.0;
+        std::mutex mutex;
+        bool stopped = false;
+        int token = 0;
+    };
+
+    /**
+     * This function schedules the next time the metrics are written out
+     * by the given writer.  Each time they're written, the next time is
+     * scheduled, until the writer is stopped.
+     *
+     * @param[in] writer
+     *     This holds what's needed to write out the metrics.
+     */
+    void ScheduleMetricsWrite(const std::shared_ptr< MetricsWriter >& writer) {
+        std::weak_ptr< MetricsWriter > writerWeak(writer);
+        writer->token = writer->timers->Schedule(
+            [writerWeak]{
+                const auto writer = writerWeak.lock();
+                if (writer == nullptr) {
+                    return;
+                }
+                std::lock_guard< decltype(writer->mutex) > lock(writer->mutex);
+                if (writer->stopped) {
+                    return;
+                }
+                WriteMetrics(
+                    *writer->metrics,
+                    writer->path,
+                    *writer->diagnosticsSender
+                );
+                ScheduleMetricsWrite(writer);
+            },
+            writer->timeKeeper->GetCurrentTime() + writer->interval
+        );
+    }
+
+    /**
+     * This function stops the given writer from writing out the metrics
+     * periodically, and writes them out one last time.
+     *
+     * @param[in] writer
+     *     This holds what's needed to write out the metrics.
+     */
+    void StopMetricsWrites(const std::shared_ptr< MetricsWriter >& writer) {
+        std::lock_guard< decltype(writer->mutex) > lock(writer->mutex);
+        writer->stopped = true;
+        writer->timers->Cancel(writer->token);
+        WriteMetrics(
+            *writer->metrics,
+            writer->path,
+            *writer->diagnosticsSender
+        );
+    }
+
 }
 
 /**
@@ -254,15 +883,16 @@ int main(int argc, char* argv[]) {
     //_crtBreakAlloc = 18;
     _CrtSetDbgFlag(_CRTDBG_ALLOC_MEM_DF | _CRTDBG_LEAK_CHECK_DF);
 #endif /* _WIN32 */
-    // Set up a handler for SIGINT to set our "shutDown" flag.
-    const auto previousInterruptHandler = signal(SIGINT, InterruptHandler);
-
-    // Turn off standard output stream buffering.
-    (void)setbuf(stdout, NULL);
+    // Set up a handler for SIGINT to set our shutdown event.
+    ShutdownEvent shutdown;
+    InterruptHandlerInstallation interruptHandlerInstallation(shutdown);
 
     // Set up diagnostic message publisher that prints diagnostic messages
-    // to the standard error stream.
-    const auto diagnosticsPublisher = SystemAbstractions::DiagnosticsStreamReporter(stderr, stderr);
+    // to the standard error stream.  Messages are written out from a
+    // background thread, so that the threads producing them never wait
+    // on the stream.
+    AsyncDiagnosticsReporter diagnosticsReporter(stderr);
+    const auto diagnosticsPublisher = diagnosticsReporter.GetDelegate();
 
     // Set up diagnostics sender representing the application, and
     // register the diagnostic message publisher.
@@ -278,127 +908,263 @@ int main(int argc, char* argv[]) {
         return EXIT_FAILURE;
     }
 
-    // Load trusted certificate authority (CA) certificate bundle to use
-    // at the TLS layer of web connections.
-    std::string caCerts;
-    if (!LoadCaCerts(caCerts, *diagnosticsSender)) {
-        return EXIT_FAILURE;
-    }
+    // Start loading the trusted certificate authority (CA) certificate
+    // bundle to use at the TLS layer of web connections.  It's loaded in
+    // the background while everything else is set up, and connections
+    // wait for it only once they need it.
+    const std::shared_future< std::shared_ptr< const TrustStore > > trustStore = std::async(
+        std::launch::async,
+        [diagnosticsSender]{
+            std::shared_ptr< const TrustStore > loadedTrustStore;
+            (void)LoadCaCerts(loadedTrustStore, *diagnosticsSender);
+            return loadedTrustStore;
+        }
+    ).share();
 
-    // Set up a clock and scheduler for use by the HTTP client and Discord
-    // gateway user agent.
+    // Set up a clock and scheduler for use by the HTTP client and the
+    // application's own components.
     const auto timeKeeper = std::make_shared< TimeKeeper >();
     const auto scheduler = std::make_shared< Timekeeping::Scheduler >();
     scheduler->SetClock(timeKeeper);
 
+    // Give the Discord gateways, whose only timers are their heartbeats,
+    // a scheduler (and so a thread) of their own, so that heartbeats
+    // aren't held up behind rate limiting, metrics writing, or anything
+    // else scheduled.
+    const auto heartbeatScheduler = std::make_shared< Timekeeping::Scheduler >();
+    heartbeatScheduler->SetClock(timeKeeper);
+
+    // Set up the timers used by the application's own components, which
+    // may be kept either in a timing wheel or in the scheduler.
+    std::shared_ptr< Timers > timers;
+    if (environment.timingWheel) {
+        timers = std::make_shared< TimingWheel >(timeKeeper);
+    } else {
+        timers = std::make_shared< SchedulerTimers >(scheduler);
+    }
+
     // Set up an HTTP client to be used to connect to web APIs.
     const auto client = std::make_shared< Http::Client >();
     const auto diagnosticsSubscription = client->SubscribeToDiagnostics(diagnosticsSender->Chain());
+    std::shared_ptr< ConnectionPool > connectionPool;
     if (
         !StartClient(
             *client,
             timeKeeper,
+            connectionPool,
             environment,
-            caCerts,
+            trustStore,
             *diagnosticsSender
         )
     ) {
         return EXIT_FAILURE;
     }
 
+    // Start connecting to the API server, and the gateway server if its
+    // URL was kept from an earlier run, in the background, so that the
+    // first requests and the gateway connections find connections with
+    // their TLS handshakes done already.
+    std::shared_ptr< GatewayCache > gatewayCache;
+    connectionPool->Warm("https", API_SERVER_NAME, HTTPS_PORT, 1);
+    if (!environment.gatewayCachePath.empty()) {
+        gatewayCache = std::make_shared< GatewayCache >();
+        (void)gatewayCache->SubscribeToDiagnostics(
+            diagnosticsSender->Chain(),
+            DIAG_LEVEL_GATEWAY_CACHE
+        );
+        gatewayCache->Configure(
+            environment.gatewayCachePath,
+            environment.gatewayCacheMaxAge
+        );
+        std::string gatewayUrl;
+        Uri::Uri gatewayUri;
+        if (
+            gatewayCache->GetGatewayUrl(gatewayUrl)
+            && gatewayUri.ParseFromString(gatewayUrl)
+        ) {
+            connectionPool->Warm(
+                gatewayUri.GetScheme(),
+                gatewayUri.GetHost(),
+                (gatewayUri.HasPort() ? gatewayUri.GetPort() : HTTPS_PORT),
+                environment.lastShard - environment.firstShard + 1
+            );
+        }
+    }
+
+    // Make sure the CA certificate bundle loaded before going any further.
+    if (trustStore.get() == nullptr) {
+        return EXIT_FAILURE;
+    }
+
+    // Set up a pool of workers to handle gateway events, if requested.
+    std::shared_ptr< EventDispatcher > dispatcher;
+    if (environment.dispatchWorkers > 0) {
+        dispatcher = std::make_shared< EventDispatcher >(environment.dispatchWorkers);
+        environment.webSocket.dispatcher = dispatcher;
+    }
+
     // Set up connections interface for Discord.
     auto connections = std::make_shared< Connections >();
     connections->Configure(client);
+    connections->SetTimers(timers, timeKeeper);
+    connections->SetWebSocketConfiguration(environment.webSocket);
+    connections->SetGetCoalescing(environment.coalesceGets);
+    connections->SetResponseCacheConfiguration(environment.responseCache);
+    connections->SetMaxRequestsInFlight(environment.maxRequestsInFlight);
+    auto bulkLane = connections->GetLaneConfiguration(Connections::Priority::Bulk);
+    bulkLane.maxInFlight = environment.bulkRequestsInFlight;
+    connections->SetLaneConfiguration(Connections::Priority::Bulk, bulkLane);
+    if (gatewayCache != nullptr) {
+        connections->SetGatewayCache(gatewayCache);
+    }
+    std::shared_ptr< MetricsWriter > metricsWriter;
+    if (!environment.metricsPath.empty()) {
+        const auto metrics = std::make_shared< Metrics >();
+        connections->SetMetrics(metrics);
+        connectionPool->SetMetrics(metrics);
+        environment.session.metrics = metrics;
+        metricsWriter = std::make_shared< MetricsWriter >();
+        metricsWriter->timers = timers;
+        metricsWriter->timeKeeper = timeKeeper;
+        metricsWriter->metrics = metrics;
+        metricsWriter->diagnosticsSender = diagnosticsSender;
+        metricsWriter->path = environment.metricsPath;
+        metricsWriter->interval = environment.metricsInterval;
+        std::lock_guard< decltype(metricsWriter->mutex) > lock(metricsWriter->mutex);
+        ScheduleMetricsWrite(metricsWriter);
+    }
     (void)connections->SubscribeToDiagnostics(
         diagnosticsSender->Chain(),
         DIAG_LEVEL_CONNECTIONS_INTERFACE
     );
 
-    // Set up a Discord Gateway interface and subscribe
-    // to diagnostic messages from it.
-    Discord::Gateway gateway;
-    gateway.SetScheduler(scheduler);
-    gateway.RegisterDiagnosticMessageCallback(
-        [diagnosticsMessageDelegate](
-            size_t level,
-            std::string&& message
-        ){
-            diagnosticsMessageDelegate(
-                "Gateway",
-                level,
-                message
-            );
-        }
-    );
-
-    // Connect Discord gateway.
+    // Set up a Discord Gateway interface for each shard run by this process,
+    // all sharing the same connections interface, and subscribe to
+    // diagnostic messages from them.
+    const bool sharded = (environment.shardCount > 0);
+    std::shared_ptr< IdentifyGate > identifyGate;
+    if (sharded) {
+        identifyGate = std::make_shared< IdentifyGate >();
+        identifyGate->Configure(
+            timers,
+            timeKeeper,
+            environment.maxConcurrency
+        );
+        (void)identifyGate->SubscribeToDiagnostics(
+            diagnosticsSender->Chain(),
+            DIAG_LEVEL_IDENTIFY_GATE
+        );
+    }
+    std::vector< std::unique_ptr< GatewaySession > > sessions;
+    std::vector< std::future< bool > > startedFutures;
     diagnosticsSender->SendDiagnosticInformationString(
         3,
         "Connecting to Discord gateway"
     );
-    auto connected = gateway.Connect(
-        connections,
-        environment.configuration
-    );
-    if (
-        connected.wait_for(std::chrono::seconds(5))
-        != std::future_status::ready
+    for (
+        size_t shardId = environment.firstShard;
+        shardId <= environment.lastShard;
+        ++shardId
     ) {
-        diagnosticsSender->SendDiagnosticInformationString(
-            SystemAbstractions::DiagnosticsSender::Levels::ERROR,
-            "Timeout connecting to Discord gateway"
+        ::Connections::WebSocketDecorator decorator;
+        std::string gatewayName = "Gateway";
+        if (sharded) {
+            const auto shardConnections = std::make_shared< ShardConnections >();
+            shardConnections->Configure(
+                connections,
+                identifyGate,
+                shardId,
+                environment.shardCount
+            );
+            decorator = shardConnections->GetWebSocketDecorator();
+            gatewayName += "[" + std::to_string(shardId) + "]";
+        }
+        std::unique_ptr< GatewaySession > session(new GatewaySession(gatewayName));
+        (void)session->SubscribeToDiagnostics(diagnosticsMessageDelegate);
+        session->Configure(
+            connections,
+            decorator,
+            heartbeatScheduler,
+            timeKeeper,
+            environment.configuration,
+            environment.session
         );
-        gateway.Disconnect();
-        (void)connected.get();
-        return EXIT_FAILURE;
-    }
-    if (!connected.get()) {
-        diagnosticsSender->SendDiagnosticInformationString(
-            SystemAbstractions::DiagnosticsSender::Levels::ERROR,
-            "Failed to connect to Discord gateway"
+
+        // Shut down if any session ends, which happens when its
+        // connection is lost and it isn't set up to connect again.
+        session->RegisterEndCallback(
+            [&shutdown]{
+                shutdown.Set();
+            }
         );
-        return EXIT_FAILURE;
+        startedFutures.push_back(session->Start());
+        sessions.push_back(std::move(session));
     }
-    diagnosticsSender->SendDiagnosticInformationString(
-        3,
-        "Gateway connected"
-    );
 
-    // Set up callback for if WebSocket is closed.
-    const auto webSocketClosedPromise = std::make_shared< std::promise< void > >();
-    gateway.RegisterCloseCallback(
-        [webSocketClosedPromise]{
-            webSocketClosedPromise->set_value();
+    // Wait for every gateway to connect.
+    bool allConnected = true;
+    for (auto& started: startedFutures) {
+        if (!started.get()) {
+            allConnected = false;
+        }
+    }
+    if (!allConnected) {
+        for (auto& session: sessions) {
+            session->Stop();
         }
+        return EXIT_FAILURE;
+    }
+    diagnosticsSender->SendDiagnosticInformationFormatted(
+        3,
+        "Gateway connected (%zu shard(s))",
+        sessions.size()
     );
-    auto webSocketClosedFuture = webSocketClosedPromise->get_future();
 
-    // Loop until interrupted with SIGINT.
+    // Sleep until interrupted with SIGINT or a session ends.
     diagnosticsSender->SendDiagnosticInformationString(
         3,
         "Press <Ctrl>+<C> (and then <Enter>, if necessary) to exit."
     );
-    while (
-        !shutDown
-        && (
-            webSocketClosedFuture.wait_for(
-                std::chrono::milliseconds(100)
-            ) != std::future_status::ready
-        )
-    ) {
-    }
+    shutdown.Wait();
 
-    // Shut down Discord gateway and its dependencies.
-    gateway.Disconnect();
+    // Shut down Discord gateways and their dependencies.  The dispatcher
+    // is drained only after the sessions stop, so that the notifications
+    // of their gateways closing are still delivered.
+    for (auto& session: sessions) {
+        session->Stop();
+    }
+    if (dispatcher != nullptr) {
+        dispatcher->Drain();
+        dispatcher->Stop();
+        const auto dispatcherStatistics = dispatcher->GetStatistics();
+        diagnosticsSender->SendDiagnosticInformationFormatted(
+            3,
+            "Event dispatcher: %zu dispatched, %zu stolen, %zu max queued",
+            dispatcherStatistics.dispatched,
+            dispatcherStatistics.stolen,
+            dispatcherStatistics.maxQueued
+        );
+    }
 
     // Shut down the client, since we no longer need it.
     StopClient(*client);
+    if (metricsWriter != nullptr) {
+        StopMetricsWrites(metricsWriter);
+    }
+    const auto connectionPoolStatistics = connectionPool->GetStatistics();
+    diagnosticsSender->SendDiagnosticInformationFormatted(
+        3,
+        "Connection pool: %zu hits, %zu misses, %zu evictions",
+        connectionPoolStatistics.hits,
+        connectionPoolStatistics.misses,
+        connectionPoolStatistics.evictions
+    );
 
     // We're all done!
-    (void)signal(SIGINT, previousInterruptHandler);
     diagnosticsSender->SendDiagnosticInformationString(
         3,
         "Exiting."
     );
+    diagnosticsReporter.Stop();
     return EXIT_SUCCESS;
 }